@@ -0,0 +1,443 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include <Error.h>
+#include <InternalErr.h>
+
+#include "ArithmeticExpression.h"
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+struct FunctionEntry {
+    const char *name;
+    ArithmeticExpression::Opcode opcode;
+    unsigned int arity;
+};
+
+static const FunctionEntry FUNCTIONS[] = {
+    { "sqrt", ArithmeticExpression::f_sqrt, 1 },
+    { "abs", ArithmeticExpression::f_abs, 1 },
+    { "exp", ArithmeticExpression::f_exp, 1 },
+    { "log", ArithmeticExpression::f_log, 1 },
+    { "log10", ArithmeticExpression::f_log10, 1 },
+    { "sin", ArithmeticExpression::f_sin, 1 },
+    { "cos", ArithmeticExpression::f_cos, 1 },
+    { "tan", ArithmeticExpression::f_tan, 1 },
+    { "asin", ArithmeticExpression::f_asin, 1 },
+    { "acos", ArithmeticExpression::f_acos, 1 },
+    { "atan", ArithmeticExpression::f_atan, 1 },
+    { "floor", ArithmeticExpression::f_floor, 1 },
+    { "ceil", ArithmeticExpression::f_ceil, 1 },
+    { "hypot", ArithmeticExpression::f_hypot, 2 },
+    { "atan2", ArithmeticExpression::f_atan2, 2 },
+    { "pow", ArithmeticExpression::power, 2 },
+    { "min", ArithmeticExpression::f_min, 2 },
+    { "max", ArithmeticExpression::f_max, 2 },
+    { "mask", ArithmeticExpression::f_mask, 2 }
+};
+
+static const unsigned int FUNCTION_COUNT = sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+
+ArithmeticExpression::ArithmeticExpression(const string &text) :
+    d_text(text), d_maxDepth(0), d_pos(0)
+{
+    unsigned int depth = 0;
+    parseComparison(&depth);
+
+    skipSpace();
+    if (d_pos != d_text.size()) fail("unexpected '" + d_text.substr(d_pos, 1) + "'");
+}
+
+void ArithmeticExpression::fail(const string &why) const
+{
+    ostringstream oss;
+    oss << "ArithmeticExpression() - Could not parse the expression '" << d_text << "': " << why << " at position "
+        << d_pos + 1 << ".";
+    throw Error(malformed_expr, oss.str());
+}
+
+void ArithmeticExpression::skipSpace()
+{
+    while (d_pos < d_text.size() && isspace(d_text[d_pos]))
+        ++d_pos;
+}
+
+bool ArithmeticExpression::accept(const string &token)
+{
+    skipSpace();
+    if (d_text.compare(d_pos, token.size(), token) != 0) return false;
+
+    d_pos += token.size();
+    return true;
+}
+
+void ArithmeticExpression::expect(const string &token)
+{
+    if (!accept(token)) fail("expected '" + token + "'");
+}
+
+/**
+ * Append an instruction that changes the depth of the stack by change.
+ */
+void ArithmeticExpression::emit(Opcode opcode, unsigned int *depth, int change)
+{
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.constant = 0;
+    instruction.variable = 0;
+    d_program.push_back(instruction);
+
+    *depth += change;
+    if (*depth > d_maxDepth) d_maxDepth = *depth;
+}
+
+// comparison := sum [ ('<' | '<=' | '>' | '>=' | '==' | '!=') sum ]
+void ArithmeticExpression::parseComparison(unsigned int *depth)
+{
+    parseSum(depth);
+
+    Opcode opcode;
+    if (accept("<="))
+        opcode = less_equal;
+    else if (accept(">="))
+        opcode = greater_equal;
+    else if (accept("=="))
+        opcode = equal;
+    else if (accept("!="))
+        opcode = not_equal;
+    else if (accept("<"))
+        opcode = less;
+    else if (accept(">"))
+        opcode = greater;
+    else
+        return;
+
+    parseSum(depth);
+    emit(opcode, depth, -1);
+}
+
+// sum := product { ('+' | '-') product }
+void ArithmeticExpression::parseSum(unsigned int *depth)
+{
+    parseProduct(depth);
+
+    for (;;) {
+        if (accept("+")) {
+            parseProduct(depth);
+            emit(add, depth, -1);
+        }
+        else if (accept("-")) {
+            parseProduct(depth);
+            emit(subtract, depth, -1);
+        }
+        else {
+            return;
+        }
+    }
+}
+
+// product := unary { ('*' | '/') unary }
+void ArithmeticExpression::parseProduct(unsigned int *depth)
+{
+    parseUnary(depth);
+
+    for (;;) {
+        if (accept("*")) {
+            parseUnary(depth);
+            emit(multiply, depth, -1);
+        }
+        else if (accept("/")) {
+            parseUnary(depth);
+            emit(divide, depth, -1);
+        }
+        else {
+            return;
+        }
+    }
+}
+
+// unary := ('-' | '+') unary | power
+void ArithmeticExpression::parseUnary(unsigned int *depth)
+{
+    if (accept("-")) {
+        parseUnary(depth);
+        emit(negate, depth, 0);
+    }
+    else if (accept("+")) {
+        parseUnary(depth);
+    }
+    else {
+        parsePower(depth);
+    }
+}
+
+// power := primary [ '^' unary ]
+void ArithmeticExpression::parsePower(unsigned int *depth)
+{
+    parsePrimary(depth);
+
+    if (accept("^")) {
+        parseUnary(depth);
+        emit(power, depth, -1);
+    }
+}
+
+// primary := number | name | function '(' comparison { ',' comparison } ')' | '(' comparison ')'
+void ArithmeticExpression::parsePrimary(unsigned int *depth)
+{
+    skipSpace();
+    if (d_pos == d_text.size()) fail("unexpected end of expression");
+
+    char c = d_text[d_pos];
+
+    if (c == '(') {
+        ++d_pos;
+        parseComparison(depth);
+        expect(")");
+    }
+    else if (isdigit(c) || c == '.') {
+        const char *begin = d_text.c_str() + d_pos;
+        char *end;
+        double value = strtod(begin, &end);
+        if (end == begin) fail("expected a number");
+        d_pos += end - begin;
+
+        emit(push_constant, depth, 1);
+        d_program.back().constant = value;
+    }
+    else if (isalpha(c) || c == '_') {
+        string::size_type start = d_pos;
+        while (d_pos < d_text.size() && (isalnum(d_text[d_pos]) || d_text[d_pos] == '_' || d_text[d_pos] == '.'))
+            ++d_pos;
+        string name = d_text.substr(start, d_pos - start);
+
+        if (accept("(")) {
+            unsigned int f = 0;
+            while (f < FUNCTION_COUNT && name != FUNCTIONS[f].name)
+                ++f;
+            if (f == FUNCTION_COUNT) fail("unknown function '" + name + "'");
+
+            unsigned int arity = 0;
+            do {
+                parseComparison(depth);
+                ++arity;
+            } while (accept(","));
+            expect(")");
+
+            if (arity != FUNCTIONS[f].arity) fail("wrong number of arguments to '" + name + "'");
+
+            emit(FUNCTIONS[f].opcode, depth, 1 - (int) arity);
+        }
+        else {
+            unsigned int v = 0;
+            while (v < d_variables.size() && d_variables[v] != name)
+                ++v;
+            if (v == d_variables.size()) d_variables.push_back(name);
+
+            emit(push_variable, depth, 1);
+            d_program.back().variable = v;
+        }
+    }
+    else {
+        fail(string("unexpected '") + c + "'");
+    }
+}
+
+static double (*unaryFunction(ArithmeticExpression::Opcode opcode))(double)
+{
+    switch (opcode) {
+    case ArithmeticExpression::f_sqrt:
+        return static_cast<double (*)(double)>(sqrt);
+    case ArithmeticExpression::f_abs:
+        return static_cast<double (*)(double)>(fabs);
+    case ArithmeticExpression::f_exp:
+        return static_cast<double (*)(double)>(exp);
+    case ArithmeticExpression::f_log:
+        return static_cast<double (*)(double)>(log);
+    case ArithmeticExpression::f_log10:
+        return static_cast<double (*)(double)>(log10);
+    case ArithmeticExpression::f_sin:
+        return static_cast<double (*)(double)>(sin);
+    case ArithmeticExpression::f_cos:
+        return static_cast<double (*)(double)>(cos);
+    case ArithmeticExpression::f_tan:
+        return static_cast<double (*)(double)>(tan);
+    case ArithmeticExpression::f_asin:
+        return static_cast<double (*)(double)>(asin);
+    case ArithmeticExpression::f_acos:
+        return static_cast<double (*)(double)>(acos);
+    case ArithmeticExpression::f_atan:
+        return static_cast<double (*)(double)>(atan);
+    case ArithmeticExpression::f_floor:
+        return static_cast<double (*)(double)>(floor);
+    case ArithmeticExpression::f_ceil:
+        return static_cast<double (*)(double)>(ceil);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Evaluate the expression for n elements.
+ *
+ * @param inputs For each of variables(), a pointer to its n values.
+ * @param result Storage for the n results.
+ */
+void ArithmeticExpression::evaluate(const vector<const double *> &inputs, unsigned int n, double *result) const
+{
+    if (n == 0) return;
+
+    if (d_stack.size() < d_maxDepth) d_stack.resize(d_maxDepth);
+    for (unsigned int s = 0; s < d_maxDepth; ++s)
+        if (d_stack[s].size() < n) d_stack[s].resize(n);
+
+    double nan = numeric_limits<double>::quiet_NaN();
+    unsigned int sp = 0;
+
+    for (vector<Instruction>::const_iterator it = d_program.begin(); it != d_program.end(); ++it) {
+        switch (it->opcode) {
+        case push_constant: {
+            double *a = &d_stack[sp++][0];
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = it->constant;
+            continue;
+        }
+        case push_variable: {
+            double *a = &d_stack[sp++][0];
+            const double *v = inputs[it->variable];
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = v[i];
+            continue;
+        }
+        case negate: {
+            double *a = &d_stack[sp - 1][0];
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = -a[i];
+            continue;
+        }
+        default:
+            break;
+        }
+
+        double (*f)(double) = unaryFunction(it->opcode);
+        if (f) {
+            double *a = &d_stack[sp - 1][0];
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = f(a[i]);
+            continue;
+        }
+
+        // The rest are binary; the result replaces the left operand.
+        double *a = &d_stack[sp - 2][0];
+        const double *b = &d_stack[sp - 1][0];
+        --sp;
+
+        switch (it->opcode) {
+        case add:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] += b[i];
+            break;
+        case subtract:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] -= b[i];
+            break;
+        case multiply:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] *= b[i];
+            break;
+        case divide:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] /= b[i];
+            break;
+        case power:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = pow(a[i], b[i]);
+            break;
+        case less:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] < b[i];
+            break;
+        case less_equal:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] <= b[i];
+            break;
+        case greater:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] > b[i];
+            break;
+        case greater_equal:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] >= b[i];
+            break;
+        case equal:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] == b[i];
+            break;
+        case not_equal:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = a[i] != b[i];
+            break;
+        case f_hypot:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = hypot(a[i], b[i]);
+            break;
+        case f_atan2:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = atan2(a[i], b[i]);
+            break;
+        case f_min:
+            for (unsigned int i = 0; i < n; ++i)
+                if (b[i] < a[i]) a[i] = b[i];
+            break;
+        case f_max:
+            for (unsigned int i = 0; i < n; ++i)
+                if (b[i] > a[i]) a[i] = b[i];
+            break;
+        case f_mask:
+            for (unsigned int i = 0; i < n; ++i)
+                a[i] = (a[i] != 0 && a[i] == a[i]) ? b[i] : nan;
+            break;
+        default:
+            throw InternalErr(__FILE__, __LINE__, "ArithmeticExpression::evaluate() - Unknown instruction.");
+        }
+    }
+
+    const double *a = &d_stack[0][0];
+    for (unsigned int i = 0; i < n; ++i)
+        result[i] = a[i];
+}
+
+} // namespace ugrid
@@ -0,0 +1,115 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _ArithmeticExpression_h
+#define _ArithmeticExpression_h 1
+
+#include <string>
+#include <vector>
+
+namespace ugrid {
+
+/**
+ * An arithmetic expression over named range variables, e.g.
+ * 'hypot(u, v)' or 'mask(depth > 5, temp - 273.15)', compiled once into a
+ * short stack program. The program is evaluated over whole slabs of values:
+ * each instruction runs a simple loop over the slab before the next one
+ * starts, so the per-element cost is a few arithmetic operations.
+ *
+ * Supported are numbers, variable names, parentheses, unary minus, the
+ * operators + - * / ^, the comparisons < <= > >= == != (which yield 1 or 0),
+ * the one-argument functions sqrt, abs, exp, log, log10, sin, cos, tan, asin,
+ * acos, atan, floor and ceil, and the two-argument functions hypot, atan2,
+ * pow, min, max and mask. mask(condition, value) is value where condition is
+ * non-zero and NaN elsewhere.
+ */
+class ArithmeticExpression {
+public:
+    enum Opcode {
+        push_constant, push_variable,
+        negate, add, subtract, multiply, divide, power,
+        less, less_equal, greater, greater_equal, equal, not_equal,
+        f_sqrt, f_abs, f_exp, f_log, f_log10, f_sin, f_cos, f_tan, f_asin, f_acos, f_atan, f_floor, f_ceil,
+        f_hypot, f_atan2, f_min, f_max, f_mask
+    };
+
+private:
+    struct Instruction {
+        Opcode opcode;
+        double constant;
+        unsigned int variable;
+    };
+
+    std::string d_text;
+    std::vector<std::string> d_variables;
+    std::vector<Instruction> d_program;
+    unsigned int d_maxDepth;
+
+    // Scratch space for evaluate(), one slab per stack entry.
+    mutable std::vector<std::vector<double> > d_stack;
+
+    // The parser state.
+    std::string::size_type d_pos;
+
+    void parseComparison(unsigned int *depth);
+    void parseSum(unsigned int *depth);
+    void parseProduct(unsigned int *depth);
+    void parseUnary(unsigned int *depth);
+    void parsePower(unsigned int *depth);
+    void parsePrimary(unsigned int *depth);
+
+    void skipSpace();
+    bool accept(const std::string &token);
+    void expect(const std::string &token);
+    void emit(Opcode opcode, unsigned int *depth, int change);
+    void fail(const std::string &why) const;
+
+public:
+    /**
+     * Compile text.
+     * @exception libdap::Error If text is not a valid expression.
+     */
+    ArithmeticExpression(const std::string &text);
+
+    const std::string &text() const
+    {
+        return d_text;
+    }
+
+    /**
+     * @return The names of the variables the expression uses, in the order
+     * evaluate() expects their values.
+     */
+    const std::vector<std::string> &variables() const
+    {
+        return d_variables;
+    }
+
+    void evaluate(const std::vector<const double *> &inputs, unsigned int n, double *result) const;
+};
+
+} // namespace ugrid
+
+#endif // _ArithmeticExpression_h
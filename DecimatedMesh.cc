@@ -0,0 +1,275 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "BESDebug.h"
+
+#include "MeshGeometry.h"
+#include "DecimatedMesh.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+// Marks nodes that are in no cluster and pads the corners of coarse faces.
+static const unsigned int NO_NODE = ~0U;
+
+// If the first grid yields more faces than the budget, it is shrunk and the
+// clustering redone, at most this many times.
+static const unsigned int DECIMATION_MAX_TRIES = 8;
+
+/**
+ * Orders the corner lists of candidate coarse faces, which are stored one
+ * after the other in keys.
+ */
+struct FaceKeyLess {
+    const vector<unsigned int> &keys;
+    unsigned int length;
+
+    FaceKeyLess(const vector<unsigned int> &k, unsigned int n) :
+        keys(k), length(n)
+    {
+    }
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return lexicographical_compare(keys.begin() + a * length, keys.begin() + (a + 1) * length,
+            keys.begin() + b * length, keys.begin() + (b + 1) * length);
+    }
+};
+
+DecimatedMesh::DecimatedMesh(const MeshGeometry *geometry, unsigned int faceBudget) :
+    d_nodesPerFace(geometry->nodesPerFace())
+{
+    unsigned int nodeCount = geometry->nodeCount();
+
+    // Only the nodes that are corners of some face are clustered.
+    vector<bool> used(nodeCount, false);
+    for (unsigned int f = 0; f < geometry->faceCount(); ++f) {
+        unsigned int corners = 0;
+        while (corners < d_nodesPerFace && geometry->faceNode(f, corners) < nodeCount)
+            ++corners;
+        if (corners < 3) continue;
+
+        for (unsigned int c = 0; c < corners; ++c)
+            used[geometry->faceNode(f, c)] = true;
+    }
+
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+    bool first = true;
+    for (unsigned int n = 0; n < nodeCount; ++n) {
+        if (!used[n]) continue;
+
+        double x = geometry->nodeX(n), y = geometry->nodeY(n);
+        if (first) {
+            minX = maxX = x, minY = maxY = y;
+            first = false;
+        }
+        else {
+            minX = min(minX, x), maxX = max(maxX, x);
+            minY = min(minY, y), maxY = max(maxY, y);
+        }
+    }
+
+    vector<unsigned int> nodeCluster(nodeCount, NO_NODE);
+
+    // A budget the mesh already meets leaves it as it is.
+    if (faceBudget >= geometry->faceCount()) {
+        unsigned int clusterCount = 0;
+        for (unsigned int n = 0; n < nodeCount; ++n)
+            if (used[n]) nodeCluster[n] = clusterCount++;
+
+        cluster(geometry, nodeCluster, clusterCount);
+        return;
+    }
+
+    double width = maxX - minX, height = maxY - minY;
+    double cells = max(1.0, faceBudget / 2.0);
+
+    for (unsigned int tries = 1;; ++tries) {
+        unsigned int nx = 1, ny = 1;
+        if (width > 0 && height > 0) {
+            nx = (unsigned int) ceil(sqrt(cells * width / height));
+            ny = (unsigned int) ceil(sqrt(cells * height / width));
+        }
+        else if (width > 0) {
+            nx = (unsigned int) ceil(cells);
+        }
+        else if (height > 0) {
+            ny = (unsigned int) ceil(cells);
+        }
+        if (nx < 1) nx = 1;
+        if (ny < 1) ny = 1;
+
+        double cellWidth = (width > 0) ? width / nx : 1;
+        double cellHeight = (height > 0) ? height / ny : 1;
+
+        // Clusters are numbered in the order of their lowest numbered node.
+        vector<unsigned int> cellCluster(nx * ny, NO_NODE);
+        unsigned int clusterCount = 0;
+        for (unsigned int n = 0; n < nodeCount; ++n) {
+            if (!used[n]) continue;
+
+            unsigned int col = min(nx - 1, (unsigned int) ((geometry->nodeX(n) - minX) / cellWidth));
+            unsigned int row = min(ny - 1, (unsigned int) ((geometry->nodeY(n) - minY) / cellHeight));
+            unsigned int &c = cellCluster[row * nx + col];
+            if (c == NO_NODE) c = clusterCount++;
+            nodeCluster[n] = c;
+        }
+
+        cluster(geometry, nodeCluster, clusterCount);
+
+        BESDEBUG("ugrid",
+            "DecimatedMesh::DecimatedMesh() - " << nx << " x " << ny << " cells: " << d_nodeX.size() << " nodes, " << faceCount() << " faces (budget " << faceBudget << ")" << endl);
+
+        if (faceCount() <= faceBudget || tries == DECIMATION_MAX_TRIES) break;
+
+        cells = max(1.0, cells * 0.9 * faceBudget / faceCount());
+    }
+}
+
+/**
+ * Build the coarse mesh given the cluster of each source node.
+ */
+void DecimatedMesh::cluster(const MeshGeometry *geometry, const vector<unsigned int> &nodeCluster,
+    unsigned int clusterCount)
+{
+    unsigned int nodeCount = geometry->nodeCount();
+
+    // The members of each cluster and their mean position.
+    d_nodeX.assign(clusterCount, 0.0);
+    d_nodeY.assign(clusterCount, 0.0);
+    d_nodeStart.assign(clusterCount + 1, 0);
+    for (unsigned int n = 0; n < nodeCount; ++n) {
+        unsigned int c = nodeCluster[n];
+        if (c == NO_NODE) continue;
+
+        d_nodeStart[c + 1]++;
+        d_nodeX[c] += geometry->nodeX(n);
+        d_nodeY[c] += geometry->nodeY(n);
+    }
+    for (unsigned int c = 0; c < clusterCount; ++c)
+        d_nodeStart[c + 1] += d_nodeStart[c];
+
+    d_nodeMembers.resize(d_nodeStart.back());
+    vector<unsigned int> fill(d_nodeStart.begin(), d_nodeStart.end() - 1);
+    for (unsigned int n = 0; n < nodeCount; ++n) {
+        if (nodeCluster[n] != NO_NODE) d_nodeMembers[fill[nodeCluster[n]]++] = n;
+    }
+
+    d_representativeNodes.resize(clusterCount);
+    for (unsigned int c = 0; c < clusterCount; ++c) {
+        unsigned int members = d_nodeStart[c + 1] - d_nodeStart[c];
+        d_nodeX[c] /= members;
+        d_nodeY[c] /= members;
+
+        double best = 0;
+        for (unsigned int i = d_nodeStart[c]; i < d_nodeStart[c + 1]; ++i) {
+            unsigned int n = d_nodeMembers[i];
+            double dx = geometry->nodeX(n) - d_nodeX[c], dy = geometry->nodeY(n) - d_nodeY[c];
+            if (i == d_nodeStart[c] || dx * dx + dy * dy < best) {
+                best = dx * dx + dy * dy;
+                d_representativeNodes[c] = n;
+            }
+        }
+    }
+
+    // Rewrite each face in terms of the clusters, dropping repeated corners.
+    // Those with at least three corners left are candidate coarse faces, keyed
+    // by their corners starting from the lowest numbered one.
+    vector<unsigned int> keys;
+    vector<unsigned int> sourceFaces;
+    vector<unsigned int> corners;
+    for (unsigned int f = 0; f < geometry->faceCount(); ++f) {
+        corners.clear();
+        for (unsigned int c = 0; c < d_nodesPerFace; ++c) {
+            unsigned int n = geometry->faceNode(f, c);
+            if (n >= nodeCount) break;
+
+            unsigned int k = nodeCluster[n];
+            if (corners.empty() || corners.back() != k) corners.push_back(k);
+        }
+        while (corners.size() > 1 && corners.back() == corners.front())
+            corners.pop_back();
+        if (corners.size() < 3) continue;
+
+        rotate(corners.begin(), min_element(corners.begin(), corners.end()), corners.end());
+        corners.resize(d_nodesPerFace, NO_NODE);
+
+        keys.insert(keys.end(), corners.begin(), corners.end());
+        sourceFaces.push_back(f);
+    }
+
+    // Merge candidates with the same corners. The stable sort keeps the source
+    // faces of each coarse face in ascending order.
+    vector<unsigned int> order(sourceFaces.size());
+    for (unsigned int i = 0; i < order.size(); ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), FaceKeyLess(keys, d_nodesPerFace));
+
+    // Each group of equal keys is a coarse face; number them in the order of
+    // their lowest numbered source face.
+    FaceKeyLess less(keys, d_nodesPerFace);
+    vector<pair<unsigned int, pair<unsigned int, unsigned int> > > groups;  // (lowest source face, [start, end) in order)
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        if (i == 0 || less(order[i - 1], order[i]))
+            groups.push_back(make_pair(sourceFaces[order[i]], make_pair(i, i + 1)));
+        else
+            groups.back().second.second = i + 1;
+    }
+    sort(groups.begin(), groups.end());
+
+    d_faceNodes.clear();
+    d_faceStart.assign(1, 0);
+    d_faceMembers.clear();
+    for (unsigned int g = 0; g < groups.size(); ++g) {
+        unsigned int k = order[groups[g].second.first];
+        d_faceNodes.insert(d_faceNodes.end(), keys.begin() + k * d_nodesPerFace,
+            keys.begin() + (k + 1) * d_nodesPerFace);
+
+        for (unsigned int j = groups[g].second.first; j < groups[g].second.second; ++j)
+            d_faceMembers.push_back(sourceFaces[order[j]]);
+        d_faceStart.push_back(d_faceMembers.size());
+    }
+}
+
+unsigned long DecimatedMesh::sizeInBytes() const
+{
+    return sizeof(DecimatedMesh) + (d_nodeX.capacity() + d_nodeY.capacity()) * sizeof(double)
+        + (d_faceNodes.capacity() + d_nodeStart.capacity() + d_nodeMembers.capacity() + d_faceStart.capacity()
+            + d_faceMembers.capacity() + d_representativeNodes.capacity()) * sizeof(unsigned int);
+}
+
+} // namespace ugrid
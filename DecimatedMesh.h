@@ -0,0 +1,153 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _DecimatedMesh_h
+#define _DecimatedMesh_h 1
+
+#include <vector>
+
+#include "MeshGeometry.h"
+
+namespace ugrid {
+
+/**
+ * A coarsened version of a mesh with about a given number of faces, made by
+ * vertex clustering: the bounding box of the mesh is covered by a regular
+ * grid of cells, the nodes in each cell are merged into one node at their
+ * mean position, and the faces are rewritten in terms of the merged nodes.
+ * Faces left with fewer than three distinct corners are dropped and faces
+ * that end up with the same corners are merged. The grid is sized from the
+ * face budget (a triangle mesh has about two faces per node) and shrunk if
+ * the first try yields too many faces.
+ *
+ * Besides the coarse topology this keeps, for each coarse node and face, the
+ * nodes and faces of the source mesh that were merged into it, so that range
+ * variables can be aggregated onto the coarse mesh. Instances are kept as
+ * products of the MeshGeometry, one per face budget.
+ */
+class DecimatedMesh: public MeshGeometryProduct {
+
+private:
+    unsigned int d_nodesPerFace;
+
+    std::vector<double> d_nodeX;
+    std::vector<double> d_nodeY;
+    std::vector<unsigned int> d_faceNodes;
+
+    // The source nodes of coarse node c are d_nodeMembers[d_nodeStart[c]] up to
+    // (but not including) d_nodeMembers[d_nodeStart[c + 1]]; likewise for faces.
+    std::vector<unsigned int> d_nodeStart;
+    std::vector<unsigned int> d_nodeMembers;
+    std::vector<unsigned int> d_faceStart;
+    std::vector<unsigned int> d_faceMembers;
+
+    std::vector<unsigned int> d_representativeNodes;
+
+    void cluster(const MeshGeometry *geometry, const std::vector<unsigned int> &nodeCluster,
+        unsigned int clusterCount);
+
+    DecimatedMesh(const DecimatedMesh &);
+    DecimatedMesh &operator=(const DecimatedMesh &);
+
+public:
+    DecimatedMesh(const MeshGeometry *geometry, unsigned int faceBudget);
+
+    unsigned int nodeCount() const
+    {
+        return d_nodeX.size();
+    }
+
+    unsigned int faceCount() const
+    {
+        return d_nodesPerFace ? d_faceNodes.size() / d_nodesPerFace : 0;
+    }
+
+    unsigned int nodesPerFace() const
+    {
+        return d_nodesPerFace;
+    }
+
+    double nodeX(unsigned int node) const
+    {
+        return d_nodeX[node];
+    }
+
+    double nodeY(unsigned int node) const
+    {
+        return d_nodeY[node];
+    }
+
+    /**
+     * @return The corner'th coarse node of the coarse face, or a value >=
+     * nodeCount() if the face does not have that many corners.
+     */
+    unsigned int faceNode(unsigned int face, unsigned int corner) const
+    {
+        return d_faceNodes[face * d_nodesPerFace + corner];
+    }
+
+    const std::vector<unsigned int> &nodeStart() const
+    {
+        return d_nodeStart;
+    }
+
+    const std::vector<unsigned int> &nodeMembers() const
+    {
+        return d_nodeMembers;
+    }
+
+    const std::vector<unsigned int> &faceStart() const
+    {
+        return d_faceStart;
+    }
+
+    const std::vector<unsigned int> &faceMembers() const
+    {
+        return d_faceMembers;
+    }
+
+    /**
+     * @return The source node, of those merged into the coarse node, that is
+     * closest to it.
+     */
+    unsigned int representativeNode(unsigned int node) const
+    {
+        return d_representativeNodes[node];
+    }
+
+    /**
+     * @return The lowest numbered source face merged into the coarse face.
+     */
+    unsigned int representativeFace(unsigned int face) const
+    {
+        return d_faceMembers[d_faceStart[face]];
+    }
+
+    virtual unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _DecimatedMesh_h
@@ -0,0 +1,85 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "MeshGeometry.h"
+#include "FaceAdjacency.h"
+
+using namespace std;
+
+namespace ugrid {
+
+const unsigned int FaceAdjacency::NO_NEIGHBOR = ~0U;
+
+/**
+ * Build the adjacency by listing every face edge, keyed by its two node ids
+ * (smallest first), and sorting the list so the two faces that share an edge
+ * end up next to each other.
+ */
+FaceAdjacency::FaceAdjacency(const MeshGeometry *geometry) :
+    d_nodesPerFace(geometry->nodesPerFace())
+{
+    unsigned int faceCount = geometry->faceCount();
+    unsigned int nodeCount = geometry->nodeCount();
+
+    d_neighbors.assign(faceCount * d_nodesPerFace, NO_NEIGHBOR);
+
+    // ((low node, high node), face * d_nodesPerFace + edge)
+    typedef pair<pair<unsigned int, unsigned int>, unsigned int> Edge;
+    vector<Edge> edges;
+    edges.reserve(faceCount * d_nodesPerFace);
+
+    for (unsigned int f = 0; f < faceCount; ++f) {
+        unsigned int corners = 0;
+        while (corners < d_nodesPerFace && geometry->faceNode(f, corners) < nodeCount)
+            ++corners;
+        if (corners < 3) continue;
+
+        for (unsigned int e = 0; e < corners; ++e) {
+            unsigned int a = geometry->faceNode(f, e);
+            unsigned int b = geometry->faceNode(f, (e + 1) % corners);
+            edges.push_back(make_pair(make_pair(min(a, b), max(a, b)), f * d_nodesPerFace + e));
+        }
+    }
+
+    sort(edges.begin(), edges.end());
+
+    // An edge shared by more than two faces means the mesh is not a proper
+    // manifold; such edges are linked pairwise in the order found.
+    for (unsigned int i = 0; i + 1 < edges.size(); ++i) {
+        if (edges[i].first == edges[i + 1].first) {
+            d_neighbors[edges[i].second] = edges[i + 1].second / d_nodesPerFace;
+            d_neighbors[edges[i + 1].second] = edges[i].second / d_nodesPerFace;
+            ++i;
+        }
+    }
+}
+
+} // namespace ugrid
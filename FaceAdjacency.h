@@ -0,0 +1,74 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _FaceAdjacency_h
+#define _FaceAdjacency_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+class MeshGeometry;
+
+/**
+ * The faces that share an edge with each face of a mesh, derived from the
+ * face node connectivity. Edge e of a face runs from its corner e to the
+ * next valid corner (wrapping around to corner 0), so for a face with n
+ * valid corners only edges 0 to n-1 are meaningful. An edge on the boundary
+ * of the mesh has no neighbor.
+ */
+class FaceAdjacency {
+
+private:
+    unsigned int d_nodesPerFace;
+
+    // d_neighbors[face * d_nodesPerFace + edge]
+    std::vector<unsigned int> d_neighbors;
+
+    FaceAdjacency(const FaceAdjacency &);
+    FaceAdjacency &operator=(const FaceAdjacency &);
+
+public:
+    static const unsigned int NO_NEIGHBOR;
+
+    FaceAdjacency(const MeshGeometry *geometry);
+
+    /**
+     * @return The face across the given edge of face, or NO_NEIGHBOR.
+     */
+    unsigned int neighbor(unsigned int face, unsigned int edge) const
+    {
+        return d_neighbors[face * d_nodesPerFace + edge];
+    }
+
+    unsigned long sizeInBytes() const
+    {
+        return d_neighbors.capacity() * sizeof(unsigned int);
+    }
+};
+
+} // namespace ugrid
+
+#endif // _FaceAdjacency_h
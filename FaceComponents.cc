@@ -0,0 +1,132 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "FaceAdjacency.h"
+#include "FaceComponents.h"
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * @return The root of the set holding i, halving the path to it on the way.
+ */
+static unsigned int findRoot(vector<unsigned int> &parent, unsigned int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * @param adjacency The edge neighbors of the faces of the whole mesh.
+ * @param nodesPerFace The number of corners (and so edges) of each face.
+ * @param faces The subset, in ascending order.
+ */
+FaceComponents::FaceComponents(const FaceAdjacency *adjacency, unsigned int nodesPerFace,
+    const vector<unsigned int> &faces)
+{
+    unsigned int count = faces.size();
+
+    // Union by size over the positions of the faces in the subset.
+    vector<unsigned int> parent(count), setSize(count, 1);
+    for (unsigned int i = 0; i < count; ++i)
+        parent[i] = i;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        for (unsigned int e = 0; e < nodesPerFace; ++e) {
+            unsigned int neighbor = adjacency->neighbor(faces[i], e);
+            // Each shared edge is seen from both faces; join it once.
+            if (neighbor == FaceAdjacency::NO_NEIGHBOR || neighbor < faces[i]) continue;
+
+            vector<unsigned int>::const_iterator it = lower_bound(faces.begin(), faces.end(), neighbor);
+            if (it == faces.end() || *it != neighbor) continue;
+
+            unsigned int a = findRoot(parent, i);
+            unsigned int b = findRoot(parent, it - faces.begin());
+            if (a == b) continue;
+            if (setSize[a] < setSize[b]) swap(a, b);
+            parent[b] = a;
+            setSize[a] += setSize[b];
+        }
+    }
+
+    // Number the components by their first face.
+    const unsigned int unnumbered = ~0U;
+    vector<unsigned int> number(count, unnumbered);
+    d_component.resize(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int root = findRoot(parent, i);
+        if (number[root] == unnumbered) {
+            number[root] = d_size.size();
+            d_size.push_back(0);
+        }
+        d_component[i] = number[root];
+        ++d_size[number[root]];
+    }
+}
+
+/**
+ * Remove the faces of components with fewer than minFaces faces.
+ * @param faces The subset the components were built from.
+ */
+void FaceComponents::keepLarge(vector<unsigned int> *faces, unsigned int minFaces) const
+{
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < faces->size(); ++i) {
+        if (d_size[d_component[i]] >= minFaces) (*faces)[kept++] = (*faces)[i];
+    }
+    faces->resize(kept);
+}
+
+/**
+ * Remove every face that is not in the same component as face. If face is
+ * not in the subset, nothing is kept.
+ * @param faces The subset the components were built from.
+ */
+void FaceComponents::keepComponentOf(vector<unsigned int> *faces, unsigned int face) const
+{
+    vector<unsigned int>::iterator it = lower_bound(faces->begin(), faces->end(), face);
+    if (it == faces->end() || *it != face) {
+        faces->clear();
+        return;
+    }
+
+    unsigned int c = d_component[it - faces->begin()];
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < faces->size(); ++i) {
+        if (d_component[i] == c) (*faces)[kept++] = (*faces)[i];
+    }
+    faces->resize(kept);
+}
+
+} // namespace ugrid
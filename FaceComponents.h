@@ -0,0 +1,81 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _FaceComponents_h
+#define _FaceComponents_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+class FaceAdjacency;
+
+/**
+ * The connected components of a subset of the faces of a mesh, where two
+ * faces are connected if they share an edge and both are in the subset.
+ * Components are found with a union-find over the shared edges and are
+ * numbered in the order of their first face in the subset.
+ */
+class FaceComponents {
+
+private:
+    // d_component[i] is the component of the i-th face of the subset.
+    std::vector<unsigned int> d_component;
+    std::vector<unsigned int> d_size;
+
+    FaceComponents(const FaceComponents &);
+    FaceComponents &operator=(const FaceComponents &);
+
+public:
+    FaceComponents(const FaceAdjacency *adjacency, unsigned int nodesPerFace, const std::vector<unsigned int> &faces);
+
+    unsigned int componentCount() const
+    {
+        return d_size.size();
+    }
+
+    /**
+     * @return The component of the i-th face of the subset.
+     */
+    unsigned int component(unsigned int i) const
+    {
+        return d_component[i];
+    }
+
+    /**
+     * @return The number of faces in component c.
+     */
+    unsigned int size(unsigned int c) const
+    {
+        return d_size[c];
+    }
+
+    void keepLarge(std::vector<unsigned int> *faces, unsigned int minFaces) const;
+    void keepComponentOf(std::vector<unsigned int> *faces, unsigned int face) const;
+};
+
+} // namespace ugrid
+
+#endif // _FaceComponents_h
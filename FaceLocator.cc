@@ -0,0 +1,274 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cmath>
+#include <vector>
+
+#include "MeshGeometry.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+
+using namespace std;
+
+namespace ugrid {
+
+// Barycentric weights this far below zero still count as inside, so points
+// that fall on a shared edge are not lost to rounding.
+static const double BARYCENTRIC_TOLERANCE = 1e-10;
+
+// A walk that has not reached the point after this many faces gives up and
+// falls back to the bucket search.
+static const unsigned int WALK_MAX_STEPS = 256;
+
+FaceLocator::FaceLocator(const MeshGeometry *geometry) :
+    d_geometry(geometry), d_minX(0), d_minY(0), d_maxX(0), d_maxY(0), d_cellWidth(1), d_cellHeight(1), d_nx(1), d_ny(1)
+{
+    unsigned int faceCount = d_geometry->faceCount();
+
+    // The extent of all the faces.
+    bool first = true;
+    for (unsigned int f = 0; f < faceCount; ++f) {
+        double fMinX, fMinY, fMaxX, fMaxY;
+        if (!faceBounds(f, &fMinX, &fMinY, &fMaxX, &fMaxY)) continue;
+
+        if (first) {
+            d_minX = fMinX, d_minY = fMinY, d_maxX = fMaxX, d_maxY = fMaxY;
+            first = false;
+        }
+        else {
+            if (fMinX < d_minX) d_minX = fMinX;
+            if (fMinY < d_minY) d_minY = fMinY;
+            if (fMaxX > d_maxX) d_maxX = fMaxX;
+            if (fMaxY > d_maxY) d_maxY = fMaxY;
+        }
+    }
+
+    // About one bucket per face, shaped to the aspect ratio of the mesh.
+    double width = d_maxX - d_minX;
+    double height = d_maxY - d_minY;
+    if (faceCount > 0 && width > 0 && height > 0) {
+        double cells = faceCount;
+        d_nx = (unsigned int) ceil(sqrt(cells * width / height));
+        d_ny = (unsigned int) ceil(sqrt(cells * height / width));
+        if (d_nx < 1) d_nx = 1;
+        if (d_ny < 1) d_ny = 1;
+        if (d_nx > faceCount) d_nx = faceCount;
+        if (d_ny > faceCount) d_ny = faceCount;
+    }
+    d_cellWidth = (width > 0) ? width / d_nx : 1;
+    d_cellHeight = (height > 0) ? height / d_ny : 1;
+
+    // Two passes: count the faces in each bucket, then fill them in.
+    d_bucketStart.assign(d_nx * d_ny + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        vector<unsigned int> fill;
+        if (pass == 1) {
+            for (unsigned int b = 1; b < d_bucketStart.size(); ++b)
+                d_bucketStart[b] += d_bucketStart[b - 1];
+            d_bucketFaces.resize(d_bucketStart.back());
+            fill.assign(d_bucketStart.begin(), d_bucketStart.end() - 1);
+        }
+
+        for (unsigned int f = 0; f < faceCount; ++f) {
+            double fMinX, fMinY, fMaxX, fMaxY;
+            if (!faceBounds(f, &fMinX, &fMinY, &fMaxX, &fMaxY)) continue;
+
+            unsigned int c0 = column(fMinX), c1 = column(fMaxX);
+            unsigned int r0 = row(fMinY), r1 = row(fMaxY);
+            for (unsigned int r = r0; r <= r1; ++r) {
+                for (unsigned int c = c0; c <= c1; ++c) {
+                    unsigned int b = r * d_nx + c;
+                    if (pass == 0)
+                        d_bucketStart[b + 1]++;
+                    else
+                        d_bucketFaces[fill[b]++] = f;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Compute the bounding box of a face.
+ * @return False if the face has fewer than three valid corners.
+ */
+bool FaceLocator::faceBounds(unsigned int face, double *minX, double *minY, double *maxX, double *maxY) const
+{
+    unsigned int corners = 0;
+    for (unsigned int c = 0; c < d_geometry->nodesPerFace(); ++c) {
+        unsigned int n = d_geometry->faceNode(face, c);
+        if (n >= d_geometry->nodeCount()) continue;
+
+        double x = d_geometry->nodeX(n), y = d_geometry->nodeY(n);
+        if (corners == 0) {
+            *minX = *maxX = x;
+            *minY = *maxY = y;
+        }
+        else {
+            if (x < *minX) *minX = x;
+            if (x > *maxX) *maxX = x;
+            if (y < *minY) *minY = y;
+            if (y > *maxY) *maxY = y;
+        }
+        ++corners;
+    }
+
+    return corners >= 3;
+}
+
+unsigned int FaceLocator::column(double x) const
+{
+    double c = floor((x - d_minX) / d_cellWidth);
+    if (c < 0) return 0;
+    if (c >= d_nx) return d_nx - 1;
+    return (unsigned int) c;
+}
+
+unsigned int FaceLocator::row(double y) const
+{
+    double r = floor((y - d_minY) / d_cellHeight);
+    if (r < 0) return 0;
+    if (r >= d_ny) return d_ny - 1;
+    return (unsigned int) r;
+}
+
+/**
+ * Test if the point (x, y) is in the given face and if so compute its
+ * barycentric weights. Faces with more than three corners are treated as a
+ * fan of triangles around the first corner.
+ *
+ * @return True if the point is in the face; result is only set in that case.
+ */
+bool FaceLocator::weightsInFace(unsigned int face, double x, double y, FaceWeights *result) const
+{
+    unsigned int nodeCount = d_geometry->nodeCount();
+    unsigned int a = d_geometry->faceNode(face, 0);
+    if (a >= nodeCount) return false;
+
+    double xa = d_geometry->nodeX(a), ya = d_geometry->nodeY(a);
+
+    for (unsigned int c = 1; c + 1 < d_geometry->nodesPerFace(); ++c) {
+        unsigned int b = d_geometry->faceNode(face, c);
+        unsigned int n = d_geometry->faceNode(face, c + 1);
+        if (b >= nodeCount || n >= nodeCount) break;
+
+        double xb = d_geometry->nodeX(b), yb = d_geometry->nodeY(b);
+        double xc = d_geometry->nodeX(n), yc = d_geometry->nodeY(n);
+
+        double det = (yb - yc) * (xa - xc) + (xc - xb) * (ya - yc);
+        if (det == 0) continue;  // degenerate triangle
+
+        double la = ((yb - yc) * (x - xc) + (xc - xb) * (y - yc)) / det;
+        double lb = ((yc - ya) * (x - xc) + (xa - xc) * (y - yc)) / det;
+        double lc = 1.0 - la - lb;
+
+        if (la >= -BARYCENTRIC_TOLERANCE && lb >= -BARYCENTRIC_TOLERANCE && lc >= -BARYCENTRIC_TOLERANCE) {
+            result->face = face;
+            result->nodes[0] = a, result->nodes[1] = b, result->nodes[2] = n;
+            result->weights[0] = la, result->weights[1] = lb, result->weights[2] = lc;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Find the face that contains (x, y).
+ *
+ * @return True if a face was found, with its weights in result. False if the
+ * point is outside the mesh.
+ */
+bool FaceLocator::locate(double x, double y, FaceWeights *result) const
+{
+    if (d_bucketFaces.empty()) return false;
+
+    // Points outside the extent of the mesh would otherwise be clamped into
+    // an edge bucket; the face test would reject them, but this is cheaper.
+    if (x < d_minX || y < d_minY || x > d_maxX || y > d_maxY) return false;
+
+    unsigned int b = row(y) * d_nx + column(x);
+    for (unsigned int i = d_bucketStart[b]; i < d_bucketStart[b + 1]; ++i) {
+        if (weightsInFace(d_bucketFaces[i], x, y, result)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Find the face that contains (x, y) by walking across the mesh from
+ * startFace, which should be near the point (e.g., the face holding the
+ * previous sample of a transect). At each step the walk leaves the current
+ * face through an edge that has the point on its far side. If the walk runs
+ * off the boundary of the mesh (which can happen with concave boundaries or
+ * holes) or takes too many steps, this falls back to locate().
+ *
+ * @return True if a face was found, with its weights in result.
+ */
+bool FaceLocator::walk(const FaceAdjacency *adjacency, unsigned int startFace, double x, double y,
+    FaceWeights *result) const
+{
+    unsigned int nodeCount = d_geometry->nodeCount();
+    unsigned int face = startFace;
+
+    for (unsigned int step = 0; step < WALK_MAX_STEPS && face < d_geometry->faceCount(); ++step) {
+        if (weightsInFace(face, x, y, result)) return true;
+
+        unsigned int corners = 0;
+        while (corners < d_geometry->nodesPerFace() && d_geometry->faceNode(face, corners) < nodeCount)
+            ++corners;
+        if (corners < 3) break;
+
+        // Twice the signed area; its sign gives the winding of the face.
+        double area = 0;
+        for (unsigned int c = 0; c < corners; ++c) {
+            unsigned int a = d_geometry->faceNode(face, c);
+            unsigned int b = d_geometry->faceNode(face, (c + 1) % corners);
+            area += d_geometry->nodeX(a) * d_geometry->nodeY(b) - d_geometry->nodeX(b) * d_geometry->nodeY(a);
+        }
+        if (area == 0) break;
+
+        unsigned int next = FaceAdjacency::NO_NEIGHBOR;
+        for (unsigned int e = 0; e < corners; ++e) {
+            unsigned int a = d_geometry->faceNode(face, e);
+            unsigned int b = d_geometry->faceNode(face, (e + 1) % corners);
+            double xa = d_geometry->nodeX(a), ya = d_geometry->nodeY(a);
+            double cross = (d_geometry->nodeX(b) - xa) * (y - ya) - (d_geometry->nodeY(b) - ya) * (x - xa);
+            if ((area > 0) ? cross < 0 : cross > 0) {
+                next = adjacency->neighbor(face, e);
+                break;
+            }
+        }
+        if (next == FaceAdjacency::NO_NEIGHBOR) break;
+
+        face = next;
+    }
+
+    return locate(x, y, result);
+}
+
+} // namespace ugrid
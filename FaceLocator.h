@@ -0,0 +1,93 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _FaceLocator_h
+#define _FaceLocator_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+class MeshGeometry;
+class FaceAdjacency;
+
+/**
+ * The face that contains a point and the barycentric weights of the point
+ * with respect to three of that face's nodes. For triangles these are the
+ * face's corners; a face with more corners is split into a fan of triangles
+ * around its first corner and the weights are those of the fan triangle that
+ * holds the point.
+ */
+struct FaceWeights {
+    unsigned int face;
+    unsigned int nodes[3];
+    double weights[3];
+};
+
+/**
+ * Finds the face of a mesh that contains a point. The faces are binned, by
+ * their bounding boxes, into a regular grid of buckets covering the mesh
+ * (about one bucket per face), so a lookup only tests the few faces in one
+ * bucket. The buckets are held in compressed form: d_bucketStart[b] is the
+ * offset in d_bucketFaces of the faces of bucket b.
+ *
+ * The locator keeps a pointer to the MeshGeometry it was built from, which
+ * must outlive it; normally the MeshGeometry owns the locator.
+ */
+class FaceLocator {
+
+private:
+    const MeshGeometry *d_geometry;
+
+    double d_minX, d_minY, d_maxX, d_maxY;
+    double d_cellWidth, d_cellHeight;
+    unsigned int d_nx, d_ny;
+
+    std::vector<unsigned int> d_bucketStart;
+    std::vector<unsigned int> d_bucketFaces;
+
+    bool faceBounds(unsigned int face, double *minX, double *minY, double *maxX, double *maxY) const;
+    unsigned int column(double x) const;
+    unsigned int row(double y) const;
+
+    FaceLocator(const FaceLocator &);
+    FaceLocator &operator=(const FaceLocator &);
+
+public:
+    FaceLocator(const MeshGeometry *geometry);
+
+    bool locate(double x, double y, FaceWeights *result) const;
+    bool weightsInFace(unsigned int face, double x, double y, FaceWeights *result) const;
+    bool walk(const FaceAdjacency *adjacency, unsigned int startFace, double x, double y, FaceWeights *result) const;
+
+    unsigned long sizeInBytes() const
+    {
+        return (d_bucketStart.capacity() + d_bucketFaces.capacity()) * sizeof(unsigned int);
+    }
+};
+
+} // namespace ugrid
+
+#endif // _FaceLocator_h
@@ -0,0 +1,153 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#include "FilterBounds.h"
+
+using namespace std;
+
+namespace ugrid {
+
+static string strip(const string &s)
+{
+    string::size_type first = s.find_first_not_of(" \t\n\r");
+    if (first == string::npos) return "";
+
+    return s.substr(first, s.find_last_not_of(" \t\n\r") - first + 1);
+}
+
+/**
+ * @return True if s is a number (and nothing else), which is returned in value.
+ */
+static bool parseNumber(const string &s, double *value)
+{
+    if (s.empty()) return false;
+
+    char *end;
+    *value = strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+
+FilterBounds::FilterBounds(const string &filterExpression, const string &xName, const string &yName) :
+    d_bounded(false)
+{
+    for (unsigned int axis = 0; axis < 2; ++axis) {
+        d_lower[axis] = -numeric_limits<double>::infinity();
+        d_upper[axis] = numeric_limits<double>::infinity();
+        d_lowerStrict[axis] = d_upperStrict[axis] = false;
+    }
+
+    if (filterExpression.find_first_of("|()!") != string::npos) return;
+
+    string::size_type start = 0;
+    while (start <= filterExpression.size()) {
+        string::size_type end = filterExpression.find('&', start);
+        if (end == string::npos) end = filterExpression.size();
+
+        addTerm(strip(filterExpression.substr(start, end - start)), xName, yName);
+
+        start = end + 1;
+    }
+}
+
+/**
+ * Use one term of the conjunction, if it compares a coordinate with a number.
+ */
+void FilterBounds::addTerm(const string &term, const string &xName, const string &yName)
+{
+    static const char *ops[] = { ">=", "<=", "==", ">", "<", "=" };
+
+    for (unsigned int i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        string::size_type pos = term.find(ops[i]);
+        if (pos == string::npos) continue;
+
+        string op = ops[i];
+        string left = strip(term.substr(0, pos));
+        string right = strip(term.substr(pos + op.size()));
+
+        // Put the coordinate on the left; '26 < X' is 'X > 26'.
+        double value;
+        if (parseNumber(left, &value)) {
+            left.swap(right);
+            if (op[0] == '<')
+                op[0] = '>';
+            else if (op[0] == '>') op[0] = '<';
+        }
+        else if (!parseNumber(right, &value)) {
+            return;
+        }
+
+        if (!xName.empty() && left == xName)
+            addBound(0, op, value);
+        else if (!yName.empty() && left == yName) addBound(1, op, value);
+
+        return;
+    }
+}
+
+void FilterBounds::addBound(unsigned int axis, const string &op, double value)
+{
+    bool lower = op[0] == '>' || op[0] == '=';
+    bool upper = op[0] == '<' || op[0] == '=';
+    bool strict = op.size() == 1 && op[0] != '=';
+
+    if (lower && (value > d_lower[axis] || (value == d_lower[axis] && strict))) {
+        d_lower[axis] = value;
+        d_lowerStrict[axis] = strict;
+    }
+    if (upper && (value < d_upper[axis] || (value == d_upper[axis] && strict))) {
+        d_upper[axis] = value;
+        d_upperStrict[axis] = strict;
+    }
+
+    d_bounded = true;
+}
+
+/**
+ * @return False if no point in the box can satisfy the bounds.
+ */
+bool FilterBounds::intersects(double minX, double minY, double maxX, double maxY) const
+{
+    double minimum[2] = { minX, minY };
+    double maximum[2] = { maxX, maxY };
+
+    for (unsigned int axis = 0; axis < 2; ++axis) {
+        double lo = d_lower[axis], hi = d_upper[axis];
+
+        if (lo > hi || (lo == hi && (d_lowerStrict[axis] || d_upperStrict[axis]))) return false;
+
+        if (lo > maximum[axis] || (lo == maximum[axis] && d_lowerStrict[axis])) return false;
+        if (hi < minimum[axis] || (hi == minimum[axis] && d_upperStrict[axis])) return false;
+    }
+
+    return true;
+}
+
+} // namespace ugrid
@@ -0,0 +1,72 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _FilterBounds_h
+#define _FilterBounds_h 1
+
+#include <string>
+
+namespace ugrid {
+
+/**
+ * The bounds a restriction filter expression puts on the x and y node
+ * coordinates, found without evaluating it. Only the terms of a conjunction
+ * that compare a coordinate with a number (e.g., 'X > 26 & Y <= 27.5' or
+ * '26 < X') are used; any other term (e.g., one comparing a range variable)
+ * only narrows the subset further, so it is skipped. An expression with a
+ * disjunction or parentheses puts no bounds on the coordinates.
+ *
+ * If the bounds do not intersect the extent of a mesh the restriction is
+ * known to be empty before any of the mesh is read.
+ */
+class FilterBounds {
+
+private:
+    double d_lower[2];
+    double d_upper[2];
+    bool d_lowerStrict[2];
+    bool d_upperStrict[2];
+    bool d_bounded;
+
+    void addTerm(const std::string &term, const std::string &xName, const std::string &yName);
+    void addBound(unsigned int axis, const std::string &op, double value);
+
+public:
+    FilterBounds(const std::string &filterExpression, const std::string &xName, const std::string &yName);
+
+    /**
+     * @return True if the expression bounds either coordinate.
+     */
+    bool bounded() const
+    {
+        return d_bounded;
+    }
+
+    bool intersects(double minX, double minY, double maxX, double maxY) const;
+};
+
+} // namespace ugrid
+
+#endif // _FilterBounds_h
@@ -0,0 +1,202 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include "config.h"
+
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
+#include "GatherKernel.h"
+
+// The AVX2 loops are compiled for that instruction set on their own (the
+// rest of the module is not) and only called if the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define GATHER_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define GATHER_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define GATHER_PREFETCH(address)
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+// Runs of at least this many consecutive indices are copied with memcpy().
+static const unsigned int GATHER_MIN_RUN = 16;
+
+// How many values ahead of the one being copied the scalar loops prefetch.
+static const unsigned int GATHER_PREFETCH_DISTANCE = 16;
+
+bool GatherKernel::d_useAvx2 = GatherKernel::avx2Available();
+
+/**
+ * @return True if this build has the AVX2 loops and the CPU can run them.
+ */
+bool GatherKernel::avx2Available()
+{
+#ifdef GATHER_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+template<typename T>
+static void gatherScalar(const T *src, const unsigned int *index, unsigned int n, T *dst)
+{
+    unsigned int i = 0;
+    for (; i + GATHER_PREFETCH_DISTANCE < n; ++i) {
+        GATHER_PREFETCH(src + index[i + GATHER_PREFETCH_DISTANCE]);
+        dst[i] = src[index[i]];
+    }
+    for (; i < n; ++i)
+        dst[i] = src[index[i]];
+}
+
+#ifdef GATHER_AVX2
+__attribute__((target("avx2")))
+static void gather32Avx2(const uint32_t *src, const unsigned int *index, unsigned int n, uint32_t *dst)
+{
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i vindex = _mm256_loadu_si256((const __m256i *) (index + i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_i32gather_epi32((const int *) src, vindex, 4));
+    }
+    for (; i < n; ++i)
+        dst[i] = src[index[i]];
+}
+
+__attribute__((target("avx2")))
+static void gather64Avx2(const uint64_t *src, const unsigned int *index, unsigned int n, uint64_t *dst)
+{
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i vindex = _mm_loadu_si128((const __m128i *) (index + i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_i32gather_epi64((const long long *) src, vindex, 8));
+    }
+    for (; i < n; ++i)
+        dst[i] = src[index[i]];
+}
+#endif
+
+/**
+ * Find the runs of consecutive indices in index, which must outlive the
+ * kernel. The index need not be sorted, but the subsets of a mesh are, and
+ * that is what makes the runs long.
+ */
+GatherKernel::GatherKernel(const vector<unsigned int> *index) :
+    d_index(index), d_vectorizable(index->empty() || index->back() <= (unsigned int) INT_MAX)
+{
+    unsigned int n = index->size();
+    unsigned int i = 0;
+    while (i < n) {
+        unsigned int j = i + 1;
+        while (j < n && (*index)[j] == (*index)[j - 1] + 1)
+            ++j;
+
+        if (j - i >= GATHER_MIN_RUN) {
+            d_runBegin.push_back(i);
+            d_runEnd.push_back(j);
+        }
+        i = j;
+    }
+}
+
+/**
+ * Gather the values at positions [begin, end) of the index.
+ */
+void GatherKernel::gatherSegment(const char *src, unsigned int width, unsigned int begin, unsigned int end,
+    char *dst) const
+{
+    if (begin == end) return;
+
+    const unsigned int *index = &(*d_index)[begin];
+    unsigned int n = end - begin;
+    dst += (size_t) begin * width;
+
+    switch (width) {
+    case 1:
+        gatherScalar((const uint8_t *) src, index, n, (uint8_t *) dst);
+        break;
+    case 2:
+        gatherScalar((const uint16_t *) src, index, n, (uint16_t *) dst);
+        break;
+    case 4:
+#ifdef GATHER_AVX2
+        if (d_useAvx2 && d_vectorizable) {
+            gather32Avx2((const uint32_t *) src, index, n, (uint32_t *) dst);
+            break;
+        }
+#endif
+        gatherScalar((const uint32_t *) src, index, n, (uint32_t *) dst);
+        break;
+    case 8:
+#ifdef GATHER_AVX2
+        if (d_useAvx2 && d_vectorizable) {
+            gather64Avx2((const uint64_t *) src, index, n, (uint64_t *) dst);
+            break;
+        }
+#endif
+        gatherScalar((const uint64_t *) src, index, n, (uint64_t *) dst);
+        break;
+    default:
+        for (unsigned int i = 0; i < n; ++i)
+            memcpy(dst + (size_t) i * width, src + (size_t) index[i] * width, width);
+        break;
+    }
+}
+
+/**
+ * Copy the values of width bytes at the kernel's indices in src to
+ * consecutive values in dst.
+ */
+void GatherKernel::gather(const void *src, unsigned int width, void *dst) const
+{
+    const char *in = (const char *) src;
+    char *out = (char *) dst;
+
+    unsigned int pos = 0;
+    for (unsigned int r = 0; r < d_runBegin.size(); ++r) {
+        gatherSegment(in, width, pos, d_runBegin[r], out);
+
+        unsigned int begin = d_runBegin[r];
+        memcpy(out + (size_t) begin * width, in + (size_t) (*d_index)[begin] * width,
+            (size_t) (d_runEnd[r] - begin) * width);
+        pos = d_runEnd[r];
+    }
+    gatherSegment(in, width, pos, d_index->size(), out);
+}
+
+} // namespace ugrid
@@ -0,0 +1,90 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _GatherKernel_h
+#define _GatherKernel_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+/**
+ * Copies the values at a sorted subset index out of a slab of a range
+ * variable, e.g., the nodes of a restriction out of each time step. The runs
+ * of consecutive indices long enough to be worth a memcpy() are found once,
+ * when the kernel is made, and the kernel is then applied to every slab.
+ * Between the runs the values are gathered by a loop for their width (1, 2,
+ * 4 or 8 bytes); the 4 and 8 byte loops use AVX2 gathers when the CPU has
+ * them and the others prefetch the values a little ahead.
+ */
+class GatherKernel {
+
+private:
+    const std::vector<unsigned int> *d_index;
+
+    // The runs are the positions [d_runBegin[r], d_runEnd[r]) of the index.
+    std::vector<unsigned int> d_runBegin;
+    std::vector<unsigned int> d_runEnd;
+
+    // AVX2 gathers take signed 32-bit indices.
+    bool d_vectorizable;
+
+    static bool d_useAvx2;
+
+    void gatherSegment(const char *src, unsigned int width, unsigned int begin, unsigned int end, char *dst) const;
+
+    GatherKernel(const GatherKernel &);
+    GatherKernel &operator=(const GatherKernel &);
+
+public:
+    GatherKernel(const std::vector<unsigned int> *index);
+
+    const std::vector<unsigned int> *index() const
+    {
+        return d_index;
+    }
+
+    unsigned int runCount() const
+    {
+        return d_runBegin.size();
+    }
+
+    void gather(const void *src, unsigned int width, void *dst) const;
+
+    static bool avx2Available();
+
+    /**
+     * Use (or stop using) the AVX2 loops; they are used by default when the
+     * CPU has them. For tests and benchmarks.
+     */
+    static void useAvx2(bool use)
+    {
+        d_useAvx2 = use && avx2Available();
+    }
+};
+
+} // namespace ugrid
+
+#endif // _GatherKernel_h
@@ -0,0 +1,139 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include "config.h"
+
+#include <vector>
+
+#include "GatherKernel.h"
+#include "GatherPlan.h"
+
+using namespace std;
+
+namespace ugrid {
+
+// Parts of the subset closer than this many elements are read together.
+static const unsigned int GATHER_READ_MAX_GAP = 1024;
+
+// A subset in more parts than this is read over its whole span.
+static const unsigned int GATHER_MAX_READS = 16;
+
+/**
+ * Choose how to read the values at index (which is copied) from slabs whose
+ * location dimension is slabLength long.
+ *
+ * Partial reads are only planned for a sorted index. A subset that spans
+ * most of the slab reads it whole. Otherwise the subset is split where
+ * consecutive indices are more than GATHER_READ_MAX_GAP apart; if that gives
+ * a few parts that together cover at most half of the span, each is read on
+ * its own, and if not the span is read at once.
+ */
+GatherPlan::GatherPlan(const vector<unsigned int> &index, unsigned int slabLength) :
+    d_index(index), d_slabLength(slabLength), d_strategy(read_full), d_fullKernel(0)
+{
+    d_fullKernel = new GatherKernel(&d_index);
+
+    // Nothing to read.
+    if (d_index.empty()) {
+        d_strategy = read_runs;
+        return;
+    }
+
+    for (unsigned int i = 1; i < d_index.size(); ++i)
+        if (d_index[i] < d_index[i - 1]) return;
+
+    if (d_index.back() >= slabLength) return;
+
+    unsigned long span = d_index.back() - d_index.front() + 1;
+    if (span * 4 > (unsigned long) slabLength * 3) return;
+
+    vector<unsigned int> first(1, d_index.front()), last(1, d_index.front());
+    for (unsigned int i = 1; i < d_index.size(); ++i) {
+        if (d_index[i] - last.back() > GATHER_READ_MAX_GAP) {
+            first.push_back(d_index[i]);
+            last.push_back(d_index[i]);
+        }
+        else {
+            last.back() = d_index[i];
+        }
+    }
+
+    unsigned long covered = 0;
+    for (unsigned int r = 0; r < first.size(); ++r)
+        covered += last[r] - first[r] + 1;
+
+    if (first.size() > 1 && first.size() <= GATHER_MAX_READS && covered * 2 <= span) {
+        d_strategy = read_runs;
+        planReads(first, last);
+    }
+    else {
+        d_strategy = read_bounds;
+        planReads(vector<unsigned int>(1, d_index.front()), vector<unsigned int>(1, d_index.back()));
+    }
+}
+
+GatherPlan::~GatherPlan()
+{
+    delete d_fullKernel;
+    for (vector<GatherKernel *>::iterator it = d_readKernels.begin(); it != d_readKernels.end(); ++it)
+        delete *it;
+}
+
+/**
+ * Make the reads of the element ranges [first[r], last[r]], which must
+ * together hold every index, in order.
+ */
+void GatherPlan::planReads(const vector<unsigned int> &first, const vector<unsigned int> &last)
+{
+    d_readFirst = first;
+    d_readLast = last;
+    d_readIndex.resize(first.size());
+
+    unsigned int i = 0;
+    for (unsigned int r = 0; r < first.size(); ++r) {
+        d_readPosition.push_back(i);
+        while (i < d_index.size() && d_index[i] <= last[r])
+            d_readIndex[r].push_back(d_index[i++] - first[r]);
+    }
+
+    // The kernels keep pointers to d_readIndex's vectors, so they are made
+    // once it is complete.
+    for (unsigned int r = 0; r < first.size(); ++r)
+        d_readKernels.push_back(new GatherKernel(&d_readIndex[r]));
+}
+
+unsigned long GatherPlan::sizeInBytes() const
+{
+    unsigned long size = sizeof(GatherPlan) + d_index.capacity() * sizeof(unsigned int);
+    size += (d_readFirst.capacity() + d_readLast.capacity() + d_readPosition.capacity()) * sizeof(unsigned int);
+    for (unsigned int r = 0; r < d_readIndex.size(); ++r)
+        size += d_readIndex[r].capacity() * sizeof(unsigned int) + 2 * d_readKernels[r]->runCount() * sizeof(unsigned int);
+    size += 2 * d_fullKernel->runCount() * sizeof(unsigned int);
+
+    return size;
+}
+
+} // namespace ugrid
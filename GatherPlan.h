@@ -0,0 +1,137 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _GatherPlan_h
+#define _GatherPlan_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+class GatherKernel;
+
+/**
+ * How to read the values of range variables at a subset of the locations
+ * (nodes or faces) of a mesh, one slab of the location dimension at a time.
+ * The plan is made once for a subset and used for every slab of every range
+ * variable at that location. Depending on how much of the location dimension
+ * the subset spans, each slab is read whole (read_full), only over the span of
+ * the subset (read_bounds) or as a few separate parts that each cover a
+ * cluster of the subset (read_runs); a read's values are then copied out
+ * with a GatherKernel.
+ */
+class GatherPlan {
+
+public:
+    enum Strategy {
+        read_full, read_bounds, read_runs
+    };
+
+private:
+    std::vector<unsigned int> d_index;
+    unsigned int d_slabLength;
+    Strategy d_strategy;
+
+    // For reading the whole slab; made for every plan, since a slab whose
+    // location dimension is not slabLength long has to be read whole.
+    GatherKernel *d_fullKernel;
+
+    // For read_bounds and read_runs, read r covers the elements
+    // [d_readFirst[r], d_readLast[r]] of the slab and fills the positions
+    // of the index from d_readPosition[r]; d_readIndex[r] holds their
+    // indices relative to d_readFirst[r].
+    std::vector<unsigned int> d_readFirst;
+    std::vector<unsigned int> d_readLast;
+    std::vector<unsigned int> d_readPosition;
+    std::vector<std::vector<unsigned int> > d_readIndex;
+    std::vector<GatherKernel *> d_readKernels;
+
+    void planReads(const std::vector<unsigned int> &first, const std::vector<unsigned int> &last);
+
+    GatherPlan(const GatherPlan &);
+    GatherPlan &operator=(const GatherPlan &);
+
+public:
+    GatherPlan(const std::vector<unsigned int> &index, unsigned int slabLength);
+    ~GatherPlan();
+
+    const std::vector<unsigned int> &index() const
+    {
+        return d_index;
+    }
+
+    /**
+     * @return The length of the location dimension the plan was made for.
+     */
+    unsigned int slabLength() const
+    {
+        return d_slabLength;
+    }
+
+    Strategy strategy() const
+    {
+        return d_strategy;
+    }
+
+    const GatherKernel &fullKernel() const
+    {
+        return *d_fullKernel;
+    }
+
+    /**
+     * @return The number of reads of a slab; zero for read_full (one read
+     * of the whole slab, copied with fullKernel()) and for an empty subset.
+     */
+    unsigned int readCount() const
+    {
+        return d_readKernels.size();
+    }
+
+    unsigned int readFirst(unsigned int r) const
+    {
+        return d_readFirst[r];
+    }
+
+    unsigned int readLast(unsigned int r) const
+    {
+        return d_readLast[r];
+    }
+
+    unsigned int readPosition(unsigned int r) const
+    {
+        return d_readPosition[r];
+    }
+
+    const GatherKernel &readKernel(unsigned int r) const
+    {
+        return *d_readKernels[r];
+    }
+
+    unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _GatherPlan_h
@@ -0,0 +1,162 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "KDTree.h"
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * Orders point ids by their coordinate value along one axis. Used by
+ * nth_element() to find the splitting point of each sub-tree.
+ */
+struct AxisLess {
+    const double *d_coord;
+
+    AxisLess(const double *coord) :
+        d_coord(coord)
+    {
+    }
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return d_coord[a] < d_coord[b];
+    }
+};
+
+KDTree::KDTree(const double *x, const double *y, unsigned int size) :
+    d_x(x), d_y(y), d_size(size), d_index(size), d_axis(size, 0)
+{
+    for (unsigned int i = 0; i < d_size; ++i)
+        d_index[i] = i;
+
+    build(0, d_size);
+}
+
+/**
+ * Recursively organize the ids in [lo, hi) so that the middle element is
+ * the median along the axis with the largest spread.
+ */
+void KDTree::build(unsigned int lo, unsigned int hi)
+{
+    if (hi <= lo + 1) return;
+
+    double minX = d_x[d_index[lo]], maxX = minX;
+    double minY = d_y[d_index[lo]], maxY = minY;
+    for (unsigned int i = lo + 1; i < hi; ++i) {
+        unsigned int id = d_index[i];
+        if (d_x[id] < minX) minX = d_x[id];
+        if (d_x[id] > maxX) maxX = d_x[id];
+        if (d_y[id] < minY) minY = d_y[id];
+        if (d_y[id] > maxY) maxY = d_y[id];
+    }
+
+    unsigned char axis = ((maxX - minX) >= (maxY - minY)) ? 0 : 1;
+    unsigned int mid = lo + (hi - lo) / 2;
+
+    nth_element(d_index.begin() + lo, d_index.begin() + mid, d_index.begin() + hi,
+        AxisLess(axis == 0 ? d_x : d_y));
+    d_axis[mid] = axis;
+
+    build(lo, mid);
+    build(mid + 1, hi);
+}
+
+/**
+ * Descend the sub-tree [lo, hi) keeping the k closest points seen so far in
+ * a max-heap (by squared distance). The far side of a split is only visited
+ * when the heap is not yet full or when the splitting plane is closer than
+ * the current k-th nearest point.
+ */
+void KDTree::search(unsigned int lo, unsigned int hi, double qx, double qy, unsigned int k,
+    vector<pair<double, unsigned int> > *heap) const
+{
+    if (hi <= lo) return;
+
+    unsigned int mid = lo + (hi - lo) / 2;
+    unsigned int id = d_index[mid];
+
+    double dx = qx - d_x[id];
+    double dy = qy - d_y[id];
+    double d2 = dx * dx + dy * dy;
+
+    if (heap->size() < k) {
+        heap->push_back(make_pair(d2, id));
+        push_heap(heap->begin(), heap->end());
+    }
+    else if (make_pair(d2, id) < heap->front()) {
+        pop_heap(heap->begin(), heap->end());
+        heap->back() = make_pair(d2, id);
+        push_heap(heap->begin(), heap->end());
+    }
+
+    if (hi == lo + 1) return;
+
+    double diff = (d_axis[mid] == 0) ? dx : dy;
+
+    if (diff < 0) {
+        search(lo, mid, qx, qy, k, heap);
+        if (heap->size() < k || diff * diff <= heap->front().first) search(mid + 1, hi, qx, qy, k, heap);
+    }
+    else {
+        search(mid + 1, hi, qx, qy, k, heap);
+        if (heap->size() < k || diff * diff <= heap->front().first) search(lo, mid, qx, qy, k, heap);
+    }
+}
+
+/**
+ * Find the k points closest to (qx, qy). The ids and (Euclidean) distances
+ * are returned in the value-result parameters ordered from nearest to
+ * farthest. If the tree holds fewer than k points, all of them are returned.
+ */
+void KDTree::nearest(double qx, double qy, unsigned int k, vector<unsigned int> *ids, vector<double> *distances) const
+{
+    ids->clear();
+    distances->clear();
+
+    if (k > d_size) k = d_size;
+    if (k == 0) return;
+
+    vector<pair<double, unsigned int> > heap;
+    heap.reserve(k);
+
+    search(0, d_size, qx, qy, k, &heap);
+
+    sort_heap(heap.begin(), heap.end());
+
+    for (vector<pair<double, unsigned int> >::iterator it = heap.begin(); it != heap.end(); ++it) {
+        ids->push_back(it->second);
+        distances->push_back(sqrt(it->first));
+    }
+}
+
+} // namespace ugrid
@@ -0,0 +1,80 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _KDTree_h
+#define _KDTree_h 1
+
+#include <vector>
+#include <utility>
+
+namespace ugrid {
+
+/**
+ * A static, two dimensional k-d tree over a set of points (typically the
+ * nodes of a mesh). The tree is stored implicitly: d_index holds a
+ * permutation of the point ids such that for every sub-range [lo, hi) the
+ * point at the middle of the range is the splitting point and the points
+ * on either side of it are the left and right sub-trees. d_axis holds the
+ * splitting axis (0 for x, 1 for y) of each of those middle positions.
+ *
+ * The coordinate values are not copied; the tree keeps pointers to the
+ * caller's arrays, which must outlive it. In practice the tree is owned by
+ * the MeshGeometry that owns the coordinates.
+ */
+class KDTree {
+
+private:
+    const double *d_x;
+    const double *d_y;
+    unsigned int d_size;
+
+    std::vector<unsigned int> d_index;
+    std::vector<unsigned char> d_axis;
+
+    void build(unsigned int lo, unsigned int hi);
+
+    void search(unsigned int lo, unsigned int hi, double qx, double qy, unsigned int k,
+        std::vector<std::pair<double, unsigned int> > *heap) const;
+
+public:
+    KDTree(const double *x, const double *y, unsigned int size);
+
+    unsigned int size() const
+    {
+        return d_size;
+    }
+
+    void nearest(double qx, double qy, unsigned int k, std::vector<unsigned int> *ids,
+        std::vector<double> *distances) const;
+
+    unsigned long sizeInBytes() const
+    {
+        return d_index.capacity() * sizeof(unsigned int) + d_axis.capacity();
+    }
+};
+
+} // namespace ugrid
+
+#endif // _KDTree_h
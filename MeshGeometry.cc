@@ -0,0 +1,279 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <limits>
+
+#include "KDTree.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+#include "NodeFaces.h"
+#include "RegridWeights.h"
+#include "DecimatedMesh.h"
+#include "MeshGeometry.h"
+
+using namespace std;
+
+namespace ugrid {
+
+unsigned long MeshGeometry::d_maxProductBytes = UGRID_TOPOLOGY_CACHE_DEFAULT_MAX_PRODUCT_MEGABYTES * 1024UL * 1024UL;
+
+/**
+ * Build a new MeshGeometry. The contents of the passed vectors are swapped
+ * into the new instance (so they are empty when this returns); this avoids
+ * copying the coordinate and connectivity data of large meshes.
+ */
+MeshGeometry::MeshGeometry(vector<double> *nodeX, vector<double> *nodeY, vector<unsigned int> *faceNodes,
+    unsigned int nodesPerFace) :
+    d_nodeCount(nodeX->size()), d_faceCount(0), d_nodesPerFace(nodesPerFace), d_x(0), d_y(0), d_faces(0),
+    d_storage(0), d_minX(numeric_limits<double>::quiet_NaN()), d_minY(d_minX), d_maxX(d_minX), d_maxY(d_minX),
+    d_startIndex(0), d_facesFirst(true), d_nodeTree(0), d_faceLocator(0), d_faceAdjacency(0), d_nodeFaces(0),
+    d_productClock(0)
+{
+    d_nodeX.swap(*nodeX);
+    d_nodeY.swap(*nodeY);
+    d_faceNodes.swap(*faceNodes);
+
+    if (d_nodesPerFace > 0) d_faceCount = d_faceNodes.size() / d_nodesPerFace;
+
+    if (!d_nodeX.empty()) {
+        d_x = &d_nodeX[0];
+        d_y = &d_nodeY[0];
+    }
+    if (!d_faceNodes.empty()) d_faces = &d_faceNodes[0];
+
+    computeExtent();
+}
+
+/**
+ * Build a MeshGeometry over arrays it does not own. They must stay valid
+ * until storage, which this instance takes ownership of, is deleted.
+ */
+MeshGeometry::MeshGeometry(const double *nodeX, const double *nodeY, unsigned int nodeCount,
+    const unsigned int *faceNodes, unsigned int faceCount, unsigned int nodesPerFace, MeshGeometryStorage *storage) :
+    d_nodeCount(nodeCount), d_faceCount(faceCount), d_nodesPerFace(nodesPerFace), d_x(nodeX), d_y(nodeY),
+    d_faces(faceNodes), d_storage(storage), d_minX(numeric_limits<double>::quiet_NaN()), d_minY(d_minX),
+    d_maxX(d_minX), d_maxY(d_minX), d_startIndex(0), d_facesFirst(true), d_nodeTree(0), d_faceLocator(0),
+    d_faceAdjacency(0), d_nodeFaces(0), d_productClock(0)
+{
+    computeExtent();
+}
+
+void MeshGeometry::computeExtent()
+{
+    bool first = true;
+    for (unsigned int n = 0; n < d_nodeCount; ++n) {
+        double x = d_x[n], y = d_y[n];
+        if (x != x || y != y) continue;
+
+        if (first) {
+            d_minX = d_maxX = x;
+            d_minY = d_maxY = y;
+            first = false;
+        }
+        else {
+            if (x < d_minX) d_minX = x;
+            if (x > d_maxX) d_maxX = x;
+            if (y < d_minY) d_minY = y;
+            if (y > d_maxY) d_maxY = y;
+        }
+    }
+}
+
+MeshGeometry::~MeshGeometry()
+{
+    delete d_nodeTree;
+    delete d_faceLocator;
+    delete d_faceAdjacency;
+    delete d_nodeFaces;
+
+    for (map<string, ProductEntry>::iterator it = d_products.begin(); it != d_products.end(); ++it)
+        delete it->second.product;
+
+    // Last, since everything above may refer to the arrays it holds.
+    delete d_storage;
+}
+
+/**
+ * @return The k-d tree over the nodes of the mesh, building it the first
+ * time it is asked for.
+ */
+const KDTree *MeshGeometry::getNodeTree()
+{
+    if (!d_nodeTree) {
+        if (d_nodeCount == 0)
+            d_nodeTree = new KDTree(0, 0, 0);
+        else
+            d_nodeTree = new KDTree(d_x, d_y, d_nodeCount);
+    }
+
+    return d_nodeTree;
+}
+
+/**
+ * @return The locator used to find the face containing a point, building it
+ * the first time it is asked for.
+ */
+const FaceLocator *MeshGeometry::getFaceLocator()
+{
+    if (!d_faceLocator) d_faceLocator = new FaceLocator(this);
+
+    return d_faceLocator;
+}
+
+/**
+ * @return The neighbors of each face, building them the first time they are
+ * asked for.
+ */
+const FaceAdjacency *MeshGeometry::getFaceAdjacency()
+{
+    if (!d_faceAdjacency) d_faceAdjacency = new FaceAdjacency(this);
+
+    return d_faceAdjacency;
+}
+
+/**
+ * @return The faces of each node, building them the first time they are
+ * asked for.
+ */
+const NodeFaces *MeshGeometry::getNodeFaces()
+{
+    if (!d_nodeFaces) d_nodeFaces = new NodeFaces(this);
+
+    return d_nodeFaces;
+}
+
+/**
+ * @return The product stored under key, or null if there is none.
+ */
+MeshGeometryProduct *MeshGeometry::getProduct(const string &key)
+{
+    map<string, ProductEntry>::iterator it = d_products.find(key);
+    if (it == d_products.end()) return 0;
+
+    it->second.lastUsed = ++d_productClock;
+    return it->second.product;
+}
+
+/**
+ * Store a product under key; this instance takes ownership of it. The least
+ * recently used products are deleted until all of them, the new one included,
+ * fit in getMaxProductBytes(); the new product is kept even if it does not fit
+ * by itself. So a pointer returned by getProduct() is only valid until the
+ * next call to putProduct().
+ */
+void MeshGeometry::putProduct(const string &key, MeshGeometryProduct *product)
+{
+    map<string, ProductEntry>::iterator it = d_products.find(key);
+    if (it != d_products.end()) {
+        if (it->second.product == product) return;
+        delete it->second.product;
+        d_products.erase(it);
+    }
+
+    unsigned long size = product->sizeInBytes();
+    for (it = d_products.begin(); it != d_products.end(); ++it)
+        size += it->second.product->sizeInBytes();
+
+    while (!d_products.empty() && size > d_maxProductBytes) {
+        map<string, ProductEntry>::iterator lru = d_products.begin();
+        for (it = d_products.begin(); it != d_products.end(); ++it) {
+            if (it->second.lastUsed < lru->second.lastUsed) lru = it;
+        }
+        size -= lru->second.product->sizeInBytes();
+        delete lru->second.product;
+        d_products.erase(lru);
+    }
+
+    ProductEntry entry;
+    entry.product = product;
+    entry.lastUsed = ++d_productClock;
+    d_products[key] = entry;
+}
+
+/**
+ * @return The weights that regrid this mesh to the grid with points (minX + i * dx,
+ * minY + j * dy), i < nx, j < ny. They are built the first time they are asked
+ * for and kept as one of this geometry's products.
+ */
+const RegridWeights *MeshGeometry::getRegridWeights(double minX, double minY, double dx, double dy, unsigned int nx,
+    unsigned int ny)
+{
+    string key = "regrid " + RegridWeights::makeKey(minX, minY, dx, dy, nx, ny);
+
+    RegridWeights *weights = dynamic_cast<RegridWeights *>(getProduct(key));
+    if (!weights) {
+        weights = new RegridWeights(this, minX, minY, dx, dy, nx, ny);
+        putProduct(key, weights);
+    }
+
+    return weights;
+}
+
+/**
+ * @return This mesh coarsened to about faceBudget faces, built the first time
+ * it is asked for and kept as one of this geometry's products.
+ */
+const DecimatedMesh *MeshGeometry::getDecimatedMesh(unsigned int faceBudget)
+{
+    ostringstream key;
+    key << "decimate " << faceBudget;
+
+    DecimatedMesh *mesh = dynamic_cast<DecimatedMesh *>(getProduct(key.str()));
+    if (!mesh) {
+        mesh = new DecimatedMesh(this, faceBudget);
+        putProduct(key.str(), mesh);
+    }
+
+    return mesh;
+}
+
+/**
+ * @return The approximate amount of memory held by this instance, including
+ * any indexes that have been built.
+ */
+unsigned long MeshGeometry::sizeInBytes() const
+{
+    unsigned long size = sizeof(MeshGeometry);
+    size += (d_storage ? 2 * (unsigned long) d_nodeCount : d_nodeX.capacity() + d_nodeY.capacity()) * sizeof(double);
+    size += (d_storage ? (unsigned long) d_faceCount * d_nodesPerFace : d_faceNodes.capacity()) * sizeof(unsigned int);
+
+    if (d_nodeTree) size += d_nodeTree->sizeInBytes();
+    if (d_faceLocator) size += d_faceLocator->sizeInBytes();
+    if (d_faceAdjacency) size += d_faceAdjacency->sizeInBytes();
+    if (d_nodeFaces) size += d_nodeFaces->sizeInBytes();
+
+    for (map<string, ProductEntry>::const_iterator it = d_products.begin(); it != d_products.end(); ++it)
+        size += it->second.product->sizeInBytes();
+
+    return size;
+}
+
+} // namespace ugrid
@@ -0,0 +1,282 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _MeshGeometry_h
+#define _MeshGeometry_h 1
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace ugrid {
+
+class KDTree;
+class FaceLocator;
+class FaceAdjacency;
+class NodeFaces;
+class RegridWeights;
+class DecimatedMesh;
+
+// The memory, in megabytes, that the products (see MeshGeometryProduct) of
+// each MeshGeometry may use.
+#define UGRID_TOPOLOGY_CACHE_MAX_PRODUCT_MEGABYTES_KEY "UgridFunctions.TopologyCache.MaxProductMegabytes"
+#define UGRID_TOPOLOGY_CACHE_DEFAULT_MAX_PRODUCT_MEGABYTES 128
+
+/**
+ * Something computed from a MeshGeometry for one kind of request, such as the
+ * weights that regrid the mesh to one target grid. The geometry keeps the most
+ * recently used products, by key, so that repeated requests can reuse them,
+ * for as long as their sizeInBytes() fit the geometry's product budget.
+ */
+class MeshGeometryProduct {
+public:
+    virtual ~MeshGeometryProduct()
+    {
+    }
+
+    virtual unsigned long sizeInBytes() const = 0;
+};
+
+/**
+ * Holds the arrays of a MeshGeometry that was made over storage it does not
+ * own (e.g., a shared memory mapping); the geometry deletes it last.
+ */
+class MeshGeometryStorage {
+public:
+    virtual ~MeshGeometryStorage()
+    {
+    }
+};
+
+/**
+ * The geometric content of a two dimensional mesh: the node coordinates and
+ * the face node connectivity, held as plain arrays with no reference to the
+ * DAP variables they were read from. Because of that a MeshGeometry can
+ * outlive the request (and the DDS) that built it and be kept in the
+ * MeshGeometryCache, where the spatial indexes that are built on demand
+ * from it (e.g., the node k-d tree, the face locator and the face adjacency)
+ * are reused by subsequent requests. The same goes for the products computed
+ * from the geometry for particular requests (e.g., regridding weights), of which
+ * the most recently used are kept.
+ *
+ * The face node connectivity is stored face by face (nFaces x nodesPerFace)
+ * using zero-based node indices, regardless of the organization and
+ * start_index of the source array. For flexible meshes the unused corners
+ * of a face hold a value greater than or equal to nodeCount().
+ *
+ * The arrays are either owned by the geometry or, for a geometry attached
+ * to a SharedMeshStore, read-only views of memory held by a
+ * MeshGeometryStorage.
+ */
+class MeshGeometry {
+
+private:
+    unsigned int d_nodeCount;
+    unsigned int d_faceCount;
+    unsigned int d_nodesPerFace;
+
+    std::vector<double> d_nodeX;
+    std::vector<double> d_nodeY;
+    std::vector<unsigned int> d_faceNodes;
+
+    // The arrays in use: those above or those of d_storage.
+    const double *d_x;
+    const double *d_y;
+    const unsigned int *d_faces;
+    MeshGeometryStorage *d_storage;
+
+    double d_minX, d_minY, d_maxX, d_maxY;
+
+    int d_startIndex;
+    bool d_facesFirst;
+
+    KDTree *d_nodeTree;
+    FaceLocator *d_faceLocator;
+    FaceAdjacency *d_faceAdjacency;
+    NodeFaces *d_nodeFaces;
+
+    struct ProductEntry {
+        MeshGeometryProduct *product;
+        unsigned long lastUsed;
+    };
+    std::map<std::string, ProductEntry> d_products;
+    unsigned long d_productClock;
+
+    static unsigned long d_maxProductBytes;
+
+    void computeExtent();
+
+    MeshGeometry(const MeshGeometry &);
+    MeshGeometry &operator=(const MeshGeometry &);
+
+public:
+    MeshGeometry(std::vector<double> *nodeX, std::vector<double> *nodeY, std::vector<unsigned int> *faceNodes,
+        unsigned int nodesPerFace);
+    MeshGeometry(const double *nodeX, const double *nodeY, unsigned int nodeCount, const unsigned int *faceNodes,
+        unsigned int faceCount, unsigned int nodesPerFace, MeshGeometryStorage *storage);
+    ~MeshGeometry();
+
+    unsigned int nodeCount() const
+    {
+        return d_nodeCount;
+    }
+
+    unsigned int faceCount() const
+    {
+        return d_faceCount;
+    }
+
+    unsigned int nodesPerFace() const
+    {
+        return d_nodesPerFace;
+    }
+
+    double nodeX(unsigned int node) const
+    {
+        return d_x[node];
+    }
+
+    double nodeY(unsigned int node) const
+    {
+        return d_y[node];
+    }
+
+    /**
+     * @return The node coordinate and face node connectivity arrays, e.g., to
+     * copy them to a SharedMeshStore.
+     */
+    const double *nodeXArray() const
+    {
+        return d_x;
+    }
+
+    const double *nodeYArray() const
+    {
+        return d_y;
+    }
+
+    const unsigned int *faceNodeArray() const
+    {
+        return d_faces;
+    }
+
+    /**
+     * @return True if the arrays are held by a MeshGeometryStorage, e.g.,
+     * memory shared with other processes.
+     */
+    bool isShared() const
+    {
+        return d_storage != 0;
+    }
+
+    /**
+     * The extent of the node coordinates; NaN coordinates are skipped and
+     * the extent is all NaN if no node has coordinates.
+     */
+    double minX() const
+    {
+        return d_minX;
+    }
+
+    double minY() const
+    {
+        return d_minY;
+    }
+
+    double maxX() const
+    {
+        return d_maxX;
+    }
+
+    double maxY() const
+    {
+        return d_maxY;
+    }
+
+    /**
+     * The start_index and organization (face by face, or corner by corner)
+     * of the face node connectivity array this geometry was read from. They
+     * describe the source only; faceNode() is always zero-based.
+     */
+    void setSourceLayout(int startIndex, bool facesFirst)
+    {
+        d_startIndex = startIndex;
+        d_facesFirst = facesFirst;
+    }
+
+    int startIndex() const
+    {
+        return d_startIndex;
+    }
+
+    bool facesFirst() const
+    {
+        return d_facesFirst;
+    }
+
+    /**
+     * @return The zero-based index of the corner'th node of the face, or a
+     * value >= nodeCount() if the face does not have that many corners.
+     */
+    unsigned int faceNode(unsigned int face, unsigned int corner) const
+    {
+        return d_faces[face * d_nodesPerFace + corner];
+    }
+
+    const KDTree *getNodeTree();
+    const FaceLocator *getFaceLocator();
+    const FaceAdjacency *getFaceAdjacency();
+    const NodeFaces *getNodeFaces();
+    MeshGeometryProduct *getProduct(const std::string &key);
+    void putProduct(const std::string &key, MeshGeometryProduct *product);
+
+    unsigned int productCount() const
+    {
+        return d_products.size();
+    }
+
+    /**
+     * The memory, in bytes, that the products of each geometry may use.
+     */
+    static unsigned long getMaxProductBytes()
+    {
+        return d_maxProductBytes;
+    }
+
+    static void setMaxProductBytes(unsigned long maxBytes)
+    {
+        d_maxProductBytes = maxBytes;
+    }
+
+    const RegridWeights *getRegridWeights(double minX, double minY, double dx, double dy, unsigned int nx,
+        unsigned int ny);
+    const DecimatedMesh *getDecimatedMesh(unsigned int faceBudget);
+
+    unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _MeshGeometry_h
@@ -0,0 +1,280 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <sstream>
+#include <map>
+
+#include "BESDebug.h"
+#include "BESIndent.h"
+
+#include "MeshGeometry.h"
+#include "RestrictionResult.h"
+#include "MeshGeometryCache.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+MeshGeometryCache *MeshGeometryCache::d_instance = 0;
+
+MeshGeometryCache::MeshGeometryCache() :
+    d_maxEntries(UGRID_TOPOLOGY_CACHE_DEFAULT_MAX_ENTRIES), d_clock(0), d_hits(0), d_misses(0)
+{
+}
+
+MeshGeometryCache::~MeshGeometryCache()
+{
+    clear();
+}
+
+MeshGeometryCache *MeshGeometryCache::TheCache()
+{
+    if (!d_instance) d_instance = new MeshGeometryCache();
+
+    return d_instance;
+}
+
+void MeshGeometryCache::delete_instance()
+{
+    delete d_instance;
+    d_instance = 0;
+}
+
+string MeshGeometryCache::makeKey(const string &datasetName, const string &meshName)
+{
+    return datasetName + "#" + meshName;
+}
+
+/**
+ * @return The key of the result of restricting a mesh at location (node, edge
+ * or face) with the filter expression; used here and by the SharedMeshStore.
+ */
+string MeshGeometryCache::makeRestrictionKey(const string &datasetName, const string &meshName, unsigned int location,
+    const string &filterExpression)
+{
+    return makeKey(datasetName, meshName) + "#" + RestrictionResult::makeKey(location, filterExpression);
+}
+
+/**
+ * @return A string that changes when the dataset file is rewritten (its
+ * modification time and size) or the empty string if the dataset is not a
+ * file we can stat(). Meshes from datasets without a stamp are not cached.
+ */
+string MeshGeometryCache::makeStamp(const string &datasetName)
+{
+    struct stat buf;
+    if (datasetName.empty() || stat(datasetName.c_str(), &buf) != 0) return "";
+
+    ostringstream oss;
+    oss << buf.st_mtime << ":" << buf.st_size;
+    return oss.str();
+}
+
+/**
+ * @return The cached geometry for key, or null if there is none or if the
+ * cached entry was built from a different version of the dataset.
+ */
+MeshGeometry *MeshGeometryCache::get(const string &key, const string &stamp)
+{
+    map<string, CacheEntry>::iterator it = d_entries.find(key);
+    if (it == d_entries.end()) {
+        ++d_misses;
+        BESDEBUG("ugrid", "MeshGeometryCache::get() - Miss for '" << key << "'" << endl);
+        return 0;
+    }
+
+    if (it->second.stamp != stamp) {
+        ++d_misses;
+        BESDEBUG("ugrid", "MeshGeometryCache::get() - Stale entry for '" << key << "', removing it." << endl);
+        remove(it);
+        return 0;
+    }
+
+    ++d_hits;
+    it->second.lastUsed = ++d_clock;
+    BESDEBUG("ugrid", "MeshGeometryCache::get() - Hit for '" << key << "'" << endl);
+
+    return it->second.geometry;
+}
+
+/**
+ * Add a geometry to the cache. The cache takes ownership of the geometry. If
+ * the cache is full, the least recently used entry is deleted first.
+ */
+void MeshGeometryCache::put(const string &key, const string &stamp, MeshGeometry *geometry)
+{
+    map<string, CacheEntry>::iterator it = d_entries.find(key);
+    if (it != d_entries.end()) {
+        if (it->second.geometry == geometry) return;
+        remove(it);
+    }
+
+    while (!d_entries.empty() && d_entries.size() >= d_maxEntries)
+        evict();
+
+    CacheEntry entry;
+    entry.geometry = geometry;
+    entry.stamp = stamp;
+    entry.lastUsed = ++d_clock;
+    d_entries[key] = entry;
+
+    BESDEBUG("ugrid",
+        "MeshGeometryCache::put() - Cached '" << key << "' (" << geometry->sizeInBytes() << " bytes)" << endl);
+}
+
+/**
+ * @return The cached result of a restriction for key (see
+ * RestrictionResult::makeKey(), which is appended to the mesh's key), or null
+ * if there is none or if it was made from a different version of the dataset.
+ */
+RestrictionResult *MeshGeometryCache::getRestriction(const string &key, const string &stamp)
+{
+    map<string, RestrictionEntry>::iterator it = d_restrictions.find(key);
+    if (it == d_restrictions.end()) return 0;
+
+    if (it->second.stamp != stamp) {
+        BESDEBUG("ugrid", "MeshGeometryCache::getRestriction() - Stale entry for '" << key << "', removing it." << endl);
+        remove(it);
+        return 0;
+    }
+
+    it->second.lastUsed = ++d_clock;
+    BESDEBUG("ugrid", "MeshGeometryCache::getRestriction() - Hit for '" << key << "'" << endl);
+
+    return it->second.result;
+}
+
+/**
+ * Add the result of a restriction to the cache, which takes ownership of it.
+ * The least recently used results are deleted until all of them, the new one
+ * included, fit in MeshGeometry::getMaxProductBytes(); the new result is kept
+ * even if it does not fit by itself. Like a geometry, a result returned by
+ * getRestriction() is valid until the next call to putRestriction().
+ *
+ * The results make their gather plans when those are first used, so their
+ * sizes are taken anew each time.
+ */
+void MeshGeometryCache::putRestriction(const string &key, const string &stamp, RestrictionResult *result)
+{
+    map<string, RestrictionEntry>::iterator it = d_restrictions.find(key);
+    if (it != d_restrictions.end()) {
+        if (it->second.result == result) return;
+        remove(it);
+    }
+
+    unsigned long size = result->sizeInBytes();
+    for (it = d_restrictions.begin(); it != d_restrictions.end(); ++it)
+        size += it->second.result->sizeInBytes();
+
+    while (!d_restrictions.empty() && size > MeshGeometry::getMaxProductBytes()) {
+        map<string, RestrictionEntry>::iterator lru = d_restrictions.begin();
+        for (it = d_restrictions.begin(); it != d_restrictions.end(); ++it) {
+            if (it->second.lastUsed < lru->second.lastUsed) lru = it;
+        }
+        size -= lru->second.result->sizeInBytes();
+        remove(lru);
+    }
+
+    RestrictionEntry entry;
+    entry.result = result;
+    entry.stamp = stamp;
+    entry.lastUsed = ++d_clock;
+    d_restrictions[key] = entry;
+
+    BESDEBUG("ugrid",
+        "MeshGeometryCache::putRestriction() - Cached '" << key << "' (" << result->sizeInBytes() << " bytes)" << endl);
+}
+
+void MeshGeometryCache::remove(map<string, CacheEntry>::iterator it)
+{
+    delete it->second.geometry;
+    d_entries.erase(it);
+}
+
+void MeshGeometryCache::remove(map<string, RestrictionEntry>::iterator it)
+{
+    delete it->second.result;
+    d_restrictions.erase(it);
+}
+
+/**
+ * Delete the least recently used entry.
+ */
+void MeshGeometryCache::evict()
+{
+    map<string, CacheEntry>::iterator lru = d_entries.begin();
+    for (map<string, CacheEntry>::iterator it = d_entries.begin(); it != d_entries.end(); ++it) {
+        if (it->second.lastUsed < lru->second.lastUsed) lru = it;
+    }
+
+    BESDEBUG("ugrid", "MeshGeometryCache::evict() - Evicting '" << lru->first << "'" << endl);
+    remove(lru);
+}
+
+void MeshGeometryCache::setMaxEntries(unsigned int maxEntries)
+{
+    d_maxEntries = (maxEntries > 0) ? maxEntries : 1;
+
+    while (d_entries.size() > d_maxEntries)
+        evict();
+}
+
+void MeshGeometryCache::clear()
+{
+    while (!d_entries.empty())
+        remove(d_entries.begin());
+    while (!d_restrictions.empty())
+        remove(d_restrictions.begin());
+}
+
+void MeshGeometryCache::dump(ostream &strm) const
+{
+    strm << BESIndent::LMarg << "MeshGeometryCache::dump - (" << (void *) this << ")" << endl;
+    BESIndent::Indent();
+    strm << BESIndent::LMarg << "max entries: " << d_maxEntries << endl;
+    strm << BESIndent::LMarg << "max product bytes: " << MeshGeometry::getMaxProductBytes() << endl;
+    strm << BESIndent::LMarg << "hits: " << d_hits << "  misses: " << d_misses << endl;
+    for (map<string, CacheEntry>::const_iterator it = d_entries.begin(); it != d_entries.end(); ++it) {
+        strm << BESIndent::LMarg << it->first << " [" << it->second.stamp << "] " << it->second.geometry->sizeInBytes()
+            << " bytes" << endl;
+    }
+    for (map<string, RestrictionEntry>::const_iterator it = d_restrictions.begin(); it != d_restrictions.end(); ++it) {
+        strm << BESIndent::LMarg << it->first << " [" << it->second.stamp << "] " << it->second.result->sizeInBytes()
+            << " bytes" << endl;
+    }
+    BESIndent::UnIndent();
+}
+
+} // namespace ugrid
@@ -0,0 +1,119 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _MeshGeometryCache_h
+#define _MeshGeometryCache_h 1
+
+#include <string>
+#include <map>
+#include <ostream>
+
+namespace ugrid {
+
+class MeshGeometry;
+class RestrictionResult;
+
+#define UGRID_TOPOLOGY_CACHE_MAX_ENTRIES_KEY "UgridFunctions.TopologyCache.MaxEntries"
+#define UGRID_TOPOLOGY_CACHE_DEFAULT_MAX_ENTRIES 8
+
+/**
+ * A per-process, least recently used cache of MeshGeometry instances. Entries
+ * are keyed by the dataset and mesh topology variable names and carry a
+ * 'stamp' made from the modification time and size of the dataset file;
+ * an entry whose stamp does not match the dataset's current stamp is
+ * discarded, so a rewritten file never yields a stale mesh.
+ *
+ * The cache owns the geometries it holds. A pointer returned by get() (or
+ * passed to put()) remains valid until the next call to put() or clear(),
+ * which is the only time entries are evicted. The server functions look up
+ * each mesh once, use it, and move on, so that is long enough.
+ *
+ * The results of restricting meshes (see RestrictionResult) are kept the
+ * same way, apart from the geometries so that a request that only needs a
+ * subset does not have to build its mesh's geometry. They are keyed by mesh,
+ * location and filter expression, and are held for as long as they fit in
+ * one mesh's product budget (see MeshGeometry::getMaxProductBytes()).
+ */
+class MeshGeometryCache {
+
+private:
+    struct CacheEntry {
+        MeshGeometry *geometry;
+        std::string stamp;
+        unsigned long lastUsed;
+    };
+
+    struct RestrictionEntry {
+        RestrictionResult *result;
+        std::string stamp;
+        unsigned long lastUsed;
+    };
+
+    std::map<std::string, CacheEntry> d_entries;
+    std::map<std::string, RestrictionEntry> d_restrictions;
+    unsigned int d_maxEntries;
+    unsigned long d_clock;
+
+    unsigned long d_hits;
+    unsigned long d_misses;
+
+    static MeshGeometryCache *d_instance;
+
+    MeshGeometryCache();
+    ~MeshGeometryCache();
+
+    void remove(std::map<std::string, CacheEntry>::iterator it);
+    void remove(std::map<std::string, RestrictionEntry>::iterator it);
+    void evict();
+
+public:
+    static MeshGeometryCache *TheCache();
+    static void delete_instance();
+
+    static std::string makeKey(const std::string &datasetName, const std::string &meshName);
+    static std::string makeRestrictionKey(const std::string &datasetName, const std::string &meshName,
+        unsigned int location, const std::string &filterExpression);
+    static std::string makeStamp(const std::string &datasetName);
+
+    MeshGeometry *get(const std::string &key, const std::string &stamp);
+    void put(const std::string &key, const std::string &stamp, MeshGeometry *geometry);
+
+    RestrictionResult *getRestriction(const std::string &key, const std::string &stamp);
+    void putRestriction(const std::string &key, const std::string &stamp, RestrictionResult *result);
+
+    void setMaxEntries(unsigned int maxEntries);
+    unsigned int getMaxEntries() const
+    {
+        return d_maxEntries;
+    }
+
+    void clear();
+
+    void dump(std::ostream &strm) const;
+};
+
+} // namespace ugrid
+
+#endif // _MeshGeometryCache_h
@@ -0,0 +1,346 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include "BESDebug.h"
+#include "BESIndent.h"
+
+#include "ModuleExecutor.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+ModuleExecutor *ModuleExecutor::d_instance = 0;
+
+ModuleExecutor::ModuleExecutor() :
+    d_threadCount(UGRID_EXECUTOR_DEFAULT_THREADS), d_queueDepth(UGRID_EXECUTOR_DEFAULT_QUEUE_DEPTH),
+        d_requestConcurrency(UGRID_EXECUTOR_DEFAULT_REQUEST_CONCURRENCY), d_pid(0), d_active(0), d_stopping(false),
+        d_startedAt(0), d_submitted(0), d_rejected(0), d_cancelled(0), d_completed(0), d_queueWait(0),
+        d_maxQueueWait(0), d_busy(0)
+{
+    pthread_mutex_init(&d_mutex, 0);
+    pthread_cond_init(&d_jobQueued, 0);
+}
+
+ModuleExecutor::~ModuleExecutor()
+{
+    checkProcess();
+    stop();
+
+    pthread_cond_destroy(&d_jobQueued);
+    pthread_mutex_destroy(&d_mutex);
+}
+
+ModuleExecutor *ModuleExecutor::TheExecutor()
+{
+    if (!d_instance) d_instance = new ModuleExecutor();
+
+    return d_instance;
+}
+
+void ModuleExecutor::delete_instance()
+{
+    delete d_instance;
+    d_instance = 0;
+}
+
+unsigned long long ModuleExecutor::now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * If the threads were started by another process (this is a forked child
+ * of it), forget them.
+ */
+void ModuleExecutor::checkProcess()
+{
+    if (d_pid != 0 && d_pid != getpid()) forget();
+}
+
+/**
+ * Drop the threads and queued jobs of the parent process. Only the thread
+ * that called fork() is in the child, so the mutex may have been copied in
+ * a locked state and is made anew.
+ */
+void ModuleExecutor::forget()
+{
+    BESDEBUG("ugrid", "ModuleExecutor::forget() - Dropping the threads of process " << d_pid << endl);
+
+    pthread_mutex_init(&d_mutex, 0);
+    pthread_cond_init(&d_jobQueued, 0);
+
+    d_pid = 0;
+    d_threads.clear();
+    d_queue.clear();
+    d_active = 0;
+    d_stopping = false;
+
+    d_startedAt = 0;
+    d_submitted = d_rejected = d_cancelled = d_completed = 0;
+    d_queueWait = d_maxQueueWait = d_busy = 0;
+}
+
+/**
+ * Start the threads; called with the mutex held. They block all signals so
+ * that those meant for the BES are handled by the request's thread.
+ */
+void ModuleExecutor::start()
+{
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+
+    for (unsigned int i = 0; i < d_threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, runWorker, this) == 0) d_threads.push_back(thread);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, 0);
+
+    d_pid = getpid();
+    d_startedAt = now();
+
+    BESDEBUG("ugrid", "ModuleExecutor::start() - Started " << d_threads.size() << " threads in process " << d_pid << endl);
+}
+
+/**
+ * Run the jobs still queued, then stop the threads and wait for them.
+ */
+void ModuleExecutor::stop()
+{
+    if (d_threads.empty()) return;
+
+    pthread_mutex_lock(&d_mutex);
+    d_stopping = true;
+    pthread_cond_broadcast(&d_jobQueued);
+    pthread_mutex_unlock(&d_mutex);
+
+    for (vector<pthread_t>::iterator it = d_threads.begin(); it != d_threads.end(); ++it)
+        pthread_join(*it, 0);
+
+    d_threads.clear();
+    d_stopping = false;
+}
+
+void *ModuleExecutor::runWorker(void *arg)
+{
+    static_cast<ModuleExecutor *>(arg)->work();
+
+    return 0;
+}
+
+void ModuleExecutor::work()
+{
+    pthread_mutex_lock(&d_mutex);
+    while (true) {
+        while (d_queue.empty() && !d_stopping)
+            pthread_cond_wait(&d_jobQueued, &d_mutex);
+
+        if (d_queue.empty()) break;
+
+        QueuedJob queued = d_queue.front();
+        d_queue.pop_front();
+
+        unsigned long long started = now();
+        unsigned long long wait = started - queued.queuedAt;
+        d_queueWait += wait;
+        if (wait > d_maxQueueWait) d_maxQueueWait = wait;
+        ++d_active;
+        pthread_mutex_unlock(&d_mutex);
+
+        // Jobs report their own errors; one that escapes must not end the thread.
+        try {
+            queued.job->run();
+        }
+        catch (...) {
+        }
+
+        unsigned long long busy = now() - started;
+
+        pthread_mutex_lock(&d_mutex);
+        d_busy += busy;
+        --d_active;
+        ++d_completed;
+    }
+    pthread_mutex_unlock(&d_mutex);
+}
+
+/**
+ * Set the number of threads, the most jobs that can be queued and the most
+ * threads (including its own) one request uses. Threads already running
+ * are stopped; the new ones are started by the next submit().
+ */
+void ModuleExecutor::configure(unsigned int threads, unsigned int queueDepth, unsigned int requestConcurrency)
+{
+    checkProcess();
+    stop();
+
+    d_threadCount = threads;
+    d_queueDepth = (queueDepth > 0) ? queueDepth : 1;
+    d_requestConcurrency = (requestConcurrency > 0) ? requestConcurrency : 1;
+}
+
+/**
+ * @return The number of threads one request should use, counting its own:
+ * one if the executor has no threads.
+ */
+unsigned int ModuleExecutor::concurrency() const
+{
+    if (d_threadCount == 0) return 1;
+
+    return (d_requestConcurrency < d_threadCount + 1) ? d_requestConcurrency : d_threadCount + 1;
+}
+
+/**
+ * Queue the job if there is room; called with the mutex held.
+ */
+bool ModuleExecutor::enqueue(Job *job)
+{
+    if (d_queue.size() >= d_queueDepth || d_threads.empty()) {
+        ++d_rejected;
+        return false;
+    }
+
+    QueuedJob entry;
+    entry.job = job;
+    entry.queuedAt = now();
+    d_queue.push_back(entry);
+    ++d_submitted;
+    pthread_cond_signal(&d_jobQueued);
+
+    return true;
+}
+
+/**
+ * Queue a job to be run by one of the threads.
+ *
+ * @return False if the executor has no threads or its queue is full; the
+ * job will not be run.
+ */
+bool ModuleExecutor::submit(Job *job)
+{
+    checkProcess();
+    if (d_threadCount == 0) return false;
+
+    pthread_mutex_lock(&d_mutex);
+    if (d_threads.empty()) start();
+    bool queued = enqueue(job);
+    pthread_mutex_unlock(&d_mutex);
+
+    return queued;
+}
+
+/**
+ * Like submit(), but only take the job if a thread is free to start it now,
+ * for jobs that others will wait on (e.g., the reader of a SlabPipeline).
+ */
+bool ModuleExecutor::runNow(Job *job)
+{
+    checkProcess();
+    if (d_threadCount == 0) return false;
+
+    pthread_mutex_lock(&d_mutex);
+    if (d_threads.empty()) start();
+    bool queued = d_active + d_queue.size() < d_threads.size() && enqueue(job);
+    pthread_mutex_unlock(&d_mutex);
+
+    return queued;
+}
+
+/**
+ * Remove a job that has not been started from the queue.
+ *
+ * @return True if the job was removed; false if it has been, or is being, run.
+ */
+bool ModuleExecutor::cancel(Job *job)
+{
+    checkProcess();
+
+    pthread_mutex_lock(&d_mutex);
+    bool found = false;
+    for (deque<QueuedJob>::iterator it = d_queue.begin(); it != d_queue.end(); ++it) {
+        if (it->job == job) {
+            d_queue.erase(it);
+            ++d_cancelled;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d_mutex);
+
+    return found;
+}
+
+void ModuleExecutor::dump(ostream &strm) const
+{
+    // The mutex of a parent process may have been copied locked.
+    bool ours = d_pid == getpid();
+    if (ours) pthread_mutex_lock(&d_mutex);
+
+    strm << BESIndent::LMarg << "ModuleExecutor::dump - (" << (void *) this << ")" << endl;
+    BESIndent::Indent();
+    strm << BESIndent::LMarg << "threads: " << d_threadCount << "  queue depth: " << d_queueDepth
+        << "  request concurrency: " << d_requestConcurrency << endl;
+    if (ours) {
+        unsigned long long elapsed = now() - d_startedAt;
+        double utilization = (elapsed > 0 && !d_threads.empty()) ? 100.0 * d_busy / (elapsed * d_threads.size()) : 0;
+        unsigned long started = d_submitted - d_cancelled - d_queue.size();
+
+        strm << BESIndent::LMarg << "running: " << d_threads.size() << " threads in process " << d_pid << ", "
+            << d_active << " busy, " << d_queue.size() << " queued" << endl;
+        strm << BESIndent::LMarg << "jobs submitted: " << d_submitted << "  completed: " << d_completed
+            << "  rejected: " << d_rejected << "  cancelled: " << d_cancelled << endl;
+        strm << BESIndent::LMarg << "queue wait: mean " << (started > 0 ? d_queueWait / started : 0) << "us  max "
+            << d_maxQueueWait << "us" << endl;
+        strm << BESIndent::LMarg << "utilization: " << utilization << "%" << endl;
+    }
+    else {
+        strm << BESIndent::LMarg << "running: no threads in this process" << endl;
+    }
+    BESIndent::UnIndent();
+
+    if (ours) pthread_mutex_unlock(&d_mutex);
+}
+
+} // namespace ugrid
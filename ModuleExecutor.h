@@ -0,0 +1,149 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _ModuleExecutor_h
+#define _ModuleExecutor_h 1
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include <deque>
+#include <ostream>
+#include <vector>
+
+namespace ugrid {
+
+#define UGRID_EXECUTOR_THREADS_KEY "UgridFunctions.Executor.Threads"
+#define UGRID_EXECUTOR_QUEUE_DEPTH_KEY "UgridFunctions.Executor.QueueDepth"
+#define UGRID_EXECUTOR_REQUEST_CONCURRENCY_KEY "UgridFunctions.Executor.RequestConcurrency"
+#define UGRID_EXECUTOR_DEFAULT_THREADS 0
+#define UGRID_EXECUTOR_DEFAULT_QUEUE_DEPTH 64
+#define UGRID_EXECUTOR_DEFAULT_REQUEST_CONCURRENCY 4
+
+/**
+ * The module's threads for running work in parallel (see WorkStealingPool and
+ * SlabPipeline). The executor is configured when the module is initialized,
+ * but its threads are only started when the first job is submitted, and they
+ * belong to the process that started them: the BES loads the module and then
+ * forks a beslistener for each connection, and the threads of a parent are
+ * not in its child. The executor notes the process it started its threads in
+ * and, when used in another (a forked child), forgets the parent's threads
+ * and jobs and starts its own.
+ *
+ * A job is run at most once. The executor does not own jobs; whoever
+ * submits one must keep it until it has run or has been cancelled.
+ */
+class ModuleExecutor {
+
+public:
+    class Job {
+    public:
+        virtual ~Job()
+        {
+        }
+
+        virtual void run() = 0;
+    };
+
+private:
+    struct QueuedJob {
+        Job *job;
+        unsigned long long queuedAt;
+    };
+
+    unsigned int d_threadCount;
+    unsigned int d_queueDepth;
+    unsigned int d_requestConcurrency;
+
+    pid_t d_pid;
+    std::vector<pthread_t> d_threads;
+    std::deque<QueuedJob> d_queue;
+    unsigned int d_active;
+    bool d_stopping;
+
+    mutable pthread_mutex_t d_mutex;
+    pthread_cond_t d_jobQueued;
+
+    // Times are in microseconds.
+    unsigned long long d_startedAt;
+    unsigned long d_submitted;
+    unsigned long d_rejected;
+    unsigned long d_cancelled;
+    unsigned long d_completed;
+    unsigned long long d_queueWait;
+    unsigned long long d_maxQueueWait;
+    unsigned long long d_busy;
+
+    static ModuleExecutor *d_instance;
+
+    ModuleExecutor();
+    ~ModuleExecutor();
+
+    void checkProcess();
+    void forget();
+    void start();
+    void stop();
+    bool enqueue(Job *job);
+    void work();
+
+    static void *runWorker(void *arg);
+    static unsigned long long now();
+
+    ModuleExecutor(const ModuleExecutor &);
+    ModuleExecutor &operator=(const ModuleExecutor &);
+
+public:
+    static ModuleExecutor *TheExecutor();
+    static void delete_instance();
+
+    void configure(unsigned int threads, unsigned int queueDepth, unsigned int requestConcurrency);
+
+    unsigned int getThreads() const
+    {
+        return d_threadCount;
+    }
+
+    unsigned int getQueueDepth() const
+    {
+        return d_queueDepth;
+    }
+
+    unsigned int getRequestConcurrency() const
+    {
+        return d_requestConcurrency;
+    }
+
+    unsigned int concurrency() const;
+
+    bool submit(Job *job);
+    bool runNow(Job *job);
+    bool cancel(Job *job);
+
+    void dump(std::ostream &strm) const;
+};
+
+} // namespace ugrid
+
+#endif // _ModuleExecutor_h
@@ -24,6 +24,9 @@
 
 #include "config.h"
 
+#include <sys/mman.h>
+
+#include <climits>
 #include <sstream>      // std::stringstream
 #include <string.h>
 
@@ -47,6 +50,17 @@
 
 namespace libdap {
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+// Results of 64MB or more are mapped rather than allocated from the heap.
+unsigned long NDimensionalArray::_mapThreshold = 64UL * 1024 * 1024;
+
 string NDimensionalArray::vectorToIndices(vector<unsigned int> *v)
 {
     stringstream s;
@@ -68,7 +82,7 @@ NDimensionalArray::NDimensionalArray()
 
 NDimensionalArray::NDimensionalArray(libdap::Array *a) :
     _dapType(dods_null_c), _shape(0), _currentLastDimensionSlabIndex(0), _totalValueCount(0), _sizeOfValue(0), _storage(
-        0)
+        0), _storageBytes(0), _storageMapped(false), _rank(0), _slabBytes(0)
 {
     BESDEBUG(NDimensionalArray_debug_key, "NDimensionalArray::NDimensionalArray(libdap::Array *) - BEGIN"<< endl);
 
@@ -81,12 +95,13 @@ NDimensionalArray::NDimensionalArray(libdap::Array *a) :
         "NDimensionalArray::NDimensionalArray() - Total Value Count: " << _totalValueCount << " element(s) of type '"<< libdap::type_name(_dapType) << "'" << endl);
 
     allocateStorage(_totalValueCount, _dapType);
+    computeStrides();
     BESDEBUG(NDimensionalArray_debug_key, "NDimensionalArray::NDimensionalArray(libdap::Array *) - END"<< endl);
 }
 
 NDimensionalArray::NDimensionalArray(std::vector<unsigned int> *shape, libdap::Type dapType) :
     _dapType(dods_null_c), _shape(0), _currentLastDimensionSlabIndex(0), _totalValueCount(0), _sizeOfValue(0), _storage(
-        0)
+        0), _storageBytes(0), _storageMapped(false), _rank(0), _slabBytes(0)
 {
     BESDEBUG(NDimensionalArray_debug_key,
         "NDimensionalArray::NDimensionalArray(std::vector<unsigned int> *, libdap::Type) - BEGIN"<< endl);
@@ -99,6 +114,7 @@ NDimensionalArray::NDimensionalArray(std::vector<unsigned int> *shape, libdap::T
     BESDEBUG(NDimensionalArray_debug_key,
         "NDimensionalArray::NDimensionalArray() - Total Value Count: " << _totalValueCount << " element(s) of type '"<< libdap::type_name(_dapType) << "'" << endl);
     allocateStorage(_totalValueCount, _dapType);
+    computeStrides();
     BESDEBUG(NDimensionalArray_debug_key,
         "NDimensionalArray::NDimensionalArray(std::vector<unsigned int> *, libdap::Type) - END"<< endl);
 
@@ -106,7 +122,7 @@ NDimensionalArray::NDimensionalArray(std::vector<unsigned int> *shape, libdap::T
 
 NDimensionalArray::~NDimensionalArray()
 {
-    delete[] (char *) _storage;
+    releaseStorage();
     delete _shape;
 }
 
@@ -116,11 +132,18 @@ NDimensionalArray::~NDimensionalArray()
  * the memory will not be deleted by this call, the instance of NDimensionalArray will remove it's internal reference to
  * the storage and thus when the NDimensionalArray goes out of scope, or is otherwise deleted the storage WILL NOT BE DELETED.
  * CALLING THIS METHOD MEANS THAT YOU ARE NOW RESPONSIBLE FOR FREEING THE MEMORY REFERENCED BY THE RETURNED POINTER.
+ * The returned memory is always freed with delete[]; mapped storage is copied to the heap first.
  */
 void *NDimensionalArray::relinquishStorage()
 {
     void *s = _storage;
+    if (_storageMapped && _storage) {
+        s = new char[_storageBytes];
+        memcpy(s, _storage, _storageBytes);
+        releaseStorage();
+    }
     _storage = 0;
+    _storageMapped = false;
     return s;
 }
 
@@ -251,42 +274,96 @@ long NDimensionalArray::computeArraySizeFromShapeVector(vector<unsigned int> *sh
 }
 
 /**
- * Allocates internal storage for the NDimensionalArray
+ * @return The size, in bytes, of a value of the given DAP type.
  */
-void NDimensionalArray::allocateStorage(long numValues, Type dapType)
+unsigned int NDimensionalArray::sizeOfType(Type dapType)
 {
-
-    BESDEBUG(NDimensionalArray_debug_key,
-        "NDimensionalArray::allocateStorage() - Allocating memory for " << numValues << " element(s) of type '"<< libdap::type_name(dapType) << "'" << endl);
-
     switch (dapType) {
     case dods_byte_c:
-        _sizeOfValue = sizeof(dods_byte);
-        break;
+        return sizeof(dods_byte);
     case dods_int16_c:
-        _sizeOfValue = sizeof(dods_int16);
-        break;
+        return sizeof(dods_int16);
     case dods_uint16_c:
-        _sizeOfValue = sizeof(dods_uint16);
-        break;
+        return sizeof(dods_uint16);
     case dods_int32_c:
-        _sizeOfValue = sizeof(dods_int32);
-        break;
+        return sizeof(dods_int32);
     case dods_uint32_c:
-        _sizeOfValue = sizeof(dods_uint32);
-        break;
+        return sizeof(dods_uint32);
     case dods_float32_c:
-        _sizeOfValue = sizeof(dods_float32);
-        break;
+        return sizeof(dods_float32);
     case dods_float64_c:
-        _sizeOfValue = sizeof(dods_float64);
-        break;
+        return sizeof(dods_float64);
     default:
         throw InternalErr(__FILE__, __LINE__, "Unknown DAP type encountered when constructing NDimensionalArray");
     }
+}
+
+/**
+ * Allocates internal storage for the NDimensionalArray
+ */
+void NDimensionalArray::allocateStorage(long numValues, Type dapType)
+{
+
+    BESDEBUG(NDimensionalArray_debug_key,
+        "NDimensionalArray::allocateStorage() - Allocating memory for " << numValues << " element(s) of type '"<< libdap::type_name(dapType) << "'" << endl);
+
+    _sizeOfValue = sizeOfType(dapType);
+
+    if (numValues < 0 || (unsigned long) numValues > ULONG_MAX / _sizeOfValue) {
+        string msg = "NDimensionalArray::allocateStorage() - The array is too large to allocate ("
+            + libdap::long_to_string(numValues) + " elements).";
+        BESDEBUG(NDimensionalArray_debug_key, msg << endl);
+        throw Error(msg);
+    }
+
+    _storageBytes = (unsigned long) numValues * _sizeOfValue;
+
+    if (_storageBytes > 0 && _storageBytes >= _mapThreshold) {
+        void *mapped = mmap(0, _storageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+            0);
+        if (mapped != MAP_FAILED) {
+            BESDEBUG(NDimensionalArray_debug_key,
+                "NDimensionalArray::allocateStorage() - Mapped " << _storageBytes << " bytes." << endl);
+            _storage = mapped;
+            _storageMapped = true;
+            return;
+        }
+
+        // Fall back to the heap; if that fails too, new[] says so.
+        BESDEBUG(NDimensionalArray_debug_key,
+            "NDimensionalArray::allocateStorage() - mmap() of " << _storageBytes << " bytes failed." << endl);
+    }
 
-    _storage = new char[numValues * _sizeOfValue];
+    _storage = new char[_storageBytes];
+    _storageMapped = false;
+}
+
+/**
+ * Free the internal storage, however it was allocated.
+ */
+void NDimensionalArray::releaseStorage()
+{
+    if (_storageMapped)
+        munmap(_storage, _storageBytes);
+    else
+        delete[] (char *) _storage;
+
+    _storage = 0;
+    _storageMapped = false;
+}
+
+/**
+ * Computes the stride of each dimension and the size of a last dimension hyper-slab once, so
+ * that locating a value or a slab takes no loop over the shape.
+ */
+void NDimensionalArray::computeStrides()
+{
+    _rank = _shape->size();
+    _strides.assign(_rank, 1);
+    for (int i = (int) _rank - 2; i >= 0; --i)
+        _strides[i] = _strides[i + 1] * (*_shape)[i + 1];
 
+    _slabBytes = (_rank > 0) ? (unsigned long) _shape->back() * _sizeOfValue : _sizeOfValue;
 }
 
 /**
@@ -333,124 +410,14 @@ void NDimensionalArray::confirmLastDimSize(unsigned int n)
 }
 
 /**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
+ * Throw the error for a location vector that does not fit the array's shape.
  */
-dods_byte NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_byte value)
+void NDimensionalArray::throwLocationError(std::vector<unsigned int> *location)
 {
+    // getStorageIndex() says what is wrong with the location.
+    getStorageIndex(_shape, location);
 
-    confirmStorage();
-    confirmType(dods_byte_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_byte *_store = static_cast<dods_byte*>(_storage);
-    dods_byte oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_int16 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_int16 value)
-{
-
-    confirmStorage();
-    confirmType(dods_int16_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_int16 *_store = static_cast<dods_int16 *>(_storage);
-    dods_int16 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_uint16 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_uint16 value)
-{
-    confirmStorage();
-    confirmType(dods_uint16_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_uint16 *_store = static_cast<dods_uint16 *>(_storage);
-    dods_uint16 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_int32 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_int32 value)
-{
-    confirmStorage();
-    confirmType(dods_int32_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_int32 *_store = static_cast<dods_int32 *>(_storage);
-    dods_int32 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_uint32 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_uint32 value)
-{
-    confirmStorage();
-    confirmType(dods_uint32_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_uint32 *_store = static_cast<dods_uint32 *>(_storage);
-    dods_uint32 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_float32 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_float32 value)
-{
-    confirmStorage();
-    confirmType(dods_float32_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_float32 *_store = static_cast<dods_float32 *>(_storage);
-    dods_float32 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
-}
-
-/**
- * Sets the value of the array at the location specified by the passed location vector. The number
- * of elements in the location vector must be the the same as the number of dimensions in the NDimensionalArray
- * and the type of the passed value must match the underlying type of the NDimensionalArray
- */
-dods_float64 NDimensionalArray::setValue(std::vector<unsigned int> *location, dods_float64 value)
-{
-    confirmStorage();
-    confirmType(dods_float64_c);
-
-    unsigned int storageIndex = getStorageIndex(_shape, location);
-    dods_float64 *_store = static_cast<dods_float64 *>(_storage);
-    dods_float64 oldValue = _store[storageIndex];
-    _store[storageIndex] = value;
-    return oldValue;
+    throw InternalErr(__FILE__, __LINE__, "NDimensionalArray::storageIndex() - Invalid location " + vectorToIndices(location));
 }
 
 /**
@@ -459,7 +426,7 @@ dods_float64 NDimensionalArray::setValue(std::vector<unsigned int> *location, do
  * have N-1 elements where N is the number of dimensions in the NDimensionalArray.
  */
 void NDimensionalArray::getLastDimensionHyperSlab(std::vector<unsigned int> *location, void **slab,
-    unsigned int *elementCount)
+    unsigned long *elementCount)
 {
     BESDEBUG(NDimensionalArray_debug_key, endl<< endl <<"NDimensionalArray::getLastDimensionHyperSlab() - BEGIN"<<endl);
     confirmStorage();
@@ -479,24 +446,14 @@ void NDimensionalArray::getLastDimensionHyperSlab(std::vector<unsigned int> *loc
     BESDEBUG(NDimensionalArray_debug_key,
         "NDimensionalArray::getLastDimensionHyperSlab() - slabLocation" <<vectorToIndices(&slabLocation) << endl);
 
-    unsigned int storageIndex = getStorageIndex(_shape, &slabLocation);
+    long index = storageIndex(&slabLocation);
 
-    *slab = &((char *) _storage)[storageIndex * _sizeOfValue];
+    *slab = (char *) _storage + (unsigned long) index * _sizeOfValue;
     *elementCount = *(_shape->rbegin());
     BESDEBUG(NDimensionalArray_debug_key, "NDimensionalArray::getLastDimensionHyperSlab() - END"<<endl<<endl);
 
 }
 
-void NDimensionalArray::getNextLastDimensionHyperSlab(void **slab)
-{
-
-    unsigned int storageIndex = _shape->back() * _currentLastDimensionSlabIndex++;
-    BESDEBUG(NDimensionalArray_debug_key,
-        "NDimensionalArray::getNextLastDimensionHyperSlab() - Storage Index:"<< libdap::long_to_string(storageIndex) << endl);
-    *slab = &((char *) _storage)[storageIndex * _sizeOfValue];
-
-}
-
 /**
  * Computes the element index in the underlying one dimensional array for the passed location based on an
  * n-dimensional array described by the shape vector.
@@ -540,97 +497,6 @@ long NDimensionalArray::getStorageIndex(vector<unsigned int> *shape, vector<unsi
     return storageIndex;
 }
 
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_byte *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_byte_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_byte));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int16 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_int16_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_int16));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint16 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_uint16_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_uint16));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int32 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_int32_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_int32));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint32 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_uint32_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_uint32));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float32 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_float32_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_float32));
-}
-
-/**
- * Sets all of the values in the last dimension hyper-hyper slab identified by the N-1 element location vector (where N is the
- * number of dimensions in the NDimensionalArray). The number of values passed in must match the size of the last dimension
- * hyper-slab, and the type of the values must match the underlying type of the NDimensionalArray.
- */
-void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float64 *values,
-    unsigned int valueCount)
-{
-    confirmType(dods_float64_c);
-    confirmLastDimSize(valueCount);
-    setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(dods_float64));
-}
-
 /**
  * This private method uses 'memcopy' to perform a byte by byte copy of the passed values array onto the last dimension
  * hyper-slab referenced by the N-1 element vector location.
@@ -640,7 +506,7 @@ void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *loc
 {
     confirmStorage();
     void *slab;
-    unsigned int slabElementCount;
+    unsigned long slabElementCount;
 
     getLastDimensionHyperSlab(location, &slab, &slabElementCount);
     memcpy(slab, values, byteCount);
@@ -653,7 +519,7 @@ void NDimensionalArray::setLastDimensionHyperSlab(std::vector<unsigned int> *loc
 void NDimensionalArray::setAll(char val)
 {
     confirmStorage();
-    memset(_storage, val, _totalValueCount * _sizeOfValue);
+    memset(_storage, val, _storageBytes);
 
 }
 
@@ -665,101 +531,74 @@ long NDimensionalArray::getLastDimensionElementCount()
     return *(_shape->rbegin());
 }
 
-libdap::Array *NDimensionalArray::getArray(libdap::Array *templateArray)
+/**
+ * Make a DAP Array of PROTO (e.g., libdap::Int32) with the name, dimension names and attributes of
+ * templateArray, the given shape and the values of type T.
+ */
+template<class PROTO, typename T>
+static libdap::Array *newTypedArray(libdap::Array *templateArray, vector<unsigned int> *shape, void *values,
+    long count)
 {
-
-    if (_shape->size() != templateArray->dimensions(true))
-        throw Error("Template Array has different number of dimensions than NDimensional Array!!");
-
-    libdap::Array *resultDapArray;
-
-    switch (_dapType) {
-    case dods_byte_c: {
-        libdap::Byte tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_uint16_c: {
-        libdap::Int16 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_int16_c: {
-        libdap::UInt16 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_int32_c: {
-        libdap::Int32 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_uint32_c: {
-        libdap::UInt32 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_float32_c: {
-        libdap::Float32 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    case dods_float64_c: {
-        libdap::Float64 tt(templateArray->name());
-        resultDapArray = new libdap::Array(templateArray->name(), &tt);
-        break;
-    }
-    default:
-        throw InternalErr(__FILE__, __LINE__,
-            "Unknown DAP type encountered when converting to gridfields internal type.");
-    }
+    PROTO tt(templateArray->name());
+    libdap::Array *resultDapArray = new libdap::Array(templateArray->name(), &tt);
 
     libdap::Array::Dim_iter dimIt;
     int s = 0;
     for (dimIt = templateArray->dim_begin(); dimIt != templateArray->dim_end(); dimIt++, s++) {
-        resultDapArray->append_dim((*_shape)[s], (*dimIt).name);
+        resultDapArray->append_dim((*shape)[s], (*dimIt).name);
     }
 
     // Copy the source objects attributes.
     BESDEBUG(NDimensionalArray_debug_key,
-        "TwoDMeshTopology::getGFAttributeAsDapArray() - Copying libdap::Attribute's from template array " << templateArray->name() << endl);
+        "NDimensionalArray::getArray() - Copying libdap::Attribute's from template array " << templateArray->name() << endl);
     resultDapArray->set_attr_table(templateArray->get_attr_table());
 
+    resultDapArray->set_value((T *) values, count);
+
+    return resultDapArray;
+}
+
+/**
+ * @return A new DAP Array holding the values, with the name, dimension names and attributes of
+ * templateArray.
+ */
+libdap::Array *NDimensionalArray::getArray(libdap::Array *templateArray)
+{
+
+    if (_shape->size() != templateArray->dimensions(true))
+        throw Error("Template Array has different number of dimensions than NDimensional Array!!");
+
+    // libdap::Vector counts its values with an int.
+    if (_totalValueCount > INT_MAX)
+        throw Error(
+            "The result for " + templateArray->name() + " has " + libdap::long_to_string(_totalValueCount)
+                + " values, more than a DAP array can hold. Constrain the request to fewer values.");
+
     switch (_dapType) {
-    case dods_byte_c: {
-        resultDapArray->set_value((dods_byte *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_uint16_c: {
-        resultDapArray->set_value((dods_uint16 *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_int16_c: {
-        resultDapArray->set_value((dods_int16 *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_uint32_c: {
-        resultDapArray->set_value((dods_uint32 *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_int32_c: {
-        resultDapArray->set_value((dods_int32 *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_float32_c: {
-        resultDapArray->set_value((dods_float32 *) _storage, _totalValueCount);
-        break;
-    }
-    case dods_float64_c: {
-        resultDapArray->set_value((dods_float64 *) _storage, _totalValueCount);
-        break;
-    }
+    case dods_byte_c:
+        return newTypedArray<libdap::Byte, dods_byte>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_int16_c:
+        return newTypedArray<libdap::Int16, dods_int16>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_uint16_c:
+        return newTypedArray<libdap::UInt16, dods_uint16>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_int32_c:
+        return newTypedArray<libdap::Int32, dods_int32>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_uint32_c:
+        return newTypedArray<libdap::UInt32, dods_uint32>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_float32_c:
+        return newTypedArray<libdap::Float32, dods_float32>(templateArray, _shape, _storage, _totalValueCount);
+    case dods_float64_c:
+        return newTypedArray<libdap::Float64, dods_float64>(templateArray, _shape, _storage, _totalValueCount);
     default:
         throw InternalErr(__FILE__, __LINE__,
             "Unknown DAP type encountered when converting to gridfields internal type.");
     }
+}
 
-    return resultDapArray;
+template<typename T>
+static void printValue(stringstream &s, void *storage, long index)
+{
+    s << ((T *) storage)[index];
 }
 
 string NDimensionalArray::toString_worker(vector<unsigned int> *location)
@@ -771,36 +610,29 @@ string NDimensionalArray::toString_worker(vector<unsigned int> *location)
         s << vectorToIndices(location);
 
         s << ": ";
-        long storageIndex = getStorageIndex(_shape, location);
+        long index = storageIndex(location);
         switch (_dapType) {
-        case dods_byte_c: {
-            s << ((dods_byte *) _storage)[storageIndex];
+        case dods_byte_c:
+            printValue<dods_byte>(s, _storage, index);
             break;
-        }
-        case dods_uint16_c: {
-            s << ((dods_uint16 *) _storage)[storageIndex];
+        case dods_uint16_c:
+            printValue<dods_uint16>(s, _storage, index);
             break;
-        }
-        case dods_int16_c: {
-            s << ((dods_int16 *) _storage)[storageIndex];
+        case dods_int16_c:
+            printValue<dods_int16>(s, _storage, index);
             break;
-        }
-        case dods_uint32_c: {
-            s << ((dods_uint32 *) _storage)[storageIndex];
+        case dods_uint32_c:
+            printValue<dods_uint32>(s, _storage, index);
             break;
-        }
-        case dods_int32_c: {
-            s << ((dods_int32 *) _storage)[storageIndex];
+        case dods_int32_c:
+            printValue<dods_int32>(s, _storage, index);
             break;
-        }
-        case dods_float32_c: {
-            s << ((dods_float32 *) _storage)[storageIndex];
+        case dods_float32_c:
+            printValue<dods_float32>(s, _storage, index);
             break;
-        }
-        case dods_float64_c: {
-            s << ((dods_float64 *) _storage)[storageIndex];
+        case dods_float64_c:
+            printValue<dods_float64>(s, _storage, index);
             break;
-        }
         default:
             throw InternalErr(__FILE__, __LINE__,
                 "Unknown DAP type encountered when converting to gridfields internal type.");
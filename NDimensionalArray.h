@@ -34,7 +34,10 @@ namespace libdap {
 static string NDimensionalArray_debug_key = "ugrid";
 
 /**
- *
+ * An n-dimensional array of one of the DAP numeric types, stored in row major
+ * order. The strides of the dimensions are computed when the array is made,
+ * and the DAP type is only examined at its edges (construction, getArray());
+ * the typed operations are templates on the element type.
  */
 class NDimensionalArray {
 private:
@@ -44,18 +47,91 @@ private:
     libdap::Type _dapType;
 
     std::vector<unsigned int> *_shape;
-    unsigned int _currentLastDimensionSlabIndex;
+    unsigned long _currentLastDimensionSlabIndex;
 
     long _totalValueCount; // Number of elements
     unsigned int _sizeOfValue;
     void *_storage;
+    unsigned long _storageBytes;
+    bool _storageMapped; // True if _storage came from mmap() rather than new[]
 
+    static unsigned long _mapThreshold;
+
+    // _strides[i] is the number of elements between consecutive indices of
+    // dimension i; the last dimension's stride is 1.
+    unsigned int _rank;
+    std::vector<long> _strides;
+    unsigned long _slabBytes;
+
+    void computeStrides();
     void allocateStorage(long numValues, libdap::Type dapType);
+    void releaseStorage();
     void confirmStorage();
     void confirmType(Type dapType);
     void confirmLastDimSize(unsigned int n);
     void setLastDimensionHyperSlab(std::vector<unsigned int> *location, void *values, unsigned int byteCount);
 
+    void throwLocationError(std::vector<unsigned int> *location);
+
+    /**
+     * @return The element index of location, which must have one index per
+     * dimension, each within the array's shape.
+     */
+    long storageIndex(std::vector<unsigned int> *location)
+    {
+        if (location->size() != _rank) throwLocationError(location);
+        if (_rank == 0) return 0;
+
+        const unsigned int *l = &(*location)[0];
+        const unsigned int *s = &(*_shape)[0];
+
+        switch (_rank) {
+        case 1:
+            if (l[0] >= s[0]) break;
+            return l[0];
+        case 2:
+            if (l[0] >= s[0] || l[1] >= s[1]) break;
+            return l[0] * _strides[0] + l[1];
+        case 3:
+            if (l[0] >= s[0] || l[1] >= s[1] || l[2] >= s[2]) break;
+            return l[0] * _strides[0] + l[1] * _strides[1] + l[2];
+        case 4:
+            if (l[0] >= s[0] || l[1] >= s[1] || l[2] >= s[2] || l[3] >= s[3]) break;
+            return l[0] * _strides[0] + l[1] * _strides[1] + l[2] * _strides[2] + l[3];
+        default: {
+            long index = 0;
+            unsigned int i = 0;
+            for (; i < _rank && l[i] < s[i]; ++i)
+                index += l[i] * _strides[i];
+            if (i == _rank) return index;
+            break;
+        }
+        }
+
+        throwLocationError(location);
+        return 0;
+    }
+
+    template<typename T> T setTypedValue(std::vector<unsigned int> *location, T value, libdap::Type dapType)
+    {
+        confirmStorage();
+        confirmType(dapType);
+
+        T *store = static_cast<T *>(_storage);
+        long i = storageIndex(location);
+        T oldValue = store[i];
+        store[i] = value;
+        return oldValue;
+    }
+
+    template<typename T> void setTypedLastDimensionHyperSlab(std::vector<unsigned int> *location, T *values,
+        unsigned int valueCount, libdap::Type dapType)
+    {
+        confirmType(dapType);
+        confirmLastDimSize(valueCount);
+        setLastDimensionHyperSlab(location, (void *) values, valueCount * sizeof(T));
+    }
+
     string toString_worker(vector<unsigned int> *index);
 
 public:
@@ -65,13 +141,54 @@ public:
 
     virtual ~NDimensionalArray();
 
-    dods_byte setValue(std::vector<unsigned int> *location, dods_byte value);
-    dods_int16 setValue(std::vector<unsigned int> *location, dods_int16 value);
-    dods_uint16 setValue(std::vector<unsigned int> *location, dods_uint16 value);
-    dods_int32 setValue(std::vector<unsigned int> *location, dods_int32 value);
-    dods_uint32 setValue(std::vector<unsigned int> *location, dods_uint32 value);
-    dods_float32 setValue(std::vector<unsigned int> *location, dods_float32 value);
-    dods_float64 setValue(std::vector<unsigned int> *location, dods_float64 value);
+    static unsigned int sizeOfType(libdap::Type dapType);
+
+    /**
+     * Storage of at least this many bytes is mapped (anonymous mmap()) rather
+     * than allocated with new[], so that very large results are backed by
+     * pages the kernel only commits as they are written.
+     */
+    static unsigned long getMapThreshold()
+    {
+        return _mapThreshold;
+    }
+    static void setMapThreshold(unsigned long bytes)
+    {
+        _mapThreshold = bytes;
+    }
+    bool isStorageMapped()
+    {
+        return _storageMapped;
+    }
+
+    dods_byte setValue(std::vector<unsigned int> *location, dods_byte value)
+    {
+        return setTypedValue(location, value, dods_byte_c);
+    }
+    dods_int16 setValue(std::vector<unsigned int> *location, dods_int16 value)
+    {
+        return setTypedValue(location, value, dods_int16_c);
+    }
+    dods_uint16 setValue(std::vector<unsigned int> *location, dods_uint16 value)
+    {
+        return setTypedValue(location, value, dods_uint16_c);
+    }
+    dods_int32 setValue(std::vector<unsigned int> *location, dods_int32 value)
+    {
+        return setTypedValue(location, value, dods_int32_c);
+    }
+    dods_uint32 setValue(std::vector<unsigned int> *location, dods_uint32 value)
+    {
+        return setTypedValue(location, value, dods_uint32_c);
+    }
+    dods_float32 setValue(std::vector<unsigned int> *location, dods_float32 value)
+    {
+        return setTypedValue(location, value, dods_float32_c);
+    }
+    dods_float64 setValue(std::vector<unsigned int> *location, dods_float64 value)
+    {
+        return setTypedValue(location, value, dods_float64_c);
+    }
 
     static void retrieveLastDimHyperSlabLocationFromConstrainedArrray(libdap::Array *a, vector<unsigned int> *location);
     static long computeConstrainedShape(libdap::Array *a, vector<unsigned int> *shape);
@@ -102,28 +219,57 @@ public:
         return _dapType;
     }
 
-    void getLastDimensionHyperSlab(std::vector<unsigned int> *location, void **slab, unsigned int *elementCount);
-    void getNextLastDimensionHyperSlab(void **slab);
+    void getLastDimensionHyperSlab(std::vector<unsigned int> *location, void **slab, unsigned long *elementCount);
+
+    /**
+     * Return the next last dimension hyper-slab in storage order and advance
+     * the slab index; the slabs are a fixed number of bytes apart.
+     */
+    void getNextLastDimensionHyperSlab(void **slab)
+    {
+        *slab = (char *) _storage + _slabBytes * _currentLastDimensionSlabIndex++;
+    }
     void resetSlabIndex()
     {
         _currentLastDimensionSlabIndex = 0;
     }
-    unsigned int getCurrentLastDimensionHyperSlab()
+    unsigned long getCurrentLastDimensionHyperSlab()
     {
         return _currentLastDimensionSlabIndex;
     }
-    void setCurrentLastDimensionHyperSlab(unsigned int newIndex)
+    void setCurrentLastDimensionHyperSlab(unsigned long newIndex)
     {
         _currentLastDimensionSlabIndex = newIndex;
     }
 
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_byte *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int16 *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint16 *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int32 *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint32 *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float32 *values, unsigned int numVal);
-    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float64 *values, unsigned int numVal);
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_byte *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_byte_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int16 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_int16_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint16 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_uint16_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_int32 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_int32_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_uint32 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_uint32_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float32 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_float32_c);
+    }
+    void setLastDimensionHyperSlab(std::vector<unsigned int> *location, dods_float64 *values, unsigned int numVal)
+    {
+        setTypedLastDimensionHyperSlab(location, values, numVal, dods_float64_c);
+    }
 
     libdap::Array *getArray(libdap::Array *templateArray);
 
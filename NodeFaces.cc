@@ -0,0 +1,117 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "MeshGeometry.h"
+#include "NodeFaces.h"
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * Build the rows with two passes over the face node connectivity: count the
+ * faces of each node, then fill them in. Faces are visited in order, so each
+ * row comes out sorted.
+ */
+NodeFaces::NodeFaces(const MeshGeometry *geometry) :
+    d_geometry(geometry)
+{
+    unsigned int faceCount = geometry->faceCount();
+    unsigned int nodeCount = geometry->nodeCount();
+
+    d_start.assign(nodeCount + 1, 0);
+    for (unsigned int f = 0; f < faceCount; ++f) {
+        for (unsigned int c = 0; c < geometry->nodesPerFace(); ++c) {
+            unsigned int n = geometry->faceNode(f, c);
+            if (n < nodeCount) d_start[n + 1]++;
+        }
+    }
+
+    for (unsigned int n = 1; n <= nodeCount; ++n)
+        d_start[n] += d_start[n - 1];
+
+    d_faces.resize(d_start.back());
+    vector<unsigned int> fill(d_start.begin(), d_start.end() - 1);
+    for (unsigned int f = 0; f < faceCount; ++f) {
+        for (unsigned int c = 0; c < geometry->nodesPerFace(); ++c) {
+            unsigned int n = geometry->faceNode(f, c);
+            if (n < nodeCount) d_faces[fill[n]++] = f;
+        }
+    }
+}
+
+/**
+ * Add the given number of rings of neighboring faces to a set of faces. Each
+ * ring is every face that shares a node with the faces added by the previous
+ * ring (or with the original set, for the first ring), found breadth first.
+ * On return faces is sorted and holds no duplicates.
+ */
+void NodeFaces::grow(vector<unsigned int> *faces, unsigned int rings) const
+{
+    unsigned int faceCount = d_geometry->faceCount();
+    unsigned int nodeCount = d_geometry->nodeCount();
+
+    vector<bool> inSet(faceCount, false);
+    vector<bool> nodeVisited(nodeCount, false);
+
+    vector<unsigned int> frontier;
+    for (vector<unsigned int>::iterator it = faces->begin(); it != faces->end(); ++it) {
+        if (*it < faceCount && !inSet[*it]) {
+            inSet[*it] = true;
+            frontier.push_back(*it);
+        }
+    }
+
+    for (unsigned int ring = 0; ring < rings && !frontier.empty(); ++ring) {
+        vector<unsigned int> next;
+        for (vector<unsigned int>::iterator it = frontier.begin(); it != frontier.end(); ++it) {
+            for (unsigned int c = 0; c < d_geometry->nodesPerFace(); ++c) {
+                unsigned int n = d_geometry->faceNode(*it, c);
+                if (n >= nodeCount || nodeVisited[n]) continue;
+                nodeVisited[n] = true;
+
+                for (unsigned int i = d_start[n]; i < d_start[n + 1]; ++i) {
+                    unsigned int f = d_faces[i];
+                    if (!inSet[f]) {
+                        inSet[f] = true;
+                        next.push_back(f);
+                    }
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+
+    faces->clear();
+    for (unsigned int f = 0; f < faceCount; ++f)
+        if (inSet[f]) faces->push_back(f);
+}
+
+} // namespace ugrid
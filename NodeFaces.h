@@ -0,0 +1,76 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _NodeFaces_h
+#define _NodeFaces_h 1
+
+#include <vector>
+
+namespace ugrid {
+
+class MeshGeometry;
+
+/**
+ * The faces that use each node of a mesh (the inverse of the face node
+ * connectivity), stored in compressed rows: the faces of node n are
+ * faces()[start()[n]] up to (but not including) faces()[start()[n + 1]], in
+ * ascending order. This is what is needed to grow a set of faces by rings of
+ * neighbors, where two faces are neighbors if they share a node.
+ */
+class NodeFaces {
+
+private:
+    const MeshGeometry *d_geometry;
+
+    std::vector<unsigned int> d_start;
+    std::vector<unsigned int> d_faces;
+
+    NodeFaces(const NodeFaces &);
+    NodeFaces &operator=(const NodeFaces &);
+
+public:
+    NodeFaces(const MeshGeometry *geometry);
+
+    const std::vector<unsigned int> &start() const
+    {
+        return d_start;
+    }
+
+    const std::vector<unsigned int> &faces() const
+    {
+        return d_faces;
+    }
+
+    void grow(std::vector<unsigned int> *faces, unsigned int rings) const;
+
+    unsigned long sizeInBytes() const
+    {
+        return (d_start.capacity() + d_faces.capacity()) * sizeof(unsigned int);
+    }
+};
+
+} // namespace ugrid
+
+#endif // _NodeFaces_h
@@ -0,0 +1,85 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "RegionIndex.h"
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * @param faceIds The id of each face of the mesh.
+ */
+RegionIndex::RegionIndex(const vector<int> &faceIds) :
+    d_ids(faceIds)
+{
+    sort(d_ids.begin(), d_ids.end());
+    d_ids.erase(unique(d_ids.begin(), d_ids.end()), d_ids.end());
+
+    // Two passes: count the faces with each id, then fill them in. Faces are
+    // visited in order, so each list comes out sorted.
+    d_start.assign(d_ids.size() + 1, 0);
+    vector<unsigned int> slot(faceIds.size());
+    for (unsigned int f = 0; f < faceIds.size(); ++f) {
+        slot[f] = lower_bound(d_ids.begin(), d_ids.end(), faceIds[f]) - d_ids.begin();
+        d_start[slot[f] + 1]++;
+    }
+    for (unsigned int i = 1; i < d_start.size(); ++i)
+        d_start[i] += d_start[i - 1];
+
+    d_faces.resize(faceIds.size());
+    vector<unsigned int> fill(d_start.begin(), d_start.end() - 1);
+    for (unsigned int f = 0; f < faceIds.size(); ++f)
+        d_faces[fill[slot[f]]++] = f;
+}
+
+/**
+ * Set faces to the faces whose id is one of ids, in ascending order.
+ */
+void RegionIndex::select(const vector<int> &ids, vector<unsigned int> *faces) const
+{
+    faces->clear();
+
+    vector<int> wanted(ids);
+    sort(wanted.begin(), wanted.end());
+    wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+
+    for (vector<int>::iterator it = wanted.begin(); it != wanted.end(); ++it) {
+        vector<int>::const_iterator id = lower_bound(d_ids.begin(), d_ids.end(), *it);
+        if (id == d_ids.end() || *id != *it) continue;
+
+        unsigned int i = id - d_ids.begin();
+        vector<unsigned int>::size_type middle = faces->size();
+        faces->insert(faces->end(), d_faces.begin() + d_start[i], d_faces.begin() + d_start[i + 1]);
+        inplace_merge(faces->begin(), faces->begin() + middle, faces->end());
+    }
+}
+
+} // namespace ugrid
@@ -0,0 +1,81 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _RegionIndex_h
+#define _RegionIndex_h 1
+
+#include <vector>
+
+#include "MeshGeometry.h"
+
+namespace ugrid {
+
+/**
+ * An inverted index of an integer face variable (e.g., a basin or region
+ * id): for each distinct value, the faces that hold it in ascending order.
+ * The faces with id ids()[i] are faces()[start()[i]] up to (but not
+ * including) faces()[start()[i + 1]], so the faces with a given set of ids
+ * can be listed without looking at the others. Instances are kept as
+ * products of the MeshGeometry, keyed by the variable's name.
+ */
+class RegionIndex: public MeshGeometryProduct {
+
+private:
+    std::vector<int> d_ids;
+    std::vector<unsigned int> d_start;
+    std::vector<unsigned int> d_faces;
+
+    RegionIndex(const RegionIndex &);
+    RegionIndex &operator=(const RegionIndex &);
+
+public:
+    RegionIndex(const std::vector<int> &faceIds);
+
+    const std::vector<int> &ids() const
+    {
+        return d_ids;
+    }
+
+    const std::vector<unsigned int> &start() const
+    {
+        return d_start;
+    }
+
+    const std::vector<unsigned int> &faces() const
+    {
+        return d_faces;
+    }
+
+    void select(const std::vector<int> &ids, std::vector<unsigned int> *faces) const;
+
+    virtual unsigned long sizeInBytes() const
+    {
+        return d_ids.capacity() * sizeof(int) + (d_start.capacity() + d_faces.capacity()) * sizeof(unsigned int);
+    }
+};
+
+} // namespace ugrid
+
+#endif // _RegionIndex_h
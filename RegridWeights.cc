@@ -0,0 +1,139 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#include "BESDebug.h"
+
+#include "MeshGeometry.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+#include "RegridWeights.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * Locate every point of the grid in the mesh and build the node and face
+ * weight matrices. Points along a row of the grid are next to each other, so
+ * each is found by walking the mesh from the face of the previous point.
+ */
+RegridWeights::RegridWeights(MeshGeometry *geometry, double minX, double minY, double dx, double dy, unsigned int nx,
+    unsigned int ny) :
+    d_minX(minX), d_minY(minY), d_dx(dx), d_dy(dy), d_nx(nx), d_ny(ny)
+{
+    const FaceLocator *locator = geometry->getFaceLocator();
+    const FaceAdjacency *adjacency = geometry->getFaceAdjacency();
+
+    unsigned long rows = (unsigned long) nx * ny;
+    d_nodeWeights.rowStart.reserve(rows + 1);
+    d_faceWeights.rowStart.reserve(rows + 1);
+    d_nodeWeights.rowStart.push_back(0);
+    d_faceWeights.rowStart.push_back(0);
+
+    unsigned long located = 0;
+    FaceWeights fw;
+    for (unsigned int j = 0; j < ny; ++j) {
+        bool previous = false;
+        for (unsigned int i = 0; i < nx; ++i) {
+            bool found;
+            if (previous)
+                found = locator->walk(adjacency, fw.face, x(i), y(j), &fw);
+            else
+                found = locator->locate(x(i), y(j), &fw);
+
+            if (found) {
+                ++located;
+                for (unsigned int k = 0; k < 3; ++k) {
+                    d_nodeWeights.columns.push_back(fw.nodes[k]);
+                    d_nodeWeights.weights.push_back(fw.weights[k]);
+                }
+                d_faceWeights.columns.push_back(fw.face);
+                d_faceWeights.weights.push_back(1.0);
+            }
+            d_nodeWeights.rowStart.push_back(d_nodeWeights.columns.size());
+            d_faceWeights.rowStart.push_back(d_faceWeights.columns.size());
+
+            previous = found;
+        }
+    }
+
+    compress(&d_nodeWeights);
+    compress(&d_faceWeights);
+
+    BESDEBUG("ugrid",
+        "RegridWeights::RegridWeights() - " << located << " of " << rows << " grid points are in the mesh; " << d_nodeWeights.locations.size() << " nodes and " << d_faceWeights.locations.size() << " faces used" << endl);
+}
+
+/**
+ * Replace the mesh location ids in sw->columns with their positions in the
+ * sorted list of the distinct ids used, which is stored in sw->locations.
+ */
+void RegridWeights::compress(SparseWeights *sw)
+{
+    sw->locations = sw->columns;
+    sort(sw->locations.begin(), sw->locations.end());
+    sw->locations.erase(unique(sw->locations.begin(), sw->locations.end()), sw->locations.end());
+
+    for (vector<unsigned int>::iterator it = sw->columns.begin(); it != sw->columns.end(); ++it)
+        *it = lower_bound(sw->locations.begin(), sw->locations.end(), *it) - sw->locations.begin();
+}
+
+/**
+ * @return A key that identifies the grid, used to find its weights again.
+ */
+string RegridWeights::makeKey(double minX, double minY, double dx, double dy, unsigned int nx, unsigned int ny)
+{
+    ostringstream oss;
+    oss << setprecision(17) << minX << " " << minY << " " << dx << " " << dy << " " << nx << " " << ny;
+    return oss.str();
+}
+
+unsigned long RegridWeights::sizeInBytes() const
+{
+    unsigned long size = sizeof(RegridWeights);
+
+    const SparseWeights *sw[] = { &d_nodeWeights, &d_faceWeights };
+    for (int i = 0; i < 2; ++i) {
+        size += (sw[i]->locations.capacity() + sw[i]->rowStart.capacity() + sw[i]->columns.capacity())
+            * sizeof(unsigned int);
+        size += sw[i]->weights.capacity() * sizeof(double);
+    }
+
+    return size;
+}
+
+} // namespace ugrid
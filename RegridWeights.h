@@ -0,0 +1,118 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _RegridWeights_h
+#define _RegridWeights_h 1
+
+#include <string>
+#include <vector>
+
+#include "MeshGeometry.h"
+
+namespace ugrid {
+
+/**
+ * A sparse matrix, in compressed row form, that maps the values of a range
+ * variable at a set of mesh locations (nodes or faces) to the points of a
+ * regular grid. The columns of the matrix are the entries of 'locations', the
+ * sorted ids of just the locations the grid uses, so a range variable can be
+ * gathered for exactly those locations and multiplied by the matrix directly.
+ * The entries of row r are [rowStart[r], rowStart[r+1]); a row with no
+ * entries is a grid point outside the mesh.
+ */
+struct SparseWeights {
+    std::vector<unsigned int> locations;
+    std::vector<unsigned int> rowStart;
+    std::vector<unsigned int> columns;
+    std::vector<double> weights;
+};
+
+/**
+ * The interpolation weights from a mesh to a regular grid whose points are
+ * (minX + i * dx, minY + j * dy) for i < nx and j < ny. Rows are ordered with
+ * i varying fastest. Node variables use the barycentric weights of each grid
+ * point in the face that contains it; face variables take the value of that
+ * face.
+ *
+ * Building the weights means locating every grid point, so instances are
+ * kept by the MeshGeometry they were built from (see
+ * MeshGeometry::getRegridWeights()) and reused for the same grid.
+ */
+class RegridWeights: public MeshGeometryProduct {
+
+private:
+    double d_minX, d_minY, d_dx, d_dy;
+    unsigned int d_nx, d_ny;
+
+    SparseWeights d_nodeWeights;
+    SparseWeights d_faceWeights;
+
+    static void compress(SparseWeights *sw);
+
+    RegridWeights(const RegridWeights &);
+    RegridWeights &operator=(const RegridWeights &);
+
+public:
+    RegridWeights(MeshGeometry *geometry, double minX, double minY, double dx, double dy, unsigned int nx,
+        unsigned int ny);
+
+    static std::string makeKey(double minX, double minY, double dx, double dy, unsigned int nx, unsigned int ny);
+
+    unsigned int nx() const
+    {
+        return d_nx;
+    }
+
+    unsigned int ny() const
+    {
+        return d_ny;
+    }
+
+    double x(unsigned int i) const
+    {
+        return d_minX + i * d_dx;
+    }
+
+    double y(unsigned int j) const
+    {
+        return d_minY + j * d_dy;
+    }
+
+    const SparseWeights &nodeWeights() const
+    {
+        return d_nodeWeights;
+    }
+
+    const SparseWeights &faceWeights() const
+    {
+        return d_faceWeights;
+    }
+
+    virtual unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _RegridWeights_h
@@ -0,0 +1,144 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "MeshGeometry.h"
+#include "GatherPlan.h"
+#include "RestrictionResult.h"
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * Build the result from the node and face indices of a restriction of a mesh
+ * with the given numbers of nodes and faces; the contents of nodes and faces
+ * are taken (the vectors are left empty).
+ */
+RestrictionResult::RestrictionResult(unsigned int meshNodeCount, unsigned int meshFaceCount,
+    vector<unsigned int> *nodes, vector<unsigned int> *faces) :
+    d_measured(false), d_edgeCount(0), d_minX(numeric_limits<double>::quiet_NaN()), d_minY(d_minX), d_maxX(d_minX),
+        d_maxY(d_minX), d_meshNodeCount(meshNodeCount), d_meshFaceCount(meshFaceCount), d_nodePlan(0), d_facePlan(0)
+{
+    d_nodes.swap(*nodes);
+    d_faces.swap(*faces);
+}
+
+/**
+ * Compute the bounding box of the nodes and the number of distinct edges of
+ * the faces, using the geometry of the mesh that was restricted. Only the
+ * first call does any work.
+ */
+void RestrictionResult::measure(const MeshGeometry *geometry)
+{
+    if (d_measured) return;
+
+    for (unsigned int i = 0; i < d_nodes.size(); ++i) {
+        double x = geometry->nodeX(d_nodes[i]), y = geometry->nodeY(d_nodes[i]);
+        if (i == 0) {
+            d_minX = d_maxX = x;
+            d_minY = d_maxY = y;
+        }
+        else {
+            if (x < d_minX) d_minX = x;
+            if (x > d_maxX) d_maxX = x;
+            if (y < d_minY) d_minY = y;
+            if (y > d_maxY) d_maxY = y;
+        }
+    }
+
+    // An edge shared by two faces is counted once.
+    vector<pair<unsigned int, unsigned int> > edges;
+    for (vector<unsigned int>::iterator it = d_faces.begin(); it != d_faces.end(); ++it) {
+        unsigned int corners = 0;
+        while (corners < geometry->nodesPerFace() && geometry->faceNode(*it, corners) < geometry->nodeCount())
+            ++corners;
+
+        for (unsigned int c = 0; c < corners; ++c) {
+            unsigned int a = geometry->faceNode(*it, c);
+            unsigned int b = geometry->faceNode(*it, (c + 1) % corners);
+            edges.push_back(a < b ? make_pair(a, b) : make_pair(b, a));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    d_edgeCount = unique(edges.begin(), edges.end()) - edges.begin();
+
+    d_measured = true;
+}
+
+RestrictionResult::~RestrictionResult()
+{
+    delete d_nodePlan;
+    delete d_facePlan;
+}
+
+/**
+ * @return The key of the result of restricting the mesh at location (node,
+ * edge or face) with the filter expression.
+ */
+string RestrictionResult::makeKey(unsigned int location, const string &filterExpression)
+{
+    ostringstream oss;
+    oss << "restrict " << location << " " << filterExpression;
+    return oss.str();
+}
+
+/**
+ * @return The plan for reading range variables at the nodes of the subset.
+ */
+const GatherPlan *RestrictionResult::nodePlan()
+{
+    if (!d_nodePlan) d_nodePlan = new GatherPlan(d_nodes, d_meshNodeCount);
+
+    return d_nodePlan;
+}
+
+/**
+ * @return The plan for reading range variables at the faces of the subset.
+ */
+const GatherPlan *RestrictionResult::facePlan()
+{
+    if (!d_facePlan) d_facePlan = new GatherPlan(d_faces, d_meshFaceCount);
+
+    return d_facePlan;
+}
+
+unsigned long RestrictionResult::sizeInBytes() const
+{
+    unsigned long size = sizeof(RestrictionResult) + (d_nodes.capacity() + d_faces.capacity()) * sizeof(unsigned int);
+    if (d_nodePlan) size += d_nodePlan->sizeInBytes();
+    if (d_facePlan) size += d_facePlan->sizeInBytes();
+
+    return size;
+}
+
+} // namespace ugrid
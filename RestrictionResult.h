@@ -0,0 +1,133 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _RestrictionResult_h
+#define _RestrictionResult_h 1
+
+#include <string>
+#include <vector>
+
+#include "MeshGeometry.h"
+
+namespace ugrid {
+
+class GatherPlan;
+
+/**
+ * The outcome of restricting a mesh with one filter expression: the nodes and
+ * faces of the mesh that are in the subset, in the order the restriction
+ * returns them. Instances are kept by the MeshGeometryCache, one per mesh,
+ * location and filter expression, so that a request that repeats a filter
+ * reuses them without the mesh's geometry. The plans for reading range
+ * variables at the nodes and faces of the subset are made the first time
+ * they are needed and kept with it.
+ *
+ * The number of distinct edges of the faces and the bounding box of the
+ * nodes, which ugct() reports, are only computed when measure() is called.
+ */
+class RestrictionResult {
+
+private:
+    std::vector<unsigned int> d_nodes;
+    std::vector<unsigned int> d_faces;
+
+    bool d_measured;
+    unsigned int d_edgeCount;
+    double d_minX, d_minY, d_maxX, d_maxY;
+
+    unsigned int d_meshNodeCount;
+    unsigned int d_meshFaceCount;
+    GatherPlan *d_nodePlan;
+    GatherPlan *d_facePlan;
+
+    RestrictionResult(const RestrictionResult &);
+    RestrictionResult &operator=(const RestrictionResult &);
+
+public:
+    RestrictionResult(unsigned int meshNodeCount, unsigned int meshFaceCount, std::vector<unsigned int> *nodes,
+        std::vector<unsigned int> *faces);
+    ~RestrictionResult();
+
+    static std::string makeKey(unsigned int location, const std::string &filterExpression);
+
+    const std::vector<unsigned int> &nodes() const
+    {
+        return d_nodes;
+    }
+
+    const std::vector<unsigned int> &faces() const
+    {
+        return d_faces;
+    }
+
+    bool empty() const
+    {
+        return d_nodes.empty();
+    }
+
+    void measure(const MeshGeometry *geometry);
+
+    /**
+     * The number of distinct edges of the faces in the subset; zero until
+     * measure() is called.
+     */
+    unsigned int edgeCount() const
+    {
+        return d_edgeCount;
+    }
+
+    /**
+     * The bounding box of the nodes in the subset; all NaN if it is empty or
+     * until measure() is called.
+     */
+    double minX() const
+    {
+        return d_minX;
+    }
+
+    double minY() const
+    {
+        return d_minY;
+    }
+
+    double maxX() const
+    {
+        return d_maxX;
+    }
+
+    double maxY() const
+    {
+        return d_maxY;
+    }
+
+    const GatherPlan *nodePlan();
+    const GatherPlan *facePlan();
+
+    unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _RestrictionResult_h
@@ -0,0 +1,723 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Error.h"
+
+#include "BESDebug.h"
+#include "BESIndent.h"
+
+#include "MeshGeometry.h"
+#include "SharedMeshStore.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+static const char SHARED_MESH_MAGIC[8] = { 'U', 'G', 'R', 'I', 'D', 'M', 'S', 'H' };
+static const uint32_t SHARED_MESH_VERSION = 1;
+
+static const char SHARED_SUBSET_MAGIC[8] = { 'U', 'G', 'R', 'I', 'D', 'S', 'U', 'B' };
+static const uint32_t SHARED_SUBSET_VERSION = 1;
+
+// A failed build is reported to the processes that waited for it for this
+// many seconds; after that the next request tries the build again.
+static const time_t FAILURE_LIFETIME = 10;
+
+// Temporary files older than this many seconds were left by a process that
+// died while it wrote them.
+static const time_t STALE_FILE_AGE = 3600;
+
+// The longest pause, in microseconds, between attempts to take a build lock.
+static const useconds_t BUILD_LOCK_MAX_PAUSE = 50000;
+
+/**
+ * The start of a shared mesh file. The offsets are from the start of the
+ * file and the arrays are aligned to eight bytes.
+ */
+struct SharedMeshHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t faceCount;
+    uint32_t nodesPerFace;
+    int32_t startIndex;
+    uint32_t facesFirst;
+    uint64_t generation;
+    uint64_t totalBytes;
+    uint64_t keyOffset;
+    uint64_t keyLength;
+    uint64_t stampOffset;
+    uint64_t stampLength;
+    uint64_t nodeXOffset;
+    uint64_t nodeYOffset;
+    uint64_t faceNodesOffset;
+};
+
+/**
+ * The start of a shared subset file; the key, the stamp and then (aligned to
+ * four bytes) the node and face indices follow it.
+ */
+struct SharedSubsetHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t faceCount;
+    uint32_t keyLength;
+    uint32_t stampLength;
+    uint32_t reserved;
+};
+
+/**
+ * A read-only mapping of a shared mesh file, which the MeshGeometry made over
+ * it deletes.
+ */
+class SharedMeshMapping: public MeshGeometryStorage {
+private:
+    void *d_address;
+    size_t d_length;
+
+public:
+    SharedMeshMapping(void *address, size_t length) :
+        d_address(address), d_length(length)
+    {
+    }
+
+    virtual ~SharedMeshMapping()
+    {
+        munmap(d_address, d_length);
+    }
+};
+
+static uint64_t align8(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+/**
+ * @return True if the region [offset, offset + bytes) is inside a file of
+ * the given size.
+ */
+static bool inside(uint64_t offset, uint64_t bytes, uint64_t size)
+{
+    return offset <= size && bytes <= size - offset;
+}
+
+/**
+ * @return True if the header describes a whole file of the given size.
+ */
+static bool validHeader(const SharedMeshHeader *header, uint64_t size)
+{
+    return memcmp(header->magic, SHARED_MESH_MAGIC, sizeof(SHARED_MESH_MAGIC)) == 0
+        && header->version == SHARED_MESH_VERSION && header->totalBytes == size
+        && inside(header->keyOffset, header->keyLength, size) && inside(header->stampOffset, header->stampLength, size)
+        && inside(header->nodeXOffset, (uint64_t) header->nodeCount * sizeof(double), size)
+        && inside(header->nodeYOffset, (uint64_t) header->nodeCount * sizeof(double), size)
+        && inside(header->faceNodesOffset,
+            (uint64_t) header->faceCount * header->nodesPerFace * sizeof(unsigned int), size);
+}
+
+SharedMeshStore *SharedMeshStore::d_instance = 0;
+
+SharedMeshStore::SharedMeshStore() :
+    d_buildTimeout(UGRID_SHARED_CACHE_DEFAULT_BUILD_TIMEOUT),
+        d_maxBytes(UGRID_SHARED_CACHE_DEFAULT_MAX_MEGABYTES * 1024UL * 1024UL), d_attached(0), d_published(0),
+        d_failures(0), d_waits(0), d_timeouts(0), d_buildErrors(0), d_evicted(0)
+{
+}
+
+SharedMeshStore *SharedMeshStore::TheStore()
+{
+    if (!d_instance) d_instance = new SharedMeshStore();
+
+    return d_instance;
+}
+
+void SharedMeshStore::delete_instance()
+{
+    delete d_instance;
+    d_instance = 0;
+}
+
+/**
+ * @return The name of the key's file with the given suffix. Keys hold
+ * dataset path names, so the file is named by a hash (64-bit FNV-1a) of
+ * the key; the key itself is kept in the file and checked when it is
+ * attached.
+ */
+string SharedMeshStore::path(const string &key, const string &suffix) const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::const_iterator it = key.begin(); it != key.end(); ++it) {
+        hash ^= (unsigned char) *it;
+        hash *= 1099511628211ULL;
+    }
+
+    ostringstream oss;
+    oss << d_directory << "/" << hex;
+    oss.width(16);
+    oss.fill('0');
+    oss << hash << suffix;
+    return oss.str();
+}
+
+bool SharedMeshStore::prepareDirectory()
+{
+    if (mkdir(d_directory.c_str(), 0755) == 0 || errno == EEXIST) return true;
+
+    BESDEBUG("ugrid",
+        "SharedMeshStore::prepareDirectory() - Could not make '" << d_directory << "': " << strerror(errno) << endl);
+    return false;
+}
+
+/**
+ * Write contents to the key's file with the given suffix. The file is
+ * written under a temporary name and renamed into place, so readers see
+ * either the old file or the whole new one.
+ */
+bool SharedMeshStore::writeFile(const string &key, const string &suffix, const string &contents)
+{
+    if (!enabled() || !prepareDirectory()) return false;
+
+    ostringstream tempSuffix;
+    tempSuffix << suffix << "." << getpid() << ".tmp";
+    string tempFile = path(key, tempSuffix.str());
+
+    int fd = open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ++d_failures;
+        return false;
+    }
+
+    const char *data = contents.data();
+    size_t remaining = contents.size();
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) break;
+        data += written;
+        remaining -= written;
+    }
+
+    if (close(fd) != 0 || remaining > 0 || rename(tempFile.c_str(), path(key, suffix).c_str()) != 0) {
+        unlink(tempFile.c_str());
+        ++d_failures;
+        return false;
+    }
+
+    return true;
+}
+
+bool SharedMeshStore::readFile(const string &key, const string &suffix, string *contents) const
+{
+    int fd = open(path(key, suffix).c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0) {
+        close(fd);
+        return false;
+    }
+
+    contents->resize(buf.st_size);
+    size_t done = 0;
+    while (done < contents->size()) {
+        ssize_t got = read(fd, &(*contents)[done], contents->size() - done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        done += got;
+    }
+    close(fd);
+
+    return done == contents->size();
+}
+
+/**
+ * A mesh or subset file in the store, as seen by sweep().
+ */
+struct StoreFile {
+    string path;
+    string stem;
+    double used;
+    unsigned long bytes;
+
+    bool operator<(const StoreFile &other) const
+    {
+        return used < other.used;
+    }
+};
+
+static bool hasSuffix(const string &name, const string &suffix)
+{
+    return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Remove a lock file if no process holds it.
+ */
+static bool removeUnheldLock(const string &lockFile)
+{
+    int fd = open(lockFile.c_str(), O_RDWR);
+    if (fd < 0) return false;
+
+    bool removed = flock(fd, LOCK_EX | LOCK_NB) == 0 && unlink(lockFile.c_str()) == 0;
+    close(fd);
+    return removed;
+}
+
+/**
+ * Remove the meshes and subsets least recently attached until the directory
+ * holds no more than the budget less the bytes about to be written, and the
+ * files that builds leave behind: errors past their lifetime, temporary
+ * files older than STALE_FILE_AGE and the locks of keys that have no mesh
+ * or subset and that no process holds. Files are counted by the blocks they
+ * use, so a small subset costs at least a page. This reads the directory,
+ * which is cheap next to the build that precedes a publish.
+ *
+ * A process that opened a lock just before it is removed may build at the
+ * same time as one that makes a new lock; both results are whole, so the
+ * cost is only the second build.
+ */
+void SharedMeshStore::sweep(unsigned long bytes)
+{
+    DIR *dir = opendir(d_directory.c_str());
+    if (!dir) return;
+
+    // The new file will use whole pages, too.
+    unsigned long page = sysconf(_SC_PAGESIZE);
+    bytes = (bytes + page - 1) / page * page;
+
+    vector<StoreFile> files;
+    vector<string> locks;
+    unsigned long total = 0;
+    time_t now = time(0);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != 0) {
+        string name = entry->d_name;
+        string file = d_directory + "/" + name;
+        struct stat buf;
+        if (name[0] == '.' || stat(file.c_str(), &buf) != 0) continue;
+
+        if (hasSuffix(name, ".mesh") || hasSuffix(name, ".subset")) {
+            StoreFile sf;
+            sf.path = file;
+            sf.stem = name.substr(0, name.find('.'));
+            sf.used = buf.st_mtim.tv_sec + buf.st_mtim.tv_nsec / 1e9;
+            sf.bytes = buf.st_blocks * 512UL;
+            files.push_back(sf);
+            total += sf.bytes;
+        }
+        else if (hasSuffix(name, ".lock")) {
+            locks.push_back(name.substr(0, name.find('.')));
+        }
+        else if ((hasSuffix(name, ".err") && now - buf.st_mtime > FAILURE_LIFETIME)
+            || (hasSuffix(name, ".tmp") && now - buf.st_mtime > STALE_FILE_AGE)) {
+            unlink(file.c_str());
+        }
+    }
+    closedir(dir);
+
+    sort(files.begin(), files.end());
+    vector<string> kept;
+    for (vector<StoreFile>::iterator it = files.begin(); it != files.end(); ++it) {
+        if (d_maxBytes > 0 && total + bytes > d_maxBytes && unlink(it->path.c_str()) == 0) {
+            total -= it->bytes;
+            ++d_evicted;
+            BESDEBUG("ugrid", "SharedMeshStore::sweep() - Removed " << it->path << " (" << it->bytes << " bytes)" << endl);
+        }
+        else {
+            kept.push_back(it->stem);
+        }
+    }
+
+    sort(kept.begin(), kept.end());
+    for (vector<string>::iterator it = locks.begin(); it != locks.end(); ++it)
+        if (!binary_search(kept.begin(), kept.end(), *it)) removeUnheldLock(d_directory + "/" + *it + ".lock");
+}
+
+static double secondsSince(const struct timeval &start)
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+}
+
+/**
+ * Take the key's build lock, waiting for at most the store's build timeout.
+ * The lock is polled rather than waited on, since a blocking flock() can only
+ * be given a timeout with a signal and the BES uses those for itself.
+ */
+SharedMeshStore::BuildLock::BuildLock(SharedMeshStore *store, const string &key) :
+    d_fd(-1), d_waited(false), d_timedOut(false)
+{
+    if (!store->enabled() || !store->prepareDirectory()) return;
+
+    string lockFile = store->path(key, ".lock");
+    int fd = open(lockFile.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+
+    struct timeval start;
+    gettimeofday(&start, 0);
+    useconds_t pause = 1000;
+    while (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EINTR) continue;
+        if (errno != EWOULDBLOCK) {
+            close(fd);
+            return;
+        }
+
+        d_waited = true;
+        if (store->d_buildTimeout > 0 && secondsSince(start) >= store->d_buildTimeout) {
+            BESDEBUG("ugrid",
+                "SharedMeshStore::BuildLock() - Gave up waiting for the build of '" << key << "' after " << store->d_buildTimeout << " seconds." << endl);
+            ++store->d_timeouts;
+            d_timedOut = true;
+            close(fd);
+            return;
+        }
+
+        usleep(pause);
+        if (pause < BUILD_LOCK_MAX_PAUSE) pause *= 2;
+    }
+
+    if (d_waited) ++store->d_waits;
+    d_fd = fd;
+}
+
+SharedMeshStore::BuildLock::~BuildLock()
+{
+    if (d_fd >= 0) {
+        flock(d_fd, LOCK_UN);
+        close(d_fd);
+    }
+}
+
+/**
+ * @return A geometry over the shared copy of the mesh, or null if there is
+ * none, or it was made from another version of the dataset (its stamp
+ * differs), or the store is disabled. The caller owns the geometry; the
+ * mapping is released when it is deleted.
+ */
+MeshGeometry *SharedMeshStore::attach(const string &key, const string &stamp)
+{
+    if (!enabled()) return 0;
+
+    int fd = open(path(key, ".mesh").c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || (uint64_t) buf.st_size < sizeof(SharedMeshHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = buf.st_size;
+    void *address = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) return 0;
+
+    const char *base = (const char *) address;
+    const SharedMeshHeader *header = (const SharedMeshHeader *) address;
+    if (!validHeader(header, size) || string(base + header->keyOffset, header->keyLength) != key) {
+        munmap(address, size);
+        return 0;
+    }
+
+    if (string(base + header->stampOffset, header->stampLength) != stamp) {
+        BESDEBUG("ugrid",
+            "SharedMeshStore::attach() - Generation " << header->generation << " of '" << key << "' is stale." << endl);
+        munmap(address, size);
+        return 0;
+    }
+
+    MeshGeometry *geometry = new MeshGeometry((const double *) (base + header->nodeXOffset),
+        (const double *) (base + header->nodeYOffset), header->nodeCount,
+        (const unsigned int *) (base + header->faceNodesOffset), header->faceCount, header->nodesPerFace,
+        new SharedMeshMapping(address, size));
+    geometry->setSourceLayout(header->startIndex, header->facesFirst != 0);
+
+    // Record the use, so sweep() removes the meshes that are not used.
+    utimes(path(key, ".mesh").c_str(), 0);
+
+    ++d_attached;
+    BESDEBUG("ugrid",
+        "SharedMeshStore::attach() - Attached generation " << header->generation << " of '" << key << "' (" << size << " bytes)" << endl);
+
+    return geometry;
+}
+
+/**
+ * Write the geometry to the store, replacing any copy made from another
+ * version of the dataset, and attach to what was written. The caller should
+ * hold the mesh's BuildLock.
+ *
+ * @return A geometry over the shared copy, which the caller owns, or null if
+ * the mesh could not be written (e.g., the file system is full); the caller
+ * then keeps using its own geometry.
+ */
+MeshGeometry *SharedMeshStore::publish(const string &key, const string &stamp, const MeshGeometry *geometry)
+{
+    if (!enabled() || !prepareDirectory()) return 0;
+
+    string meshFile = path(key, ".mesh");
+
+    SharedMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHARED_MESH_MAGIC, sizeof(SHARED_MESH_MAGIC));
+    header.version = SHARED_MESH_VERSION;
+    header.nodeCount = geometry->nodeCount();
+    header.faceCount = geometry->faceCount();
+    header.nodesPerFace = geometry->nodesPerFace();
+    header.startIndex = geometry->startIndex();
+    header.facesFirst = geometry->facesFirst();
+
+    // The generation follows that of the file being replaced.
+    header.generation = 1;
+    int oldFd = open(meshFile.c_str(), O_RDONLY);
+    if (oldFd >= 0) {
+        SharedMeshHeader old;
+        if (read(oldFd, &old, sizeof(old)) == (ssize_t) sizeof(old)
+            && memcmp(old.magic, SHARED_MESH_MAGIC, sizeof(SHARED_MESH_MAGIC)) == 0)
+            header.generation = old.generation + 1;
+        close(oldFd);
+    }
+
+    header.keyOffset = sizeof(SharedMeshHeader);
+    header.keyLength = key.size();
+    header.stampOffset = header.keyOffset + header.keyLength;
+    header.stampLength = stamp.size();
+    header.nodeXOffset = align8(header.stampOffset + header.stampLength);
+    header.nodeYOffset = header.nodeXOffset + (uint64_t) header.nodeCount * sizeof(double);
+    header.faceNodesOffset = header.nodeYOffset + (uint64_t) header.nodeCount * sizeof(double);
+    header.totalBytes = header.faceNodesOffset
+        + (uint64_t) header.faceCount * header.nodesPerFace * sizeof(unsigned int);
+
+    sweep(header.totalBytes);
+
+    ostringstream suffix;
+    suffix << "." << getpid() << ".tmp";
+    string tempFile = path(key, suffix.str());
+
+    int fd = open(tempFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ++d_failures;
+        return 0;
+    }
+
+    // Reserve the space first; a write to a mapping of a file system that
+    // then turns out to be full would be a SIGBUS.
+    void *address = MAP_FAILED;
+    if (posix_fallocate(fd, 0, header.totalBytes) == 0)
+        address = mmap(0, header.totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (address == MAP_FAILED) {
+        BESDEBUG("ugrid",
+            "SharedMeshStore::publish() - Could not write " << header.totalBytes << " bytes for '" << key << "'" << endl);
+        unlink(tempFile.c_str());
+        ++d_failures;
+        return 0;
+    }
+
+    char *base = (char *) address;
+    memcpy(base, &header, sizeof(header));
+    memcpy(base + header.keyOffset, key.data(), key.size());
+    memcpy(base + header.stampOffset, stamp.data(), stamp.size());
+    if (header.nodeCount > 0) {
+        memcpy(base + header.nodeXOffset, geometry->nodeXArray(), header.nodeCount * sizeof(double));
+        memcpy(base + header.nodeYOffset, geometry->nodeYArray(), header.nodeCount * sizeof(double));
+    }
+    if (header.faceCount > 0 && header.nodesPerFace > 0)
+        memcpy(base + header.faceNodesOffset, geometry->faceNodeArray(),
+            (size_t) header.faceCount * header.nodesPerFace * sizeof(unsigned int));
+    munmap(address, header.totalBytes);
+
+    if (rename(tempFile.c_str(), meshFile.c_str()) != 0) {
+        unlink(tempFile.c_str());
+        ++d_failures;
+        return 0;
+    }
+
+    ++d_published;
+    unlink(path(key, ".err").c_str());
+    BESDEBUG("ugrid",
+        "SharedMeshStore::publish() - Wrote generation " << header.generation << " of '" << key << "' to " << meshFile << endl);
+
+    return attach(key, stamp);
+}
+
+/**
+ * Copy the shared node and face subset for key into nodes and faces.
+ *
+ * @return False if there is none, or it was made from another version of
+ * the dataset, or the store is disabled.
+ */
+bool SharedMeshStore::attachSubset(const string &key, const string &stamp, vector<unsigned int> *nodes,
+    vector<unsigned int> *faces)
+{
+    string contents;
+    if (!enabled() || !readFile(key, ".subset", &contents) || contents.size() < sizeof(SharedSubsetHeader))
+        return false;
+
+    SharedSubsetHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    if (memcmp(header.magic, SHARED_SUBSET_MAGIC, sizeof(SHARED_SUBSET_MAGIC)) != 0
+        || header.version != SHARED_SUBSET_VERSION)
+        return false;
+
+    uint64_t indexOffset = align8(sizeof(header) + (uint64_t) header.keyLength + header.stampLength);
+    uint64_t indexBytes = ((uint64_t) header.nodeCount + header.faceCount) * sizeof(unsigned int);
+    if (indexOffset + indexBytes != contents.size()
+        || contents.compare(sizeof(header), header.keyLength, key) != 0
+        || contents.compare(sizeof(header) + header.keyLength, header.stampLength, stamp) != 0)
+        return false;
+
+    const unsigned int *indices = (const unsigned int *) (contents.data() + indexOffset);
+    nodes->assign(indices, indices + header.nodeCount);
+    faces->assign(indices + header.nodeCount, indices + header.nodeCount + header.faceCount);
+
+    // Record the use, as attach() does.
+    utimes(path(key, ".subset").c_str(), 0);
+
+    ++d_attached;
+    BESDEBUG("ugrid",
+        "SharedMeshStore::attachSubset() - Attached '" << key << "' (" << nodes->size() << " nodes, " << faces->size() << " faces)" << endl);
+
+    return true;
+}
+
+/**
+ * Write a node and face subset to the store. The caller should hold its
+ * BuildLock.
+ *
+ * @return False if the subset could not be written.
+ */
+bool SharedMeshStore::publishSubset(const string &key, const string &stamp, const vector<unsigned int> &nodes,
+    const vector<unsigned int> &faces)
+{
+    SharedSubsetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHARED_SUBSET_MAGIC, sizeof(SHARED_SUBSET_MAGIC));
+    header.version = SHARED_SUBSET_VERSION;
+    header.nodeCount = nodes.size();
+    header.faceCount = faces.size();
+    header.keyLength = key.size();
+    header.stampLength = stamp.size();
+
+    string contents((const char *) &header, sizeof(header));
+    contents += key;
+    contents += stamp;
+    contents.resize(align8(contents.size()), '\0');
+    if (!nodes.empty()) contents.append((const char *) &nodes[0], nodes.size() * sizeof(unsigned int));
+    if (!faces.empty()) contents.append((const char *) &faces[0], faces.size() * sizeof(unsigned int));
+
+    if (enabled()) sweep(contents.size());
+    if (!writeFile(key, ".subset", contents)) return false;
+
+    ++d_published;
+    unlink(path(key, ".err").c_str());
+    return true;
+}
+
+/**
+ * Record that the build of key failed, so the processes waiting for it can
+ * report the same error (see rethrowFailure()). The caller should hold the
+ * key's BuildLock.
+ */
+void SharedMeshStore::recordFailure(const string &key, const string &stamp, int code, const string &message)
+{
+    ostringstream oss;
+    oss << stamp << "\n" << code << "\n" << message;
+    if (writeFile(key, ".err", oss.str())) ++d_buildErrors;
+}
+
+/**
+ * If the last build of key, from this version of the dataset, failed in the
+ * past few seconds, throw its error.
+ */
+void SharedMeshStore::rethrowFailure(const string &key, const string &stamp)
+{
+    struct stat buf;
+    string contents;
+    if (!enabled() || stat(path(key, ".err").c_str(), &buf) != 0 || time(0) - buf.st_mtime > FAILURE_LIFETIME
+        || !readFile(key, ".err", &contents))
+        return;
+
+    istringstream iss(contents);
+    string recordedStamp, message, line;
+    int code = unknown_error;
+    getline(iss, recordedStamp);
+    iss >> code;
+    getline(iss, line);
+    while (getline(iss, line))
+        message += (message.empty() ? "" : "\n") + line;
+
+    if (recordedStamp != stamp) return;
+
+    BESDEBUG("ugrid", "SharedMeshStore::rethrowFailure() - The build of '" << key << "' failed: " << message << endl);
+    throw Error(code, message);
+}
+
+void SharedMeshStore::dump(ostream &strm) const
+{
+    strm << BESIndent::LMarg << "SharedMeshStore::dump - (" << (void *) this << ")" << endl;
+    BESIndent::Indent();
+    strm << BESIndent::LMarg << "directory: " << (enabled() ? d_directory : "(disabled)") << endl;
+    strm << BESIndent::LMarg << "build timeout: " << d_buildTimeout << " seconds" << endl;
+    strm << BESIndent::LMarg << "max bytes: " << d_maxBytes << "  evicted: " << d_evicted << endl;
+    strm << BESIndent::LMarg << "attached: " << d_attached << "  published: " << d_published << "  failures: "
+        << d_failures << endl;
+    strm << BESIndent::LMarg << "waits: " << d_waits << "  timeouts: " << d_timeouts << "  build errors: "
+        << d_buildErrors << endl;
+    BESIndent::UnIndent();
+}
+
+} // namespace ugrid
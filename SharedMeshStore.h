@@ -0,0 +1,212 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _SharedMeshStore_h
+#define _SharedMeshStore_h 1
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace ugrid {
+
+class MeshGeometry;
+
+#define UGRID_SHARED_CACHE_DIRECTORY_KEY "UgridFunctions.SharedCache.Directory"
+#define UGRID_SHARED_CACHE_BUILD_TIMEOUT_KEY "UgridFunctions.SharedCache.BuildTimeout"
+#define UGRID_SHARED_CACHE_DEFAULT_BUILD_TIMEOUT 60
+#define UGRID_SHARED_CACHE_MAX_MEGABYTES_KEY "UgridFunctions.SharedCache.MaxMegabytes"
+#define UGRID_SHARED_CACHE_DEFAULT_MAX_MEGABYTES 1024
+
+/**
+ * Mesh geometries (node coordinates and face node connectivity) shared by
+ * all the BES processes on a host. The BES forks a beslistener for each
+ * connection, so the MeshGeometryCache of one process does not help the
+ * others; with this store the first process to read a mesh writes it to a
+ * file in a directory that should be on a memory file system (e.g.,
+ * /dev/shm/ugrid_functions) and every process maps that file read-only, so
+ * there is one copy of each mesh on the host.
+ *
+ * There is one file per mesh, named by a hash of its cache key. A file is
+ * written under a temporary name and renamed into place once complete, so
+ * readers take no locks: whatever file they open is whole. Only one process
+ * builds a given mesh at a time; the others wait on the mesh's lock file
+ * (see BuildLock) and then attach to what it wrote. Each file records the
+ * dataset stamp it was made from (see MeshGeometryCache::makeStamp()); a
+ * file with a different stamp is stale and is replaced by the next build,
+ * which gives the new file the next generation number. Processes that have
+ * the old file mapped keep using it until they let it go.
+ *
+ * The same is done for the node and face subsets that restrictions of a
+ * mesh produce (see ugct()), so when many requests for a new dataset arrive
+ * at once, one process builds each mesh and each subset while the others
+ * wait for it and then share the result. A wait is given up after the
+ * build timeout, and the waiting process then builds its own copy. If the
+ * build fails, its error is recorded for a short time so the processes that
+ * waited for it report the same error rather than each repeating the build.
+ *
+ * The directory is held to a budget (see setMaxBytes()): before a mesh or
+ * subset is written, the meshes and subsets least recently attached are
+ * removed until it fits, along with the lock, error and temporary files
+ * that are no longer needed. A file's modification time records when it
+ * was last attached. Processes that have a removed file mapped keep using
+ * it until they let it go.
+ *
+ * The spatial indexes and other products built from a geometry are still
+ * made by each process that needs them.
+ */
+class SharedMeshStore {
+
+private:
+    std::string d_directory;
+    unsigned int d_buildTimeout;
+    unsigned long d_maxBytes;
+
+    unsigned long d_attached;
+    unsigned long d_published;
+    unsigned long d_failures;
+    unsigned long d_waits;
+    unsigned long d_timeouts;
+    unsigned long d_buildErrors;
+    unsigned long d_evicted;
+
+    static SharedMeshStore *d_instance;
+
+    SharedMeshStore();
+
+    std::string path(const std::string &key, const std::string &suffix) const;
+    bool prepareDirectory();
+    bool writeFile(const std::string &key, const std::string &suffix, const std::string &contents);
+    bool readFile(const std::string &key, const std::string &suffix, std::string *contents) const;
+    void sweep(unsigned long bytes);
+
+    SharedMeshStore(const SharedMeshStore &);
+    SharedMeshStore &operator=(const SharedMeshStore &);
+
+public:
+    /**
+     * Holds the lock that makes a process (or thread) the only one building
+     * a mesh or subset; it is released when the instance is destroyed. If
+     * another holds the lock, this waits for it, for at most the build
+     * timeout. If the store is disabled, the lock file cannot be made or the
+     * wait times out, nothing is locked.
+     */
+    class BuildLock {
+    private:
+        int d_fd;
+        bool d_waited;
+        bool d_timedOut;
+
+        BuildLock(const BuildLock &);
+        BuildLock &operator=(const BuildLock &);
+
+    public:
+        BuildLock(SharedMeshStore *store, const std::string &key);
+        ~BuildLock();
+
+        bool locked() const
+        {
+            return d_fd >= 0;
+        }
+
+        /**
+         * @return True if another process held the lock when this was made.
+         */
+        bool waited() const
+        {
+            return d_waited;
+        }
+
+        bool timedOut() const
+        {
+            return d_timedOut;
+        }
+    };
+
+    static SharedMeshStore *TheStore();
+    static void delete_instance();
+
+    /**
+     * Use the directory for the store; the empty string disables it.
+     */
+    void setDirectory(const std::string &directory)
+    {
+        d_directory = directory;
+    }
+
+    const std::string &getDirectory() const
+    {
+        return d_directory;
+    }
+
+    bool enabled() const
+    {
+        return !d_directory.empty();
+    }
+
+    /**
+     * Wait at most this many seconds for another process's build; zero
+     * waits as long as it takes.
+     */
+    void setBuildTimeout(unsigned int seconds)
+    {
+        d_buildTimeout = seconds;
+    }
+
+    unsigned int getBuildTimeout() const
+    {
+        return d_buildTimeout;
+    }
+
+    /**
+     * Hold the files in the directory to this many bytes; zero is no limit.
+     */
+    void setMaxBytes(unsigned long maxBytes)
+    {
+        d_maxBytes = maxBytes;
+    }
+
+    unsigned long getMaxBytes() const
+    {
+        return d_maxBytes;
+    }
+
+    MeshGeometry *attach(const std::string &key, const std::string &stamp);
+    MeshGeometry *publish(const std::string &key, const std::string &stamp, const MeshGeometry *geometry);
+
+    bool attachSubset(const std::string &key, const std::string &stamp, std::vector<unsigned int> *nodes,
+        std::vector<unsigned int> *faces);
+    bool publishSubset(const std::string &key, const std::string &stamp, const std::vector<unsigned int> &nodes,
+        const std::vector<unsigned int> &faces);
+
+    void recordFailure(const std::string &key, const std::string &stamp, int code, const std::string &message);
+    void rethrowFailure(const std::string &key, const std::string &stamp);
+
+    void dump(std::ostream &strm) const;
+};
+
+} // namespace ugrid
+
+#endif // _SharedMeshStore_h
@@ -0,0 +1,213 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <signal.h>
+
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "Error.h"
+#include "InternalErr.h"
+#include "BESError.h"
+
+#include "ModuleExecutor.h"
+#include "SlabPipeline.h"
+
+using namespace std;
+
+namespace ugrid {
+
+unsigned int SlabPipeline::d_depth = UGRID_SLAB_PIPELINE_DEFAULT_DEPTH;
+
+/**
+ * Make a pipeline of depth buffers (at least one) of bufferBytes each. The
+ * reader thread is not started until start() is called.
+ */
+SlabPipeline::SlabPipeline(unsigned int depth, unsigned long bufferBytes) :
+    d_bufferBytes(bufferBytes), d_head(0), d_tail(0), d_started(false), d_done(false), d_cancelled(false),
+        d_error(0), d_producer(0), d_ownThread(false)
+{
+    if (depth < 1) depth = 1;
+
+    for (unsigned int i = 0; i < depth; ++i)
+        d_buffers.push_back(new char[bufferBytes > 0 ? bufferBytes : 1]);
+
+    pthread_mutex_init(&d_mutex, 0);
+    pthread_cond_init(&d_notFull, 0);
+    pthread_cond_init(&d_notEmpty, 0);
+}
+
+SlabPipeline::~SlabPipeline()
+{
+    if (d_started) finish();
+
+    for (vector<char *>::iterator it = d_buffers.begin(); it != d_buffers.end(); ++it)
+        delete[] *it;
+    delete d_error;
+
+    pthread_cond_destroy(&d_notEmpty);
+    pthread_cond_destroy(&d_notFull);
+    pthread_mutex_destroy(&d_mutex);
+}
+
+/**
+ * Start the reader, which calls producer->run(). A reader thread of the
+ * pipeline's own blocks all signals, as the executor's do, so that those
+ * meant for the BES (e.g., its timeout alarm) are handled by the thread
+ * that made the pipeline.
+ */
+void SlabPipeline::start(Producer *producer)
+{
+    if (d_started) throw libdap::InternalErr(__FILE__, __LINE__, "SlabPipeline::start() - Already started.");
+
+    d_producer = producer;
+    d_started = true;
+
+    d_job.pipeline = this;
+    if (ModuleExecutor::TheExecutor()->runNow(&d_job)) return;
+
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    int status = pthread_create(&d_thread, 0, runProducer, this);
+    pthread_sigmask(SIG_SETMASK, &previous, 0);
+
+    if (status != 0) {
+        d_started = false;
+        throw libdap::InternalErr(__FILE__, __LINE__, "SlabPipeline::start() - Could not start the reader thread.");
+    }
+
+    d_ownThread = true;
+}
+
+void *SlabPipeline::runProducer(void *arg)
+{
+    SlabPipeline *pipeline = static_cast<SlabPipeline *>(arg);
+
+    libdap::Error *error = 0;
+    try {
+        pipeline->d_producer->run(pipeline);
+    }
+    catch (libdap::Error &e) {
+        error = new libdap::Error(e);
+    }
+    catch (BESError &e) {
+        error = new libdap::Error(internal_error, e.get_message());
+    }
+    catch (std::exception &e) {
+        error = new libdap::InternalErr(__FILE__, __LINE__, string("SlabPipeline - ") + e.what());
+    }
+    catch (...) {
+        error = new libdap::InternalErr(__FILE__, __LINE__, "SlabPipeline - Unknown error while reading a slab.");
+    }
+
+    pthread_mutex_lock(&pipeline->d_mutex);
+    pipeline->d_error = error;
+    pipeline->d_done = true;
+    pthread_cond_broadcast(&pipeline->d_notEmpty);
+    pthread_mutex_unlock(&pipeline->d_mutex);
+
+    return 0;
+}
+
+/**
+ * Stop the producer, if it is still running, and wait for it to return.
+ */
+void SlabPipeline::finish()
+{
+    pthread_mutex_lock(&d_mutex);
+    d_cancelled = true;
+    pthread_cond_broadcast(&d_notFull);
+    if (!d_ownThread) {
+        while (!d_done)
+            pthread_cond_wait(&d_notEmpty, &d_mutex);
+    }
+    pthread_mutex_unlock(&d_mutex);
+
+    if (d_ownThread) pthread_join(d_thread, 0);
+    d_started = false;
+}
+
+/**
+ * Wait for an empty buffer.
+ *
+ * @return The buffer, or null if the consumer has stopped, in which case the
+ * producer should return.
+ */
+void *SlabPipeline::nextEmpty()
+{
+    pthread_mutex_lock(&d_mutex);
+    while (!d_cancelled && d_tail - d_head >= d_buffers.size())
+        pthread_cond_wait(&d_notFull, &d_mutex);
+
+    char *buffer = d_cancelled ? 0 : d_buffers[d_tail % d_buffers.size()];
+    pthread_mutex_unlock(&d_mutex);
+
+    return buffer;
+}
+
+void SlabPipeline::filled()
+{
+    pthread_mutex_lock(&d_mutex);
+    ++d_tail;
+    pthread_cond_signal(&d_notEmpty);
+    pthread_mutex_unlock(&d_mutex);
+}
+
+/**
+ * Wait for the next full buffer.
+ *
+ * @return The buffer, or null once the producer has returned and every
+ * buffer it filled has been consumed.
+ * @exception Error The producer's error, once the buffers it filled before
+ * it failed have been consumed.
+ */
+void *SlabPipeline::nextFull()
+{
+    pthread_mutex_lock(&d_mutex);
+    while (d_head == d_tail && !d_done)
+        pthread_cond_wait(&d_notEmpty, &d_mutex);
+
+    char *buffer = (d_head != d_tail) ? d_buffers[d_head % d_buffers.size()] : 0;
+    libdap::Error *error = (buffer == 0) ? d_error : 0;
+    pthread_mutex_unlock(&d_mutex);
+
+    if (error) throw libdap::Error(*error);
+
+    return buffer;
+}
+
+void SlabPipeline::consumed()
+{
+    pthread_mutex_lock(&d_mutex);
+    ++d_head;
+    pthread_cond_signal(&d_notFull);
+    pthread_mutex_unlock(&d_mutex);
+}
+
+} // namespace ugrid
@@ -0,0 +1,155 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _SlabPipeline_h
+#define _SlabPipeline_h 1
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "ModuleExecutor.h"
+
+namespace libdap {
+class Error;
+}
+
+namespace ugrid {
+
+#define UGRID_SLAB_PIPELINE_DEPTH_KEY "UgridFunctions.SlabPipeline.Depth"
+#define UGRID_SLAB_PIPELINE_DEFAULT_DEPTH 0
+
+/**
+ * A bounded ring of slab buffers filled by a reader thread and emptied by the
+ * thread that made the pipeline, so that reading (and decompressing) the next
+ * slabs of a range variable overlaps with gathering the current one.
+ *
+ * The reader is a Producer whose run() loops over the slabs, asking for an
+ * empty buffer with nextEmpty() and handing it back with filled(). The
+ * consumer takes the buffers, in the order they were filled, with nextFull()
+ * and returns them with consumed(). If the producer throws, the buffers it
+ * filled before that are still delivered and then nextFull() throws the error
+ * as a libdap::Error. If the consumer stops early (e.g., it throws), the
+ * destructor stops the producer and waits for it.
+ *
+ * The reader runs on a thread of the ModuleExecutor if one is free, and on a
+ * thread of its own if not.
+ */
+class SlabPipeline {
+
+public:
+    /**
+     * The reader side of a pipeline; run() is called once, on the reader thread.
+     */
+    class Producer {
+    public:
+        virtual ~Producer()
+        {
+        }
+
+        virtual void run(SlabPipeline *pipeline) = 0;
+    };
+
+private:
+    class ProducerJob: public ModuleExecutor::Job {
+    public:
+        SlabPipeline *pipeline;
+
+        virtual void run()
+        {
+            runProducer(pipeline);
+        }
+    };
+
+    std::vector<char *> d_buffers;
+    unsigned long d_bufferBytes;
+
+    // Buffers [d_head, d_tail) are full; d_tail - d_head is at most the depth.
+    unsigned long d_head;
+    unsigned long d_tail;
+
+    bool d_started;
+    bool d_done;
+    bool d_cancelled;
+
+    // Set if the producer threw; thrown by nextFull() once the ring is empty.
+    libdap::Error *d_error;
+
+    Producer *d_producer;
+
+    // The reader is either d_job, run by the executor, or d_thread.
+    ProducerJob d_job;
+    bool d_ownThread;
+    pthread_t d_thread;
+    pthread_mutex_t d_mutex;
+    pthread_cond_t d_notFull;
+    pthread_cond_t d_notEmpty;
+
+    static unsigned int d_depth;
+
+    static void *runProducer(void *arg);
+    void finish();
+
+    SlabPipeline(const SlabPipeline &);
+    SlabPipeline &operator=(const SlabPipeline &);
+
+public:
+    SlabPipeline(unsigned int depth, unsigned long bufferBytes);
+    ~SlabPipeline();
+
+    void start(Producer *producer);
+
+    // Called by the producer.
+    void *nextEmpty();
+    void filled();
+
+    // Called by the consumer.
+    void *nextFull();
+    void consumed();
+
+    unsigned long bufferBytes() const
+    {
+        return d_bufferBytes;
+    }
+
+    /**
+     * @return The number of buffers the range variable readers use; below two,
+     * slabs are read and gathered one after the other on the calling thread.
+     */
+    static unsigned int getDepth()
+    {
+        return d_depth;
+    }
+
+    static void setDepth(unsigned int depth)
+    {
+        d_depth = depth;
+    }
+};
+
+} // namespace ugrid
+
+#endif // _SlabPipeline_h
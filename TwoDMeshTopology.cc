@@ -27,6 +27,8 @@
 
 #include "config.h"
 
+#include <climits>
+#include <limits>
 #include <sstream>
 #include <vector>
 #include <algorithm>
@@ -44,6 +46,8 @@
 
 #include "BaseType.h"
 #include "Int32.h"
+#include "Int64.h"
+#include "UInt64.h"
 #include "Float64.h"
 #include "Array.h"
 #include "util.h"
@@ -51,6 +55,9 @@
 #include "ugrid_utils.h"
 //#include "NDimensionalArray.h"
 #include "MeshDataVariable.h"
+#include "MeshGeometry.h"
+#include "MeshGeometryCache.h"
+#include "SharedMeshStore.h"
 #include "TwoDMeshTopology.h"
 
 #include "BESDebug.h"
@@ -70,7 +77,7 @@ namespace ugrid {
 /* not used. faceCoordinateNames(0), */
 TwoDMeshTopology::TwoDMeshTopology() :
     d_meshVar(0), nodeCoordinateArrays(0), nodeCount(0), faceNodeConnectivityArray(0), faceCount(0), faceCoordinateArrays(
-        0), gridTopology(0), d_inputGridField(0), resultGridField(0), fncCellArray(0), _initialized(false)
+        0), gridTopology(0), d_inputGridField(0), resultGridField(0), fncCellArray(0), d_geometry(0), d_ownsGeometry(false), _initialized(false)
 {
     rangeDataArrays = new vector<MeshDataVariable *>();
     sharedIntArrays = new vector<int *>();
@@ -128,6 +135,11 @@ TwoDMeshTopology::~TwoDMeshTopology()
     BESDEBUG("ugrid", "~TwoDMeshTopology() - Deleting face node connectivity cell array (GF::Node's)." << endl);
     delete[] fncCellArray;
 
+    if (d_ownsGeometry) {
+        BESDEBUG("ugrid", "~TwoDMeshTopology() - Deleting uncached MeshGeometry." << endl);
+        delete d_geometry;
+    }
+
     BESDEBUG("ugrid", "~TwoDMeshTopology() - END" << endl);
 }
 
@@ -727,11 +739,111 @@ void TwoDMeshTopology::buildBasicGfTopology()
     }
 }
 
-int TwoDMeshTopology::getResultGridSize(locationType dim)
+long TwoDMeshTopology::getResultGridSize(locationType dim)
 {
     return resultGridField->Size(dim);
 }
 
+/**
+ * @return True if the face node connectivity values are 64-bit integers.
+ */
+static bool isWideIndexType(libdap::Type type)
+{
+    return type == dods_int64_c || type == dods_uint64_c;
+}
+
+/**
+ * Read a face node connectivity array of 64-bit integers as GF::Node (int)
+ * values. A libdap dimension, and so the number of nodes, is an int, so a
+ * value outside the range of an int cannot be a node index; those (e.g., a
+ * 64-bit _FillValue) are stored as -1, the value a missing corner has in the
+ * face node connectivity of a result (see setFncValues()).
+ */
+static GF::Node *extractNarrowedIndices(libdap::Array *fncVar)
+{
+    fncVar->read();
+
+    long length = fncVar->length();
+    GF::Node *cells = new GF::Node[length];
+
+    if (fncVar->var()->type() == dods_int64_c) {
+        vector<dods_int64> wide(length);
+        fncVar->value(&wide[0]);
+        for (long i = 0; i < length; ++i)
+            cells[i] = (wide[i] < INT_MIN || wide[i] > INT_MAX) ? -1 : (GF::Node) wide[i];
+    }
+    else {
+        vector<dods_uint64> wide(length);
+        fncVar->value(&wide[0]);
+        for (long i = 0; i < length; ++i)
+            cells[i] = (wide[i] > (dods_uint64) INT_MAX) ? -1 : (GF::Node) wide[i];
+    }
+
+    return cells;
+}
+
+/**
+ * @return A new DAP Array, with no dimensions, for the face node connectivity
+ * of a result. Its type is the type of the source when that is a 64-bit
+ * integer and Int32 otherwise, so small meshes keep 32-bit indices.
+ */
+static libdap::Array *newFncArrayLike(libdap::Array *source)
+{
+    switch (source->var()->type()) {
+    case dods_int64_c:
+        return new libdap::Array(source->name(), new Int64(source->name()));
+    case dods_uint64_c:
+        return new libdap::Array(source->name(), new UInt64(source->name()));
+    default:
+        return new libdap::Array(source->name(), new Int32(source->name()));
+    }
+}
+
+/**
+ * @return The _FillValue of source as a T, or missing if it has none.
+ */
+template<typename T>
+static T getFillValue(libdap::Array *source, T missing)
+{
+    string fill = getAttributeValue(source, "_FillValue");
+    if (fill.empty()) return missing;
+
+    T value;
+    istringstream iss(fill);
+    return (iss >> value) ? value : missing;
+}
+
+template<typename T>
+static void setWidenedValues(libdap::Array *a, vector<dods_int32> &values, T missing)
+{
+    vector<T> wide(values.size());
+    for (unsigned long i = 0; i < values.size(); ++i)
+        wide[i] = (values[i] == -1) ? missing : (T) values[i];
+    a->set_value(wide, wide.size());
+}
+
+/**
+ * Set the values of an array made by newFncArrayLike() from source, widening
+ * them if it holds 64-bit integers. Missing corners (-1) become the
+ * _FillValue of source when it has one, so that the value read from the
+ * dataset comes back out; otherwise they stay -1 (Int64) or become the
+ * largest UInt64.
+ */
+static void setFncValues(libdap::Array *a, vector<dods_int32> &values, libdap::Array *source)
+{
+    switch (a->var()->type()) {
+    case dods_int64_c:
+        setWidenedValues<dods_int64>(a, values, getFillValue<dods_int64>(source, -1));
+        break;
+    case dods_uint64_c:
+        setWidenedValues<dods_uint64>(a, values, getFillValue<dods_uint64>(source, numeric_limits<dods_uint64>::max()));
+        break;
+    default:
+        a->set_value(values, values.size());
+        break;
+    }
+}
+
 /**
  * Takes a Face node connectivity DAP array, either Nx3 or 3xN,
  * and converts it to a collection GF::Cells organized as
@@ -746,8 +858,8 @@ GF::Node *TwoDMeshTopology::getFncArrayAsGFCells(libdap::Array *fncVar)
 {
     BESDEBUG("ugrid", "TwoDMeshTopology::getFncArrayAsGFCells() - BEGIN" << endl);
 
-    int nodesPerFace = fncVar->dimension_size(fncNodesDim, true);
-    int faceCount = fncVar->dimension_size(fncFacesDim, true);
+    long nodesPerFace = fncVar->dimension_size(fncNodesDim, true);
+    long faceCount = fncVar->dimension_size(fncFacesDim, true);
 
     GF::Node *cells = 0;        // return the result in this var
 
@@ -763,13 +875,16 @@ GF::Node *TwoDMeshTopology::getFncArrayAsGFCells(libdap::Array *fncVar)
             temp_nodes = new GF::Node[faceCount * nodesPerFace];
             fncVar->value(temp_nodes);
         }
+        else if (isWideIndexType(fncVar->var()->type())) {
+            temp_nodes = extractNarrowedIndices(fncVar);
+        }
         else {
             // cover the odd case when the FNC Array is not a int/uint.
             temp_nodes = ugrid::extractArray<GF::Node>(fncVar);
         }
 
-        for (int fIndex = 0; fIndex < faceCount; fIndex++) {
-            for (int nIndex = 0; nIndex < nodesPerFace; nIndex++) {
+        for (long fIndex = 0; fIndex < faceCount; fIndex++) {
+            for (long nIndex = 0; nIndex < nodesPerFace; nIndex++) {
                 cells[nodesPerFace * fIndex + nIndex] = *(temp_nodes + (fIndex + (faceCount * nIndex)));
             }
         }
@@ -785,6 +900,9 @@ GF::Node *TwoDMeshTopology::getFncArrayAsGFCells(libdap::Array *fncVar)
             cells = new GF::Node[faceCount * nodesPerFace];
             fncVar->value(cells);
         }
+        else if (isWideIndexType(fncVar->var()->type())) {
+            cells = extractNarrowedIndices(fncVar);
+        }
         else {
             // cover the odd case when the FNC Array is not a int/uint.
             cells = ugrid::extractArray<GF::Node>(fncVar);
@@ -834,7 +952,7 @@ GF::CellArray *TwoDMeshTopology::getFaceNodeConnectivityCells()
         "TwoDMeshTopology::getFaceNodeConnectivityCells() - Building face node connectivity Cell array from the Array '" << faceNodeConnectivityArray->name() << "'" << endl);
 
     int nodesPerFace = faceNodeConnectivityArray->dimension_size(fncNodesDim);
-    int total_size = nodesPerFace * faceCount;
+    long total_size = (long) nodesPerFace * faceCount;
 
     BESDEBUG("ugrid",
         "TwoDMeshTopology::getFaceNodeConnectivityCells() - Converting FNCArray to GF::Node array." << endl);
@@ -845,7 +963,7 @@ GF::CellArray *TwoDMeshTopology::getFaceNodeConnectivityCells()
     if (startIndex != 0) {
         BESDEBUG("ugrid",
             "TwoDMeshTopology::getFaceNodeConnectivityCells() - Applying startIndex to GF::Node array." << endl);
-        for (int j = 0; j < total_size; j++) {
+        for (long j = 0; j < total_size; j++) {
             fncCellArray[j] -= startIndex;
         }
     }
@@ -874,6 +992,9 @@ void TwoDMeshTopology::applyRestrictOperator(locationType loc, string filterExpr
     BESDEBUG("ugrid", "TwoDMeshTopology::applyRestrictOperator() - Applying GridField operator." << endl);
     GF::GridField *resultGF = op.getResult();
 
+    // The operator may be applied more than once to the same input (see ugnrb()); only
+    // the latest result is kept.
+    delete resultGridField;
     resultGridField = resultGF;
     BESDEBUG("ugrid",
         "TwoDMeshTopology::applyRestrictOperator() - GridField operator applied and result obtained." << endl);
@@ -945,7 +1066,7 @@ libdap::Array *TwoDMeshTopology::getGridFieldCellArrayAsDapArray(GF::GridField *
     // This is a vector of size N holding vectors of size 3
     vector<vector<int> > nodes2 = gfCellArray->makeArrayInts();
 
-    libdap::Array *resultFncDapArray = new libdap::Array(sourceFcnArray->name(), new Int32(sourceFcnArray->name()));
+    libdap::Array *resultFncDapArray = newFncArrayLike(sourceFcnArray);
 
     // Is the sourceFcnArray a Nx3 (follows the ugrid 0.9 spec) or 3xN - both
     // commonly appear. Make the resultFncDapArray match the source's organization
@@ -996,7 +1117,7 @@ libdap::Array *TwoDMeshTopology::getGridFieldCellArrayAsDapArray(GF::GridField *
             }
         }
 
-        resultFncDapArray->set_value(node_data, node_data.size());
+        setFncValues(resultFncDapArray, node_data, sourceFcnArray);
     }
     else {
         // build a new set of values and set them as the value of the result fnc array.
@@ -1018,7 +1139,7 @@ libdap::Array *TwoDMeshTopology::getGridFieldCellArrayAsDapArray(GF::GridField *
             }
         }
 
-        resultFncDapArray->set_value(node_data, node_data.size());
+        setFncValues(resultFncDapArray, node_data, sourceFcnArray);
     }
 
     BESDEBUG("ugrid", "TwoDMeshTopology::getGridFieldCellArrayAsDapArray() - DONE" << endl);
@@ -1256,7 +1377,7 @@ static string getIndexVariableName(locationType location)
     throw Error(malformed_expr, msg);
 }
 
-int TwoDMeshTopology::getInputGridSize(locationType location)
+long TwoDMeshTopology::getInputGridSize(locationType location)
 {
     switch (location) {
     case node:
@@ -1280,7 +1401,7 @@ int TwoDMeshTopology::getInputGridSize(locationType location)
  */
 void TwoDMeshTopology::addIndexVariable(locationType location)
 {
-    int size = getInputGridSize(location);
+    long size = getInputGridSize(location);
     string name = getIndexVariableName(location);
 
     BESDEBUG("ugrid",
@@ -1300,4 +1421,282 @@ void TwoDMeshTopology::getResultIndex(locationType location, void *target)
     getResultGFAttributeValues(name, dods_int32_c, location, target);
 }
 
+/**
+ * @return The name of the i'th node coordinate variable of the mesh (0 is x and
+ * 1 is y), or the empty string if the mesh does not have that many.
+ */
+string TwoDMeshTopology::nodeCoordinateName(unsigned int i) const
+{
+    if (i >= nodeCoordinateArrays->size()) return "";
+
+    return (*nodeCoordinateArrays)[i]->name();
+}
+
+/**
+ * Returns the node coordinates and face node connectivity of this mesh as a
+ * MeshGeometry. The geometry is looked up in the MeshGeometryCache first;
+ * only when it is not there (or the dataset has changed since it was cached)
+ * are the coordinate and connectivity arrays read. The returned object
+ * belongs to the cache (or to this TwoDMeshTopology) and must not be deleted.
+ *
+ * The first two node coordinate arrays are used as the x and y coordinates.
+ */
+MeshGeometry *TwoDMeshTopology::getMeshGeometry(libdap::DDS *dds)
+{
+    if (d_geometry) return d_geometry;
+
+    if (!_initialized) throw InternalErr(__FILE__, __LINE__, "TwoDMeshTopology::getMeshGeometry() - Not initialized.");
+
+    MeshGeometryCache *cache = MeshGeometryCache::TheCache();
+    string key = MeshGeometryCache::makeKey(dds->filename(), meshVarName());
+    string stamp = MeshGeometryCache::makeStamp(dds->filename());
+
+    if (!stamp.empty()) {
+        d_geometry = cache->get(key, stamp);
+        if (d_geometry) return d_geometry;
+    }
+
+    SharedMeshStore *store = SharedMeshStore::TheStore();
+    if (stamp.empty() || !store->enabled()) {
+        d_geometry = readMeshGeometry();
+    }
+    else {
+        // Another process may have published the mesh already; if not, take
+        // the mesh's build lock and look again, since the process that held
+        // it may have just finished (or failed, in which case its error is
+        // ours too). If the wait for the lock timed out, read the mesh
+        // without sharing it.
+        d_geometry = store->attach(key, stamp);
+        if (!d_geometry) {
+            SharedMeshStore::BuildLock lock(store, key);
+            if (lock.locked()) d_geometry = store->attach(key, stamp);
+            if (!d_geometry) {
+                if (lock.waited()) store->rethrowFailure(key, stamp);
+
+                MeshGeometry *geometry;
+                try {
+                    geometry = readMeshGeometry();
+                }
+                catch (Error &e) {
+                    if (lock.locked()) store->recordFailure(key, stamp, e.get_error_code(), e.get_error_message());
+                    throw;
+                }
+
+                d_geometry = lock.locked() ? store->publish(key, stamp, geometry) : 0;
+                if (d_geometry)
+                    delete geometry;
+                else
+                    d_geometry = geometry;
+            }
+        }
+    }
+
+    if (stamp.empty()) {
+        BESDEBUG("ugrid", "TwoDMeshTopology::getMeshGeometry() - Dataset has no stamp, geometry not cached." << endl);
+        d_ownsGeometry = true;
+    }
+    else {
+        cache->put(key, stamp, d_geometry);
+    }
+
+    return d_geometry;
+}
+
+/**
+ * Read the node coordinates and face node connectivity of the mesh into a
+ * new MeshGeometry, which the caller owns.
+ */
+MeshGeometry *TwoDMeshTopology::readMeshGeometry()
+{
+    if (nodeCoordinateArrays->size() < 2)
+        throw Error(malformed_expr,
+            "The " UGRID_NODE_COORDINATES " attribute of the mesh variable '" + meshVarName()
+                + "' must name at least two coordinate variables.");
+
+    BESDEBUG("ugrid", "TwoDMeshTopology::readMeshGeometry() - Reading geometry for mesh '" << meshVarName() << "'" << endl);
+
+    vector<double> nodeX, nodeY;
+    double *values = ugrid::extractArray<double>((*nodeCoordinateArrays)[0]);
+    nodeX.assign(values, values + nodeCount);
+    delete[] values;
+
+    values = ugrid::extractArray<double>((*nodeCoordinateArrays)[1]);
+    nodeY.assign(values, values + nodeCount);
+    delete[] values;
+
+    int nodesPerFace = faceNodeConnectivityArray->dimension_size(fncNodesDim, true);
+    long total_size = (long) nodesPerFace * faceCount;
+
+    faceNodeConnectivityArray->read();
+    GF::Node *cells = getFncArrayAsGFCells(faceNodeConnectivityArray);
+
+    // The MeshGeometry holds zero-based indices; fill values (or indices that
+    // are negative after the start_index is applied) become large unsigned
+    // values, which MeshGeometry treats as 'no node'.
+    int startIndex = getStartIndex(faceNodeConnectivityArray);
+    vector<unsigned int> faceNodes(total_size);
+    for (long j = 0; j < total_size; j++) {
+        faceNodes[j] = (unsigned int) (cells[j] - startIndex);
+    }
+    delete[] cells;
+
+    MeshGeometry *geometry = new MeshGeometry(&nodeX, &nodeY, &faceNodes, nodesPerFace);
+    geometry->setSourceLayout(startIndex, faceNodeConnectivityArray->dim_begin() != fncNodesDim);
+
+    return geometry;
+}
+
+/**
+ * Returns the values of a one dimensional coordinate array at the given
+ * locations, in a new DAP array shaped like the one
+ * getGFAttributeAsDapArray() makes: Int32 for integer coordinates and
+ * Float64 otherwise, with the source array's attributes. The source is not
+ * read when there are no locations.
+ */
+libdap::Array *TwoDMeshTopology::getSubsetAsDapArray(libdap::Array *templateArray, vector<unsigned int> *subsetIndex)
+{
+    libdap::Array *dapArray;
+    BaseType *templateVar = templateArray->var();
+
+    switch (templateVar->type()) {
+    case dods_byte_c:
+    case dods_uint16_c:
+    case dods_int16_c:
+    case dods_uint32_c:
+    case dods_int32_c: {
+        vector<dods_int32> subset(subsetIndex->size());
+        if (!subset.empty()) {
+            dods_int32 *values = ugrid::extractArray<dods_int32>(templateArray);
+            for (unsigned int i = 0; i < subsetIndex->size(); ++i)
+                subset[i] = values[(*subsetIndex)[i]];
+            delete[] values;
+        }
+
+        dapArray = new libdap::Array(templateArray->name(), new libdap::Int32(templateVar->name()));
+        dapArray->append_dim(subset.size(), copySizeOneDimensions(templateArray, dapArray));
+        dapArray->set_value(subset, subset.size());
+        break;
+    }
+    case dods_float32_c:
+    case dods_float64_c: {
+        vector<dods_float64> subset(subsetIndex->size());
+        if (!subset.empty()) {
+            dods_float64 *values = ugrid::extractArray<dods_float64>(templateArray);
+            for (unsigned int i = 0; i < subsetIndex->size(); ++i)
+                subset[i] = values[(*subsetIndex)[i]];
+            delete[] values;
+        }
+
+        dapArray = new libdap::Array(templateArray->name(), new libdap::Float64(templateVar->name()));
+        dapArray->append_dim(subset.size(), copySizeOneDimensions(templateArray, dapArray));
+        dapArray->set_value(subset, subset.size());
+        break;
+    }
+    default:
+        throw InternalErr(__FILE__, __LINE__, "Unknown DAP type encountered when subsetting a coordinate array");
+    }
+
+    dapArray->set_attr_table(templateArray->get_attr_table());
+
+    return dapArray;
+}
+
+/**
+ * The counterpart of convertResultGridFieldStructureToDapObjects() for a
+ * subset given by the indices of its nodes and faces rather than by the
+ * result of applyRestrictOperator(); used when the restriction's result has
+ * been changed (e.g., grown by rings of neighboring faces). The nodes and
+ * faces must be in ascending order and every corner of the faces must be one
+ * of the nodes. The nodes are renumbered by their position in nodes and the
+ * face node connectivity keeps the organization and start_index of the
+ * source array.
+ */
+void TwoDMeshTopology::convertSubsetToDapObjects(libdap::DDS *dds, vector<unsigned int> *nodes,
+    vector<unsigned int> *faces, vector<BaseType *> *results)
+{
+    BESDEBUG("ugrid",
+        "TwoDMeshTopology::convertSubsetToDapObjects() - " << nodes->size() << " nodes and " << faces->size() << " faces." << endl);
+
+    if (nodes->empty()) {
+        throw BESError("Oops! The ugrid constraint expression resulted in an empty response.", BES_SYNTAX_USER_ERROR,
+            __FILE__, __LINE__);
+    }
+
+    MeshGeometry *geometry = getMeshGeometry(dds);
+
+    vector<libdap::Array *>::iterator it;
+    for (it = nodeCoordinateArrays->begin(); it != nodeCoordinateArrays->end(); ++it)
+        results->push_back(getSubsetAsDapArray(*it, nodes));
+
+    for (it = faceCoordinateArrays->begin(); it != faceCoordinateArrays->end(); ++it)
+        results->push_back(getSubsetAsDapArray(*it, faces));
+
+    // The renumbered corners, face by face; missing corners are -1.
+    unsigned int nodesPerFace = geometry->nodesPerFace();
+    vector<dods_int32> corners(faces->size() * nodesPerFace, -1);
+    for (unsigned int i = 0; i < faces->size(); ++i) {
+        for (unsigned int c = 0; c < nodesPerFace; ++c) {
+            unsigned int n = geometry->faceNode((*faces)[i], c);
+            if (n >= geometry->nodeCount()) continue;
+
+            vector<unsigned int>::iterator pos = lower_bound(nodes->begin(), nodes->end(), n);
+            if (pos == nodes->end() || *pos != n)
+                throw InternalErr(__FILE__, __LINE__,
+                    "TwoDMeshTopology::convertSubsetToDapObjects() - A face corner is not in the node subset.");
+            corners[i * nodesPerFace + c] = (pos - nodes->begin()) + geometry->startIndex();
+        }
+    }
+
+    libdap::Array *fnc = newFncArrayLike(faceNodeConnectivityArray);
+    libdap::Array::Dim_iter di = faceNodeConnectivityArray->dim_begin();
+    if (geometry->facesFirst()) {
+        fnc->append_dim(faces->size(), di->name);
+        fnc->append_dim(nodesPerFace, (di + 1)->name);
+        setFncValues(fnc, corners, faceNodeConnectivityArray);
+    }
+    else {
+        vector<dods_int32> transposed(corners.size());
+        for (unsigned int i = 0; i < faces->size(); ++i)
+            for (unsigned int c = 0; c < nodesPerFace; ++c)
+                transposed[c * faces->size() + i] = corners[i * nodesPerFace + c];
+
+        fnc->append_dim(nodesPerFace, di->name);
+        fnc->append_dim(faces->size(), (di + 1)->name);
+        setFncValues(fnc, transposed, faceNodeConnectivityArray);
+    }
+    fnc->set_attr_table(faceNodeConnectivityArray->get_attr_table());
+    results->push_back(fnc);
+
+    results->push_back(getMeshVariable()->ptr_duplicate());
+}
+
+/**
+ * Add the zero-length counterparts of the mesh's coordinate arrays and face
+ * node connectivity, and its mesh variable, to results: what a subset with
+ * no nodes or faces holds. Used by the batch restrictions, where one empty
+ * region should not fail the others. Nothing is read but the mesh variable.
+ */
+void TwoDMeshTopology::convertEmptySubsetToDapObjects(vector<BaseType *> *results)
+{
+    vector<unsigned int> none;
+
+    vector<libdap::Array *>::iterator it;
+    for (it = nodeCoordinateArrays->begin(); it != nodeCoordinateArrays->end(); ++it)
+        results->push_back(getSubsetAsDapArray(*it, &none));
+
+    for (it = faceCoordinateArrays->begin(); it != faceCoordinateArrays->end(); ++it)
+        results->push_back(getSubsetAsDapArray(*it, &none));
+
+    libdap::Array *fnc = newFncArrayLike(faceNodeConnectivityArray);
+    for (libdap::Array::Dim_iter di = faceNodeConnectivityArray->dim_begin();
+        di != faceNodeConnectivityArray->dim_end(); ++di)
+        fnc->append_dim(di == fncNodesDim ? faceNodeConnectivityArray->dimension_size(di, true) : 0, di->name);
+    vector<dods_int32> corners;
+    setFncValues(fnc, corners, faceNodeConnectivityArray);
+    fnc->set_attr_table(faceNodeConnectivityArray->get_attr_table());
+    results->push_back(fnc);
+
+    results->push_back(getMeshVariable()->ptr_duplicate());
+}
+
 } // namespace ugrid
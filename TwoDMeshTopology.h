@@ -45,6 +45,8 @@ class Grid;
 
 namespace ugrid {
 
+class MeshGeometry;
+
 /**
  * Identifies the location/rank/dimension that various grid components are associated with.
  */
@@ -77,7 +79,7 @@ private:
      */
     vector<libdap::Array *> *nodeCoordinateArrays;
     string nodeDimensionName;
-    int nodeCount;
+    long nodeCount;
 
     /**
      * REQUIRED
@@ -112,7 +114,7 @@ private:
     libdap::Array *faceNodeConnectivityArray;
     libdap::Array::Dim_iter fncNodesDim, fncFacesDim;
     string faceDimensionName;
-    int faceCount;
+    long faceCount;
 
     vector<MeshDataVariable *> *rangeDataArrays;
 
@@ -190,6 +192,14 @@ private:
 
     GF::Node *fncCellArray;
 
+    /**
+     * The node coordinates and face node connectivity as plain arrays. Usually
+     * this is owned by the MeshGeometryCache; d_ownsGeometry is true when it
+     * could not be cached and must be deleted with this object.
+     */
+    MeshGeometry *d_geometry;
+    bool d_ownsGeometry;
+
     bool _initialized;
 
     void ingestFaceNodeConnectivityArray(libdap::BaseType *meshTopology, libdap::DDS *dds);
@@ -199,10 +209,12 @@ private:
     GF::Node *getFncArrayAsGFCells(libdap::Array *fncVar);
     int getStartIndex(libdap::Array *array);
     GF::CellArray *getFaceNodeConnectivityCells();
+    MeshGeometry *readMeshGeometry();
 
     libdap::Array *getGFAttributeAsDapArray(libdap::Array *sourceArray, locationType rank,
         GF::GridField *resultGridField);
     libdap::Array *getGridFieldCellArrayAsDapArray(GF::GridField *resultGridField, libdap::Array *sourceFcnArray);
+    libdap::Array *getSubsetAsDapArray(libdap::Array *templateArray, vector<unsigned int> *subsetIndex);
     // libdap::Array *getNewFncDapArray(libdap::Array *templateArray, int N);
 
     void setNodeCoordinateDimension(MeshDataVariable *mdv);
@@ -227,10 +239,13 @@ public:
     void buildBasicGfTopology();
     void applyRestrictOperator(locationType loc, string filterExpression);
 
-    int getInputGridSize(locationType location);
-    int getResultGridSize(locationType location);
+    long getInputGridSize(locationType location);
+    long getResultGridSize(locationType location);
 
     void convertResultGridFieldStructureToDapObjects(vector<libdap::BaseType *> *results);
+    void convertSubsetToDapObjects(libdap::DDS *dds, vector<unsigned int> *nodes, vector<unsigned int> *faces,
+        vector<libdap::BaseType *> *results);
+    void convertEmptySubsetToDapObjects(vector<libdap::BaseType *> *results);
 
     void setLocationCoordinateDimension(MeshDataVariable *mdv);
 
@@ -238,6 +253,10 @@ public:
     void getResultIndex(locationType location, void *target);
 
     void getResultGFAttributeValues(string attrName, libdap::Type type, locationType rank, void *target);
+
+    string nodeCoordinateName(unsigned int i) const;
+
+    MeshGeometry *getMeshGeometry(libdap::DDS *dds);
 };
 
 } // namespace ugrid
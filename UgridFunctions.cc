@@ -23,13 +23,25 @@
 // You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
 
 #include <iostream>
+#include <sstream>
 
 using std::endl;
 
 #include "UgridFunctions.h"
 #include "ServerFunctionsList.h"
 #include "BESDebug.h"
+#include "TheBESKeys.h"
 #include "ugrid_restrict.h"
+#include "ugrid_sample.h"
+#include "ugrid_zonal.h"
+#include "ugrid_decimate.h"
+#include "ugrid_count.h"
+#include "ugrid_metadata.h"
+#include "MeshGeometry.h"
+#include "MeshGeometryCache.h"
+#include "SharedMeshStore.h"
+#include "SlabPipeline.h"
+#include "ModuleExecutor.h"
 
 static string getFunctionNames()
 {
@@ -46,6 +58,23 @@ static string getFunctionNames()
     return msg;
 }
 
+/**
+ * @return The value of the BES key as an unsigned integer, or defaultValue
+ * if the key is not set.
+ */
+static unsigned int getUnsignedKey(const string &key, unsigned int defaultValue)
+{
+    bool found = false;
+    string value;
+    TheBESKeys::TheKeys()->get_value(key, value, found);
+    if (!found || value.empty()) return defaultValue;
+
+    unsigned int result = defaultValue;
+    std::istringstream iss(value);
+    iss >> result;
+    return result;
+}
+
 void UgridFunctions::initialize(const string &/*modname*/)
 {
     BESDEBUG("UgridFunctions", "initialize() - BEGIN" << endl);
@@ -66,12 +95,102 @@ void UgridFunctions::initialize(const string &/*modname*/)
 
     BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
 
+    ugrid::UGNN *ugnn = new ugrid::UGNN();
+    libdap::ServerFunctionsList::TheList()->add_function(ugnn);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGPI *ugpi = new ugrid::UGPI();
+    libdap::ServerFunctionsList::TheList()->add_function(ugpi);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGTX *ugtx = new ugrid::UGTX();
+    libdap::ServerFunctionsList::TheList()->add_function(ugtx);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGRG *ugrg = new ugrid::UGRG();
+    libdap::ServerFunctionsList::TheList()->add_function(ugrg);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGZS *ugzs = new ugrid::UGZS();
+    libdap::ServerFunctionsList::TheList()->add_function(ugzs);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGTR *ugtr = new ugrid::UGTR();
+    libdap::ServerFunctionsList::TheList()->add_function(ugtr);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGDC *ugdc = new ugrid::UGDC();
+    libdap::ServerFunctionsList::TheList()->add_function(ugdc);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGNRB *ugnrb = new ugrid::UGNRB();
+    libdap::ServerFunctionsList::TheList()->add_function(ugnrb);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGFRB *ugfrb = new ugrid::UGFRB();
+    libdap::ServerFunctionsList::TheList()->add_function(ugfrb);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGCT *ugct = new ugrid::UGCT();
+    libdap::ServerFunctionsList::TheList()->add_function(ugct);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::UGMD *ugmd = new ugrid::UGMD();
+    libdap::ServerFunctionsList::TheList()->add_function(ugmd);
+
+    BESDEBUG("UgridFunctions", "initialize() - function names: " << getFunctionNames() << endl);
+
+    ugrid::MeshGeometryCache *cache = ugrid::MeshGeometryCache::TheCache();
+    cache->setMaxEntries(getUnsignedKey(UGRID_TOPOLOGY_CACHE_MAX_ENTRIES_KEY, cache->getMaxEntries()));
+    BESDEBUG("UgridFunctions", "initialize() - topology cache max entries: " << cache->getMaxEntries() << endl);
+
+    ugrid::MeshGeometry::setMaxProductBytes(
+        getUnsignedKey(UGRID_TOPOLOGY_CACHE_MAX_PRODUCT_MEGABYTES_KEY,
+            ugrid::MeshGeometry::getMaxProductBytes() / (1024 * 1024)) * 1024UL * 1024UL);
+    BESDEBUG("UgridFunctions",
+        "initialize() - topology cache max product bytes: " << ugrid::MeshGeometry::getMaxProductBytes() << endl);
+
+    bool found = false;
+    string directory;
+    TheBESKeys::TheKeys()->get_value(UGRID_SHARED_CACHE_DIRECTORY_KEY, directory, found);
+    ugrid::SharedMeshStore *store = ugrid::SharedMeshStore::TheStore();
+    store->setDirectory(directory);
+    store->setBuildTimeout(getUnsignedKey(UGRID_SHARED_CACHE_BUILD_TIMEOUT_KEY, store->getBuildTimeout()));
+    store->setMaxBytes(
+        getUnsignedKey(UGRID_SHARED_CACHE_MAX_MEGABYTES_KEY, store->getMaxBytes() / (1024 * 1024)) * 1024UL * 1024UL);
+    BESDEBUG("UgridFunctions",
+        "initialize() - shared topology cache: " << (directory.empty() ? "disabled" : directory) << ", build timeout: " << store->getBuildTimeout() << ", max bytes: " << store->getMaxBytes() << endl);
+
+    ugrid::SlabPipeline::setDepth(getUnsignedKey(UGRID_SLAB_PIPELINE_DEPTH_KEY, ugrid::SlabPipeline::getDepth()));
+    BESDEBUG("UgridFunctions", "initialize() - slab pipeline depth: " << ugrid::SlabPipeline::getDepth() << endl);
+
+    ugrid::ModuleExecutor *executor = ugrid::ModuleExecutor::TheExecutor();
+    executor->configure(getUnsignedKey(UGRID_EXECUTOR_THREADS_KEY, executor->getThreads()),
+        getUnsignedKey(UGRID_EXECUTOR_QUEUE_DEPTH_KEY, executor->getQueueDepth()),
+        getUnsignedKey(UGRID_EXECUTOR_REQUEST_CONCURRENCY_KEY, executor->getRequestConcurrency()));
+    BESDEBUG("UgridFunctions",
+        "initialize() - executor threads: " << executor->getThreads() << ", queue depth: " << executor->getQueueDepth() << ", request concurrency: " << executor->getRequestConcurrency() << endl);
+
     BESDEBUG("UgridFunctions", "initialize() - END" << endl);
 }
 
 void UgridFunctions::terminate(const string &/*modname*/)
 {
-    BESDEBUG("UgridFunctions", "Removing UgridFunctions Modules (this does nothing)." << endl);
+    BESDEBUG("UgridFunctions", "Removing UgridFunctions Modules." << endl);
+
+    ugrid::MeshGeometryCache::delete_instance();
+    ugrid::SharedMeshStore::delete_instance();
+    ugrid::ModuleExecutor::delete_instance();
 }
 
 /** @brief dumps information about this object
@@ -83,6 +202,11 @@ void UgridFunctions::terminate(const string &/*modname*/)
 void UgridFunctions::dump(ostream &strm) const
 {
     strm << BESIndent::LMarg << "UgridFunctions::dump - (" << (void *) this << ")" << endl;
+    BESIndent::Indent();
+    ugrid::MeshGeometryCache::TheCache()->dump(strm);
+    ugrid::SharedMeshStore::TheStore()->dump(strm);
+    ugrid::ModuleExecutor::TheExecutor()->dump(strm);
+    BESIndent::UnIndent();
 }
 
 extern "C" {
@@ -0,0 +1,172 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+
+#include <Error.h>
+
+#include "ValuePredicates.h"
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+static string strip(const string &s)
+{
+    string::size_type first = s.find_first_not_of(" \t\n\r");
+    if (first == string::npos) return "";
+
+    return s.substr(first, s.find_last_not_of(" \t\n\r") - first + 1);
+}
+
+/**
+ * @return True if s is a number (and nothing else), which is returned in value.
+ */
+static bool parseNumber(const string &s, double *value)
+{
+    if (s.empty()) return false;
+
+    char *end;
+    *value = strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+
+bool ValuePredicate::test(double v) const
+{
+    if (op == ">=") return v >= value;
+    if (op == "<=") return v <= value;
+    if (op == ">") return v > value;
+    if (op == "<") return v < value;
+    if (op == "!=") return v != value;
+
+    return v == value;  // '=' and '=='
+}
+
+ValuePredicates::ValuePredicates(const string &filterExpression, const set<string> &variables)
+{
+    if (filterExpression.find_first_of("|()") != string::npos) {
+        // Not a conjunction, so it must not use the range variables at all.
+        string::size_type start = 0;
+        while ((start = filterExpression.find_first_not_of(" \t\n\r0123456789.|&()!<>=+-*/[]", start)) != string::npos) {
+            string::size_type end = filterExpression.find_first_of(" \t\n\r|&()!<>=+-*/[]", start);
+            string name = filterExpression.substr(start, end - start);
+            if (variables.find(name) != variables.end())
+                throw Error(malformed_expr,
+                    "The filter '" + filterExpression + "' compares the range variable '" + name
+                        + "' in an expression that is not a conjunction ('a & b & ...').");
+            start = end;
+        }
+
+        d_remaining = filterExpression;
+        return;
+    }
+
+    string::size_type start = 0;
+    while (start <= filterExpression.size()) {
+        string::size_type end = filterExpression.find('&', start);
+        if (end == string::npos) end = filterExpression.size();
+
+        string term = strip(filterExpression.substr(start, end - start));
+        ValuePredicate predicate;
+        if (parseTerm(term, variables, &predicate)) {
+            d_predicates.push_back(predicate);
+        }
+        else if (!term.empty()) {
+            d_remaining += (d_remaining.empty() ? "" : " & ") + term;
+        }
+
+        start = end + 1;
+    }
+}
+
+/**
+ * @return True if term compares one of variables with a number, in which
+ * case the comparison is returned in predicate.
+ */
+bool ValuePredicates::parseTerm(const string &term, const set<string> &variables, ValuePredicate *predicate)
+{
+    // Two character operators first, so '>=' is not read as '>'.
+    static const char *ops[] = { ">=", "<=", "==", "!=", ">", "<", "=" };
+
+    for (unsigned int i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        string::size_type pos = term.find(ops[i]);
+        if (pos == string::npos) continue;
+
+        string op = ops[i];
+        string left = strip(term.substr(0, pos));
+        string right = strip(term.substr(pos + op.size()));
+
+        // Put the variable on the left; '5 < depth' is 'depth > 5'.
+        double value;
+        if (parseNumber(left, &value)) {
+            left.swap(right);
+            if (op[0] == '<')
+                op[0] = '>';
+            else if (op[0] == '>') op[0] = '<';
+        }
+        else if (!parseNumber(right, &value)) {
+            return false;
+        }
+
+        string::size_type bracket = left.find('[');
+        string name = strip(left.substr(0, bracket));
+        if (variables.find(name) == variables.end()) return false;
+
+        predicate->variable = name;
+        predicate->op = op;
+        predicate->value = value;
+        predicate->indices.clear();
+
+        // '[i][j]...'
+        while (bracket != string::npos) {
+            string::size_type close = left.find(']', bracket);
+            if (close == string::npos)
+                throw Error(malformed_expr, "Unable to parse the indices in the filter term '" + term + "'.");
+
+            char *end;
+            string index = strip(left.substr(bracket + 1, close - bracket - 1));
+            long n = strtol(index.c_str(), &end, 10);
+            if (index.empty() || *end != '\0' || n < 0)
+                throw Error(malformed_expr, "The index '" + index + "' in the filter term '" + term + "' is not valid.");
+            predicate->indices.push_back(n);
+
+            bracket = left.find_first_not_of(" \t", close + 1);
+            if (bracket != string::npos && left[bracket] != '[')
+                throw Error(malformed_expr, "Unable to parse the indices in the filter term '" + term + "'.");
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace ugrid
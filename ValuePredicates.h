@@ -0,0 +1,86 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _ValuePredicates_h
+#define _ValuePredicates_h 1
+
+#include <string>
+#include <vector>
+#include <set>
+
+namespace ugrid {
+
+/**
+ * One term of a filter expression that compares the values of a range
+ * variable with a number, e.g. 'depth > 5' or, for a variable with more than
+ * the location dimension, 'twoDnodedata[2] >= 0.5', where the indices pick the
+ * slab of the outer dimensions.
+ */
+struct ValuePredicate {
+    std::string variable;
+    std::vector<unsigned int> indices;
+    std::string op;
+    double value;
+
+    bool test(double v) const;
+};
+
+/**
+ * Split a restriction filter expression into the terms gridfields can
+ * evaluate (those over the coordinates and other attributes of the grid) and
+ * the terms that compare a range variable with a number. The expression must
+ * be a conjunction when it has terms of the second kind, since those are
+ * applied after the restriction, to the locations it leaves. The names in
+ * variables are the range variables that may be used.
+ */
+class ValuePredicates {
+
+private:
+    std::string d_remaining;
+    std::vector<ValuePredicate> d_predicates;
+
+    bool parseTerm(const std::string &term, const std::set<std::string> &variables, ValuePredicate *predicate);
+
+public:
+    ValuePredicates(const std::string &filterExpression, const std::set<std::string> &variables);
+
+    /**
+     * @return The terms of the expression that are not value predicates,
+     * joined with '&'; empty if there are none.
+     */
+    const std::string &remaining() const
+    {
+        return d_remaining;
+    }
+
+    const std::vector<ValuePredicate> &predicates() const
+    {
+        return d_predicates;
+    }
+};
+
+} // namespace ugrid
+
+#endif // _ValuePredicates_h
@@ -0,0 +1,248 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <deque>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "Error.h"
+#include "InternalErr.h"
+#include "BESError.h"
+
+#include "ModuleExecutor.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+namespace ugrid {
+
+WorkStealingPool::WorkStealingPool(unsigned int threads) :
+    d_threads(threads > 0 ? threads : 1), d_task(0), d_grain(1), d_remaining(0), d_failed(0), d_steals(0),
+        d_error(0), d_pending(0)
+{
+    for (unsigned int i = 0; i < d_threads; ++i) {
+        Worker *worker = new Worker();
+        worker->pool = this;
+        worker->id = i;
+        pthread_mutex_init(&worker->mutex, 0);
+        d_workers.push_back(worker);
+    }
+
+    pthread_mutex_init(&d_errorMutex, 0);
+    pthread_mutex_init(&d_pendingMutex, 0);
+    pthread_cond_init(&d_pendingDone, 0);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    for (vector<Worker *>::iterator it = d_workers.begin(); it != d_workers.end(); ++it) {
+        pthread_mutex_destroy(&(*it)->mutex);
+        delete *it;
+    }
+
+    pthread_cond_destroy(&d_pendingDone);
+    pthread_mutex_destroy(&d_pendingMutex);
+    pthread_mutex_destroy(&d_errorMutex);
+    delete d_error;
+}
+
+/**
+ * Take the last range from the worker's own deque.
+ */
+bool WorkStealingPool::take(Worker *worker, Range *range)
+{
+    pthread_mutex_lock(&worker->mutex);
+    bool found = !worker->ranges.empty();
+    if (found) {
+        *range = worker->ranges.back();
+        worker->ranges.pop_back();
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return found;
+}
+
+/**
+ * Take the first range from the deque of one of the other workers, trying
+ * them in turn starting with the one after the thief.
+ */
+bool WorkStealingPool::steal(Worker *thief, Range *range)
+{
+    for (unsigned int i = 1; i < d_workers.size(); ++i) {
+        Worker *victim = d_workers[(thief->id + i) % d_workers.size()];
+
+        pthread_mutex_lock(&victim->mutex);
+        bool found = !victim->ranges.empty();
+        if (found) {
+            *range = victim->ranges.front();
+            victim->ranges.pop_front();
+        }
+        pthread_mutex_unlock(&victim->mutex);
+
+        if (found) {
+            __sync_fetch_and_add(&d_steals, 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Record the error (only the first is kept) and stop the workers.
+ */
+void WorkStealingPool::fail(libdap::Error *error)
+{
+    pthread_mutex_lock(&d_errorMutex);
+    if (!d_error)
+        d_error = error;
+    else
+        delete error;
+    pthread_mutex_unlock(&d_errorMutex);
+
+    __sync_lock_test_and_set(&d_failed, 1);
+}
+
+void WorkStealingPool::work(Worker *worker)
+{
+    // The atomic adds of zero are atomic reads.
+    while (__sync_fetch_and_add(&d_remaining, 0) > 0 && !__sync_fetch_and_add(&d_failed, 0)) {
+        Range range;
+        if (!take(worker, &range) && !steal(worker, &range)) {
+            // The rest of the work is being run, or split, by other threads.
+            sched_yield();
+            continue;
+        }
+
+        while (range.end - range.begin > d_grain) {
+            Range half;
+            half.begin = range.begin + (range.end - range.begin) / 2;
+            half.end = range.end;
+            range.end = half.begin;
+
+            pthread_mutex_lock(&worker->mutex);
+            worker->ranges.push_back(half);
+            pthread_mutex_unlock(&worker->mutex);
+        }
+
+        try {
+            d_task->run(range.begin, range.end);
+        }
+        catch (libdap::Error &e) {
+            fail(new libdap::Error(e));
+        }
+        catch (BESError &e) {
+            fail(new libdap::Error(internal_error, e.get_message()));
+        }
+        catch (std::exception &e) {
+            fail(new libdap::InternalErr(__FILE__, __LINE__, string("WorkStealingPool - ") + e.what()));
+        }
+        catch (...) {
+            fail(new libdap::InternalErr(__FILE__, __LINE__, "WorkStealingPool - Unknown error in a task."));
+        }
+
+        __sync_fetch_and_sub(&d_remaining, range.end - range.begin);
+    }
+}
+
+void WorkStealingPool::Worker::run()
+{
+    pool->work(this);
+    pool->workerDone();
+}
+
+/**
+ * Called by a worker run by the executor when it returns; the pool may be
+ * deleted as soon as the last one has.
+ */
+void WorkStealingPool::workerDone()
+{
+    pthread_mutex_lock(&d_pendingMutex);
+    if (--d_pending == 0) pthread_cond_signal(&d_pendingDone);
+    pthread_mutex_unlock(&d_pendingMutex);
+}
+
+/**
+ * Run task over [0, count), in ranges of at most grain indices, on the
+ * pool's threads and return once every index has been run.
+ *
+ * @exception Error The first error thrown by the task.
+ */
+void WorkStealingPool::parallelFor(unsigned long count, unsigned long grain, Task *task)
+{
+    if (count == 0) return;
+
+    d_task = task;
+    d_grain = (grain > 0) ? grain : 1;
+    d_remaining = count;
+    d_failed = 0;
+    d_steals = 0;
+    delete d_error;
+    d_error = 0;
+
+    for (unsigned int i = 0; i < d_workers.size(); ++i) {
+        Range range;
+        range.begin = count * i / d_workers.size();
+        range.end = count * (i + 1) / d_workers.size();
+        d_workers[i]->ranges.clear();
+        if (range.end > range.begin) d_workers[i]->ranges.push_back(range);
+    }
+
+    // The calling thread is the first worker.
+    ModuleExecutor *executor = ModuleExecutor::TheExecutor();
+    vector<Worker *> submitted;
+    for (unsigned int i = 1; i < d_workers.size(); ++i) {
+        pthread_mutex_lock(&d_pendingMutex);
+        ++d_pending;
+        pthread_mutex_unlock(&d_pendingMutex);
+
+        if (executor->submit(d_workers[i]))
+            submitted.push_back(d_workers[i]);
+        else
+            workerDone();
+    }
+
+    work(d_workers[0]);
+
+    // Workers still queued have nothing left to do.
+    for (vector<Worker *>::iterator it = submitted.begin(); it != submitted.end(); ++it) {
+        if (executor->cancel(*it)) workerDone();
+    }
+
+    pthread_mutex_lock(&d_pendingMutex);
+    while (d_pending > 0)
+        pthread_cond_wait(&d_pendingDone, &d_pendingMutex);
+    pthread_mutex_unlock(&d_pendingMutex);
+
+    if (d_error) throw libdap::Error(*d_error);
+}
+
+} // namespace ugrid
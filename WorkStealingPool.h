@@ -0,0 +1,141 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _WorkStealingPool_h
+#define _WorkStealingPool_h 1
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "ModuleExecutor.h"
+
+namespace libdap {
+class Error;
+}
+
+namespace ugrid {
+
+/**
+ * Runs a Task over the index space [0, count) on several threads. The space
+ * is first divided evenly between the threads; each thread splits the range
+ * it takes in halves, keeping the first half and pushing the second onto its
+ * own deque, until what it keeps is no bigger than the grain. A thread takes
+ * the last range from its own deque (the nearest one, just split off) and,
+ * when that is empty, steals the first range (the biggest) from another
+ * thread's deque, so threads that finish early take over the work of those
+ * that are slow.
+ *
+ * The calling thread is one of the threads; the others are jobs on the
+ * ModuleExecutor. A job the executor cannot take (its queue is full) leaves
+ * its share to be stolen by the rest. If a task throws, the other threads
+ * stop taking ranges and parallelFor() throws the first error as a
+ * libdap::Error.
+ */
+class WorkStealingPool {
+
+public:
+    /**
+     * The work to do for the indices [begin, end); run() is called from
+     * several threads at once, with ranges that do not overlap.
+     */
+    class Task {
+    public:
+        virtual ~Task()
+        {
+        }
+
+        virtual void run(unsigned long begin, unsigned long end) = 0;
+    };
+
+private:
+    struct Range {
+        unsigned long begin;
+        unsigned long end;
+    };
+
+    class Worker: public ModuleExecutor::Job {
+    public:
+        WorkStealingPool *pool;
+        unsigned int id;
+        pthread_mutex_t mutex;
+        std::deque<Range> ranges;
+
+        virtual void run();
+    };
+
+    unsigned int d_threads;
+    std::vector<Worker *> d_workers;
+
+    Task *d_task;
+    unsigned long d_grain;
+
+    // The number of indices not yet run; updated with atomic operations.
+    volatile unsigned long d_remaining;
+    volatile int d_failed;
+    volatile unsigned long d_steals;
+
+    pthread_mutex_t d_errorMutex;
+    libdap::Error *d_error;
+
+    // The number of workers submitted to the executor that have not returned.
+    unsigned int d_pending;
+    pthread_mutex_t d_pendingMutex;
+    pthread_cond_t d_pendingDone;
+
+    bool take(Worker *worker, Range *range);
+    bool steal(Worker *thief, Range *range);
+    void fail(libdap::Error *error);
+    void work(Worker *worker);
+    void workerDone();
+
+    WorkStealingPool(const WorkStealingPool &);
+    WorkStealingPool &operator=(const WorkStealingPool &);
+
+public:
+    WorkStealingPool(unsigned int threads);
+    ~WorkStealingPool();
+
+    void parallelFor(unsigned long count, unsigned long grain, Task *task);
+
+    unsigned int threads() const
+    {
+        return d_threads;
+    }
+
+    /**
+     * @return The number of ranges taken from another thread's deque by the
+     * last call to parallelFor().
+     */
+    unsigned long steals() const
+    {
+        return d_steals;
+    }
+};
+
+} // namespace ugrid
+
+#endif // _WorkStealingPool_h
@@ -0,0 +1,174 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cmath>
+#include <vector>
+
+#include "BESDebug.h"
+
+#include "MeshGeometry.h"
+#include "ZoneMembership.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+
+namespace ugrid {
+
+/**
+ * Build the membership from polygons. Polygon z is given by the vertices
+ * (polygonX[z][i], polygonY[z][i]); it need not be closed (the last vertex is
+ * joined to the first). A face belongs to the first polygon holding its
+ * centroid.
+ */
+ZoneMembership::ZoneMembership(const MeshGeometry *geometry, const vector<vector<double> > &polygonX,
+    const vector<vector<double> > &polygonY) :
+    d_zoneCount(polygonX.size()), d_zoneAreas(polygonX.size(), 0.0), d_zoneFaceCounts(polygonX.size(), 0)
+{
+    // The polygons' bounding boxes, to skip most of the point in polygon tests.
+    vector<double> minX(d_zoneCount), minY(d_zoneCount), maxX(d_zoneCount), maxY(d_zoneCount);
+    for (unsigned int z = 0; z < d_zoneCount; ++z) {
+        minX[z] = maxX[z] = polygonX[z][0];
+        minY[z] = maxY[z] = polygonY[z][0];
+        for (unsigned int i = 1; i < polygonX[z].size(); ++i) {
+            minX[z] = min(minX[z], polygonX[z][i]);
+            maxX[z] = max(maxX[z], polygonX[z][i]);
+            minY[z] = min(minY[z], polygonY[z][i]);
+            maxY[z] = max(maxY[z], polygonY[z][i]);
+        }
+    }
+
+    for (unsigned int f = 0; f < geometry->faceCount(); ++f) {
+        double x, y;
+        if (!faceCentroid(geometry, f, &x, &y)) continue;
+
+        for (unsigned int z = 0; z < d_zoneCount; ++z) {
+            if (x < minX[z] || x > maxX[z] || y < minY[z] || y > maxY[z]) continue;
+            if (inPolygon(x, y, polygonX[z], polygonY[z])) {
+                addFace(geometry, f, z);
+                break;
+            }
+        }
+    }
+
+    BESDEBUG("ugrid",
+        "ZoneMembership::ZoneMembership() - " << d_faces.size() << " of " << geometry->faceCount() << " faces are in " << d_zoneCount << " polygon(s)" << endl);
+}
+
+/**
+ * Build the membership from the zone of each face; faceZones[f] is the zone of
+ * face f, or a negative value (or one >= zoneCount) if the face is in no zone.
+ */
+ZoneMembership::ZoneMembership(const MeshGeometry *geometry, const vector<int> &faceZones, unsigned int zoneCount) :
+    d_zoneCount(zoneCount), d_zoneAreas(zoneCount, 0.0), d_zoneFaceCounts(zoneCount, 0)
+{
+    for (unsigned int f = 0; f < geometry->faceCount() && f < faceZones.size(); ++f) {
+        if (faceZones[f] < 0 || (unsigned int) faceZones[f] >= zoneCount) continue;
+        addFace(geometry, f, faceZones[f]);
+    }
+}
+
+void ZoneMembership::addFace(const MeshGeometry *geometry, unsigned int face, unsigned int zone)
+{
+    double area = faceArea(geometry, face);
+
+    d_faces.push_back(face);
+    d_zones.push_back(zone);
+    d_areas.push_back(area);
+
+    d_zoneAreas[zone] += area;
+    d_zoneFaceCounts[zone]++;
+}
+
+/**
+ * @return The area of the face, in the square of the units of the mesh
+ * coordinates.
+ */
+double ZoneMembership::faceArea(const MeshGeometry *geometry, unsigned int face)
+{
+    unsigned int corners = 0;
+    while (corners < geometry->nodesPerFace() && geometry->faceNode(face, corners) < geometry->nodeCount())
+        ++corners;
+
+    double area = 0;
+    for (unsigned int c = 0; c < corners; ++c) {
+        unsigned int a = geometry->faceNode(face, c);
+        unsigned int b = geometry->faceNode(face, (c + 1) % corners);
+        area += geometry->nodeX(a) * geometry->nodeY(b) - geometry->nodeX(b) * geometry->nodeY(a);
+    }
+
+    return fabs(area) / 2.0;
+}
+
+/**
+ * Compute the mean of the corners of the face.
+ * @return False if the face has no valid corners.
+ */
+bool ZoneMembership::faceCentroid(const MeshGeometry *geometry, unsigned int face, double *x, double *y)
+{
+    unsigned int corners = 0;
+    double sumX = 0, sumY = 0;
+    for (unsigned int c = 0; c < geometry->nodesPerFace(); ++c) {
+        unsigned int n = geometry->faceNode(face, c);
+        if (n >= geometry->nodeCount()) break;
+        sumX += geometry->nodeX(n);
+        sumY += geometry->nodeY(n);
+        ++corners;
+    }
+    if (corners == 0) return false;
+
+    *x = sumX / corners;
+    *y = sumY / corners;
+    return true;
+}
+
+/**
+ * Even-odd test for the point (x, y) in the polygon.
+ */
+bool ZoneMembership::inPolygon(double x, double y, const vector<double> &polygonX, const vector<double> &polygonY)
+{
+    bool inside = false;
+    unsigned int n = polygonX.size();
+    for (unsigned int i = 0, j = n - 1; i < n; j = i++) {
+        if ((polygonY[i] > y) != (polygonY[j] > y)
+            && x < (polygonX[j] - polygonX[i]) * (y - polygonY[i]) / (polygonY[j] - polygonY[i]) + polygonX[i])
+            inside = !inside;
+    }
+
+    return inside;
+}
+
+unsigned long ZoneMembership::sizeInBytes() const
+{
+    return sizeof(ZoneMembership) + (d_faces.capacity() + d_zones.capacity() + d_zoneFaceCounts.capacity())
+        * sizeof(unsigned int) + (d_areas.capacity() + d_zoneAreas.capacity()) * sizeof(double);
+}
+
+} // namespace ugrid
@@ -0,0 +1,110 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _ZoneMembership_h
+#define _ZoneMembership_h 1
+
+#include <string>
+#include <vector>
+
+#include "MeshGeometry.h"
+
+namespace ugrid {
+
+/**
+ * The assignment of the faces of a mesh to a set of zones (e.g., counties or
+ * basins), along with the area of each member face. Zones are numbered from
+ * zero. A face belongs to at most one zone; faces in no zone are not listed.
+ *
+ * Zones can be given as polygons, in which case a face belongs to the first
+ * polygon that holds its centroid (the mean of its corners), or as a zone
+ * number for each face. Since working out the membership means testing every
+ * face, instances are kept as products of the MeshGeometry and reused for the
+ * same set of zones.
+ */
+class ZoneMembership: public MeshGeometryProduct {
+
+private:
+    unsigned int d_zoneCount;
+
+    // The member faces in ascending order, with the zone and area of each.
+    std::vector<unsigned int> d_faces;
+    std::vector<unsigned int> d_zones;
+    std::vector<double> d_areas;
+
+    std::vector<double> d_zoneAreas;
+    std::vector<unsigned int> d_zoneFaceCounts;
+
+    void addFace(const MeshGeometry *geometry, unsigned int face, unsigned int zone);
+
+    ZoneMembership(const ZoneMembership &);
+    ZoneMembership &operator=(const ZoneMembership &);
+
+public:
+    ZoneMembership(const MeshGeometry *geometry, const std::vector<std::vector<double> > &polygonX,
+        const std::vector<std::vector<double> > &polygonY);
+    ZoneMembership(const MeshGeometry *geometry, const std::vector<int> &faceZones, unsigned int zoneCount);
+
+    static double faceArea(const MeshGeometry *geometry, unsigned int face);
+    static bool faceCentroid(const MeshGeometry *geometry, unsigned int face, double *x, double *y);
+    static bool inPolygon(double x, double y, const std::vector<double> &polygonX,
+        const std::vector<double> &polygonY);
+
+    unsigned int zoneCount() const
+    {
+        return d_zoneCount;
+    }
+
+    const std::vector<unsigned int> &faces() const
+    {
+        return d_faces;
+    }
+
+    const std::vector<unsigned int> &zones() const
+    {
+        return d_zones;
+    }
+
+    const std::vector<double> &areas() const
+    {
+        return d_areas;
+    }
+
+    double zoneArea(unsigned int zone) const
+    {
+        return d_zoneAreas[zone];
+    }
+
+    unsigned int zoneFaceCount(unsigned int zone) const
+    {
+        return d_zoneFaceCounts[zone];
+    }
+
+    virtual unsigned long sizeInBytes() const;
+};
+
+} // namespace ugrid
+
+#endif // _ZoneMembership_h
@@ -0,0 +1,272 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <map>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Array.h>
+#include <Structure.h>
+#include <Error.h>
+#include <util.h>
+#include <escaping.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+#include "BESStopWatch.h"
+
+#include "ugrid_utils.h"
+#include "MeshDataVariable.h"
+#include "TwoDMeshTopology.h"
+#include "MeshGeometry.h"
+#include "RestrictionResult.h"
+#include "ugrid_restrict.h"
+#include <gridfields/GFError.h>
+
+#include "ugrid_count.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+#define BBOX_DIMENSION "bbox"
+
+/**
+ * Function Arguments
+ */
+struct UgridCountArgs {
+    /**
+     * The range variables whose size is estimated; they also select the meshes.
+     */
+    vector<libdap::Array *> rangeVars;
+
+    /**
+     * The domain filter expression, as for ugnr().
+     */
+    string filterExpression;
+};
+
+static string ugctUsage()
+{
+    return "ugct(rangeVariable:array, [rangeVariable:array, ... ] condition:string)";
+}
+
+/**
+ * Process the functions arguments and return the structure containing their values.
+ */
+static UgridCountArgs processCountArgs(int argc, BaseType *argv[])
+{
+    UgridCountArgs args;
+
+    if (argc < 2)
+        throw Error(malformed_expr,
+            "Wrong number of arguments to ugct(): " + ugctUsage() + " was passed " + long_to_string(argc)
+                + " argument(s)");
+
+    BaseType *bt = argv[argc - 1];
+    if (bt->type() != dods_str_c)
+        throw Error(malformed_expr,
+            "ugct() - Wrong type for the filter expression, expected DAP String. " + ugctUsage() + " was passed a/an "
+                + bt->type_name());
+    args.filterExpression = www2id(dynamic_cast<Str&>(*bt).value());
+
+    for (int i = 0; i < argc - 1; i++) {
+        libdap::Array *rangeVar = dynamic_cast<libdap::Array*>(argv[i]);
+        if (rangeVar == 0)
+            throw Error(malformed_expr,
+                "ugct() - Wrong type for range variable argument, expected DAP Array. " + ugctUsage()
+                    + " was passed a/an " + argv[i]->type_name());
+
+        args.rangeVars.push_back(rangeVar);
+    }
+
+    return args;
+}
+
+static void addCount(Structure *dapResult, const string &name, unsigned int count)
+{
+    Int32 *value = new Int32(name);
+    value->set_value(count);
+    dapResult->add_var_nocopy(value);
+}
+
+/**
+ * Add the counts and bounding box of the restricted mesh, and the estimated
+ * size of each of its range variables, to the result.
+ */
+static void countSubset(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridCountArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    RestrictionResult *owned = 0;
+    RestrictionResult *rr = getRestrictionResult(&tdmt, &dds, node, args.filterExpression, &owned);
+    try {
+        // The edges and bounding box need the mesh's geometry; they are
+        // computed once for each (cached) result.
+        if (!rr->empty()) rr->measure(tdmt.getMeshGeometry(&dds));
+
+        BESDEBUG("ugrid",
+            "countSubset() - Mesh '" << meshVariableName << "' subset has " << rr->nodes().size() << " nodes and " << rr->faces().size() << " faces." << endl);
+
+        addCount(dapResult, meshVariableName + "_node_count", rr->nodes().size());
+        addCount(dapResult, meshVariableName + "_face_count", rr->faces().size());
+        addCount(dapResult, meshVariableName + "_edge_count", rr->edgeCount());
+
+        vector<double> bbox;
+        bbox.push_back(rr->minX());
+        bbox.push_back(rr->minY());
+        bbox.push_back(rr->maxX());
+        bbox.push_back(rr->maxY());
+
+        Float64 bboxProto(meshVariableName + "_bbox");
+        libdap::Array *bboxArray = new libdap::Array(meshVariableName + "_bbox", &bboxProto);
+        bboxArray->append_dim(bbox.size(), BBOX_DIMENSION);
+        bboxArray->set_value(bbox, bbox.size());
+        bboxArray->get_attr_table().append_attr("order", "String", "min_x min_y max_x max_y");
+        dapResult->add_var_nocopy(bboxArray);
+
+        for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+            MeshDataVariable *mdv = *rvit;
+
+            unsigned int locations;
+            switch (mdv->getGridLocation()) {
+            case node:
+                locations = rr->nodes().size();
+                break;
+            case face:
+                locations = rr->faces().size();
+                break;
+            default:
+                locations = rr->edgeCount();
+                break;
+            }
+
+            tdmt.setLocationCoordinateDimension(mdv);
+
+            // The size of the (constrained) variable with its location dimension
+            // reduced to the subset, as ugnr() would return it.
+            libdap::Array *source = mdv->getDapArray();
+            double bytes = source->var()->width();
+            for (libdap::Array::Dim_iter d = source->dim_begin(); d != source->dim_end(); ++d)
+                bytes *= (d == mdv->getLocationCoordinateDimension()) ? locations : source->dimension_size(d, true);
+
+            Float64 *estimate = new Float64(mdv->getName() + "_bytes");
+            estimate->set_value(bytes);
+            dapResult->add_var_nocopy(estimate);
+        }
+    }
+    catch (...) {
+        delete owned;
+        throw;
+    }
+
+    delete owned;
+}
+
+/**
+ @brief Return the size of the subset ugnr() would return, without reading any range data.
+
+ The arguments are those of ugnr(). For each mesh the result holds the number of
+ nodes, faces and (distinct) edges in the subset, as Int32 <mesh>_node_count,
+ <mesh>_face_count and <mesh>_edge_count, and the bounding box of the subset's
+ nodes as Float64 <mesh>_bbox[bbox = 4] (min x, min y, max x, max y; NaN when the
+ subset is empty). For each range variable <var>_bytes is the size, in bytes, of
+ the values ugnr() would return for it. Only the mesh coordinates and face node
+ connectivity are read, and those only when the mesh geometry is not cached.
+ The node and face indices of each restriction are kept in the mesh geometry
+ cache, so repeating a query (e.g., while paging) does not run the
+ restriction again.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed. */
+void ugct(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    try {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::ugct()", "[function_invocation]");
+
+        BESDEBUG("ugrid", "ugct() - BEGIN" << endl);
+
+        if (argc == 0) {
+            string info = string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"ugct\" version=\"1.0\">\n" + "Server function for Unstructured grid operations.\n"
+                + "usage: " + ugctUsage() + "\n" + "</function>";
+            Str *response = new Str("info");
+            response->set_value(info);
+            *btpp = response;
+            return;
+        }
+
+        UgridCountArgs args = processCountArgs(argc, argv);
+
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        Structure *dapResult = 0;
+        try {
+            for (vector<libdap::Array *>::iterator it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
+            }
+
+            dapResult = new Structure("ugct_result_unwrap");
+
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                countSubset(dds, mit->first, mit->second, args, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            throw;
+        }
+
+        releaseRangeVars(&meshToRangeVarsMap);
+
+        *btpp = dapResult;
+
+        BESDEBUG("ugrid", "ugct() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
+}
+
+} // namespace ugrid
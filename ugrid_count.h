@@ -0,0 +1,71 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef UGRID_COUNT_H_
+#define UGRID_COUNT_H_
+
+#include "BaseType.h"
+#include "DDS.h"
+#include "ServerFunction.h"
+
+namespace ugrid {
+
+/**
+ Return the size of the subset ugnr() would return for the same arguments - the
+ node, face and edge counts, the bounding box and the estimated size of each
+ range variable - without reading any range data.
+**/
+void ugct(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ * The UGCT class encapsulates the function 'ugrid::ugct'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGCT: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGCT()
+{
+        setName("ugct");
+        setDescriptionString(
+            ((string)"This function returns the node, face and edge counts, the bounding box and the estimated size ") +
+            "of each range variable of the subset that ugnr() would return, without reading any range data.");
+        setUsageString("ugct(node_var [,node_var_2,...,node_var_n], 'relational query over domain')");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_count");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugct);
+        setVersion("1.0");
+}
+    virtual ~UGCT()
+    {
+    }
+
+};
+
+} // namespace ugrid
+
+#endif /* UGRID_COUNT_H_ */
@@ -0,0 +1,471 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <UInt32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Array.h>
+#include <Structure.h>
+#include <Error.h>
+#include <InternalErr.h>
+#include <util.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+#include "BESStopWatch.h"
+
+#include "ugrid_utils.h"
+#include "MeshDataVariable.h"
+#include "TwoDMeshTopology.h"
+#include "MeshGeometry.h"
+#include "DecimatedMesh.h"
+#include "ugrid_restrict.h"
+#include <gridfields/GFError.h>
+
+#include "ugrid_decimate.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+#define COARSE_NODES_DIMENSION "coarse_nodes"
+#define COARSE_FACES_DIMENSION "coarse_faces"
+#define MAX_FACE_NODES_DIMENSION "max_face_nodes"
+
+/**
+ * Function Arguments
+ */
+struct UgridDecimateArgs {
+    /**
+     * The range variables to aggregate onto the coarse mesh.
+     */
+    vector<libdap::Array *> rangeVars;
+
+    /**
+     * The number of faces the coarse mesh should have (at most).
+     */
+    unsigned int faceBudget;
+
+    /**
+     * If true, use the value of one representative node or face of each cluster
+     * instead of the mean of all of them.
+     */
+    bool representative;
+};
+
+static string ugdcUsage()
+{
+    return "ugdc(rangeVariable:array, [rangeVariable:array, ... ] faceBudget:integer [, aggregation:string])";
+}
+
+/**
+ * Process the function's arguments: the range variables, the face budget and,
+ * optionally, the aggregation ('mean', the default, or 'representative').
+ */
+static UgridDecimateArgs processDecimateArgs(int argc, BaseType *argv[])
+{
+    UgridDecimateArgs args;
+    args.representative = false;
+
+    int last = argc - 1;
+    if (last >= 0 && argv[last]->type() == dods_str_c) {
+        string aggregation = dynamic_cast<Str&>(*argv[last]).value();
+        if (aggregation == "representative")
+            args.representative = true;
+        else if (aggregation != "mean")
+            throw Error(malformed_expr,
+                "ugdc() - The aggregation must be 'mean' or 'representative', was passed '" + aggregation + "'. "
+                    + ugdcUsage());
+        --last;
+    }
+
+    if (last < 1)
+        throw Error(malformed_expr,
+            "Wrong number of arguments to ugdc(): " + ugdcUsage() + " was passed " + long_to_string(argc)
+                + " argument(s)");
+
+    int budget;
+    switch (argv[last]->type()) {
+    case dods_int32_c:
+        budget = dynamic_cast<Int32&>(*argv[last]).value();
+        break;
+    case dods_uint32_c:
+        budget = dynamic_cast<UInt32&>(*argv[last]).value();
+        break;
+    default:
+        throw Error(malformed_expr,
+            "ugdc() - Wrong type for the face budget, expected an integer. " + ugdcUsage() + " was passed a/an "
+                + argv[last]->type_name());
+    }
+    if (budget < 1) throw Error(malformed_expr, "ugdc() - The face budget must be at least one.");
+    args.faceBudget = budget;
+
+    for (int i = 0; i < last; ++i) {
+        libdap::Array *rangeVar = dynamic_cast<libdap::Array *>(argv[i]);
+        if (rangeVar == 0)
+            throw Error(malformed_expr,
+                "ugdc() - Wrong type for a range variable, expected DAP Array. " + ugdcUsage() + " was passed a/an "
+                    + argv[i]->type_name());
+        args.rangeVars.push_back(rangeVar);
+    }
+
+    return args;
+}
+
+/**
+ * Aggregate one slab: output i is the mean of the values that are not missing
+ * at the positions [start[i], start[i+1]) in positions, or NaN if there are
+ * none.
+ */
+template<typename T>
+static void clusterValues(const T *slab, const vector<unsigned int> &start, const vector<unsigned int> &positions,
+    const MissingValues &missing, vector<double> *values)
+{
+    for (unsigned int i = 0; i + 1 < start.size(); ++i) {
+        double sum = 0;
+        unsigned int count = 0;
+        for (unsigned int p = start[i]; p < start[i + 1]; ++p) {
+            double v = slab[positions[p]];
+            if (missing.isMissing(v)) continue;
+            sum += v;
+            ++count;
+        }
+        values->push_back(count > 0 ? sum / count : numeric_limits<double>::quiet_NaN());
+    }
+}
+
+/**
+ * A SlabSink that aggregates each slab of a range variable onto the nodes or
+ * faces of the coarse mesh.
+ */
+class ClusterAggregator: public SlabSink {
+private:
+    libdap::Type d_type;
+    MissingValues d_missing;
+
+    const vector<unsigned int> &d_start;
+    const vector<unsigned int> &d_positions;
+
+    vector<char> d_slab;
+
+public:
+    vector<double> values;
+
+    const MissingValues &missing() const
+    {
+        return d_missing;
+    }
+
+    ClusterAggregator(libdap::Array *source, unsigned int slabSize, const vector<unsigned int> &start,
+        const vector<unsigned int> &positions) :
+        d_type(source->var()->type()), d_missing(source), d_start(start), d_positions(positions),
+            d_slab(slabSize * source->var()->width())
+    {
+    }
+
+    virtual void *nextSlab()
+    {
+        return &d_slab[0];
+    }
+
+    virtual void slabFilled()
+    {
+        switch (d_type) {
+        case dods_byte_c:
+            clusterValues((dods_byte *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_uint16_c:
+            clusterValues((dods_uint16 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_int16_c:
+            clusterValues((dods_int16 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_uint32_c:
+            clusterValues((dods_uint32 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_int32_c:
+            clusterValues((dods_int32 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_float32_c:
+            clusterValues((dods_float32 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        case dods_float64_c:
+            clusterValues((dods_float64 *) &d_slab[0], d_start, d_positions, d_missing, &values);
+            break;
+        default:
+            throw InternalErr(__FILE__, __LINE__, "ClusterAggregator::slabFilled() - Unknown DAP type encountered.");
+        }
+    }
+};
+
+/**
+ * Add the coarse mesh: a mesh topology variable named for the source mesh, the
+ * node coordinates and the face node connectivity (zero-based, padded with -1).
+ */
+static void addCoarseMesh(const string &meshVariableName, const DecimatedMesh *dm, Structure *dapResult)
+{
+    string xName = meshVariableName + "_node_x";
+    string yName = meshVariableName + "_node_y";
+    string fncName = meshVariableName + "_face_nodes";
+
+    Int32 *mesh = new Int32(meshVariableName);
+    mesh->set_value(0);
+    AttrTable &meshAttrs = mesh->get_attr_table();
+    meshAttrs.append_attr("cf_role", "String", "mesh_topology");
+    meshAttrs.append_attr("topology_dimension", "Int32", "2");
+    meshAttrs.append_attr("node_coordinates", "String", xName + " " + yName);
+    meshAttrs.append_attr("face_node_connectivity", "String", fncName);
+    dapResult->add_var_nocopy(mesh);
+
+    vector<double> x(dm->nodeCount()), y(dm->nodeCount());
+    for (unsigned int n = 0; n < dm->nodeCount(); ++n) {
+        x[n] = dm->nodeX(n);
+        y[n] = dm->nodeY(n);
+    }
+
+    Float64 xProto(xName);
+    libdap::Array *xArray = new libdap::Array(xName, &xProto);
+    xArray->append_dim(dm->nodeCount(), COARSE_NODES_DIMENSION);
+    xArray->set_value(x, x.size());
+    dapResult->add_var_nocopy(xArray);
+
+    Float64 yProto(yName);
+    libdap::Array *yArray = new libdap::Array(yName, &yProto);
+    yArray->append_dim(dm->nodeCount(), COARSE_NODES_DIMENSION);
+    yArray->set_value(y, y.size());
+    dapResult->add_var_nocopy(yArray);
+
+    vector<dods_int32> fnc(dm->faceCount() * dm->nodesPerFace());
+    for (unsigned int f = 0; f < dm->faceCount(); ++f) {
+        for (unsigned int c = 0; c < dm->nodesPerFace(); ++c) {
+            unsigned int n = dm->faceNode(f, c);
+            fnc[f * dm->nodesPerFace() + c] = (n < dm->nodeCount()) ? (dods_int32) n : -1;
+        }
+    }
+
+    Int32 fncProto(fncName);
+    libdap::Array *fncArray = new libdap::Array(fncName, &fncProto);
+    fncArray->append_dim(dm->faceCount(), COARSE_FACES_DIMENSION);
+    fncArray->append_dim(dm->nodesPerFace(), MAX_FACE_NODES_DIMENSION);
+    fncArray->set_value(fnc, fnc.size());
+    AttrTable &fncAttrs = fncArray->get_attr_table();
+    fncAttrs.append_attr("cf_role", "String", "face_node_connectivity");
+    fncAttrs.append_attr("start_index", "Int32", "0");
+    fncAttrs.append_attr("_FillValue", "Int32", "-1");
+    dapResult->add_var_nocopy(fncArray);
+}
+
+/**
+ * Coarsen one mesh and aggregate its range variables onto it.
+ */
+static void decimate(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    const UgridDecimateArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+    const DecimatedMesh *dm = geometry->getDecimatedMesh(args.faceBudget);
+
+    BESDEBUG("ugrid",
+        "decimate() - Mesh '" << meshVariableName << "' decimated from " << geometry->faceCount() << " to " << dm->faceCount() << " faces" << endl);
+
+    addCoarseMesh(meshVariableName, dm, dapResult);
+
+    for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+        MeshDataVariable *mdv = *rvit;
+
+        // The source locations merged into each coarse location, or just the
+        // representative one.
+        vector<unsigned int> start, members;
+        unsigned int coarseCount;
+        string coarseDimension;
+        switch (mdv->getGridLocation()) {
+        case node:
+            coarseCount = dm->nodeCount();
+            coarseDimension = COARSE_NODES_DIMENSION;
+            if (args.representative) {
+                for (unsigned int c = 0; c < coarseCount; ++c) {
+                    start.push_back(c);
+                    members.push_back(dm->representativeNode(c));
+                }
+                start.push_back(coarseCount);
+            }
+            else {
+                start = dm->nodeStart();
+                members = dm->nodeMembers();
+            }
+            break;
+        case face:
+            coarseCount = dm->faceCount();
+            coarseDimension = COARSE_FACES_DIMENSION;
+            if (args.representative) {
+                for (unsigned int f = 0; f < coarseCount; ++f) {
+                    start.push_back(f);
+                    members.push_back(dm->representativeFace(f));
+                }
+                start.push_back(coarseCount);
+            }
+            else {
+                start = dm->faceStart();
+                members = dm->faceMembers();
+            }
+            break;
+        default:
+            throw Error(malformed_expr,
+                "ugdc() - The range variable '" + mdv->getName()
+                    + "' must be associated with the nodes or the faces of the mesh.");
+        }
+
+        // Read each location once, in ascending order.
+        vector<unsigned int> locations(members);
+        sort(locations.begin(), locations.end());
+        locations.erase(unique(locations.begin(), locations.end()), locations.end());
+        vector<unsigned int> positions;
+        for (vector<unsigned int>::iterator it = members.begin(); it != members.end(); ++it)
+            positions.push_back(lower_bound(locations.begin(), locations.end(), *it) - locations.begin());
+
+        tdmt.setLocationCoordinateDimension(mdv);
+
+        libdap::Array *source = mdv->getDapArray();
+        ClusterAggregator aggregator(source, locations.size(), start, positions);
+        if (!locations.empty()) streamRangeVariable(mdv, &locations, &aggregator);
+
+        Float64 proto(source->name());
+        libdap::Array *result = new libdap::Array(source->name(), &proto);
+        for (libdap::Array::Dim_iter d = source->dim_begin(); d + 1 != source->dim_end(); ++d)
+            result->append_dim(source->dimension_size(d, true), source->dimension_name(d));
+        result->append_dim(coarseCount, coarseDimension);
+
+        // With nothing to read every value is NaN.
+        if (aggregator.values.empty())
+            aggregator.values.assign(result->length(), numeric_limits<double>::quiet_NaN());
+
+        // The source's fill value is typed for the source; write it, and record
+        // it, as a Float64.
+        result->set_attr_table(source->get_attr_table());
+        aggregator.missing().setFloat64Attributes(result->get_attr_table());
+        aggregator.missing().fromNaN(&aggregator.values);
+
+        result->set_value(aggregator.values, aggregator.values.size());
+        dapResult->add_var_nocopy(result);
+    }
+}
+
+/**
+ @brief Return a coarsened version of an irregular mesh and its range variables.
+
+ The mesh is decimated to at most about face_budget faces by vertex clustering
+ (see DecimatedMesh) and returned as a UGRID mesh topology variable, named for
+ the source mesh, with node coordinates <mesh>_node_x and <mesh>_node_y and the
+ zero-based face node connectivity <mesh>_face_nodes. Each range variable is
+ returned, with its name and attributes, as a Float64 array whose location
+ dimension is replaced by the coarse nodes or faces. The value at a coarse
+ location is the mean of the non-missing values at the source locations merged
+ into it, or, with 'representative', the value at one of them (the node closest
+ to the coarse node, or the lowest numbered face); the latter reads far fewer
+ values. Values equal to the variable's _FillValue or missing_value are missing;
+ a coarse location with no other value holds the fill value, recorded as a
+ Float64 _FillValue, or NaN if the variable has none.
+
+ The coarse mesh is built once per mesh and face budget and kept with the cached
+ mesh geometry, so requests for a zoom level that has been seen before only read
+ and aggregate the range variables.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ an edge variable. */
+void ugdc(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    try {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::ugdc()", "[function_invocation]");
+
+        BESDEBUG("ugrid", "ugdc() - BEGIN" << endl);
+
+        if (argc == 0) {
+            string info = string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"ugdc\" version=\"1.0\">\n" + "Server function for Unstructured grid operations.\n"
+                + "usage: " + ugdcUsage() + "\n" + "</function>";
+            Str *response = new Str("info");
+            response->set_value(info);
+            *btpp = response;
+            return;
+        }
+
+        UgridDecimateArgs args = processDecimateArgs(argc, argv);
+
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        Structure *dapResult = 0;
+        try {
+            for (vector<libdap::Array *>::iterator it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
+            }
+
+            dapResult = new Structure("ugdc_result_unwrap");
+
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                decimate(dds, mit->first, mit->second, args, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            throw;
+        }
+
+        releaseRangeVars(&meshToRangeVarsMap);
+
+        *btpp = dapResult;
+
+        BESDEBUG("ugrid", "ugdc() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
+}
+
+} // namespace ugrid
@@ -0,0 +1,185 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Array.h>
+#include <Structure.h>
+#include <Error.h>
+#include <util.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+#include "BESStopWatch.h"
+
+#include "ugrid_utils.h"
+#include "MeshDataVariable.h"
+#include "TwoDMeshTopology.h"
+#include "MeshGeometry.h"
+#include <gridfields/GFError.h>
+
+#include "ugrid_metadata.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+#define BBOX_DIMENSION "bbox"
+
+static string ugmdUsage()
+{
+    return "ugmd(rangeVariable|meshVariable, [rangeVariable|meshVariable, ... ])";
+}
+
+static void addInt32(Structure *dapResult, const string &name, int value)
+{
+    Int32 *var = new Int32(name);
+    var->set_value(value);
+    dapResult->add_var_nocopy(var);
+}
+
+/**
+ * Add the metadata of one mesh to the result. It all comes from the mesh
+ * geometry, which is read only if it is not already cached.
+ */
+static void addMeshMetadata(DDS &dds, const string &meshVariableName, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+
+    addInt32(dapResult, meshVariableName + "_node_count", geometry->nodeCount());
+    addInt32(dapResult, meshVariableName + "_face_count", geometry->faceCount());
+    addInt32(dapResult, meshVariableName + "_nodes_per_face", geometry->nodesPerFace());
+    addInt32(dapResult, meshVariableName + "_start_index", geometry->startIndex());
+
+    Str *layout = new Str(meshVariableName + "_fnc_layout");
+    layout->set_value(geometry->facesFirst() ? "faces_first" : "nodes_first");
+    dapResult->add_var_nocopy(layout);
+
+    vector<double> extent;
+    extent.push_back(geometry->minX());
+    extent.push_back(geometry->minY());
+    extent.push_back(geometry->maxX());
+    extent.push_back(geometry->maxY());
+
+    Float64 extentProto(meshVariableName + "_extent");
+    libdap::Array *extentArray = new libdap::Array(meshVariableName + "_extent", &extentProto);
+    extentArray->append_dim(extent.size(), BBOX_DIMENSION);
+    extentArray->set_value(extent, extent.size());
+    extentArray->get_attr_table().append_attr("order", "String", "min_x min_y max_x max_y");
+    extentArray->get_attr_table().append_attr("x", "String", tdmt.nodeCoordinateName(0));
+    extentArray->get_attr_table().append_attr("y", "String", tdmt.nodeCoordinateName(1));
+    dapResult->add_var_nocopy(extentArray);
+}
+
+/**
+ @brief Return the metadata of the meshes of the arguments.
+
+ Each argument is either a range variable, standing for the mesh named by its
+ 'mesh' attribute, or a mesh variable. For each mesh the result holds Int32
+ <mesh>_node_count, <mesh>_face_count, <mesh>_nodes_per_face and
+ <mesh>_start_index (the start_index of the face node connectivity array),
+ the String <mesh>_fnc_layout, which is 'faces_first' for an nFaces x
+ nodesPerFace connectivity array and 'nodes_first' for the transpose, and the
+ Float64 <mesh>_extent[bbox = 4] (min x, min y, max x, max y of the nodes).
+
+ The values come from the cached mesh geometry, so once a mesh has been used
+ by any of the ugrid functions this reads no data at all. Clients can use the
+ extent to avoid requesting subsets that are certain to be empty.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if an argument is not on a mesh of the dataset. */
+void ugmd(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    try {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::ugmd()", "[function_invocation]");
+
+        BESDEBUG("ugrid", "ugmd() - BEGIN" << endl);
+
+        if (argc == 0) {
+            string info = string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"ugmd\" version=\"1.0\">\n" + "Server function for Unstructured grid operations.\n"
+                + "usage: " + ugmdUsage() + "\n" + "</function>";
+            Str *response = new Str("info");
+            response->set_value(info);
+            *btpp = response;
+            return;
+        }
+
+        // The meshes, each once, in the order they are first referenced.
+        vector<string> meshNames;
+        for (int i = 0; i < argc; ++i) {
+            string meshName = getAttributeValue(argv[i], UGRID_MESH);
+            if (meshName.empty()) meshName = argv[i]->name();
+
+            if (dds.var(meshName) == 0)
+                throw Error(malformed_expr,
+                    "ugmd() - The argument '" + argv[i]->name() + "' references the mesh variable '" + meshName
+                        + "' which cannot be located in this dataset. " + ugmdUsage());
+
+            if (find(meshNames.begin(), meshNames.end(), meshName) == meshNames.end()) meshNames.push_back(meshName);
+        }
+
+        Structure *dapResult = new Structure("ugmd_result_unwrap");
+        try {
+            for (vector<string>::iterator it = meshNames.begin(); it != meshNames.end(); ++it) {
+                addMeshMetadata(dds, *it, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            throw;
+        }
+
+        *btpp = dapResult;
+
+        BESDEBUG("ugrid", "ugmd() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
+}
+
+} // namespace ugrid
@@ -38,12 +38,18 @@
 #include <cmath>
 #include <iostream>
 #include <sstream>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <set>
 //#include <cxxabi.h>
 
 #include <curl/curl.h>
 
 #include <BaseType.h>
 #include <Int32.h>
+#include <Float64.h>
 #include <Str.h>
 #include <Array.h>
 #include <Structure.h>
@@ -60,6 +66,23 @@
 #include "MeshDataVariable.h"
 #include "TwoDMeshTopology.h"
 #include "NDimensionalArray.h"
+#include "ArithmeticExpression.h"
+#include "FilterBounds.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+#include "NodeFaces.h"
+#include "FaceComponents.h"
+#include "RegionIndex.h"
+#include "ValuePredicates.h"
+#include "GatherKernel.h"
+#include "GatherPlan.h"
+#include "ModuleExecutor.h"
+#include "SlabPipeline.h"
+#include "WorkStealingPool.h"
+#include "RestrictionResult.h"
+#include "MeshGeometry.h"
+#include "MeshGeometryCache.h"
+#include "SharedMeshStore.h"
 #include <gridfields/GFError.h>
 
 #include "ugrid_restrict.h"
@@ -78,6 +101,60 @@ namespace ugrid {
  * Function syntax
  */
 
+/**
+ * Options that change the subset a restriction returns. Each is given as a
+ * 'name=value' String argument ahead of the filter expression.
+ */
+struct RestrictOptions {
+    /**
+     * The number of rings of neighboring faces (faces that share a node) to
+     * add around the faces of the subset, e.g. so that a nested model has the
+     * cells it needs to interpolate its boundary. 'halo=n'.
+     */
+    unsigned int halo;
+
+    /**
+     * Drop the connected pieces of the subset (faces joined by shared edges)
+     * that have fewer faces than this, e.g. the slivers a bounding box cuts
+     * from barrier islands. 'min_faces=n'.
+     */
+    unsigned int minFaces;
+
+    /**
+     * Keep only the connected piece of the subset that holds this point.
+     * 'component_at=x,y'.
+     */
+    bool componentAt;
+    double componentX;
+    double componentY;
+
+    /**
+     * Keep only the faces whose value of the integer face variable
+     * regionVar is one of regionIds. 'region=basin_id:7,9'. With this option
+     * the filter expression may be left out.
+     */
+    string regionVar;
+    vector<int> regionIds;
+
+    RestrictOptions() :
+        halo(0), minFaces(0), componentAt(false), componentX(0), componentY(0)
+    {
+    }
+
+    bool prunesComponents() const
+    {
+        return minFaces > 1 || componentAt;
+    }
+
+    /**
+     * @return True if the subset differs from the result of the restriction.
+     */
+    bool changesSubset() const
+    {
+        return halo > 0 || prunesComponents() || !regionVar.empty();
+    }
+};
+
 /**
  * Function Arguments
  */
@@ -101,6 +178,18 @@ struct UgridRestrictArgs {
      */
     vector<libdap::Array *> rangeVars;
 
+    /**
+     * Derived variables, each given as 'name := expression' where the expression
+     * is arithmetic over range variables of one mesh (see ArithmeticExpression).
+     * Only the derived values are returned, not the variables they are computed from.
+     */
+    vector<string> derivedVars;
+
+    /**
+     * Options that change the subset, e.g. 'halo=2'.
+     */
+    RestrictOptions options;
+
     /**
      * Holds a domain filter expression that will be passed to the ugrid library.
      */
@@ -112,7 +201,7 @@ struct UgridRestrictArgs {
  * a new mesh topology is created. Once the associated mesh topology had been found (or created), the rangeVar
  * is added to the vector of rangeVars held by the mesh topology for later evaluation.
  */
-static void addRangeVar(DDS *dds, libdap::Array *rangeVar, map<string, vector<MeshDataVariable *> *> *rangeVariables)
+void addRangeVar(DDS *dds, libdap::Array *rangeVar, map<string, vector<MeshDataVariable *> *> *rangeVariables)
 {
     MeshDataVariable *mdv = new MeshDataVariable();
     mdv->init(rangeVar);
@@ -147,10 +236,485 @@ static void addRangeVar(DDS *dds, libdap::Array *rangeVar, map<string, vector<Me
     requestedRangeVarsForMesh->push_back(mdv);
 }
 
+/**
+ * Delete the range variables added by addRangeVar(), and their lists, and
+ * empty the map.
+ */
+void releaseRangeVars(map<string, vector<MeshDataVariable *> *> *meshToRangeVarsMap)
+{
+    map<string, vector<MeshDataVariable *> *>::iterator mit;
+    for (mit = meshToRangeVarsMap->begin(); mit != meshToRangeVarsMap->end(); ++mit) {
+        vector<MeshDataVariable *>::iterator rvit;
+        for (rvit = mit->second->begin(); rvit != mit->second->end(); ++rvit)
+            delete *rvit;
+        delete mit->second;
+    }
+    meshToRangeVarsMap->clear();
+}
+
+/**
+ * Compare the bounds the filter expression puts on the node coordinates with the
+ * extent of the mesh. The mesh geometry (usually cached) is only looked at when the
+ * expression does bound a coordinate. Only node restrictions are checked; face
+ * restrictions are on the face coordinates, which have no cached extent.
+ */
+bool filterMissesMesh(TwoDMeshTopology *tdmt, DDS *dds, locationType dimension, const string &filterExpression)
+{
+    if (dimension != node) return false;
+
+    FilterBounds bounds(filterExpression, tdmt->nodeCoordinateName(0), tdmt->nodeCoordinateName(1));
+    if (!bounds.bounded()) return false;
+
+    MeshGeometry *geometry = tdmt->getMeshGeometry(dds);
+    if (geometry->nodeCount() == 0) return false;
+
+    bool misses = !bounds.intersects(geometry->minX(), geometry->minY(), geometry->maxX(), geometry->maxY());
+    BESDEBUG("ugrid",
+        "filterMissesMesh() - '" << filterExpression << "' " << (misses ? "misses" : "may intersect") << " mesh '" << tdmt->meshVarName() << "'" << endl);
+
+    return misses;
+}
+
+/**
+ * Restrict the mesh with the filter expression and copy the indices of the
+ * nodes and faces in the result.
+ */
+static void restrictMesh(TwoDMeshTopology *tdmt, locationType dimension, const string &filterExpression,
+    vector<unsigned int> *nodes, vector<unsigned int> *faces)
+{
+    BESDEBUG("ugrid", "restrictMesh() - Restricting mesh '" << tdmt->meshVarName() << "' with '" << filterExpression << "'" << endl);
+
+    tdmt->buildBasicGfTopology();
+    tdmt->addIndexVariable(node);
+    tdmt->addIndexVariable(face);
+    tdmt->applyRestrictOperator(dimension, filterExpression);
+
+    nodes->resize(tdmt->getResultGridSize(node));
+    if (!nodes->empty()) tdmt->getResultIndex(node, &(*nodes)[0]);
+
+    faces->resize(tdmt->getResultGridSize(face));
+    if (!faces->empty()) tdmt->getResultIndex(face, &(*faces)[0]);
+}
+
+/**
+ * Restrict the mesh as restrictMesh() does, but share the result with the
+ * other processes using the SharedMeshStore: the first process to need a
+ * subset makes it, while those that ask for it at the same time wait and
+ * then use its result, or report its error.
+ *
+ * @return True if the mesh was restricted here, so that tdmt holds the
+ * restricted grid; false if the subset came from the store.
+ */
+bool restrictSharedMesh(TwoDMeshTopology *tdmt, DDS *dds, locationType dimension, const string &filterExpression,
+    vector<unsigned int> *nodes, vector<unsigned int> *faces)
+{
+    SharedMeshStore *store = SharedMeshStore::TheStore();
+    string stamp = MeshGeometryCache::makeStamp(dds->filename());
+    if (stamp.empty() || !store->enabled()) {
+        restrictMesh(tdmt, dimension, filterExpression, nodes, faces);
+        return true;
+    }
+
+    string key = MeshGeometryCache::makeRestrictionKey(dds->filename(), tdmt->meshVarName(), dimension,
+        filterExpression);
+    if (store->attachSubset(key, stamp, nodes, faces)) return false;
+
+    SharedMeshStore::BuildLock lock(store, key);
+    if (lock.locked() && store->attachSubset(key, stamp, nodes, faces)) return false;
+    if (lock.waited()) store->rethrowFailure(key, stamp);
+
+    try {
+        restrictMesh(tdmt, dimension, filterExpression, nodes, faces);
+    }
+    catch (Error &e) {
+        if (lock.locked()) store->recordFailure(key, stamp, e.get_error_code(), e.get_error_message());
+        throw;
+    }
+    catch (GFError &gfe) {
+        if (lock.locked()) store->recordFailure(key, stamp, malformed_expr, gfe.get_message());
+        throw;
+    }
+
+    if (lock.locked()) store->publishSubset(key, stamp, *nodes, *faces);
+
+    return true;
+}
+
+/**
+ * Get the result of restricting the mesh with the filter expression from the
+ * MeshGeometryCache, making it if the cache does not hold it. When nodes and
+ * faces are given they are the subset, already made by the caller (and a
+ * cached result with a different subset is replaced); otherwise the mesh is
+ * restricted here, through the SharedMeshStore, unless the filter misses it.
+ * Only the subset and the mesh's node and face counts are needed, not its
+ * geometry.
+ *
+ * The result belongs to the cache, unless the dataset has no stamp: then it
+ * is also returned in owned and the caller deletes it.
+ */
+RestrictionResult *getRestrictionResult(TwoDMeshTopology *tdmt, DDS *dds, locationType dimension,
+    const string &filterExpression, RestrictionResult **owned, const vector<unsigned int> *nodes,
+    const vector<unsigned int> *faces)
+{
+    MeshGeometryCache *cache = MeshGeometryCache::TheCache();
+    string key = MeshGeometryCache::makeRestrictionKey(dds->filename(), tdmt->meshVarName(), dimension,
+        filterExpression);
+    string stamp = MeshGeometryCache::makeStamp(dds->filename());
+
+    RestrictionResult *rr = stamp.empty() ? 0 : cache->getRestriction(key, stamp);
+    if (rr && (!nodes || (rr->nodes() == *nodes && rr->faces() == *faces))) return rr;
+
+    vector<unsigned int> rrNodes, rrFaces;
+    if (nodes) {
+        rrNodes = *nodes;
+        rrFaces = *faces;
+    }
+    else if (!filterMissesMesh(tdmt, dds, dimension, filterExpression)) {
+        // A filter whose bounds miss the mesh needs no restriction to know it leaves nothing.
+        restrictSharedMesh(tdmt, dds, dimension, filterExpression, &rrNodes, &rrFaces);
+    }
+
+    rr = new RestrictionResult(tdmt->getInputGridSize(node), tdmt->getInputGridSize(face), &rrNodes, &rrFaces);
+    if (stamp.empty())
+        *owned = rr;
+    else
+        cache->putRestriction(key, stamp, rr);
+
+    return rr;
+}
+
+/**
+ * The error for a restriction that leaves nothing, as thrown by
+ * TwoDMeshTopology::convertResultGridFieldStructureToDapObjects().
+ */
+static BESError emptyResponseError()
+{
+    return BESError("Oops! The ugrid constraint expression resulted in an empty response.", BES_SYNTAX_USER_ERROR,
+        __FILE__, __LINE__);
+}
+
+/**
+ * If arg is an option ('name=value' where name is one of the RestrictOptions
+ * and there is no ':=', which marks a derived variable) set it in options.
+ *
+ * @return True if arg was an option.
+ */
+static bool parseRestrictOption(const string &func_name, const string &arg, RestrictOptions *options)
+{
+    if (arg.find(":=") != string::npos) return false;
+
+    string::size_type eq = arg.find('=');
+    if (eq == string::npos) return false;
+
+    string name = arg.substr(0, eq);
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+
+    string value = arg.substr(eq + 1);
+
+    if (name == "halo" || name == "min_faces") {
+        char *end;
+        long n = strtol(value.c_str(), &end, 10);
+        while (*end == ' ' || *end == '\t')
+            ++end;
+        if (value.find_first_not_of(" \t") == string::npos || *end != '\0' || n < 0)
+            throw Error(malformed_expr,
+                func_name + "() - The " + name + " option must be a non-negative number of faces, not '" + value + "'.");
+        if (name == "halo")
+            options->halo = n;
+        else
+            options->minFaces = n;
+        return true;
+    }
+
+    if (name == "component_at") {
+        // 'x,y' or 'x y'
+        replace(value.begin(), value.end(), ',', ' ');
+        istringstream iss(value);
+        string rest;
+        if (!(iss >> options->componentX >> options->componentY) || (iss >> rest))
+            throw Error(malformed_expr,
+                func_name + "() - The component_at option must be a point 'x,y', not '" + arg.substr(eq + 1) + "'.");
+        options->componentAt = true;
+        return true;
+    }
+
+    if (name == "region") {
+        // 'variable:id,id,...'
+        string::size_type colon = value.find(':');
+        if (colon != string::npos) {
+            options->regionVar = value.substr(0, colon);
+            options->regionVar.erase(0, options->regionVar.find_first_not_of(" \t"));
+            options->regionVar.erase(options->regionVar.find_last_not_of(" \t") + 1);
+
+            string ids = value.substr(colon + 1);
+            replace(ids.begin(), ids.end(), ',', ' ');
+            istringstream iss(ids);
+            int id;
+            options->regionIds.clear();
+            while (iss >> id)
+                options->regionIds.push_back(id);
+            if (!iss.eof()) options->regionIds.clear();
+        }
+        if (options->regionVar.empty() || options->regionIds.empty())
+            throw Error(malformed_expr,
+                func_name + "() - The region option must name a face variable and its ids, e.g. 'region=basin_id:7,9', not '"
+                    + value + "'.");
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Get the inverted index of the region variable named in the options, reading
+ * the variable only if the mesh's geometry does not already hold the index.
+ */
+static const RegionIndex *getRegionIndex(const string &func_name, TwoDMeshTopology *tdmt, DDS *dds,
+    MeshGeometry *geometry, const RestrictOptions &options)
+{
+    string key = "region index " + options.regionVar;
+    RegionIndex *index = dynamic_cast<RegionIndex *>(geometry->getProduct(key));
+    if (index) return index;
+
+    libdap::Array *regionVar = dynamic_cast<libdap::Array *>(dds->var(options.regionVar));
+    if (!regionVar)
+        throw Error(malformed_expr, func_name + "() - The region variable '" + options.regionVar + "' was not found.");
+
+    MeshDataVariable region;
+    region.init(regionVar);
+    if (region.getMeshName() != tdmt->meshVarName() || region.getGridLocation() != face)
+        throw Error(malformed_expr,
+            func_name + "() - The region variable '" + options.regionVar + "' must be a face variable of the mesh '"
+                + tdmt->meshVarName() + "'.");
+    if ((unsigned int) regionVar->length() != geometry->faceCount())
+        throw Error(malformed_expr,
+            func_name + "() - The region variable '" + options.regionVar + "' must hold one value for every face.");
+
+    double *values = extractArray<double>(regionVar);
+    vector<int> faceIds(values, values + geometry->faceCount());
+    delete[] values;
+
+    index = new RegionIndex(faceIds);
+    geometry->putProduct(key, index);
+
+    BESDEBUG("ugrid",
+        "getRegionIndex() - Indexed " << index->ids().size() << " distinct values of '" << options.regionVar << "'" << endl);
+
+    return index;
+}
+
+/**
+ * Apply the options to the node and face indices of the restriction's result.
+ * On return both are in ascending order and the nodes include every corner of
+ * the faces.
+ *
+ * @param restricted False if there was no filter expression, in which case
+ * the subset comes from the options alone (the region option).
+ */
+static void applyRestrictOptions(const string &func_name, TwoDMeshTopology *tdmt, DDS *dds,
+    const RestrictOptions &options, bool restricted, vector<unsigned int> *nodes, vector<unsigned int> *faces)
+{
+    MeshGeometry *geometry = tdmt->getMeshGeometry(dds);
+
+    sort(faces->begin(), faces->end());
+
+    if (!options.regionVar.empty()) {
+        vector<unsigned int> regionFaces;
+        getRegionIndex(func_name, tdmt, dds, geometry, options)->select(options.regionIds, &regionFaces);
+
+        if (restricted) {
+            vector<unsigned int> both;
+            set_intersection(faces->begin(), faces->end(), regionFaces.begin(), regionFaces.end(),
+                back_inserter(both));
+            faces->swap(both);
+        }
+        else {
+            faces->swap(regionFaces);
+        }
+
+        nodes->clear();
+    }
+
+    if (options.prunesComponents()) {
+        FaceComponents components(geometry->getFaceAdjacency(), geometry->nodesPerFace(), *faces);
+        BESDEBUG("ugrid",
+            "applyRestrictOptions() - The subset of mesh '" << tdmt->meshVarName() << "' has " << components.componentCount() << " connected components." << endl);
+
+        if (options.minFaces > 1) components.keepLarge(faces, options.minFaces);
+
+        if (options.componentAt) {
+            FaceWeights located;
+            if (geometry->getFaceLocator()->locate(options.componentX, options.componentY, &located))
+                components.keepComponentOf(faces, located.face);
+            else
+                faces->clear();
+        }
+
+        // Nodes that were only in the pruned faces go with them.
+        nodes->clear();
+    }
+
+    if (options.halo > 0) geometry->getNodeFaces()->grow(faces, options.halo);
+
+    for (vector<unsigned int>::iterator it = faces->begin(); it != faces->end(); ++it) {
+        for (unsigned int c = 0; c < geometry->nodesPerFace(); ++c) {
+            unsigned int n = geometry->faceNode(*it, c);
+            if (n < geometry->nodeCount()) nodes->push_back(n);
+        }
+    }
+    sort(nodes->begin(), nodes->end());
+    nodes->erase(unique(nodes->begin(), nodes->end()), nodes->end());
+
+    BESDEBUG("ugrid",
+        "applyRestrictOptions() - The subset of mesh '" << tdmt->meshVarName() << "' has " << nodes->size() << " nodes and " << faces->size() << " faces." << endl);
+}
+
+// When a value predicate reads a range variable at scattered locations, runs
+// of locations separated by fewer than this many unused ones are read as one
+// hyperslab.
+#define VALUE_READ_MAX_GAP 1024
+
+/**
+ * @return The names of the range variables of the mesh that hold values at the
+ * given location, which are the variables a filter expression may compare.
+ */
+static set<string> valueVariableNames(DDS *dds, const string &meshVariableName, locationType location)
+{
+    set<string> names;
+    for (DDS::Vars_iter vi = dds->var_begin(); vi != dds->var_end(); ++vi) {
+        libdap::Array *a = dynamic_cast<libdap::Array *>(*vi);
+        if (!a || getAttributeValue(a, UGRID_MESH) != meshVariableName) continue;
+
+        try {
+            MeshDataVariable mdv;
+            mdv.init(a);
+            if (mdv.getGridLocation() == location) names.insert(a->name());
+        }
+        catch (Error &e) {
+            // Not a usable range variable, so it is not one a filter can use.
+        }
+    }
+
+    return names;
+}
+
+/**
+ * Read the values of the predicate's variable at the candidate locations
+ * (given in ascending order) from the slab of its outer dimensions that the
+ * predicate names. Only hyperslabs that cover the candidates are read, so a
+ * small candidate set costs little I/O however large the variable is.
+ */
+static void readValuesAt(const string &func_name, libdap::Array *a, const ValuePredicate &predicate,
+    const vector<unsigned int> &candidates, vector<double> *values)
+{
+    values->resize(candidates.size());
+    if (candidates.empty()) return;
+
+    if (predicate.indices.size() + 1 != (unsigned int) a->dimensions())
+        throw Error(malformed_expr,
+            func_name + "() - The filter must give an index ([i]) for each dimension of '" + predicate.variable
+                + "' but the last, which is " + long_to_string(a->dimensions() - 1) + " index(es).");
+
+    // Save the constraint, so it can be put back, and select the slab.
+    vector<int> start, stride, stop;
+    unsigned int d = 0;
+    for (libdap::Array::Dim_iter di = a->dim_begin(); di != a->dim_end(); ++di, ++d) {
+        start.push_back(a->dimension_start(di, true));
+        stride.push_back(a->dimension_stride(di, true));
+        stop.push_back(a->dimension_stop(di, true));
+
+        if (d < predicate.indices.size()) {
+            if (predicate.indices[d] >= (unsigned int) a->dimension_size(di))
+                throw Error(malformed_expr,
+                    func_name + "() - The filter's index " + long_to_string(predicate.indices[d]) + " is out of range for '"
+                        + predicate.variable + "'.");
+            a->add_constraint(di, predicate.indices[d], 1, predicate.indices[d]);
+        }
+    }
+    libdap::Array::Dim_iter locationDim = a->dim_end() - 1;
+
+    unsigned int reads = 0;
+    unsigned int first = 0;
+    while (first < candidates.size()) {
+        unsigned int last = first;
+        while (last + 1 < candidates.size() && candidates[last + 1] - candidates[last] <= VALUE_READ_MAX_GAP)
+            ++last;
+
+        a->add_constraint(locationDim, candidates[first], 1, candidates[last]);
+        a->set_read_p(false);
+        double *slab = extractArray<double>(a);
+        for (unsigned int i = first; i <= last; ++i)
+            (*values)[i] = slab[candidates[i] - candidates[first]];
+        delete[] slab;
+
+        ++reads;
+        first = last + 1;
+    }
+
+    d = 0;
+    for (libdap::Array::Dim_iter di = a->dim_begin(); di != a->dim_end(); ++di, ++d)
+        a->add_constraint(di, start[d], stride[d], stop[d]);
+    a->set_read_p(false);
+
+    BESDEBUG("ugrid",
+        "readValuesAt() - Read " << candidates.size() << " values of '" << predicate.variable << "' in " << reads << " hyperslab(s)." << endl);
+}
+
+/**
+ * Remove the locations that fail the value predicates from the node and face
+ * indices of the restriction's result (both in ascending order). For a node
+ * restriction, the faces that lose a corner go too; for a face restriction the
+ * nodes are left to applyRestrictOptions(), which rebuilds them from the faces.
+ */
+static void applyValuePredicates(const string &func_name, TwoDMeshTopology *tdmt, DDS *dds,
+    const vector<ValuePredicate> &predicates, locationType dimension, vector<unsigned int> *nodes,
+    vector<unsigned int> *faces)
+{
+    vector<unsigned int> *candidates = (dimension == node) ? nodes : faces;
+    sort(candidates->begin(), candidates->end());
+
+    for (vector<ValuePredicate>::const_iterator it = predicates.begin(); it != predicates.end(); ++it) {
+        libdap::Array *a = dynamic_cast<libdap::Array *>(dds->var(it->variable));
+        if (!a) throw InternalErr(__FILE__, __LINE__, "applyValuePredicates() - Missing variable " + it->variable);
+
+        vector<double> values;
+        readValuesAt(func_name, a, *it, *candidates, &values);
+
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < candidates->size(); ++i) {
+            if (it->test(values[i])) (*candidates)[kept++] = (*candidates)[i];
+        }
+        candidates->resize(kept);
+    }
+
+    if (dimension == node) {
+        MeshGeometry *geometry = tdmt->getMeshGeometry(dds);
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < faces->size(); ++i) {
+            bool keep = true;
+            for (unsigned int c = 0; c < geometry->nodesPerFace() && keep; ++c) {
+                unsigned int n = geometry->faceNode((*faces)[i], c);
+                if (n < geometry->nodeCount()) keep = binary_search(nodes->begin(), nodes->end(), n);
+            }
+            if (keep) (*faces)[kept++] = (*faces)[i];
+        }
+        faces->resize(kept);
+    }
+    else {
+        nodes->clear();
+    }
+}
 
 string usage(string fnc){
 
-    string usage = fnc+"(rangeVariable:string, [rangeVariable:string, ... ] condition:string)";
+    if (fnc == "ugtr")
+        return fnc + "(rangeVariable:string, [rangeVariable:string, ... ] reduction:string, condition:string)";
+
+    if (fnc == "ugnrb" || fnc == "ugfrb")
+        return fnc + "(rangeVariable:string, [rangeVariable:string, ... ] condition:string, [condition:string, ... ])";
+
+    string usage = fnc+"(rangeVariable:string, [rangeVariable:string, ... ] ['name := expression', ... ] ['halo=n'] ['min_faces=n'] ['component_at=x,y'] ['region=variable:id,...'] condition:string)";
 
     return usage;
 }
@@ -204,6 +768,15 @@ static UgridRestrictArgs processUgrArgs(string func_name, locationType dimension
 
     BESDEBUG("ugrid", "args.filterExpression: '" << args.filterExpression << "' (URL DECODED)" << endl);
 
+    // A region selects the subset by itself, so the filter may be left out.
+    if (parseRestrictOption(func_name, args.filterExpression, &args.options)) {
+        if (args.options.regionVar.empty())
+            throw Error(malformed_expr,
+                func_name + "() - The last argument must be the filter expression unless a region is given. "
+                    + usage(func_name));
+        args.filterExpression = "";
+    }
+
     // --------------------------------------------------
     // Process the range variables selected by the user.
     // We know that argc>=3, because we checked so the
@@ -212,10 +785,18 @@ static UgridRestrictArgs processUgrArgs(string func_name, locationType dimension
     // of argv.
     for (int i = 0; i < (argc - 1); i++) {
         bt = argv[i];
+        if (bt->type() == dods_str_c) {
+            if (parseRestrictOption(func_name, www2id(dynamic_cast<Str&>(*bt).value()), &args.options)) continue;
+
+            args.derivedVars.push_back(www2id(dynamic_cast<Str&>(*bt).value()));
+            BESDEBUG("ugrid", "args.derivedVars: '" << args.derivedVars.back() << "'" << endl);
+            continue;
+        }
+
         if (bt->type() != dods_array_c)
             throw Error(malformed_expr,
-                "Wrong type for second argument, expected DAP Array. " + usage(func_name) + "  was passed a/an "
-                    + bt->type_name());
+                "Wrong type for second argument, expected DAP Array or a derived variable String. " + usage(func_name)
+                    + "  was passed a/an " + bt->type_name());
 
         libdap::Array *newRangeVar = dynamic_cast<libdap::Array*>(bt);
         if (newRangeVar == 0) {
@@ -254,43 +835,112 @@ static string arrayState(libdap::Array *dapArray, string indent)
     return arrayState.str();
 }
 
-static void copyUsingSubsetIndex(libdap::Array *sourceArray, vector<unsigned int> *subsetIndex, void *result)
+/**
+ * @return True if the slabs of sourceArray are read whole, either because the
+ * plan says so or because the location dimension is not the length the plan
+ * was made for (e.g., it is constrained).
+ */
+static bool readsWholeSlab(libdap::Array *sourceArray, libdap::Array::Dim_iter locationDim, const GatherPlan &plan)
+{
+    return plan.strategy() == GatherPlan::read_full
+        || (unsigned int) sourceArray->dimension_size(locationDim, true) != plan.slabLength();
+}
+
+/**
+ * @return The number of bytes readUsingPlan() copies from one slab of
+ * sourceArray when it does not gather them.
+ */
+static unsigned long plannedReadBytes(libdap::Array *sourceArray, libdap::Array::Dim_iter locationDim,
+    const GatherPlan &plan)
 {
-    BESDEBUG("ugrid", "ugrid::copyUsingIndex() - BEGIN" << endl);
+    unsigned long width = NDimensionalArray::sizeOfType(sourceArray->var()->type());
+    if (readsWholeSlab(sourceArray, locationDim, plan))
+        return sourceArray->dimension_size(locationDim, true) * width;
+
+    unsigned long bytes = 0;
+    for (unsigned int r = 0; r < plan.readCount(); ++r)
+        bytes += (unsigned long) (plan.readLast(r) - plan.readFirst(r) + 1) * width;
+    return bytes;
+}
 
-    switch (sourceArray->var()->type()) {
-    case dods_byte_c:
-        sourceArray->value(subsetIndex, (dods_byte *) result);
-        break;
-    case dods_uint16_c:
-        sourceArray->value(subsetIndex, (dods_uint16 *) result);
-        break;
-    case dods_int16_c:
-        sourceArray->value(subsetIndex, (dods_int16 *) result);
-        break;
-    case dods_uint32_c:
-        sourceArray->value(subsetIndex, (dods_uint32 *) result);
-        break;
-    case dods_int32_c:
-        sourceArray->value(subsetIndex, (dods_int32 *) result);
-        break;
+/**
+ * Copy the values at the plan's locations from the bytes readUsingPlan() read,
+ * but did not gather, from one slab of an array of the given width.
+ */
+static void gatherPlannedRead(const GatherPlan &plan, bool whole, const char *read, unsigned int width, void *result)
+{
+    if (whole) {
+        plan.fullKernel().gather(read, width, result);
+        return;
+    }
 
-    case dods_float32_c:
-        sourceArray->value(subsetIndex, (dods_float32 *) result);
-        break;
-    case dods_float64_c:
-        sourceArray->value(subsetIndex, (dods_float64 *) result);
-        break;
+    for (unsigned int r = 0; r < plan.readCount(); ++r) {
+        plan.readKernel(r).gather(read, width, (char *) result + (size_t) plan.readPosition(r) * width);
+        read += (size_t) (plan.readLast(r) - plan.readFirst(r) + 1) * width;
+    }
+}
 
-    default:
-        throw InternalErr(__FILE__, __LINE__, "ugrid::hgr5::copyUsingSubsetIndex() - Unknown DAP type encountered.");
+/**
+ * Read one slab of sourceArray (its other dimensions are constrained to a
+ * single index) and copy the values at the plan's locations to result. The
+ * plan says whether the whole slab is read or only the part, or parts, of the
+ * location dimension that hold the locations; either way the values are
+ * gathered straight from the Array's buffer. If gather is false the values
+ * read are copied to result as they are, one read after the other, to be
+ * gathered later by gatherPlannedRead().
+ */
+static void readUsingPlan(libdap::Array *sourceArray, libdap::Array::Dim_iter locationDim, const GatherPlan &plan,
+    void *result, bool gather = true)
+{
+    BESDEBUG("ugrid", "ugrid::readUsingPlan() - BEGIN" << endl);
+
+    // Throws for a type that is not numeric.
+    unsigned int width = NDimensionalArray::sizeOfType(sourceArray->var()->type());
+
+    if (readsWholeSlab(sourceArray, locationDim, plan)) {
+        sourceArray->set_read_p(false);
+        sourceArray->read();
+        if (gather)
+            plan.fullKernel().gather(sourceArray->get_buf(), width, result);
+        else
+            memcpy(result, sourceArray->get_buf(), (size_t) sourceArray->dimension_size(locationDim, true) * width);
+        return;
+    }
+
+    int start = sourceArray->dimension_start(locationDim, true);
+    int stride = sourceArray->dimension_stride(locationDim, true);
+    int stop = sourceArray->dimension_stop(locationDim, true);
+
+    try {
+        char *copy = (char *) result;
+        for (unsigned int r = 0; r < plan.readCount(); ++r) {
+            sourceArray->add_constraint(locationDim, start + plan.readFirst(r) * stride, stride,
+                start + plan.readLast(r) * stride);
+            sourceArray->set_read_p(false);
+            sourceArray->read();
+            if (gather) {
+                plan.readKernel(r).gather(sourceArray->get_buf(), width,
+                    (char *) result + (size_t) plan.readPosition(r) * width);
+            }
+            else {
+                size_t bytes = (size_t) (plan.readLast(r) - plan.readFirst(r) + 1) * width;
+                memcpy(copy, sourceArray->get_buf(), bytes);
+                copy += bytes;
+            }
+        }
+    }
+    catch (...) {
+        sourceArray->add_constraint(locationDim, start, stride, stop);
+        throw;
     }
 
-    BESDEBUG("ugrid", "ugrid::copyUsingIndex() - END" << endl);
+    sourceArray->add_constraint(locationDim, start, stride, stop);
+
+    BESDEBUG("ugrid", "ugrid::readUsingPlan() - END" << endl);
 }
 
 // This is only used for the ugrid2 BESDEBUG lines.
-static string vectorToString(vector<unsigned int> *index)
+static string vectorToString(const vector<unsigned int> *index)
 {
     BESDEBUG("ugrid", "indexToString() - BEGIN"<< endl);
     BESDEBUG("ugrid", "indexToString() - index.size(): " << libdap::long_to_string(index->size()) << endl);
@@ -308,17 +958,74 @@ static string vectorToString(vector<unsigned int> *index)
 }
 
 /**
- *
+ * A SlabSink that stores each slab in the next last dimension hyperslab of an
+ * NDimensionalArray; used by gatherRangeVariable().
+ */
+class NDimensionalArraySink: public SlabSink {
+private:
+    NDimensionalArray *d_results;
+
+public:
+    NDimensionalArraySink(NDimensionalArray *results) :
+        d_results(results)
+    {
+    }
+
+    virtual void *nextSlab()
+    {
+        void *slab;
+        d_results->getNextLastDimensionHyperSlab(&slab);
+        return slab;
+    }
+
+    virtual void slabFilled()
+    {
+    }
+};
+
+/**
+ * What rDAWorker() does with each slab of a range variable once it has
+ * constrained the variable's outer dimensions to that slab.
  */
-static void rDAWorker(MeshDataVariable *mdv, libdap::Array::Dim_iter thisDim, vector<unsigned int> *slab_subset_index,
-    NDimensionalArray *results)
+class SlabReader {
+public:
+    virtual ~SlabReader()
+    {
+    }
+
+    virtual void readSlab(libdap::Array *dapArray, libdap::Array::Dim_iter locationDim) = 0;
+};
+
+/**
+ * Read each slab and pass the values at the plan's locations to the sink.
+ */
+class GatheringSlabReader: public SlabReader {
+private:
+    const GatherPlan &d_plan;
+    SlabSink *d_sink;
+
+public:
+    GatheringSlabReader(const GatherPlan &plan, SlabSink *sink) :
+        d_plan(plan), d_sink(sink)
+    {
+    }
+
+    virtual void readSlab(libdap::Array *dapArray, libdap::Array::Dim_iter locationDim)
+    {
+        void *slab = d_sink->nextSlab();
+        readUsingPlan(dapArray, locationDim, d_plan, slab);
+        d_sink->slabFilled();
+    }
+};
+
+/**
+ * Recurse over the (constrained) outer dimensions of the range variable, reading
+ * one slab of the location dimension at a time with the reader.
+ */
+static void rDAWorker(MeshDataVariable *mdv, libdap::Array::Dim_iter thisDim, SlabReader *reader)
 {
     libdap::Array *dapArray = mdv->getDapArray();
 
-    // For real data, this output is huge. jhrg 4/15/15
-    BESDEBUG("ugrid2",
-        "rDAWorker() - slab_subset_index" << vectorToString(slab_subset_index) << " size: " << slab_subset_index->size() << endl);
-
     // The locationCoordinateDimension is the dimension of the array that is associated with the ugrid "rank" - e.g. it is the
     // dimension that ties the variable to the 'nodes' (rank 0) or 'edges' (rank 1) or 'faces' (rank 2) of the ugrid.
     libdap::Array::Dim_iter locationCoordinateDim = mdv->getLocationCoordinateDimension();
@@ -336,7 +1043,7 @@ static void rDAWorker(MeshDataVariable *mdv, libdap::Array::Dim_iter thisDim, ve
 
         for (unsigned int dimIndex = start; dimIndex <= stop; dimIndex += stride) {
             dapArray->add_constraint(thisDim, dimIndex, 1, dimIndex);
-            rDAWorker(mdv, thisDim + 1, slab_subset_index, results);
+            rDAWorker(mdv, thisDim + 1, reader);
         }
 
         // Reset the constraint for this dimension.
@@ -364,16 +1071,205 @@ static void rDAWorker(MeshDataVariable *mdv, libdap::Array::Dim_iter thisDim, ve
         BESDEBUG("ugrid",
             "rdaWorker() - lastDimHyperSlabLocation: " << NDimensionalArray::vectorToIndices(&lastDimHyperSlabLocation) << endl);
 
-        // unused. 4/7/14 jhrg. unsigned int elementCount;
-
-        void *slab;
-        //results->getLastDimensionHyperSlab(&lastDimHyperSlabLocation, &slab, &elementCount);
-        results->getNextLastDimensionHyperSlab(&slab);
+        reader->readSlab(dapArray, thisDim);
+    }
+}
+
+/**
+ * The reader thread of a SlabPipeline: run rDAWorker() over the range variable
+ * and copy the bytes each slab's reads return to the pipeline's next empty
+ * buffer; the thread that made the pipeline gathers them (see
+ * pipelineRangeVariable()).
+ */
+class PipelinedSlabReader: public SlabReader, public SlabPipeline::Producer {
+private:
+    MeshDataVariable *d_mdv;
+    const GatherPlan &d_plan;
+    SlabPipeline *d_pipeline;
+
+public:
+    PipelinedSlabReader(MeshDataVariable *mdv, const GatherPlan &plan) :
+        d_mdv(mdv), d_plan(plan), d_pipeline(0)
+    {
+    }
+
+    virtual void run(SlabPipeline *pipeline)
+    {
+        d_pipeline = pipeline;
+        rDAWorker(d_mdv, d_mdv->getDapArray()->dim_begin(), this);
+    }
 
-        dapArray->read();
+    virtual void readSlab(libdap::Array *dapArray, libdap::Array::Dim_iter locationDim)
+    {
+        // Null once the consumer has stopped; the remaining slabs are skipped.
+        void *buffer = d_pipeline->nextEmpty();
+        if (!buffer) return;
 
-        copyUsingSubsetIndex(dapArray, slab_subset_index, slab);
+        readUsingPlan(dapArray, locationDim, d_plan, buffer, false);
+        d_pipeline->filled();
     }
+};
+
+/**
+ * @return The number of slabs of the location dimension in the (constrained)
+ * range variable.
+ */
+static unsigned long slabCount(MeshDataVariable *mdv)
+{
+    libdap::Array *dapArray = mdv->getDapArray();
+
+    unsigned long count = 1;
+    for (libdap::Array::Dim_iter dim = dapArray->dim_begin(); dim != dapArray->dim_end(); ++dim) {
+        if (dim != mdv->getLocationCoordinateDimension()) count *= dapArray->dimension_size(dim, true);
+    }
+
+    return count;
+}
+
+/**
+ * Like rDAWorker() with a GatheringSlabReader, but read the slabs on a second
+ * thread, up to depth slabs ahead, while the values of each slab already read
+ * are gathered and passed to the sink on this one.
+ */
+static void pipelineRangeVariable(MeshDataVariable *mdv, const GatherPlan &plan, unsigned int depth, SlabSink *sink)
+{
+    libdap::Array *dapArray = mdv->getDapArray();
+    libdap::Array::Dim_iter locationDim = mdv->getLocationCoordinateDimension();
+
+    bool whole = readsWholeSlab(dapArray, locationDim, plan);
+    unsigned int width = NDimensionalArray::sizeOfType(dapArray->var()->type());
+
+    BESDEBUG("ugrid",
+        "pipelineRangeVariable() - Reading '" << mdv->getName() << "' " << depth << " slabs ahead" << endl);
+
+    SlabPipeline pipeline(depth, plannedReadBytes(dapArray, locationDim, plan));
+    PipelinedSlabReader reader(mdv, plan);
+    pipeline.start(&reader);
+
+    while (const char *read = (const char *) pipeline.nextFull()) {
+        void *slab = sink->nextSlab();
+        gatherPlannedRead(plan, whole, read, width, slab);
+        sink->slabFilled();
+        pipeline.consumed();
+    }
+}
+
+/**
+ * A WorkStealingPool task that reads a range of the slabs of a range variable,
+ * numbered in storage order, and gathers each one straight into its place in
+ * the result. All the reads go through the one libdap::Array (and the
+ * handler behind it), so they are made one at a time; only the copying and
+ * gathering run in parallel.
+ */
+class ParallelSlabGather: public WorkStealingPool::Task {
+private:
+    MeshDataVariable *d_mdv;
+    const GatherPlan &d_plan;
+
+    // The outer dimensions and their constraints, outermost first.
+    vector<libdap::Array::Dim_iter> d_dims;
+    vector<unsigned int> d_start;
+    vector<unsigned int> d_stride;
+    vector<unsigned int> d_size;
+
+    bool d_whole;
+    unsigned int d_width;
+    unsigned long d_readBytes;
+
+    char *d_result;
+    unsigned long d_slabBytes;
+
+    pthread_mutex_t d_readMutex;
+
+public:
+    ParallelSlabGather(MeshDataVariable *mdv, const GatherPlan &plan, char *result) :
+        d_mdv(mdv), d_plan(plan), d_result(result)
+    {
+        libdap::Array *dapArray = mdv->getDapArray();
+        libdap::Array::Dim_iter locationDim = mdv->getLocationCoordinateDimension();
+
+        for (libdap::Array::Dim_iter dim = dapArray->dim_begin(); dim != locationDim; ++dim) {
+            d_dims.push_back(dim);
+            d_start.push_back(dapArray->dimension_start(dim, true));
+            d_stride.push_back(dapArray->dimension_stride(dim, true));
+            d_size.push_back(dapArray->dimension_size(dim, true));
+        }
+
+        d_whole = readsWholeSlab(dapArray, locationDim, plan);
+        d_width = NDimensionalArray::sizeOfType(dapArray->var()->type());
+        d_readBytes = plannedReadBytes(dapArray, locationDim, plan);
+        d_slabBytes = (unsigned long) plan.index().size() * d_width;
+
+        pthread_mutex_init(&d_readMutex, 0);
+    }
+
+    virtual ~ParallelSlabGather()
+    {
+        pthread_mutex_destroy(&d_readMutex);
+    }
+
+    virtual void run(unsigned long begin, unsigned long end)
+    {
+        libdap::Array *dapArray = d_mdv->getDapArray();
+        vector<char> read(d_readBytes > 0 ? d_readBytes : 1);
+
+        for (unsigned long slab = begin; slab < end; ++slab) {
+            pthread_mutex_lock(&d_readMutex);
+            try {
+                unsigned long rest = slab;
+                for (unsigned int d = d_dims.size(); d-- > 0;) {
+                    unsigned int index = d_start[d] + (rest % d_size[d]) * d_stride[d];
+                    rest /= d_size[d];
+                    dapArray->add_constraint(d_dims[d], index, 1, index);
+                }
+                readUsingPlan(dapArray, d_mdv->getLocationCoordinateDimension(), d_plan, &read[0], false);
+            }
+            catch (...) {
+                pthread_mutex_unlock(&d_readMutex);
+                throw;
+            }
+            pthread_mutex_unlock(&d_readMutex);
+
+            gatherPlannedRead(d_plan, d_whole, &read[0], d_width, d_result + slab * d_slabBytes);
+        }
+    }
+
+    /**
+     * Put back the constraints of the outer dimensions.
+     */
+    void restoreConstraints()
+    {
+        libdap::Array *dapArray = d_mdv->getDapArray();
+        for (unsigned int d = 0; d < d_dims.size(); ++d)
+            dapArray->add_constraint(d_dims[d], d_start[d], d_stride[d], d_start[d] + (d_size[d] - 1) * d_stride[d]);
+    }
+};
+
+/**
+ * Read and gather every slab of the range variable into result, which holds
+ * the slabs in storage order, using threads threads (this one and those of
+ * the ModuleExecutor). Each slab goes to its
+ * own place in result, so the slabs can be done in any order.
+ */
+static void gatherSlabsInParallel(MeshDataVariable *mdv, const GatherPlan &plan, unsigned int threads, char *result)
+{
+    unsigned long slabs = slabCount(mdv);
+
+    ParallelSlabGather task(mdv, plan, result);
+    WorkStealingPool pool(threads);
+
+    try {
+        // Small enough that every thread takes and steals a few ranges.
+        pool.parallelFor(slabs, slabs / (threads * 8) + 1, &task);
+    }
+    catch (...) {
+        task.restoreConstraints();
+        throw;
+    }
+    task.restoreConstraints();
+
+    BESDEBUG("ugrid",
+        "gatherSlabsInParallel() - Gathered " << slabs << " slabs of '" << mdv->getName() << "' on " << threads << " threads, " << pool.steals() << " steals" << endl);
 }
 
 /**
@@ -382,15 +1278,17 @@ static void rDAWorker(MeshDataVariable *mdv, libdap::Array::Dim_iter thisDim, ve
  * on which of these locations is the data is associated with), have size one.
  *  Each of these slabs is then added to the GridField, subset and the result must be packed back
  *  into the result array so that things work out.
+ *
+ *  The values at the locations of the plan's index are returned in a new NDimensionalArray which
+ *  the caller must delete. Its last dimension has plan.index().size() elements.
  **/
-static libdap::Array *restrictRangeVariableByOneDHyperSlab(MeshDataVariable *mdv,
-    vector<unsigned int> *slab_subset_index)
+NDimensionalArray *gatherRangeVariable(MeshDataVariable *mdv, const GatherPlan &plan)
 {
 
-    long restrictedSlabSize = slab_subset_index->size();
+    long restrictedSlabSize = plan.index().size();
 
     BESDEBUG("ugrid2",
-        "restrictRangeVariableByOneDHyperSlab() - slab_subset_index"<< vectorToString(slab_subset_index) << " size: " << libdap::long_to_string(restrictedSlabSize) << endl);
+        "restrictRangeVariableByOneDHyperSlab() - slab_subset_index"<< vectorToString(&plan.index()) << " size: " << libdap::long_to_string(restrictedSlabSize) << endl);
 
     libdap::Array *sourceDapArray = mdv->getDapArray();
 
@@ -434,10 +1332,171 @@ static libdap::Array *restrictRangeVariableByOneDHyperSlab(MeshDataVariable *mdv
     NDimensionalArray *result = new NDimensionalArray(&resultArrayShape, dapType);
 
     // And we pass that along with other stuff into the recursive rDAWorker that's going to go get all the stuff
-    rDAWorker(mdv, sourceDapArray->dim_begin(), slab_subset_index, result);
+    try {
+        unsigned int threads = ModuleExecutor::TheExecutor()->concurrency();
+        libdap::Array::Dim_iter locationDim = mdv->getLocationCoordinateDimension();
+        if (threads >= 2 && slabCount(mdv) >= 2 && locationDim + 1 == sourceDapArray->dim_end()) {
+            gatherSlabsInParallel(mdv, plan, threads, (char *) result->getStorage());
+        }
+        else {
+            NDimensionalArraySink sink(result);
+            streamRangeVariable(mdv, plan, &sink);
+        }
+    }
+    catch (...) {
+        delete result;
+        throw;
+    }
+
+    return result;
+}
+
+/**
+ * @return The length of the (constrained) location dimension of the range variable.
+ */
+static unsigned int locationDimensionLength(MeshDataVariable *mdv)
+{
+    return mdv->getDapArray()->dimension_size(mdv->getLocationCoordinateDimension(), true);
+}
+
+NDimensionalArray *gatherRangeVariable(MeshDataVariable *mdv, vector<unsigned int> *slab_subset_index)
+{
+    GatherPlan plan(*slab_subset_index, locationDimensionLength(mdv));
+    return gatherRangeVariable(mdv, plan);
+}
+
+/**
+ * Read the values of the range variable at the locations in slab_subset_index one
+ * slab at a time, passing each slab to the sink as it is read, so that only one
+ * slab of the variable is held in memory at once. The slabs arrive in the order
+ * of the variable's (constrained) outer dimensions, last dimension varying fastest.
+ */
+void streamRangeVariable(MeshDataVariable *mdv, const GatherPlan &plan, SlabSink *sink)
+{
+    // With more than one slab to read, and a pipeline depth set, read ahead on a second thread.
+    unsigned int depth = SlabPipeline::getDepth();
+    if (depth >= 2 && slabCount(mdv) >= 2) {
+        pipelineRangeVariable(mdv, plan, depth, sink);
+        return;
+    }
+
+    GatheringSlabReader reader(plan, sink);
+    rDAWorker(mdv, mdv->getDapArray()->dim_begin(), &reader);
+}
+
+void streamRangeVariable(MeshDataVariable *mdv, vector<unsigned int> *slab_subset_index, SlabSink *sink)
+{
+    GatherPlan plan(*slab_subset_index, locationDimensionLength(mdv));
+    streamRangeVariable(mdv, plan, sink);
+}
+
+/**
+ * @return True if the two range variables are at the same location of the mesh
+ * and have the same (constrained) dimensions, so that they can be read together
+ * by streamRangeVariables().
+ */
+static bool lockStepCompatible(MeshDataVariable *a, MeshDataVariable *b)
+{
+    libdap::Array *aArray = a->getDapArray();
+    libdap::Array *bArray = b->getDapArray();
+
+    if (a->getGridLocation() != b->getGridLocation() || aArray->dimensions() != bArray->dimensions()
+        || a->getLocationCoordinateDimension() - aArray->dim_begin()
+            != b->getLocationCoordinateDimension() - bArray->dim_begin()) return false;
+
+    libdap::Array::Dim_iter bDim = bArray->dim_begin();
+    for (libdap::Array::Dim_iter aDim = aArray->dim_begin(); aDim != aArray->dim_end(); ++aDim, ++bDim) {
+        if (aArray->dimension_size(aDim, true) != bArray->dimension_size(bDim, true)
+            || aArray->dimension_start(aDim, true) != bArray->dimension_start(bDim, true)
+            || aArray->dimension_stride(aDim, true) != bArray->dimension_stride(bDim, true)) return false;
+    }
+
+    return true;
+}
+
+/**
+ * The lock-step version of rDAWorker(): recurse over the outer dimensions the
+ * range variables share and, for each combination of their indices, read one
+ * slab of every variable into consecutive parts of the sink's storage.
+ */
+static void rLockStepWorker(vector<MeshDataVariable *> *mdvs, unsigned int dim, const GatherPlan &plan,
+    SlabSink *sink)
+{
+    libdap::Array *first = (*mdvs)[0]->getDapArray();
+    libdap::Array::Dim_iter thisDim = first->dim_begin() + dim;
+
+    if (thisDim != (*mdvs)[0]->getLocationCoordinateDimension()) {
+        unsigned int start = first->dimension_start(thisDim, true);
+        unsigned int stride = first->dimension_stride(thisDim, true);
+        unsigned int stop = first->dimension_stop(thisDim, true);
+
+        for (unsigned int dimIndex = start; dimIndex <= stop; dimIndex += stride) {
+            for (vector<MeshDataVariable *>::iterator it = mdvs->begin(); it != mdvs->end(); ++it) {
+                libdap::Array *dapArray = (*it)->getDapArray();
+                dapArray->add_constraint(dapArray->dim_begin() + dim, dimIndex, 1, dimIndex);
+            }
+            rLockStepWorker(mdvs, dim + 1, plan, sink);
+        }
+
+        // Reset the constraint for this dimension.
+        for (vector<MeshDataVariable *>::iterator it = mdvs->begin(); it != mdvs->end(); ++it) {
+            libdap::Array *dapArray = (*it)->getDapArray();
+            dapArray->add_constraint(dapArray->dim_begin() + dim, start, stride, stop);
+        }
+    }
+    else {
+        if ((thisDim + 1) != first->dim_end()) {
+            string msg =
+                "rLockStepWorker() - The location coordinate dimension is not the last dimension in the array. Hyperslab subsetting of this dimension is not supported.";
+            BESDEBUG("ugrid", msg << endl);
+            throw Error(malformed_expr, msg);
+        }
+
+        char *slab = (char *) sink->nextSlab();
+
+        for (vector<MeshDataVariable *>::iterator it = mdvs->begin(); it != mdvs->end(); ++it) {
+            libdap::Array *dapArray = (*it)->getDapArray();
+            readUsingPlan(dapArray, dapArray->dim_begin() + dim, plan, slab);
+            slab += plan.index().size() * dapArray->var()->width();
+        }
+
+        sink->slabFilled();
+    }
+}
+
+/**
+ * Read several range variables with the same location and (constrained) shape
+ * together, one slab of each at a time. Each slab passed to the sink holds the
+ * values of the variables, in the order of mdvs, one after the other and each in
+ * its own type. Reading in lock-step means each slab of every variable is read
+ * exactly once, however many results are computed from it.
+ */
+void streamRangeVariables(vector<MeshDataVariable *> *mdvs, vector<unsigned int> *slab_subset_index, SlabSink *sink)
+{
+    if (mdvs->empty()) return;
+
+    for (unsigned int i = 1; i < mdvs->size(); ++i) {
+        if (!lockStepCompatible((*mdvs)[0], (*mdvs)[i]))
+            throw Error(malformed_expr,
+                "streamRangeVariables() - The range variables '" + (*mdvs)[0]->getName() + "' and '"
+                    + (*mdvs)[i]->getName() + "' do not have the same location and shape.");
+    }
+
+    GatherPlan plan(*slab_subset_index, locationDimensionLength((*mdvs)[0]));
+    rLockStepWorker(mdvs, 0, plan, sink);
+}
+
+/**
+ * Subset the range variable using gatherRangeVariable() and return the result as a
+ * libdap::Array shaped like the (constrained) source array, with the location
+ * coordinate dimension reduced to the size of the plan's index.
+ */
+static libdap::Array *restrictRangeVariableByOneDHyperSlab(MeshDataVariable *mdv, const GatherPlan &plan)
+{
+    NDimensionalArray *result = gatherRangeVariable(mdv, plan);
 
     // And now that the recursion we grab have the NDimensionalArray cough up the rteuslt as a libdap::Array
-    libdap::Array *resultDapArray = result->getArray(sourceDapArray);
+    libdap::Array *resultDapArray = result->getArray(mdv->getDapArray());
 
     // Delete the NDimensionalArray
     delete result;
@@ -446,6 +1505,742 @@ static libdap::Array *restrictRangeVariableByOneDHyperSlab(MeshDataVariable *mdv
     return resultDapArray;
 }
 
+/**
+ * A reduction of a range variable along one of its outer dimensions, as
+ * requested by ugtr(): e.g., 'max(time)' or 'count(time > 25.0)'.
+ */
+struct TemporalReduction {
+    enum Operation {
+        reduce_max, reduce_min, reduce_mean, reduce_argmax, reduce_count
+    };
+
+    enum Comparison {
+        greater, greater_equal, less, less_equal
+    };
+
+    Operation operation;
+    string dimension;
+
+    // Only used by count(), which counts the values for which
+    // 'value comparison threshold' is true.
+    Comparison comparison;
+    double threshold;
+
+    TemporalReduction() :
+        operation(reduce_max), comparison(greater), threshold(0)
+    {
+    }
+};
+
+static string strip(const string &s)
+{
+    string::size_type first = s.find_first_not_of(" \t");
+    if (first == string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+/**
+ * Parse a reduction such as 'mean(time)' or 'count(time >= 1.5)'.
+ */
+static TemporalReduction parseTemporalReduction(const string &func_name, const string &spec)
+{
+    string msg = func_name + "() - Could not parse the reduction '" + spec
+        + "'. Expected one of max(dim), min(dim), mean(dim), argmax(dim) or count(dim > value).";
+
+    string::size_type open = spec.find('(');
+    string::size_type close = spec.rfind(')');
+    if (open == string::npos || close == string::npos || close < open || !strip(spec.substr(close + 1)).empty())
+        throw Error(malformed_expr, msg);
+
+    TemporalReduction reduction;
+    string operation = strip(spec.substr(0, open));
+    string operand = spec.substr(open + 1, close - open - 1);
+
+    if (operation == "max")
+        reduction.operation = TemporalReduction::reduce_max;
+    else if (operation == "min")
+        reduction.operation = TemporalReduction::reduce_min;
+    else if (operation == "mean")
+        reduction.operation = TemporalReduction::reduce_mean;
+    else if (operation == "argmax")
+        reduction.operation = TemporalReduction::reduce_argmax;
+    else if (operation == "count")
+        reduction.operation = TemporalReduction::reduce_count;
+    else
+        throw Error(malformed_expr, msg);
+
+    if (reduction.operation == TemporalReduction::reduce_count) {
+        string::size_type op = operand.find_first_of("<>");
+        if (op == string::npos) throw Error(malformed_expr, msg);
+
+        bool orEqual = (op + 1 < operand.size() && operand[op + 1] == '=');
+        if (operand[op] == '>')
+            reduction.comparison = orEqual ? TemporalReduction::greater_equal : TemporalReduction::greater;
+        else
+            reduction.comparison = orEqual ? TemporalReduction::less_equal : TemporalReduction::less;
+
+        string value = strip(operand.substr(op + (orEqual ? 2 : 1)));
+        char *end;
+        errno = 0;
+        reduction.threshold = strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || errno == ERANGE) throw Error(malformed_expr, msg);
+
+        operand = operand.substr(0, op);
+    }
+
+    reduction.dimension = strip(operand);
+    if (reduction.dimension.empty()) throw Error(malformed_expr, msg);
+
+    return reduction;
+}
+
+template<typename T>
+static void slabValues(const T *slab, vector<double> *values)
+{
+    for (unsigned int i = 0; i < values->size(); ++i)
+        (*values)[i] = slab[i];
+}
+
+/**
+ * Convert values->size() values of the given type, as copied into a slab by
+ * copyUsingSubsetIndex(), to doubles.
+ */
+static void slabValues(libdap::Type type, const void *slab, vector<double> *values)
+{
+    switch (type) {
+    case dods_byte_c:
+        slabValues((const dods_byte *) slab, values);
+        break;
+    case dods_uint16_c:
+        slabValues((const dods_uint16 *) slab, values);
+        break;
+    case dods_int16_c:
+        slabValues((const dods_int16 *) slab, values);
+        break;
+    case dods_uint32_c:
+        slabValues((const dods_uint32 *) slab, values);
+        break;
+    case dods_int32_c:
+        slabValues((const dods_int32 *) slab, values);
+        break;
+    case dods_float32_c:
+        slabValues((const dods_float32 *) slab, values);
+        break;
+    case dods_float64_c:
+        slabValues((const dods_float64 *) slab, values);
+        break;
+    default:
+        throw InternalErr(__FILE__, __LINE__, "ugrid::slabValues() - Unknown DAP type encountered.");
+    }
+}
+
+/**
+ * A SlabSink that folds each slab of a range variable into accumulators that
+ * hold one value per location for every combination of the outer dimensions
+ * other than the one being reduced. Memory use is independent of the length
+ * of the reduced dimension. Missing values (NaN or the variable's _FillValue
+ * or missing_value) are skipped.
+ */
+class TemporalReducer: public SlabSink {
+private:
+    const TemporalReduction &d_reduction;
+    libdap::Type d_type;
+    unsigned int d_slabSize;
+
+    // The reduced dimension: its position among the outer dimensions, its
+    // (constrained) size, start and stride, and the number of slabs that are
+    // read for each of its indices before it advances.
+    unsigned int d_dim;
+    unsigned int d_size;
+    unsigned int d_start;
+    unsigned int d_stride;
+    unsigned long d_innerSlabs;
+
+    vector<unsigned int> d_shape;
+    unsigned long d_slabNumber;
+
+    vector<char> d_slab;
+    vector<double> d_slabValues;
+
+    MissingValues d_missing;
+
+public:
+    // The max/min/sum (or, for argmax, the running maximum) and the
+    // number of values (mean), index of the maximum (argmax) or count.
+    vector<double> values;
+    vector<dods_int32> counts;
+
+    TemporalReducer(const string &func_name, MeshDataVariable *mdv, const TemporalReduction &reduction,
+        unsigned int slabSize) :
+        d_reduction(reduction), d_slabSize(slabSize), d_dim(0), d_size(0), d_start(0), d_stride(1), d_innerSlabs(1),
+            d_slabNumber(0), d_slabValues(slabSize), d_missing(mdv->getDapArray())
+    {
+        libdap::Array *source = mdv->getDapArray();
+        d_type = source->var()->type();
+        d_slab.resize(slabSize * source->var()->width());
+
+        d_shape.resize(source->dimensions(true));
+        NDimensionalArray::computeConstrainedShape(source, &d_shape);
+
+        libdap::Array::Dim_iter location = mdv->getLocationCoordinateDimension();
+        libdap::Array::Dim_iter d = source->dim_begin();
+        while (d != source->dim_end() && source->dimension_name(d) != reduction.dimension)
+            ++d;
+
+        if (d == source->dim_end())
+            throw Error(malformed_expr,
+                func_name + "() - The range variable '" + mdv->getName() + "' has no dimension named '"
+                    + reduction.dimension + "'.");
+        if (d == location)
+            throw Error(malformed_expr,
+                func_name + "() - The range variable '" + mdv->getName() + "' cannot be reduced along '"
+                    + reduction.dimension + "', its location dimension.");
+
+        d_dim = d - source->dim_begin();
+        d_size = d_shape[d_dim];
+        d_start = source->dimension_start(d, true);
+        d_stride = source->dimension_stride(d, true);
+        for (unsigned int i = d_dim + 1; i + 1 < d_shape.size(); ++i)
+            d_innerSlabs *= d_shape[i];
+
+        unsigned long resultSlabs = 1;
+        for (unsigned int i = 0; i + 1 < d_shape.size(); ++i)
+            if (i != d_dim) resultSlabs *= d_shape[i];
+
+        double initial = (reduction.operation == TemporalReduction::reduce_mean) ?
+            0 : numeric_limits<double>::quiet_NaN();
+        values.assign(resultSlabs * slabSize, initial);
+        counts.assign(resultSlabs * slabSize, (reduction.operation == TemporalReduction::reduce_argmax) ? -1 : 0);
+    }
+
+    virtual void *nextSlab()
+    {
+        return &d_slab[0];
+    }
+
+    virtual void slabFilled()
+    {
+        slabValues(d_type, &d_slab[0], &d_slabValues);
+        d_missing.toNaN(&d_slabValues);
+
+        // Which index of the reduced dimension this slab belongs to, and which
+        // slab of the result it is folded into.
+        unsigned long k = d_slabNumber++;
+        unsigned int r = (k / d_innerSlabs) % d_size;
+        unsigned long out = (k / (d_innerSlabs * d_size)) * d_innerSlabs + k % d_innerSlabs;
+
+        double *acc = &values[out * d_slabSize];
+        dods_int32 *n = &counts[out * d_slabSize];
+        const double *v = &d_slabValues[0];
+
+        switch (d_reduction.operation) {
+        case TemporalReduction::reduce_max:
+            for (unsigned int i = 0; i < d_slabSize; ++i)
+                if (v[i] == v[i] && !(acc[i] >= v[i])) acc[i] = v[i];
+            break;
+        case TemporalReduction::reduce_min:
+            for (unsigned int i = 0; i < d_slabSize; ++i)
+                if (v[i] == v[i] && !(acc[i] <= v[i])) acc[i] = v[i];
+            break;
+        case TemporalReduction::reduce_mean:
+            for (unsigned int i = 0; i < d_slabSize; ++i)
+                if (v[i] == v[i]) acc[i] += v[i], ++n[i];
+            break;
+        case TemporalReduction::reduce_argmax: {
+            dods_int32 index = d_start + r * d_stride;
+            for (unsigned int i = 0; i < d_slabSize; ++i)
+                if (v[i] == v[i] && !(acc[i] >= v[i])) acc[i] = v[i], n[i] = index;
+            break;
+        }
+        case TemporalReduction::reduce_count: {
+            double t = d_reduction.threshold;
+            for (unsigned int i = 0; i < d_slabSize; ++i) {
+                switch (d_reduction.comparison) {
+                case TemporalReduction::greater:
+                    if (v[i] > t) ++n[i];
+                    break;
+                case TemporalReduction::greater_equal:
+                    if (v[i] >= t) ++n[i];
+                    break;
+                case TemporalReduction::less:
+                    if (v[i] < t) ++n[i];
+                    break;
+                case TemporalReduction::less_equal:
+                    if (v[i] <= t) ++n[i];
+                    break;
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    /**
+     * @return The result as a libdap::Array named for the source variable,
+     * with the reduced dimension removed.
+     */
+    libdap::Array *getArray(MeshDataVariable *mdv)
+    {
+        libdap::Array *source = mdv->getDapArray();
+        string name = source->name();
+        bool isCount = (d_reduction.operation == TemporalReduction::reduce_argmax
+            || d_reduction.operation == TemporalReduction::reduce_count);
+
+        libdap::Array *result;
+        if (isCount) {
+            Int32 proto(name);
+            result = new libdap::Array(name, &proto);
+        }
+        else {
+            Float64 proto(name);
+            result = new libdap::Array(name, &proto);
+        }
+
+        unsigned int s = 0;
+        for (libdap::Array::Dim_iter d = source->dim_begin(); d != source->dim_end(); ++d, ++s) {
+            if (s == d_dim) continue;
+            result->append_dim((s + 1 == d_shape.size()) ? d_slabSize : d_shape[s], source->dimension_name(d));
+        }
+
+        if (isCount) {
+            // An index or a count has no units, but is still a variable of the mesh.
+            AttrTable &at = result->get_attr_table();
+            const char *names[] = { UGRID_MESH, UGRID_LOCATION, "coordinates" };
+            for (unsigned int i = 0; i < 3; ++i) {
+                string value = getAttributeValue(source, names[i]);
+                if (!value.empty()) at.append_attr(names[i], "String", value);
+            }
+            if (d_reduction.operation == TemporalReduction::reduce_argmax) at.append_attr("_FillValue", "Int32", "-1");
+
+            result->set_value(counts, counts.size());
+        }
+        else {
+            // Units and the like still apply to the maximum, minimum and mean;
+            // the fill value is rewritten as a Float64.
+            result->set_attr_table(source->get_attr_table());
+            d_missing.setFloat64Attributes(result->get_attr_table());
+
+            if (d_reduction.operation == TemporalReduction::reduce_mean) {
+                for (unsigned int i = 0; i < values.size(); ++i)
+                    values[i] = (counts[i] > 0) ? values[i] / counts[i] : numeric_limits<double>::quiet_NaN();
+            }
+            d_missing.fromNaN(&values);
+            result->set_value(values, values.size());
+        }
+
+        return result;
+    }
+};
+
+/**
+ * Reduce the range variable, at the locations of the plan's index, along one of
+ * its outer dimensions. The variable is read with streamRangeVariable() so only
+ * one slab and the accumulators are held in memory.
+ */
+static libdap::Array *reduceRangeVariable(const string &func_name, MeshDataVariable *mdv, const GatherPlan &plan,
+    const TemporalReduction &reduction)
+{
+    TemporalReducer reducer(func_name, mdv, reduction, plan.index().size());
+    if (!plan.index().empty()) streamRangeVariable(mdv, plan, &reducer);
+
+    return reducer.getArray(mdv);
+}
+
+/**
+ * A variable computed from range variables by an ArithmeticExpression, given to
+ * the restrict functions as 'name := expression'.
+ */
+struct DerivedRangeVariable {
+    string name;
+    ArithmeticExpression *expression;
+
+    // One for each of expression->variables().
+    vector<MeshDataVariable *> inputs;
+};
+
+static void deleteDerivedVar(DerivedRangeVariable *dv)
+{
+    for (vector<MeshDataVariable *>::iterator it = dv->inputs.begin(); it != dv->inputs.end(); ++it)
+        delete *it;
+    delete dv->expression;
+    delete dv;
+}
+
+static void releaseDerivedVars(map<string, vector<DerivedRangeVariable *> *> *meshToDerivedVarsMap)
+{
+    map<string, vector<DerivedRangeVariable *> *>::iterator dmit;
+    for (dmit = meshToDerivedVarsMap->begin(); dmit != meshToDerivedVarsMap->end(); ++dmit) {
+        vector<DerivedRangeVariable *>::iterator dvit;
+        for (dvit = dmit->second->begin(); dvit != dmit->second->end(); ++dvit)
+            deleteDerivedVar(*dvit);
+        delete dmit->second;
+    }
+    meshToDerivedVarsMap->clear();
+}
+
+/**
+ * Parse a derived variable definition, locate its inputs in the dataset and add it
+ * to the list for the mesh they are defined on. The mesh is added to rangeVariables
+ * too, if need be, so that it is subset even when no range variable on it was
+ * requested.
+ */
+static void addDerivedVar(const string &func_name, DDS *dds, const string &definition,
+    map<string, vector<DerivedRangeVariable *> *> *derivedVariables,
+    map<string, vector<MeshDataVariable *> *> *rangeVariables)
+{
+    string::size_type assign = definition.find(":=");
+    string name = (assign == string::npos) ? "" : strip(definition.substr(0, assign));
+    if (name.empty())
+        throw Error(malformed_expr,
+            func_name + "() - A derived variable must be given as 'name := expression', was passed '" + definition
+                + "'.");
+
+    DerivedRangeVariable *dv = new DerivedRangeVariable();
+    dv->name = name;
+    dv->expression = 0;
+
+    string meshVarName;
+    try {
+        dv->expression = new ArithmeticExpression(strip(definition.substr(assign + 2)));
+
+        const vector<string> &names = dv->expression->variables();
+        if (names.empty())
+            throw Error(malformed_expr,
+                func_name + "() - The derived variable '" + name + "' does not use any range variables.");
+
+        for (vector<string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+            libdap::Array *rangeVar = dynamic_cast<libdap::Array *>(dds->var(*it));
+            if (rangeVar == 0)
+                throw Error(malformed_expr,
+                    func_name + "() - The derived variable '" + name + "' uses '" + *it
+                        + "', which is not an array in this dataset.");
+
+            MeshDataVariable *mdv = new MeshDataVariable();
+            dv->inputs.push_back(mdv);
+            mdv->init(rangeVar);
+
+            if (mdv->getMeshName() != dv->inputs[0]->getMeshName()
+                || mdv->getGridLocation() != dv->inputs[0]->getGridLocation())
+                throw Error(malformed_expr,
+                    func_name + "() - The inputs of the derived variable '" + name
+                        + "' must be defined at the same location of the same mesh.");
+        }
+
+        meshVarName = dv->inputs[0]->getMeshName();
+        if (dds->var(meshVarName) == 0)
+            throw Error(malformed_expr,
+                "The derived variable '" + name + "' references the mesh variable '" + meshVarName
+                    + "' which cannot be located in this dataset.");
+    }
+    catch (...) {
+        deleteDerivedVar(dv);
+        throw;
+    }
+
+    if (rangeVariables->find(meshVarName) == rangeVariables->end())
+        (*rangeVariables)[meshVarName] = new vector<MeshDataVariable *>();
+
+    vector<DerivedRangeVariable *> *&derivedVarsForMesh = (*derivedVariables)[meshVarName];
+    if (derivedVarsForMesh == 0) derivedVarsForMesh = new vector<DerivedRangeVariable *>();
+    derivedVarsForMesh->push_back(dv);
+}
+
+/**
+ * A SlabSink for streamRangeVariables() that evaluates, slab by slab, the derived
+ * variables computed from a group of lock-step inputs.
+ */
+class DerivedVariableSink: public SlabSink {
+private:
+    vector<MeshDataVariable *> *d_inputs;
+    vector<DerivedRangeVariable *> *d_derived;
+    unsigned int d_slabSize;
+
+    vector<char> d_slab;
+    vector<vector<double> > d_inputValues;
+
+    // For each derived variable, the position of each of its inputs in d_inputs.
+    vector<vector<unsigned int> > d_positions;
+
+public:
+    // The values of each derived variable.
+    vector<vector<double> > values;
+
+    DerivedVariableSink(vector<MeshDataVariable *> *inputs, vector<DerivedRangeVariable *> *derived,
+        unsigned int slabSize) :
+        d_inputs(inputs), d_derived(derived), d_slabSize(slabSize), d_inputValues(inputs->size(),
+            vector<double>(slabSize)), d_positions(derived->size()), values(derived->size())
+    {
+        unsigned int bytes = 0;
+        for (vector<MeshDataVariable *>::iterator it = inputs->begin(); it != inputs->end(); ++it)
+            bytes += slabSize * (*it)->getDapArray()->var()->width();
+        d_slab.resize(bytes);
+
+        for (unsigned int k = 0; k < derived->size(); ++k) {
+            vector<MeshDataVariable *> &uses = (*derived)[k]->inputs;
+            for (vector<MeshDataVariable *>::iterator it = uses.begin(); it != uses.end(); ++it) {
+                unsigned int p = 0;
+                while ((*inputs)[p]->getName() != (*it)->getName())
+                    ++p;
+                d_positions[k].push_back(p);
+            }
+        }
+    }
+
+    virtual void *nextSlab()
+    {
+        return &d_slab[0];
+    }
+
+    virtual void slabFilled()
+    {
+        unsigned int offset = 0;
+        for (unsigned int j = 0; j < d_inputs->size(); ++j) {
+            libdap::Array *dapArray = (*d_inputs)[j]->getDapArray();
+            slabValues(dapArray->var()->type(), &d_slab[offset], &d_inputValues[j]);
+            offset += d_slabSize * dapArray->var()->width();
+        }
+
+        for (unsigned int k = 0; k < d_derived->size(); ++k) {
+            vector<const double *> arguments;
+            for (vector<unsigned int>::iterator p = d_positions[k].begin(); p != d_positions[k].end(); ++p)
+                arguments.push_back(&d_inputValues[*p][0]);
+
+            unsigned int n = values[k].size();
+            values[k].resize(n + d_slabSize);
+            (*d_derived)[k]->expression->evaluate(arguments, d_slabSize, &values[k][n]);
+        }
+    }
+};
+
+/**
+ * Compute the derived variables of one mesh at the locations in the subset and add
+ * them to dapResults. Derived variables whose inputs share a location and shape are
+ * evaluated together, so each slab of each input is read once.
+ */
+static void evaluateDerivedVariables(const string &func_name, TwoDMeshTopology *tdmt,
+    vector<DerivedRangeVariable *> *derivedVars, vector<vector<unsigned int> *> &location_subset_indices,
+    vector<BaseType *> *dapResults)
+{
+    vector<vector<DerivedRangeVariable *> > groups;
+    vector<vector<MeshDataVariable *> > groupInputs;
+
+    for (vector<DerivedRangeVariable *>::iterator it = derivedVars->begin(); it != derivedVars->end(); ++it) {
+        DerivedRangeVariable *dv = *it;
+        for (vector<MeshDataVariable *>::iterator in = dv->inputs.begin(); in != dv->inputs.end(); ++in) {
+            tdmt->setLocationCoordinateDimension(*in);
+            if (!lockStepCompatible(dv->inputs[0], *in))
+                throw Error(malformed_expr,
+                    func_name + "() - The inputs of the derived variable '" + dv->name
+                        + "' must have the same dimensions.");
+        }
+
+        unsigned int g = 0;
+        while (g < groups.size() && !lockStepCompatible(groupInputs[g][0], dv->inputs[0]))
+            ++g;
+        if (g == groups.size()) {
+            groups.push_back(vector<DerivedRangeVariable *>());
+            groupInputs.push_back(vector<MeshDataVariable *>());
+        }
+
+        groups[g].push_back(dv);
+        for (vector<MeshDataVariable *>::iterator in = dv->inputs.begin(); in != dv->inputs.end(); ++in) {
+            unsigned int p = 0;
+            while (p < groupInputs[g].size() && groupInputs[g][p]->getName() != (*in)->getName())
+                ++p;
+            if (p == groupInputs[g].size()) groupInputs[g].push_back(*in);
+        }
+    }
+
+    for (unsigned int g = 0; g < groups.size(); ++g) {
+        vector<unsigned int> *index = location_subset_indices[groupInputs[g][0]->getGridLocation()];
+
+        BESDEBUG("ugrid",
+            "evaluateDerivedVariables() - Reading " << groupInputs[g].size() << " input(s) in lock-step for " << groups[g].size() << " derived variable(s)" << endl);
+
+        DerivedVariableSink sink(&groupInputs[g], &groups[g], index->size());
+        if (!index->empty()) streamRangeVariables(&groupInputs[g], index, &sink);
+
+        libdap::Array *source = groupInputs[g][0]->getDapArray();
+        for (unsigned int k = 0; k < groups[g].size(); ++k) {
+            const string &name = groups[g][k]->name;
+            Float64 proto(name);
+            libdap::Array *result = new libdap::Array(name, &proto);
+            for (libdap::Array::Dim_iter d = source->dim_begin(); d != source->dim_end(); ++d)
+                result->append_dim((d + 1 == source->dim_end()) ? index->size() : source->dimension_size(d, true),
+                    source->dimension_name(d));
+
+            result->get_attr_table().append_attr("expression", "String", groups[g][k]->expression->text());
+            result->set_value(sink.values[k], sink.values[k].size());
+
+            dapResults->push_back(result);
+        }
+    }
+}
+
+/**
+ * Restrict one mesh with the filter of a ugnr(), ugfr() or ugtr() request and
+ * add its subset, with those of the range variables and derived variables
+ * defined on it, to the request's result.
+ *
+ * @param rangeVars The requested range variables defined on the mesh.
+ * @param derivedVars The derived variables defined on the mesh, or null.
+ * @param dapResult The result structure; it takes the subset variables.
+ */
+static void restrictMeshForFilter(const string &func_name, DDS &dds, const UgridRestrictArgs &args,
+    const TemporalReduction *reduction, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    vector<DerivedRangeVariable *> *derivedVars, Structure *dapResult)
+{
+    TwoDMeshTopology *tdmt = 0;
+    GatherPlan *ownedNodePlan = 0;
+    GatherPlan *ownedFacePlan = 0;
+    RestrictionResult *ownedRestriction = 0;
+    vector<BaseType *> dapResults;
+    try {
+        // Building the restricted TwoDMeshTopology without adding any range variables and then converting the result
+        // Grid field to Dap Objects should return all of the Ugrid structural stuff - mesh variable, node coordinate variables,
+        // face and edge coordinate variables if present.
+        BESDEBUG("ugrid",
+            "ugrid_restrict() - Adding restricted mesh_topology structure for mesh '" << meshVariableName << "' to DAP response." << endl);
+
+        tdmt = new TwoDMeshTopology();
+        tdmt->init(meshVariableName, &dds);
+
+        // 3: because there are nodes (rank = 0), edges (rank = 1), and faces (rank = 2). jhrg 10/25/13
+        vector<vector<unsigned int> *> location_subset_indices(3);
+        vector<unsigned int> node_subset_index;
+        vector<unsigned int> face_subset_index;
+        location_subset_indices[node] = &node_subset_index;
+        location_subset_indices[face] = &face_subset_index;
+
+        // The terms of the filter that compare range variables of this mesh are
+        // applied after the restriction, to only the locations it leaves.
+        ValuePredicates valuePredicates(args.filterExpression,
+            valueVariableNames(&dds, meshVariableName, args.dimension));
+        string spatialFilter = valuePredicates.remaining();
+        bool attached = false;
+
+        if (!spatialFilter.empty()) {
+            // Don't build and restrict the mesh if the filter's bounds are outside of it.
+            if (filterMissesMesh(tdmt, &dds, args.dimension, spatialFilter)) throw emptyResponseError();
+
+            // When another process has made this subset, the mesh is not restricted here.
+            attached = !restrictSharedMesh(tdmt, &dds, args.dimension, spatialFilter, &node_subset_index,
+                &face_subset_index);
+
+            BESDEBUG("ugrid",
+                "ugrid_restrict() - there are "<< node_subset_index.size() << " nodes and " << face_subset_index.size() << " faces in the subset." << endl);
+            BESDEBUG("ugrid2", "ugrid_restrict() - node_subset_index"<< vectorToString(&node_subset_index) << endl);
+            BESDEBUG("ugrid2", "ugrid_restrict() - face_subset_index: "<< vectorToString(&face_subset_index) << endl);
+        }
+        else if (!valuePredicates.predicates().empty()) {
+            // Only value predicates: every location is a candidate.
+            MeshGeometry *geometry = tdmt->getMeshGeometry(&dds);
+            for (unsigned int n = 0; n < geometry->nodeCount(); ++n)
+                node_subset_index.push_back(n);
+            for (unsigned int f = 0; f < geometry->faceCount(); ++f)
+                face_subset_index.push_back(f);
+        }
+
+        if (!valuePredicates.predicates().empty()) {
+            applyValuePredicates(func_name, tdmt, &dds, valuePredicates.predicates(), args.dimension,
+                &node_subset_index, &face_subset_index);
+        }
+
+        // This gets all the stuff that's attached to the grid - which at this point does not include the range variables but does include the
+        // index variable. good enough for now but need to drop the index....
+        if (args.options.changesSubset() || !valuePredicates.predicates().empty()) {
+            applyRestrictOptions(func_name, tdmt, &dds, args.options, !args.filterExpression.empty(),
+                &node_subset_index, &face_subset_index);
+            tdmt->convertSubsetToDapObjects(&dds, &node_subset_index, &face_subset_index, &dapResults);
+        }
+        else if (attached) {
+            tdmt->convertSubsetToDapObjects(&dds, &node_subset_index, &face_subset_index, &dapResults);
+        }
+        else {
+            tdmt->convertResultGridFieldStructureToDapObjects(&dapResults);
+        }
+
+        BESDEBUG("ugrid",
+            "ugrid_restrict() - Restriction of mesh_topology '"<< tdmt->getMeshVariable()->name() << "' structure completed." << endl);
+
+        // now that we have the mesh topology variable we are going to look at each of the requested
+        // range variables (aka MeshDataVariable instances) and we're going to subset that using the
+        // gridfields library and add its subset version to the results.
+        //
+        // The plans for reading the range variables at the nodes and faces of the subset are made once
+        // here and used for every range variable at that location. Those of a plain filter are kept
+        // with its RestrictionResult; the others belong to this request.
+        vector<const GatherPlan *> location_plans(3);
+        if (!args.filterExpression.empty() && !args.options.changesSubset()
+            && valuePredicates.predicates().empty()) {
+            RestrictionResult *rr = getRestrictionResult(tdmt, &dds, args.dimension, args.filterExpression,
+                &ownedRestriction, &node_subset_index, &face_subset_index);
+            location_plans[node] = rr->nodePlan();
+            location_plans[face] = rr->facePlan();
+        }
+        else {
+            location_plans[node] = ownedNodePlan = new GatherPlan(node_subset_index, tdmt->getInputGridSize(node));
+            location_plans[face] = ownedFacePlan = new GatherPlan(face_subset_index, tdmt->getInputGridSize(face));
+        }
+
+        vector<MeshDataVariable *>::iterator rvit;
+        for (rvit = rangeVars->begin(); rvit != rangeVars->end(); rvit++) {
+            MeshDataVariable *mdv = *rvit;
+
+            BESDEBUG("ugrid",
+                "ugrid_restrict() - Processing MeshDataVariable  '"<< mdv->getName() << "' associated with rank/location: "<< mdv->getGridLocation() << endl);
+
+            tdmt->setLocationCoordinateDimension(mdv);
+
+            /**
+             * Here is where we will do the range variable sub-setting including decomposing the requested variable
+             * into 1-dimensional hyper-slabs that can be fed into the gridfields library
+             */
+            const GatherPlan &plan = *location_plans[mdv->getGridLocation()];
+            libdap::Array *restrictedRangeVarArray;
+            if (reduction)
+                restrictedRangeVarArray = reduceRangeVariable(func_name, mdv, plan, *reduction);
+            else
+                restrictedRangeVarArray = restrictRangeVariableByOneDHyperSlab(mdv, plan);
+
+            BESDEBUG("ugrid",
+                "ugrid_restrict() - Adding resulting dapArray  '"<< restrictedRangeVarArray->name() << "' to dapResults." << endl);
+
+            dapResults.push_back(restrictedRangeVarArray);
+        }
+
+        delete ownedNodePlan;
+        ownedNodePlan = 0;
+        delete ownedFacePlan;
+        ownedFacePlan = 0;
+        delete ownedRestriction;
+        ownedRestriction = 0;
+
+        if (derivedVars) {
+            evaluateDerivedVariables(func_name, tdmt, derivedVars, location_subset_indices, &dapResults);
+        }
+    }
+    catch (...) {
+        delete ownedNodePlan;
+        delete ownedFacePlan;
+        delete ownedRestriction;
+        for (vector<BaseType *>::iterator i = dapResults.begin(); i != dapResults.end(); ++i)
+            delete *i;
+        delete tdmt;
+        throw;
+    }
+
+    delete tdmt;
+
+    BESDEBUG("ugrid", "ugrid_restrict() - Adding GF::GridField results to DAP structure " << dapResult->name() << endl);
+
+    for (vector<BaseType *>::iterator i = dapResults.begin(); i != dapResults.end(); ++i) {
+        BESDEBUG("ugrid",
+            "ugrid_restrict() - Adding variable "<< (*i)->name() << " to DAP structure " << dapResult->name() << endl);
+        dapResult->add_var_nocopy(*i);
+    }
+}
+
 /**
  Subset an irregular mesh (aka unstructured grid).
 
@@ -460,12 +2255,15 @@ static libdap::Array *restrictRangeVariableByOneDHyperSlab(MeshDataVariable *mdv
  referenced by this pointer to a pointer. We could have used a
  BaseType reference, instead of pointer to a pointer, but we didn't.
  This is a value-result parameter.
+ @param reduction If not null, each range variable is reduced along one of its
+ outer dimensions after it is subset (see ugtr()).
 
  @return void
 
  @exception Error Thrown If the Array is not a one dimensional
  array. */
-void ugrid_restrict(string func_name, locationType location, int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+void ugrid_restrict(string func_name, locationType location, int argc, BaseType *argv[], DDS &dds, BaseType **btpp,
+    const TemporalReduction *reduction = 0)
 {
     try { // This top level try block is used to catch gridfields library errors.
 
@@ -491,155 +2289,401 @@ void ugrid_restrict(string func_name, locationType location, int argc, BaseType
         // Each range variable is associated with a "mesh" i.e. a mesh topology variable. Since there may be more than one mesh in a
         // dataset, and the user may request more than one range variable for each mesh we need to sift through the list of requested
         // range variables and organize them by mesh topology variable name.
-        map<string, vector<MeshDataVariable *> *> *meshToRangeVarsMap = new map<string, vector<MeshDataVariable *> *>();
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        map<string, vector<DerivedRangeVariable *> *> meshToDerivedVarsMap;
+        Structure *dapResult = 0;
+        try {
+            // For every Range variable in the arguments list, locate it and ingest it.
+            vector<libdap::Array *>::iterator it;
+            for (it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
+            }
+            BESDEBUG("ugrid", "ugrid_restrict() - The user requested "<< args.rangeVars.size() << " range data variables." << endl);
+
+            if (reduction && !args.derivedVars.empty())
+                throw Error(malformed_expr, func_name + "() - Derived variables cannot be reduced.");
 
-        // For every Range variable in the arguments list, locate it and ingest it.
-        vector<libdap::Array *>::iterator it;
-        for (it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
-            addRangeVar(&dds, *it, meshToRangeVarsMap);
+            // Derived variables may be on meshes that no requested range variable is on; adding them
+            // makes sure those meshes are in meshToRangeVarsMap.
+            vector<string>::iterator defit;
+            for (defit = args.derivedVars.begin(); defit != args.derivedVars.end(); ++defit) {
+                addDerivedVar(func_name, &dds, *defit, &meshToDerivedVarsMap, &meshToRangeVarsMap);
+            }
+            BESDEBUG("ugrid",
+                "ugrid_restrict() - The user's request referenced "<< meshToRangeVarsMap.size() << " mesh topology variables." << endl);
+
+            // ----------------------------------
+            // OK, so up to this point we have not read any data from the data set, but we have QC'd the inputs and verified that
+            // it looks like the request is consistent with the semantics of the dataset.
+            // Now it's time to read some data and pack it into the GridFields library...
+
+            // TODO This returns a single structure but it would make better sense to the
+            // world if it could return a vector of objects and have them appear at the
+            // top level of the DDS.
+            // FIXME fix the names of the variables in the mesh_topology attributes
+            // If the server side function can be made to return a DDS or a collection of BaseType's then the
+            // names won't change and the original mesh_topology variable and it's metadata will be valid
+            dapResult = new Structure(reduction ? "ugtr_result_unwrap" : "ugr_result_unwrap");
+
+            // Now we need to grab an top level metadata (attriubutes) and copy them into the dapResult Structure
+            // Add any global attributes to the netcdf file
+            AttrTable &globals = dds.get_attr_table();
+            BESDEBUG("ugrid", "ugrid_restrict() - Copying Global Attributes" << endl << globals << endl);
+            dapResult->set_attr_table(globals);
+            BESDEBUG("ugrid", "ugrid_restrict() - Result Structure attrs: " << endl << dapResult->get_attr_table() << endl);
+
+            // Since we only want each ugrid structure to appear in the results one time  (cause otherwise we might be trying to add
+            // the same variables with the same names to the result multiple times.) we grind on this by iterating over the
+            // names of the mesh topology names.
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                map<string, vector<DerivedRangeVariable *> *>::iterator dmit = meshToDerivedVarsMap.find(mit->first);
+                restrictMeshForFilter(func_name, dds, args, reduction, mit->first, mit->second,
+                    dmit == meshToDerivedVarsMap.end() ? 0 : dmit->second, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            releaseDerivedVars(&meshToDerivedVarsMap);
+            throw;
         }
-        BESDEBUG("ugrid", "ugrid_restrict() - The user requested "<< args.rangeVars.size() << " range data variables." << endl);
-        BESDEBUG("ugrid",
-            "ugrid_restrict() - The user's request referenced "<< meshToRangeVarsMap->size() << " mesh topology variables." << endl);
 
-        // ----------------------------------
-        // OK, so up to this point we have not read any data from the data set, but we have QC'd the inputs and verified that
-        // it looks like the request is consistent with the semantics of the dataset.
-        // Now it's time to read some data and pack it into the GridFields library...
+        BESDEBUG("ugrid", "ugrid_restrict() - Releasing maps and vectors..." << endl);
+        releaseRangeVars(&meshToRangeVarsMap);
+        releaseDerivedVars(&meshToDerivedVarsMap);
 
-        // TODO This returns a single structure but it would make better sense to the
-        // world if it could return a vector of objects and have them appear at the
-        // top level of the DDS.
-        // FIXME fix the names of the variables in the mesh_topology attributes
-        // If the server side function can be made to return a DDS or a collection of BaseType's then the
-        // names won't change and the original mesh_topology variable and it's metadata will be valid
-        Structure *dapResult = new Structure("ugr_result_unwrap");
+        *btpp = dapResult;
 
-        // Now we need to grab an top level metadata (attriubutes) and copy them into the dapResult Structure
-        // Add any global attributes to the netcdf file
-#if 1
-        AttrTable &globals = dds.get_attr_table();
-        BESDEBUG("ugrid", "ugrid_restrict() - Copying Global Attributes" << endl << globals << endl);
+        BESDEBUG("ugrid", "ugrid_restrict() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
 
-        AttrTable *newDatasetAttrTable = new AttrTable(globals);
-        dapResult->set_attr_table(*newDatasetAttrTable);
-        BESDEBUG("ugrid", "ugrid_restrict() - Result Structure attrs: " << endl << dapResult->get_attr_table() << endl);
+    return;
+}
 
+/**
+ * Function Arguments for the batch restrict functions ugnrb() and ugfrb().
+ */
+struct UgridBatchRestrictArgs {
+    /**
+     * The UGrid "dimensionality" to which to apply the filter expressions.
+     */
+    locationType dimension;
 
-#endif
+    /**
+     * The range variables returned for every region.
+     */
+    vector<libdap::Array *> rangeVars;
 
-        // Since we only want each ugrid structure to appear in the results one time  (cause otherwise we might be trying to add
-        // the same variables with the same names to the result multiple times.) we grind on this by iterating over the
-        // names of the mesh topology names.
-        map<string, vector<MeshDataVariable *> *>::iterator mit;
-        for (mit = meshToRangeVarsMap->begin(); mit != meshToRangeVarsMap->end(); ++mit) {
+    /**
+     * One domain filter expression for each region, in the order they were given.
+     */
+    vector<string> filterExpressions;
+};
 
-            string meshVariableName = mit->first;
-            vector<MeshDataVariable *> *requestedRangeVarsForMesh = mit->second;
+/**
+ * Process the arguments of a batch restrict function: one or more range
+ * variables followed by one or more filter expressions.
+ */
+static UgridBatchRestrictArgs processUgrBatchArgs(string func_name, locationType dimension, int argc,
+    BaseType *argv[])
+{
+    UgridBatchRestrictArgs args;
+    args.dimension = dimension;
 
-            // Building the restricted TwoDMeshTopology without adding any range variables and then converting the result
-            // Grid field to Dap Objects should return all of the Ugrid structural stuff - mesh variable, node coordinate variables,
-            // face and edge coordinate variables if present.
-            BESDEBUG("ugrid",
-                "ugrid_restrict() - Adding restricted mesh_topology structure for mesh '" << meshVariableName << "' to DAP response." << endl);
+    int i = 0;
+    for (; i < argc && argv[i]->type() == dods_array_c; ++i) {
+        libdap::Array *newRangeVar = dynamic_cast<libdap::Array*>(argv[i]);
+        if (newRangeVar == 0)
+            throw Error(malformed_expr,
+                "Wrong type for range variable argument. " + usage(func_name) + "  was passed a/an "
+                    + argv[i]->type_name());
+        args.rangeVars.push_back(newRangeVar);
+    }
 
-            TwoDMeshTopology *tdmt = new TwoDMeshTopology();
-            tdmt->init(meshVariableName, &dds);
+    for (; i < argc; ++i) {
+        if (argv[i]->type() != dods_str_c)
+            throw Error(malformed_expr,
+                "Wrong type for filter expression argument, expected DAP String. " + usage(func_name)
+                    + "  was passed a/an " + argv[i]->type_name());
+        args.filterExpressions.push_back(www2id(dynamic_cast<Str&>(*argv[i]).value()));
+        BESDEBUG("ugrid", "processUgrBatchArgs() - filter expression: '" << args.filterExpressions.back() << "'" << endl);
+    }
+
+    if (args.rangeVars.empty() || args.filterExpressions.empty())
+        throw Error(malformed_expr,
+            "Wrong number of arguments to ugrid batch restrict function: " + usage(func_name) + " was passed "
+                + long_to_string(argc) + " argument(s)");
+
+    return args;
+}
+
+/**
+ * A SlabSink that receives each slab read at the union of the locations of
+ * several regions and scatters it to the NDimensionalArray of every region.
+ * positions[r][i] is the position, in the union, of the i-th location of
+ * region r.
+ */
+class RegionScatterSink: public SlabSink {
+private:
+    vector<char> d_slab;
+    unsigned int d_width;
+    vector<NDimensionalArray *> *d_results;
+    vector<vector<unsigned int> > *d_positions;
+
+public:
+    RegionScatterSink(unsigned int unionSize, unsigned int width, vector<NDimensionalArray *> *results,
+        vector<vector<unsigned int> > *positions) :
+        d_slab(max(unionSize, 1U) * width), d_width(width), d_results(results), d_positions(positions)
+    {
+    }
+
+    virtual void *nextSlab()
+    {
+        return &d_slab[0];
+    }
+
+    virtual void slabFilled()
+    {
+        for (unsigned int r = 0; r < d_results->size(); ++r) {
+            void *slab;
+            (*d_results)[r]->getNextLastDimensionHyperSlab(&slab);
+
+            char *out = (char *) slab;
+            vector<unsigned int> &positions = (*d_positions)[r];
+            for (unsigned int i = 0; i < positions.size(); ++i)
+                memcpy(out + i * d_width, &d_slab[positions[i] * d_width], d_width);
+        }
+    }
+};
+
+/**
+ * Subset the range variable for several regions at once. Every slab of the
+ * variable is read once, at the union of the regions' locations, and copied
+ * to the result of each region that uses it. The results, one for each
+ * element of regionIndices, are appended to results; a region with no
+ * locations gets a zero-length result and no part in the read.
+ */
+static void restrictRangeVariableForRegions(MeshDataVariable *mdv, vector<vector<unsigned int> *> &regionIndices,
+    vector<libdap::Array *> *results)
+{
+    vector<unsigned int> unionIndex;
+    for (unsigned int r = 0; r < regionIndices.size(); ++r)
+        unionIndex.insert(unionIndex.end(), regionIndices[r]->begin(), regionIndices[r]->end());
+    sort(unionIndex.begin(), unionIndex.end());
+    unionIndex.erase(unique(unionIndex.begin(), unionIndex.end()), unionIndex.end());
+
+    BESDEBUG("ugrid",
+        "restrictRangeVariableForRegions() - Reading '" << mdv->getName() << "' at " << unionIndex.size() << " locations for " << regionIndices.size() << " regions." << endl);
+
+    libdap::Array *sourceDapArray = mdv->getDapArray();
+    vector<unsigned int> shape(sourceDapArray->dimensions(true));
+    NDimensionalArray::computeConstrainedShape(sourceDapArray, &shape);
+    libdap::Type dapType = sourceDapArray->var()->type();
+
+    // The regions that are read, and where each of their locations is in the union.
+    vector<NDimensionalArray *> regionResults;
+    vector<NDimensionalArray *> readResults;
+    vector<vector<unsigned int> > positions;
+    try {
+        for (unsigned int r = 0; r < regionIndices.size(); ++r) {
+            vector<unsigned int> *index = regionIndices[r];
+            shape.back() = index->size();
+            regionResults.push_back(new NDimensionalArray(&shape, dapType));
+            if (index->empty()) continue;
+
+            readResults.push_back(regionResults.back());
+            positions.push_back(vector<unsigned int>());
+            positions.back().reserve(index->size());
+            for (vector<unsigned int>::iterator it = index->begin(); it != index->end(); ++it)
+                positions.back().push_back(lower_bound(unionIndex.begin(), unionIndex.end(), *it) - unionIndex.begin());
+        }
+
+        if (!readResults.empty()) {
+            RegionScatterSink sink(unionIndex.size(), sourceDapArray->var()->width(), &readResults, &positions);
+            streamRangeVariable(mdv, &unionIndex, &sink);
+        }
 
-            tdmt->buildBasicGfTopology();
-            tdmt->addIndexVariable(node);
-            tdmt->addIndexVariable(face);
-            tdmt->applyRestrictOperator(args.dimension, args.filterExpression);
+        for (unsigned int r = 0; r < regionResults.size(); ++r)
+            results->push_back(regionResults[r]->getArray(sourceDapArray));
+    }
+    catch (...) {
+        for (unsigned int r = 0; r < regionResults.size(); ++r)
+            delete regionResults[r];
+        throw;
+    }
+
+    for (unsigned int r = 0; r < regionResults.size(); ++r)
+        delete regionResults[r];
+}
 
-            // 3: because there are nodes (rank = 0), edges (rank = 1), and faces (rank = 2). jhrg 10/25/13
-            vector<vector<unsigned int> *> location_subset_indices(3);
+/**
+ * Restrict one mesh with each filter expression of a batch request and add
+ * the mesh and its range variables to the Structure of each region. The
+ * regions whose filter misses the mesh are not restricted at all; those, and
+ * the regions a restriction leaves empty, get zero-length arrays rather than
+ * failing the whole batch.
+ */
+static void restrictMeshForRegions(DDS &dds, const UgridBatchRestrictArgs &args, const string &meshVariableName,
+    vector<MeshDataVariable *> *rangeVars, vector<Structure *> &regions)
+{
+    unsigned int regionCount = regions.size();
+
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    // The node and face indices of each region: [location][region].
+    vector<vector<vector<unsigned int> > > location_subset_indices(3, vector<vector<unsigned int> >(regionCount));
+    vector<vector<BaseType *> > dapResults(regionCount);
+    vector<libdap::Array *> restricted;
+    try {
+        vector<bool> misses(regionCount);
+        bool restricts = false;
+        for (unsigned int r = 0; r < regionCount; ++r) {
+            misses[r] = filterMissesMesh(&tdmt, &dds, args.dimension, args.filterExpressions[r]);
+            if (!misses[r]) restricts = true;
+        }
 
-            long nodeResultSize = tdmt->getResultGridSize(node);
-            BESDEBUG("ugrid", "ugrid_restrict() - there are "<< nodeResultSize << " nodes in the subset." << endl);
-            vector<unsigned int> node_subset_index(nodeResultSize);
-            if (nodeResultSize > 0) {
-                tdmt->getResultIndex(node, &node_subset_index[0]);
+        if (restricts) {
+            tdmt.buildBasicGfTopology();
+            tdmt.addIndexVariable(node);
+            tdmt.addIndexVariable(face);
+        }
+
+        for (unsigned int r = 0; r < regionCount; ++r) {
+            vector<unsigned int> &node_subset_index = location_subset_indices[node][r];
+            vector<unsigned int> &face_subset_index = location_subset_indices[face][r];
+
+            if (!misses[r]) {
+                tdmt.applyRestrictOperator(args.dimension, args.filterExpressions[r]);
+
+                node_subset_index.resize(tdmt.getResultGridSize(node));
+                if (!node_subset_index.empty()) tdmt.getResultIndex(node, &node_subset_index[0]);
+
+                face_subset_index.resize(tdmt.getResultGridSize(face));
+                if (!face_subset_index.empty()) tdmt.getResultIndex(face, &face_subset_index[0]);
             }
-            location_subset_indices[node] = &node_subset_index;
 
-            BESDEBUG("ugrid2", "ugrid_restrict() - node_subset_index"<< vectorToString(&node_subset_index) << endl);
+            BESDEBUG("ugrid",
+                "restrictMeshForRegions() - Region " << r << " of mesh '" << meshVariableName << "' has " << node_subset_index.size() << " nodes and " << face_subset_index.size() << " faces." << endl);
 
-            long faceResultSize = tdmt->getResultGridSize(face);
-            BESDEBUG("ugrid", "ugrid_restrict() - there are "<< faceResultSize << " faces in the subset." << endl);
-            vector<unsigned int> face_subset_index(faceResultSize);
-            if (faceResultSize > 0) {
-                tdmt->getResultIndex(face, &face_subset_index[0]);
+            if (node_subset_index.empty()) {
+                face_subset_index.clear();
+                tdmt.convertEmptySubsetToDapObjects(&dapResults[r]);
             }
-            location_subset_indices[face] = &face_subset_index;
-            BESDEBUG("ugrid2", "ugrid_restrict() - face_subset_index: "<< vectorToString(&face_subset_index) << endl);
+            else {
+                tdmt.convertResultGridFieldStructureToDapObjects(&dapResults[r]);
+            }
+        }
 
-            // This gets all the stuff that's attached to the grid - which at this point does not include the range variables but does include the
-            // index variable. good enough for now but need to drop the index....
-            vector<BaseType *> dapResults;
-            tdmt->convertResultGridFieldStructureToDapObjects(&dapResults);
+        vector<MeshDataVariable *>::iterator rvit;
+        for (rvit = rangeVars->begin(); rvit != rangeVars->end(); rvit++) {
+            MeshDataVariable *mdv = *rvit;
+            tdmt.setLocationCoordinateDimension(mdv);
 
-            BESDEBUG("ugrid",
-                "ugrid_restrict() - Restriction of mesh_topology '"<< tdmt->getMeshVariable()->name() << "' structure completed." << endl);
+            vector<vector<unsigned int> *> regionIndices;
+            for (unsigned int r = 0; r < regionCount; ++r)
+                regionIndices.push_back(&location_subset_indices[mdv->getGridLocation()][r]);
 
-            // now that we have the mesh topology variable we are going to look at each of the requested
-            // range variables (aka MeshDataVariable instances) and we're going to subset that using the
-            // gridfields library and add its subset version to the results.
-            vector<MeshDataVariable *>::iterator rvit;
-            for (rvit = requestedRangeVarsForMesh->begin(); rvit != requestedRangeVarsForMesh->end(); rvit++) {
-                MeshDataVariable *mdv = *rvit;
+            restrictRangeVariableForRegions(mdv, regionIndices, &restricted);
+            for (unsigned int r = 0; r < regionCount; ++r)
+                dapResults[r].push_back(restricted[r]);
+            restricted.clear();
+        }
+    }
+    catch (...) {
+        for (unsigned int r = 0; r < regionCount; ++r) {
+            for (vector<BaseType *>::iterator i = dapResults[r].begin(); i != dapResults[r].end(); ++i)
+                delete *i;
+        }
+        for (vector<libdap::Array *>::iterator i = restricted.begin(); i != restricted.end(); ++i)
+            delete *i;
+        throw;
+    }
+
+    for (unsigned int r = 0; r < regionCount; ++r) {
+        for (vector<BaseType *>::iterator i = dapResults[r].begin(); i != dapResults[r].end(); ++i)
+            regions[r]->add_var_nocopy(*i);
+    }
+}
+
+/**
+ * The batch form of ugrid_restrict(): restrict the mesh with each of several
+ * filter expressions and return one Structure, named region_<i>, for each.
+ * The mesh topology of each mesh is read and built once and is shared by all
+ * of the restrictions, and each slab of a range variable is read once for all
+ * of the regions. Empty regions do not fail the batch (see
+ * restrictMeshForRegions()).
+ */
+void ugrid_restrict_batch(string func_name, locationType location, int argc, BaseType *argv[], DDS &dds,
+    BaseType **btpp)
+{
+    try { // This top level try block is used to catch gridfields library errors.
 
-                BESDEBUG("ugrid",
-                    "ugrid_restrict() - Processing MeshDataVariable  '"<< mdv->getName() << "' associated with rank/location: "<< mdv->getGridLocation() << endl);
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::ugrid_restrict_batch()", "[function_invocation]");
 
-                tdmt->setLocationCoordinateDimension(mdv);
+        BESDEBUG("ugrid", "ugrid_restrict_batch() - BEGIN" << endl);
 
-                /**
-                 * Here is where we will do the range variable sub-setting including decomposing the requested variable
-                 * into 1-dimensional hyper-slabs that can be fed into the gridfields library
-                 */
-                libdap::Array *restrictedRangeVarArray = restrictRangeVariableByOneDHyperSlab(mdv,
-                    location_subset_indices[mdv->getGridLocation()]);
+        if (argc == 0) {
+            Str *response = new Str("info");
+            response->set_value(string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"ugrid_restrict_batch\" version=\"0.1\">\n"
+                + "Server function for Unstructured grid operations.\n" + "usage: " + usage(func_name) + "\n"
+                + "</function>");
+            *btpp = response;
+            return;
+        }
 
-                BESDEBUG("ugrid",
-                    "ugrid_restrict() - Adding resulting dapArray  '"<< restrictedRangeVarArray->name() << "' to dapResults." << endl);
+        UgridBatchRestrictArgs args = processUgrBatchArgs(func_name, location, argc, argv);
+        unsigned int regionCount = args.filterExpressions.size();
 
-                dapResults.push_back(restrictedRangeVarArray);
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        Structure *dapResult = 0;
+        vector<Structure *> regions;
+        try {
+            vector<libdap::Array *>::iterator it;
+            for (it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
             }
 
-            delete tdmt;
+            dapResult = new Structure(func_name + "_result_unwrap");
+            dapResult->set_attr_table(dds.get_attr_table());
 
-            BESDEBUG("ugrid", "ugrid_restrict() - Adding GF::GridField results to DAP structure " << dapResult->name() << endl);
+            for (unsigned int r = 0; r < regionCount; ++r) {
+                Structure *region = new Structure("region_" + long_to_string(r));
+                region->get_attr_table().append_attr("filter", "String", args.filterExpressions[r]);
+                regions.push_back(region);
+            }
 
-            for (vector<BaseType *>::iterator i = dapResults.begin(); i != dapResults.end(); ++i) {
-                BESDEBUG("ugrid",
-                    "ugrid_restrict() - Adding variable "<< (*i)->name() << " to DAP structure " << dapResult->name() << endl);
-                dapResult->add_var_nocopy(*i);
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                restrictMeshForRegions(dds, args, mit->first, mit->second, regions);
             }
         }
+        catch (...) {
+            for (unsigned int r = 0; r < regions.size(); ++r)
+                delete regions[r];
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            throw;
+        }
 
-        *btpp = dapResult;
+        for (unsigned int r = 0; r < regionCount; ++r)
+            dapResult->add_var_nocopy(regions[r]);
 
-        // TODO replace with auto_ptr. jhrg 4/17/15
+        releaseRangeVars(&meshToRangeVarsMap);
 
-        BESDEBUG("ugrid", "ugrid_restrict() - Releasing maps and vectors..." << endl);
-        for (mit = meshToRangeVarsMap->begin(); mit != meshToRangeVarsMap->end(); ++mit) {
-            vector<MeshDataVariable *> *requestedRangeVarsForMesh = mit->second;
-            vector<MeshDataVariable *>::iterator rvit;
-            for (rvit = requestedRangeVarsForMesh->begin(); rvit != requestedRangeVarsForMesh->end(); rvit++) {
-                MeshDataVariable *mdv = *rvit;
-                delete mdv;
-            }
-            delete requestedRangeVarsForMesh;
-        }
-        delete meshToRangeVarsMap;
+        *btpp = dapResult;
 
-        BESDEBUG("ugrid", "ugrid_restrict() - END" << endl);
+        BESDEBUG("ugrid", "ugrid_restrict_batch() - END" << endl);
     }
     catch (GFError &gfe) {
         throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
     }
-
-    return;
 }
 
 
@@ -650,6 +2694,23 @@ void ugrid_restrict(string func_name, locationType location, int argc, BaseType
  @brief Subset an irregular mesh (aka unstructured grid) by evaluating a filter expression
  against the node values of the ugrid.
 
+ An argument of the form 'halo=n' widens the subset by n rings of faces:
+ each ring adds every face that shares a node with the faces already in it.
+ 'min_faces=n' drops the connected pieces of the subset (faces joined by
+ shared edges) with fewer than n faces and 'component_at=x,y' keeps only the
+ piece that contains the point (x, y). Pieces are dropped before the range
+ variables are read and before the halo is added.
+ 'region=variable:id,...' keeps only the faces whose value of an integer face
+ variable of the mesh (e.g., a basin id) is one of the ids; the faces are
+ found with an inverted index of the variable, built on first use and kept
+ with the mesh geometry. Given a region, the filter expression may be left
+ out, in which case the mesh is not scanned at all.
+
+ Terms of the filter expression that compare a range variable of the mesh
+ with a number (e.g., 'X > 26 & depth > 5', or 'twoDnodedata[2] > 5' to pick
+ the slab of a variable's outer dimensions) are applied after the rest of the
+ filter, reading the variable only where that leaves candidate locations.
+
  @param argc Count of the function's arguments
  @param argv Array of pointers to the functions arguments
  @param dds Reference to the DDS object for the complete dataset.
@@ -715,6 +2776,85 @@ void ugfr(int argc, BaseType *argv[], DDS &dds, BaseType **btpp) {
     ugrid_restrict("ugfr",face,argc,argv,dds,btpp);
 }
 
+/**
+ @brief Subset an irregular mesh (aka unstructured grid) by evaluating a filter expression
+ against the node values of the ugrid, then reduce the range variables along one of their
+ outer dimensions (typically time).
+
+ The next to last argument names the reduction: max(dim), min(dim), mean(dim), argmax(dim)
+ or count(dim > value), where the comparison may also be >=, < or <=. The reduced variables
+ keep their names and lose the dimension 'dim'; argmax() returns the index of the maximum
+ along 'dim' (-1 where every value is missing) and count() the number of values that pass
+ the comparison. Values equal to the variable's _FillValue or missing_value are skipped;
+ where every value is missing, max(), min() and mean() hold the variable's fill value
+ (recorded as a Float64 _FillValue) or, if it has none, NaN.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Return the function result in an instance of BaseType
+ referenced by this pointer to a pointer.
+ */
+void ugtr(int argc, BaseType *argv[], DDS &dds, BaseType **btpp) {
+    if (argc == 0) {
+        ugrid_restrict("ugtr", node, argc, argv, dds, btpp);
+        return;
+    }
+
+    if (argc < 3)
+        throw Error(malformed_expr,
+            "Wrong number of arguments to ugrid restrict function: " + usage("ugtr") + " was passed "
+                + long_to_string(argc) + " argument(s)");
+
+    BaseType *bt = argv[argc - 2];
+    if (bt->type() != dods_str_c)
+        throw Error(malformed_expr,
+            "Wrong type for the reduction argument, expected DAP String. " + usage("ugtr") + "  was passed a/an "
+                + bt->type_name());
+
+    TemporalReduction reduction = parseTemporalReduction("ugtr", www2id(dynamic_cast<Str&>(*bt).value()));
+
+    // The remaining arguments are those of ugnr().
+    vector<BaseType *> restrictArgs(argv, argv + argc - 2);
+    restrictArgs.push_back(argv[argc - 1]);
+
+    ugrid_restrict("ugtr", node, restrictArgs.size(), &restrictArgs[0], dds, btpp, &reduction);
+}
+
+/**
+ @brief Subset an irregular mesh once for each of several filter expressions evaluated
+ against the node values of the ugrid.
+
+ The arguments are the range variables followed by one or more filter expressions.
+ The result holds one Structure, region_0 ... region_<n-1>, for each filter expression,
+ each with the content ugnr() would return for that expression. A region whose expression
+ leaves nothing of the mesh (e.g., a tile that is all land or off the mesh) holds zero-length
+ arrays instead of failing the request.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Return the function result in an instance of BaseType
+ referenced by this pointer to a pointer.
+ */
+void ugnrb(int argc, BaseType *argv[], DDS &dds, BaseType **btpp) {
+    ugrid_restrict_batch("ugnrb", node, argc, argv, dds, btpp);
+}
+
+/**
+ @brief Subset an irregular mesh once for each of several filter expressions evaluated
+ against the face values of the ugrid. See ugnrb().
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Return the function result in an instance of BaseType
+ referenced by this pointer to a pointer.
+ */
+void ugfrb(int argc, BaseType *argv[], DDS &dds, BaseType **btpp) {
+    ugrid_restrict_batch("ugfrb", face, argc, argv, dds, btpp);
+}
+
 
 
 
@@ -30,12 +30,117 @@
 #ifndef UGR5_H_
 #define UGR5_H_
 
+#include <map>
+#include <vector>
+
 #include "BaseType.h"
 #include "DDS.h"
 #include "ServerFunction.h"
 
+#include "LocationType.h"
+
+namespace libdap {
+class Array;
+class NDimensionalArray;
+}
+
 namespace ugrid {
 
+class GatherPlan;
+class MeshDataVariable;
+class RestrictionResult;
+class TwoDMeshTopology;
+
+/**
+ * Find the mesh a range variable is defined on and add the variable to that mesh's
+ * list in rangeVariables. Shared by the functions that accept range variable arguments.
+ */
+void addRangeVar(libdap::DDS *dds, libdap::Array *rangeVar,
+    std::map<std::string, std::vector<MeshDataVariable *> *> *rangeVariables);
+
+/**
+ * Delete the range variables added to rangeVariables by addRangeVar(), and empty it.
+ */
+void releaseRangeVars(std::map<std::string, std::vector<MeshDataVariable *> *> *rangeVariables);
+
+/**
+ * @return True if the filter expression bounds the node coordinates to a box that
+ * misses the extent of the mesh, so that restricting the mesh with it is certain
+ * to yield nothing.
+ */
+bool filterMissesMesh(TwoDMeshTopology *tdmt, libdap::DDS *dds, locationType dimension,
+    const std::string &filterExpression);
+
+/**
+ * Restrict the mesh with the filter expression and copy the indices of the nodes
+ * and faces in the result, sharing them with the other beslistener processes when
+ * the SharedMeshStore is enabled.
+ *
+ * @return True if the mesh was restricted by this process, so that tdmt holds the
+ * restricted grid; false if the subset was made by another one.
+ */
+bool restrictSharedMesh(TwoDMeshTopology *tdmt, libdap::DDS *dds, locationType dimension,
+    const std::string &filterExpression, std::vector<unsigned int> *nodes, std::vector<unsigned int> *faces);
+
+/**
+ * Get the result of restricting the mesh with the filter expression from the
+ * MeshGeometryCache, making it, from nodes and faces when the caller has made the
+ * subset, if the cache does not hold it. The result belongs to the cache unless
+ * the dataset has no stamp; then it is also returned in owned for the caller to
+ * delete.
+ */
+RestrictionResult *getRestrictionResult(TwoDMeshTopology *tdmt, libdap::DDS *dds, locationType dimension,
+    const std::string &filterExpression, RestrictionResult **owned, const std::vector<unsigned int> *nodes = 0,
+    const std::vector<unsigned int> *faces = 0);
+
+/**
+ * Read the values of a range variable at the given locations (node, edge or face
+ * indices) for every slab of its other dimensions.
+ */
+libdap::NDimensionalArray *gatherRangeVariable(MeshDataVariable *mdv, std::vector<unsigned int> *slab_subset_index);
+
+/**
+ * Like gatherRangeVariable() above, but read the locations of a plan made for
+ * them, which can be shared by all the range variables at that location.
+ */
+libdap::NDimensionalArray *gatherRangeVariable(MeshDataVariable *mdv, const GatherPlan &plan);
+
+/**
+ * Receives the slabs of a range variable, one at a time, from streamRangeVariable().
+ * A slab holds the values at the requested locations for one combination of the
+ * indices of the variable's outer dimensions, in the variable's own type.
+ */
+class SlabSink {
+public:
+    virtual ~SlabSink()
+    {
+    }
+
+    /**
+     * @return Storage, large enough for one slab, for the values of the next slab.
+     */
+    virtual void *nextSlab() = 0;
+
+    /**
+     * Called once the storage returned by nextSlab() has been filled.
+     */
+    virtual void slabFilled() = 0;
+};
+
+/**
+ * Like gatherRangeVariable(), but pass each slab to the sink as it is read
+ * instead of collecting them all.
+ */
+void streamRangeVariable(MeshDataVariable *mdv, std::vector<unsigned int> *slab_subset_index, SlabSink *sink);
+void streamRangeVariable(MeshDataVariable *mdv, const GatherPlan &plan, SlabSink *sink);
+
+/**
+ * Like streamRangeVariable(), but read several range variables with the same
+ * location and shape together; each slab holds one slab of every variable.
+ */
+void streamRangeVariables(std::vector<MeshDataVariable *> *mdvs, std::vector<unsigned int> *slab_subset_index,
+    SlabSink *sink);
+
 /**
  Subset an irregular mesh (aka unstructured grid or ugrid) by evaluating a filter expression
  against the node values of the ugrid.
@@ -54,6 +159,25 @@ void uger(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseTyp
 **/
 void ugfr(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
 
+/**
+ Subset an irregular mesh (aka unstructured grid or ugrid) by evaluating a filter expression
+ against the node values of the ugrid and reduce the range variables along one of their
+ outer dimensions.
+**/
+void ugtr(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ Subset an irregular mesh (aka unstructured grid or ugrid) once for each of several filter
+ expressions evaluated against the node values of the ugrid.
+**/
+void ugnrb(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ Subset an irregular mesh (aka unstructured grid or ugrid) once for each of several filter
+ expressions evaluated against the face values of the ugrid.
+**/
+void ugfrb(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
 /**
  * The UGNR class encapsulates the function 'ugr::ugnr'
  * along with additional meta-data regarding its use and applicability.
@@ -69,7 +193,7 @@ public:
         setDescriptionString(
             ((string)"This function can subset the range variables of a two dimensional triangular mesh unstructured grid ") +
             "by applying a filter expression to the values of the grid associated with the nodes.");
-        setUsageString("ugnr(node_var [,node_var_2,...,node_var_n], 'relational query over domain')");
+        setUsageString("ugnr(node_var [,node_var_2,...,node_var_n] [,'name := expression',...] [,'halo=n'] [,'min_faces=n'] [,'component_at=x,y'] [,'region=variable:id,...'], 'relational query over domain')");
         setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
         setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
         setFunction(ugrid::ugnr);
@@ -91,7 +215,7 @@ public:
         setDescriptionString(
             ((string)"This function can subset the range variables of a two dimensional triangular mesh unstructured grid ") +
             "by applying a filter expression to the values of the grid associated with the edges.");
-        setUsageString("uger(node_var [,node_var_2,...,node_var_n], 'relational query over domain')");
+        setUsageString("uger(node_var [,node_var_2,...,node_var_n] [,'name := expression',...] [,'halo=n'] [,'min_faces=n'] [,'component_at=x,y'] [,'region=variable:id,...'], 'relational query over domain')");
         setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
         setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
         setFunction(ugrid::uger);
@@ -113,7 +237,7 @@ public:
         setDescriptionString(
             ((string)"This function can subset the range variables of a two dimensional triangular mesh unstructured grid ") +
             "by applying a filter expression to the values of the grid associated with the faces.");
-        setUsageString("ugfr(node_var [,node_var_2,...,node_var_n], 'relational query over domain')");
+        setUsageString("ugfr(node_var [,node_var_2,...,node_var_n] [,'name := expression',...] [,'halo=n'] [,'min_faces=n'] [,'component_at=x,y'] [,'region=variable:id,...'], 'relational query over domain')");
         setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
         setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
         setFunction(ugrid::ugfr);
@@ -125,6 +249,78 @@ public:
 
 };
 
+class UGTR: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGTR()
+{
+        setName("ugtr");
+        setDescriptionString(
+            ((string)"This function subsets the range variables of a two dimensional unstructured grid by applying ") +
+            "a filter expression to the values of the grid associated with the nodes and then reduces them along " +
+            "one of their outer dimensions (max, min, mean, argmax or count of the values past a threshold).");
+        setUsageString("ugtr(node_var [,node_var_2,...,node_var_n], 'max(time)', 'relational query over domain')");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugtr);
+        setVersion("1.0");
+}
+    virtual ~UGTR()
+    {
+    }
+
+};
+
+class UGNRB: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGNRB()
+{
+        setName("ugnrb");
+        setDescriptionString(
+            ((string)"This function subsets the range variables of a two dimensional unstructured grid once for each ") +
+            "of several filter expressions applied to the values of the grid associated with the nodes, reading " +
+            "the mesh and each range variable only once.");
+        setUsageString("ugnrb(node_var [,node_var_2,...,node_var_n], 'relational query over domain' [,'query 2',...,'query n'])");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugnrb);
+        setVersion("1.0");
+}
+    virtual ~UGNRB()
+    {
+    }
+
+};
+
+class UGFRB: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGFRB()
+{
+        setName("ugfrb");
+        setDescriptionString(
+            ((string)"This function subsets the range variables of a two dimensional unstructured grid once for each ") +
+            "of several filter expressions applied to the values of the grid associated with the faces, reading " +
+            "the mesh and each range variable only once.");
+        setUsageString("ugfrb(face_var [,face_var_2,...,face_var_n], 'relational query over domain' [,'query 2',...,'query n'])");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_restrict");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugfrb);
+        setVersion("1.0");
+}
+    virtual ~UGFRB()
+    {
+    }
+
+};
+
 } // namespace ugrid_restrict
 
 #endif /* UGR5_H_ */
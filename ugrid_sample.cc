@@ -0,0 +1,1135 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <Float32.h>
+#include <UInt32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Array.h>
+#include <Structure.h>
+#include <Grid.h>
+#include <Error.h>
+#include <InternalErr.h>
+#include <util.h>
+#include <escaping.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+#include "BESStopWatch.h"
+
+#include "ugrid_utils.h"
+#include "MeshDataVariable.h"
+#include "TwoDMeshTopology.h"
+#include "NDimensionalArray.h"
+#include "MeshGeometry.h"
+#include "KDTree.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+#include "RegridWeights.h"
+#include "ugrid_restrict.h"
+#include <gridfields/GFError.h>
+
+#include "ugrid_sample.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+#define SAMPLE_POINTS_DIMENSION "points"
+#define SAMPLE_NEIGHBORS_DIMENSION "neighbors"
+
+// The most samples a transect may have.
+#define TRANSECT_MAX_SAMPLES 1000000
+
+// The most points a regridding target grid may have.
+#define REGRID_MAX_POINTS 10000000
+
+#define REGRID_X_DIMENSION "lon"
+#define REGRID_Y_DIMENSION "lat"
+
+/**
+ * The argument, if any, that follows the point list.
+ */
+enum TrailingArg {
+    no_trailing_arg, // ugpi()
+    neighbor_count,  // ugnn(): optional number of nearest nodes
+    sample_spacing,  // ugtx(): required distance between samples
+    grid_spacing     // ugrg(): required grid spacing, one value or dx and dy
+};
+
+/**
+ * Function Arguments
+ */
+struct UgridSampleArgs {
+    /**
+     * The range variables to sample.
+     */
+    vector<libdap::Array *> rangeVars;
+
+    /**
+     * The coordinates of the sample points.
+     */
+    vector<double> x;
+    vector<double> y;
+
+    /**
+     * The number of nearest nodes to return for each point (ugnn() only).
+     */
+    unsigned int k;
+
+    /**
+     * For ugtx(), the distance along the polyline of each sample. When this is
+     * set, x and y hold the samples and not the polyline's vertices.
+     */
+    vector<double> distance;
+
+    /**
+     * For ugrg(), the spacing and number of points of the target grid. The
+     * grid's first point is (x[0], y[0]).
+     */
+    double dx, dy;
+    unsigned int nx, ny;
+};
+
+/**
+ * Adds the variables for one mesh to the function result.
+ */
+typedef void (*MeshSampler)(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridSampleArgs &args, Structure *dapResult);
+
+static string ugnnUsage()
+{
+    return "ugnn(rangeVariable:array, [rangeVariable:array, ... ] points:string [, k:int])";
+}
+
+static string ugpiUsage()
+{
+    return "ugpi(rangeVariable:array, [rangeVariable:array, ... ] points:string)";
+}
+
+static string ugtxUsage()
+{
+    return "ugtx(rangeVariable:array, [rangeVariable:array, ... ] polyline:string, spacing:number)";
+}
+
+static string ugrgUsage()
+{
+    return "ugrg(rangeVariable:array, [rangeVariable:array, ... ] bbox:string, dx:number [, dy:number])";
+}
+
+/**
+ * Parse a list of points written as 'x1 y1, x2 y2, ...'. Commas and white space
+ * are both treated as separators, so 'x1,y1,x2,y2' works too; the coordinates are
+ * taken in pairs.
+ */
+static void parsePoints(const string &func_name, const string &pointList, vector<double> *x, vector<double> *y)
+{
+    string s = pointList;
+    replace(s.begin(), s.end(), ',', ' ');
+    replace(s.begin(), s.end(), ';', ' ');
+
+    istringstream iss(s);
+    vector<double> values;
+    double value;
+    while (iss >> value)
+        values.push_back(value);
+
+    if (!iss.eof())
+        throw Error(malformed_expr, func_name + "() - Unable to parse the point list '" + pointList + "'");
+
+    if (values.empty() || values.size() % 2 != 0)
+        throw Error(malformed_expr,
+            func_name + "() - The point list must hold one or more x y pairs. It held "
+                + long_to_string(values.size()) + " value(s).");
+
+    for (unsigned int i = 0; i < values.size(); i += 2) {
+        x->push_back(values[i]);
+        y->push_back(values[i + 1]);
+    }
+}
+
+/**
+ * @return The value of a scalar integer argument, or throw an Error if bt is not one.
+ */
+static int getIntegerArg(const string &func_name, BaseType *bt, const string &argName)
+{
+    switch (bt->type()) {
+    case dods_int32_c:
+        return dynamic_cast<Int32&>(*bt).value();
+    case dods_uint32_c:
+        return dynamic_cast<UInt32&>(*bt).value();
+    default:
+        throw Error(malformed_expr,
+            func_name + "() - Wrong type for argument '" + argName + "', expected an integer but was passed a/an "
+                + bt->type_name());
+    }
+}
+
+static bool isNumberArg(BaseType *bt)
+{
+    switch (bt->type()) {
+    case dods_float64_c:
+    case dods_float32_c:
+    case dods_int32_c:
+    case dods_uint32_c:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @return The value of a scalar numeric argument, or throw an Error if bt is not one.
+ */
+static double getNumberArg(const string &func_name, BaseType *bt, const string &argName)
+{
+    switch (bt->type()) {
+    case dods_float64_c:
+        return dynamic_cast<Float64&>(*bt).value();
+    case dods_float32_c:
+        return dynamic_cast<Float32&>(*bt).value();
+    case dods_int32_c:
+    case dods_uint32_c:
+        return getIntegerArg(func_name, bt, argName);
+    default:
+        throw Error(malformed_expr,
+            func_name + "() - Wrong type for argument '" + argName + "', expected a number but was passed a/an "
+                + bt->type_name());
+    }
+}
+
+/**
+ * Replace the polyline held in args.x and args.y with samples taken every
+ * spacing units along it, starting at its first vertex. The last vertex is
+ * always included, so the final interval may be shorter than spacing. The
+ * distance along the polyline of each sample is put in args.distance.
+ * Distances are measured in the units of the mesh coordinates.
+ */
+static void makeTransect(const string &func_name, double spacing, UgridSampleArgs *args)
+{
+    vector<double> &vx = args->x;
+    vector<double> &vy = args->y;
+
+    if (vx.size() < 2)
+        throw Error(malformed_expr, func_name + "() - The polyline must have at least two vertices.");
+
+    // cumulative[i] is the distance along the polyline to vertex i.
+    vector<double> cumulative(vx.size(), 0.0);
+    for (unsigned int i = 1; i < vx.size(); ++i) {
+        double dx = vx[i] - vx[i - 1], dy = vy[i] - vy[i - 1];
+        cumulative[i] = cumulative[i - 1] + sqrt(dx * dx + dy * dy);
+    }
+    double total = cumulative.back();
+
+    if (total / spacing >= TRANSECT_MAX_SAMPLES)
+        throw Error(malformed_expr,
+            func_name + "() - The spacing is too small for the length of the polyline; the transect would have "
+                + "more than " + long_to_string(TRANSECT_MAX_SAMPLES) + " samples.");
+
+    unsigned int nIntervals = (unsigned int) floor(total / spacing);
+
+    vector<double> x, y, distance;
+    unsigned int segment = 0;
+    for (unsigned int k = 0; k <= nIntervals; ++k) {
+        double d = k * spacing;
+        while (segment + 2 < vx.size() && cumulative[segment + 1] < d)
+            ++segment;
+
+        double length = cumulative[segment + 1] - cumulative[segment];
+        double t = (length > 0) ? (d - cumulative[segment]) / length : 0.0;
+        if (t > 1.0) t = 1.0;
+
+        x.push_back(vx[segment] + t * (vx[segment + 1] - vx[segment]));
+        y.push_back(vy[segment] + t * (vy[segment + 1] - vy[segment]));
+        distance.push_back(d);
+    }
+
+    // Add the end of the polyline unless the last sample already landed on it.
+    if (total - distance.back() > 1e-9 * total) {
+        x.push_back(vx.back());
+        y.push_back(vy.back());
+        distance.push_back(total);
+    }
+
+    BESDEBUG("ugrid",
+        "makeTransect() - " << vx.size() << " vertices, length " << total << ", " << x.size() << " samples" << endl);
+
+    vx.swap(x);
+    vy.swap(y);
+    args->distance.swap(distance);
+}
+
+/**
+ * Set up the target grid of ugrg(). On entry args.x and args.y hold the two
+ * corners of the bounding box; on return they hold the lower left corner, which
+ * is the grid's first point, and args.nx and args.ny hold the number of grid
+ * points that fit in the box at the spacing args.dx and args.dy.
+ */
+static void makeGrid(const string &func_name, UgridSampleArgs *args)
+{
+    if (args->x.size() != 2)
+        throw Error(malformed_expr,
+            func_name + "() - The bounding box must be given as two corners, 'minX minY, maxX maxY'.");
+
+    double minX = args->x[0], maxX = args->x[1];
+    double minY = args->y[0], maxY = args->y[1];
+    if (!(minX <= maxX && minY <= maxY))
+        throw Error(malformed_expr,
+            func_name + "() - The first corner of the bounding box must be its lower left corner.");
+
+    // Allow for rounding so that a box that is a whole number of steps wide
+    // includes its far edge.
+    double columns = floor((maxX - minX) / args->dx + 1e-9) + 1;
+    double rows = floor((maxY - minY) / args->dy + 1e-9) + 1;
+    if (columns * rows > REGRID_MAX_POINTS)
+        throw Error(malformed_expr,
+            func_name + "() - The target grid would have more than " + long_to_string(REGRID_MAX_POINTS)
+                + " points; use a larger spacing or a smaller bounding box.");
+
+    args->nx = (unsigned int) columns;
+    args->ny = (unsigned int) rows;
+    args->x.resize(1);
+    args->y.resize(1);
+
+    BESDEBUG("ugrid", "makeGrid() - " << args->nx << " x " << args->ny << " grid points" << endl);
+}
+
+/**
+ * Process the functions arguments and return the structure containing their values.
+ * The arguments are one or more range variables, the point list and then the
+ * argument(s) given by trailing: nothing, an optional neighbor count, a required
+ * sample spacing or a required grid spacing. With a sample spacing the point list
+ * is a polyline and the points returned are the samples along it; with a grid
+ * spacing it is the two corners of the grid's bounding box.
+ */
+static UgridSampleArgs processSampleArgs(const string &func_name, const string &usage, TrailingArg trailing, int argc,
+    BaseType *argv[])
+{
+    UgridSampleArgs args;
+    args.k = 1;
+    args.dx = args.dy = 0.0;
+    args.nx = args.ny = 0;
+
+    if (argc < 2)
+        throw Error(malformed_expr,
+            "Wrong number of arguments to " + func_name + "(): " + usage + " was passed " + long_to_string(argc)
+                + " argument(s)");
+
+    int pointsArg = argc - 1;
+    double spacing = 0.0;
+    if (trailing == neighbor_count && argv[pointsArg]->type() != dods_str_c) {
+        int k = getIntegerArg(func_name, argv[pointsArg], "k");
+        if (k < 1) throw Error(malformed_expr, func_name + "() - The value of k must be at least one. " + usage);
+        args.k = k;
+        --pointsArg;
+    }
+    else if (trailing == sample_spacing) {
+        spacing = getNumberArg(func_name, argv[pointsArg], "spacing");
+        if (!(spacing > 0))
+            throw Error(malformed_expr, func_name + "() - The spacing must be greater than zero. " + usage);
+        --pointsArg;
+    }
+    else if (trailing == grid_spacing) {
+        args.dx = args.dy = getNumberArg(func_name, argv[pointsArg], "dx");
+        if (pointsArg > 1 && isNumberArg(argv[pointsArg - 1])) {
+            args.dx = getNumberArg(func_name, argv[pointsArg - 1], "dx");
+            --pointsArg;
+        }
+        if (!(args.dx > 0 && args.dy > 0))
+            throw Error(malformed_expr, func_name + "() - The grid spacing must be greater than zero. " + usage);
+        --pointsArg;
+    }
+
+    if (pointsArg < 1 || argv[pointsArg]->type() != dods_str_c)
+        throw Error(malformed_expr, func_name + "() - Expected a DAP String holding the list of points. " + usage);
+
+    string points = www2id(dynamic_cast<Str&>(*argv[pointsArg]).value());
+    BESDEBUG("ugrid", "processSampleArgs() - points: '" << points << "'" << endl);
+    parsePoints(func_name, points, &args.x, &args.y);
+
+    if (trailing == sample_spacing) makeTransect(func_name, spacing, &args);
+    if (trailing == grid_spacing) makeGrid(func_name, &args);
+
+    for (int i = 0; i < pointsArg; i++) {
+        libdap::Array *rangeVar = dynamic_cast<libdap::Array*>(argv[i]);
+        if (rangeVar == 0)
+            throw Error(malformed_expr,
+                func_name + "() - Wrong type for range variable argument, expected DAP Array. " + usage
+                    + " was passed a/an " + argv[i]->type_name());
+
+        args.rangeVars.push_back(rangeVar);
+    }
+
+    return args;
+}
+
+static libdap::Array *newPointsArray(const string &name, vector<double> *values)
+{
+    Float64 proto(name);
+    libdap::Array *a = new libdap::Array(name, &proto);
+    a->append_dim(values->size(), SAMPLE_POINTS_DIMENSION);
+    a->set_value(*values, values->size());
+    return a;
+}
+
+/**
+ * Append to target all the (constrained) dimensions of source except the last,
+ * which is the location (node, edge or face) dimension of a range variable.
+ */
+static void appendOuterDimensions(libdap::Array *source, libdap::Array *target)
+{
+    for (libdap::Array::Dim_iter d = source->dim_begin(); d + 1 != source->dim_end(); ++d) {
+        target->append_dim(source->dimension_size(d, true), source->dimension_name(d));
+    }
+}
+
+/**
+ * @return The sorted, unique values of ids.
+ */
+static vector<unsigned int> uniqueIds(const vector<unsigned int> &ids)
+{
+    vector<unsigned int> result(ids);
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+/**
+ * @return For each of ids, its position in the sorted vector uniqueIds.
+ */
+static vector<unsigned int> positionsIn(const vector<unsigned int> &uniqueIds, const vector<unsigned int> &ids)
+{
+    vector<unsigned int> positions(ids.size());
+    for (unsigned int i = 0; i < ids.size(); ++i) {
+        positions[i] = lower_bound(uniqueIds.begin(), uniqueIds.end(), ids[i]) - uniqueIds.begin();
+    }
+    return positions;
+}
+
+/**
+ * Build the result array for one range variable. The source values were gathered
+ * for the sorted, unique node ids in uniqueNodes; here they are scattered out to
+ * every point/neighbor pair so that the location dimension of the source is
+ * replaced by [points][neighbors].
+ */
+static libdap::Array *scatterRangeVariable(MeshDataVariable *mdv, NDimensionalArray *gathered,
+    vector<unsigned int> *uniqueNodes, vector<unsigned int> *nodeIds, unsigned int nPoints, unsigned int k)
+{
+    libdap::Array *source = mdv->getDapArray();
+
+    vector<unsigned int> shape(source->dimensions(true));
+    NDimensionalArray::computeConstrainedShape(source, &shape);
+    shape.back() = nPoints;
+    shape.push_back(k);
+
+    // A template with the result's dimension names; NDimensionalArray::getArray() takes the
+    // names from it, the sizes from the NDimensionalArray.
+    libdap::Array resultTemplate(source->name(), source->var());
+    appendOuterDimensions(source, &resultTemplate);
+    resultTemplate.append_dim(nPoints, SAMPLE_POINTS_DIMENSION);
+    resultTemplate.append_dim(k, SAMPLE_NEIGHBORS_DIMENSION);
+    resultTemplate.set_attr_table(source->get_attr_table());
+
+    NDimensionalArray result(&shape, gathered->getTypeTemplate());
+
+    // Where in the gathered slab each point/neighbor value is found.
+    vector<unsigned int> slabPosition = positionsIn(*uniqueNodes, *nodeIds);
+
+    unsigned int elementSize = gathered->sizeOfElement();
+    unsigned int srcSlabSize = uniqueNodes->size();
+    unsigned int dstSlabSize = nodeIds->size();
+    long slabCount = gathered->elementCount() / srcSlabSize;
+
+    char *src = (char *) gathered->getStorage();
+    char *dst = (char *) result.getStorage();
+    for (long s = 0; s < slabCount; ++s) {
+        for (unsigned int i = 0; i < dstSlabSize; ++i) {
+            memcpy(dst + i * elementSize, src + slabPosition[i] * elementSize, elementSize);
+        }
+        src += srcSlabSize * elementSize;
+        dst += dstSlabSize * elementSize;
+    }
+
+    return result.getArray(&resultTemplate);
+}
+
+/**
+ * Find the nearest nodes for every point on one mesh and add the node indices,
+ * distances and sampled range variables to the result.
+ */
+static void nearestNodeSampler(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridSampleArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+    if (geometry->nodeCount() == 0)
+        throw Error(malformed_expr, "ugnn() - The mesh '" + meshVariableName + "' has no nodes.");
+
+    const KDTree *tree = geometry->getNodeTree();
+
+    unsigned int nPoints = args.x.size();
+    unsigned int k = min(args.k, geometry->nodeCount());
+
+    vector<unsigned int> nodeIds;
+    vector<double> distances;
+    nodeIds.reserve(nPoints * k);
+    distances.reserve(nPoints * k);
+
+    vector<unsigned int> ids;
+    vector<double> dists;
+    for (unsigned int p = 0; p < nPoints; ++p) {
+        tree->nearest(args.x[p], args.y[p], k, &ids, &dists);
+        nodeIds.insert(nodeIds.end(), ids.begin(), ids.end());
+        distances.insert(distances.end(), dists.begin(), dists.end());
+    }
+
+    BESDEBUG("ugrid",
+        "nearestNodeSampler() - Found " << k << " nearest node(s) for " << nPoints << " point(s) on mesh '" << meshVariableName << "'" << endl);
+
+    Int32 indexProto(meshVariableName + "_node_index");
+    libdap::Array *indexArray = new libdap::Array(meshVariableName + "_node_index", &indexProto);
+    indexArray->append_dim(nPoints, SAMPLE_POINTS_DIMENSION);
+    indexArray->append_dim(k, SAMPLE_NEIGHBORS_DIMENSION);
+    vector<dods_int32> indexValues(nodeIds.begin(), nodeIds.end());
+    indexArray->set_value(indexValues, indexValues.size());
+    dapResult->add_var_nocopy(indexArray);
+
+    Float64 distanceProto(meshVariableName + "_node_distance");
+    libdap::Array *distanceArray = new libdap::Array(meshVariableName + "_node_distance", &distanceProto);
+    distanceArray->append_dim(nPoints, SAMPLE_POINTS_DIMENSION);
+    distanceArray->append_dim(k, SAMPLE_NEIGHBORS_DIMENSION);
+    distanceArray->set_value(distances, distances.size());
+    dapResult->add_var_nocopy(distanceArray);
+
+    // Read each range variable once for all the points: the nodes are sorted and
+    // duplicates dropped so each slab is read with a single ordered pass.
+    vector<unsigned int> uniqueNodes = uniqueIds(nodeIds);
+
+    for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+        MeshDataVariable *mdv = *rvit;
+
+        if (mdv->getGridLocation() != node)
+            throw Error(malformed_expr,
+                "ugnn() - The range variable '" + mdv->getName() + "' is not associated with the nodes of the mesh.");
+
+        tdmt.setLocationCoordinateDimension(mdv);
+
+        NDimensionalArray *gathered = gatherRangeVariable(mdv, &uniqueNodes);
+        try {
+            dapResult->add_var_nocopy(scatterRangeVariable(mdv, gathered, &uniqueNodes, &nodeIds, nPoints, k));
+        }
+        catch (...) {
+            delete gathered;
+            throw;
+        }
+        delete gathered;
+    }
+}
+
+/**
+ * For every slab, set each destination value to the weighted sum of the three
+ * source values (at positions[3 * i], ...) of that point. Points that were not
+ * found (found[i] is false) get NaN.
+ */
+template<typename T>
+static void weightedSum(const T *src, long slabCount, unsigned int srcSlabSize, const vector<unsigned int> &positions,
+    const vector<double> &weights, const vector<char> &found, double *dst)
+{
+    unsigned int nPoints = found.size();
+    double nan = numeric_limits<double>::quiet_NaN();
+
+    for (long s = 0; s < slabCount; ++s) {
+        for (unsigned int i = 0; i < nPoints; ++i) {
+            if (!found[i]) {
+                dst[i] = nan;
+                continue;
+            }
+            const unsigned int *pos = &positions[3 * i];
+            const double *w = &weights[3 * i];
+            dst[i] = w[0] * src[pos[0]] + w[1] * src[pos[1]] + w[2] * src[pos[2]];
+        }
+        src += srcSlabSize;
+        dst += nPoints;
+    }
+}
+
+/**
+ * Build the interpolated result for one range variable. The values gathered at
+ * uniqueLocations are combined using the per-point locations and weights (three
+ * of each per point). The result is Float64, shaped like the source with its
+ * location dimension replaced by [points]. If nothing was gathered (no point is
+ * in the mesh), gathered is null and every value is NaN.
+ */
+static libdap::Array *interpolateRangeVariable(MeshDataVariable *mdv, NDimensionalArray *gathered,
+    const vector<unsigned int> &uniqueLocations, const vector<unsigned int> &locations, const vector<double> &weights,
+    const vector<char> &found)
+{
+    libdap::Array *source = mdv->getDapArray();
+    unsigned int nPoints = found.size();
+
+    vector<unsigned int> shape(source->dimensions(true));
+    NDimensionalArray::computeConstrainedShape(source, &shape);
+    shape.back() = nPoints;
+
+    Float64 proto(source->name());
+    libdap::Array resultTemplate(source->name(), &proto);
+    appendOuterDimensions(source, &resultTemplate);
+    resultTemplate.append_dim(nPoints, SAMPLE_POINTS_DIMENSION);
+    resultTemplate.set_attr_table(source->get_attr_table());
+
+    NDimensionalArray result(&shape, dods_float64_c);
+    double *dst = (double *) result.getStorage();
+
+    if (!gathered) {
+        fill(dst, dst + result.elementCount(), numeric_limits<double>::quiet_NaN());
+        return result.getArray(&resultTemplate);
+    }
+
+    vector<unsigned int> positions = positionsIn(uniqueLocations, locations);
+    unsigned int srcSlabSize = uniqueLocations.size();
+    long slabCount = gathered->elementCount() / srcSlabSize;
+
+    switch (gathered->getTypeTemplate()) {
+    case dods_byte_c:
+        weightedSum((dods_byte *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_uint16_c:
+        weightedSum((dods_uint16 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_int16_c:
+        weightedSum((dods_int16 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_uint32_c:
+        weightedSum((dods_uint32 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_int32_c:
+        weightedSum((dods_int32 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_float32_c:
+        weightedSum((dods_float32 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    case dods_float64_c:
+        weightedSum((dods_float64 *) gathered->getStorage(), slabCount, srcSlabSize, positions, weights, found, dst);
+        break;
+    default:
+        throw InternalErr(__FILE__, __LINE__, "interpolateRangeVariable() - Unknown DAP type encountered.");
+    }
+
+    return result.getArray(&resultTemplate);
+}
+
+/**
+ * Locate the face containing every point on one mesh, then add the face indices
+ * and the interpolated range variables to the result. Node variables are
+ * interpolated using the barycentric weights of the point; face variables take
+ * the value of the containing face.
+ *
+ * For a transect successive points are close together, so each one is found by
+ * walking the face adjacency from the face of the previous point rather than
+ * with a fresh search.
+ */
+static void interpolationSampler(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridSampleArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+    const FaceLocator *locator = geometry->getFaceLocator();
+    const FaceAdjacency *adjacency = args.distance.empty() ? 0 : geometry->getFaceAdjacency();
+
+    unsigned int nPoints = args.x.size();
+
+    // Three node ids and weights per point; for face variables three copies of
+    // the face id with the weights 1, 0, 0.
+    vector<unsigned int> nodeIds(3 * nPoints, 0);
+    vector<double> nodeWeights(3 * nPoints, 0.0);
+    vector<unsigned int> faceIds(3 * nPoints, 0);
+    vector<double> faceWeights(3 * nPoints, 0.0);
+    vector<char> found(nPoints, 0);
+    vector<dods_int32> faceIndex(nPoints, -1);
+
+    vector<unsigned int> foundNodes, foundFaces;
+    FaceWeights fw;
+    for (unsigned int p = 0; p < nPoints; ++p) {
+        bool located;
+        if (adjacency && p > 0 && found[p - 1])
+            located = locator->walk(adjacency, faceIndex[p - 1], args.x[p], args.y[p], &fw);
+        else
+            located = locator->locate(args.x[p], args.y[p], &fw);
+        if (!located) continue;
+
+        found[p] = 1;
+        faceIndex[p] = fw.face;
+        for (unsigned int i = 0; i < 3; ++i) {
+            nodeIds[3 * p + i] = fw.nodes[i];
+            nodeWeights[3 * p + i] = fw.weights[i];
+            faceIds[3 * p + i] = fw.face;
+            foundNodes.push_back(fw.nodes[i]);
+        }
+        faceWeights[3 * p] = 1.0;
+        foundFaces.push_back(fw.face);
+    }
+
+    BESDEBUG("ugrid",
+        "interpolationSampler() - Located " << foundFaces.size() << " of " << nPoints << " point(s) on mesh '" << meshVariableName << "'" << endl);
+
+    Int32 indexProto(meshVariableName + "_face_index");
+    libdap::Array *indexArray = new libdap::Array(meshVariableName + "_face_index", &indexProto);
+    indexArray->append_dim(nPoints, SAMPLE_POINTS_DIMENSION);
+    indexArray->set_value(faceIndex, faceIndex.size());
+    dapResult->add_var_nocopy(indexArray);
+
+    vector<unsigned int> uniqueNodes = uniqueIds(foundNodes);
+    vector<unsigned int> uniqueFaces = uniqueIds(foundFaces);
+
+    for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+        MeshDataVariable *mdv = *rvit;
+
+        vector<unsigned int> *locations;
+        vector<unsigned int> *uniqueLocations;
+        vector<double> *weights;
+        switch (mdv->getGridLocation()) {
+        case node:
+            locations = &nodeIds, uniqueLocations = &uniqueNodes, weights = &nodeWeights;
+            break;
+        case face:
+            locations = &faceIds, uniqueLocations = &uniqueFaces, weights = &faceWeights;
+            break;
+        default:
+            throw Error(malformed_expr,
+                "ugpi() - The range variable '" + mdv->getName()
+                    + "' must be associated with the nodes or the faces of the mesh.");
+        }
+
+        tdmt.setLocationCoordinateDimension(mdv);
+
+        NDimensionalArray *gathered = 0;
+        if (!uniqueLocations->empty()) gathered = gatherRangeVariable(mdv, uniqueLocations);
+        try {
+            dapResult->add_var_nocopy(
+                interpolateRangeVariable(mdv, gathered, *uniqueLocations, *locations, *weights, found));
+        }
+        catch (...) {
+            delete gathered;
+            throw;
+        }
+        delete gathered;
+    }
+}
+
+/**
+ * Multiply each slab of the gathered values by the sparse weights. Rows with no
+ * weights (grid points outside the mesh) are NaN.
+ */
+template<typename T>
+static void sparseProduct(const T *src, long slabCount, unsigned int srcSlabSize, const SparseWeights &sw,
+    double *dst)
+{
+    unsigned int rows = sw.rowStart.size() - 1;
+    const unsigned int *rowStart = &sw.rowStart[0];
+    const unsigned int *columns = sw.columns.empty() ? 0 : &sw.columns[0];
+    const double *weights = sw.weights.empty() ? 0 : &sw.weights[0];
+    double nan = numeric_limits<double>::quiet_NaN();
+
+    for (long s = 0; s < slabCount; ++s) {
+        for (unsigned int r = 0; r < rows; ++r) {
+            unsigned int begin = rowStart[r], end = rowStart[r + 1];
+            if (begin == end) {
+                dst[r] = nan;
+                continue;
+            }
+            double sum = 0.0;
+            for (unsigned int e = begin; e < end; ++e)
+                sum += weights[e] * src[columns[e]];
+            dst[r] = sum;
+        }
+        src += srcSlabSize;
+        dst += rows;
+    }
+}
+
+/**
+ * Build the map vector for an outer dimension (e.g., time) of a range variable.
+ * If the dataset has a one dimensional numeric coordinate variable named for the
+ * dimension, the map holds its values for the range variable's constraint on
+ * that dimension; otherwise it holds the dimension's indices.
+ */
+static libdap::Array *newOuterMap(DDS &dds, libdap::Array *source, libdap::Array::Dim_iter d)
+{
+    string name = source->dimension_name(d);
+    unsigned int start = source->dimension_start(d, true);
+    unsigned int stride = source->dimension_stride(d, true);
+    unsigned int size = source->dimension_size(d, true);
+
+    libdap::Array *coordinate = dynamic_cast<libdap::Array*>(dds.var(name));
+    if (coordinate && coordinate->dimensions() == 1 && coordinate->var()->is_simple_type()
+        && coordinate->var()->type() != dods_str_c && coordinate->var()->type() != dods_url_c
+        && coordinate->dimension_size(coordinate->dim_begin(), true) == source->dimension_size(d, false)) {
+        double *values = extractArray<double>(coordinate);
+        vector<double> mapValues(size);
+        for (unsigned int i = 0; i < size; ++i)
+            mapValues[i] = values[start + i * stride];
+        delete[] values;
+
+        Float64 proto(name);
+        libdap::Array *map = new libdap::Array(name, &proto);
+        map->append_dim(size, name);
+        map->set_value(mapValues, size);
+        map->set_attr_table(coordinate->get_attr_table());
+        return map;
+    }
+
+    vector<dods_int32> indices(size);
+    for (unsigned int i = 0; i < size; ++i)
+        indices[i] = start + i * stride;
+
+    Int32 proto(name);
+    libdap::Array *map = new libdap::Array(name, &proto);
+    map->append_dim(size, name);
+    map->set_value(indices, size);
+    return map;
+}
+
+static libdap::Array *newGridAxis(const string &name, const RegridWeights *rw, bool isX)
+{
+    unsigned int size = isX ? rw->nx() : rw->ny();
+    vector<double> values(size);
+    for (unsigned int i = 0; i < size; ++i)
+        values[i] = isX ? rw->x(i) : rw->y(i);
+
+    Float64 proto(name);
+    libdap::Array *axis = new libdap::Array(name, &proto);
+    axis->append_dim(size, name);
+    axis->set_value(values, size);
+    return axis;
+}
+
+/**
+ * Build the regridded version of one range variable: a Grid whose array is
+ * Float64, shaped like the source with its location dimension replaced by
+ * [lat][lon], and whose maps are the source's outer dimensions followed by the
+ * grid's y and x coordinates.
+ */
+static Grid *regridRangeVariable(DDS &dds, MeshDataVariable *mdv, NDimensionalArray *gathered, const SparseWeights &sw,
+    const RegridWeights *rw)
+{
+    libdap::Array *source = mdv->getDapArray();
+
+    vector<unsigned int> shape(source->dimensions(true));
+    NDimensionalArray::computeConstrainedShape(source, &shape);
+    shape.back() = rw->ny();
+    shape.push_back(rw->nx());
+
+    Float64 proto(source->name());
+    libdap::Array resultTemplate(source->name(), &proto);
+    appendOuterDimensions(source, &resultTemplate);
+    resultTemplate.append_dim(rw->ny(), REGRID_Y_DIMENSION);
+    resultTemplate.append_dim(rw->nx(), REGRID_X_DIMENSION);
+    resultTemplate.set_attr_table(source->get_attr_table());
+
+    NDimensionalArray result(&shape, dods_float64_c);
+    double *dst = (double *) result.getStorage();
+
+    if (!gathered) {
+        fill(dst, dst + result.elementCount(), numeric_limits<double>::quiet_NaN());
+    }
+    else {
+        unsigned int srcSlabSize = sw.locations.size();
+        long slabCount = gathered->elementCount() / srcSlabSize;
+
+        switch (gathered->getTypeTemplate()) {
+        case dods_byte_c:
+            sparseProduct((dods_byte *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_uint16_c:
+            sparseProduct((dods_uint16 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_int16_c:
+            sparseProduct((dods_int16 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_uint32_c:
+            sparseProduct((dods_uint32 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_int32_c:
+            sparseProduct((dods_int32 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_float32_c:
+            sparseProduct((dods_float32 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        case dods_float64_c:
+            sparseProduct((dods_float64 *) gathered->getStorage(), slabCount, srcSlabSize, sw, dst);
+            break;
+        default:
+            throw InternalErr(__FILE__, __LINE__, "regridRangeVariable() - Unknown DAP type encountered.");
+        }
+    }
+
+    Grid *grid = new Grid(source->name());
+    try {
+        grid->add_var_nocopy(result.getArray(&resultTemplate), libdap::array);
+        for (libdap::Array::Dim_iter d = source->dim_begin(); d + 1 != source->dim_end(); ++d)
+            grid->add_var_nocopy(newOuterMap(dds, source, d), libdap::maps);
+        grid->add_var_nocopy(newGridAxis(REGRID_Y_DIMENSION, rw, false), libdap::maps);
+        grid->add_var_nocopy(newGridAxis(REGRID_X_DIMENSION, rw, true), libdap::maps);
+    }
+    catch (...) {
+        delete grid;
+        throw;
+    }
+
+    return grid;
+}
+
+/**
+ * Regrid the range variables of one mesh to the target grid and add the
+ * resulting Grids to the result. The weights are taken from the mesh geometry,
+ * which keeps them for reuse, so a repeated request for the same grid only
+ * gathers the values it needs and applies the weights to them.
+ */
+static void regridSampler(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridSampleArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+    const RegridWeights *rw = geometry->getRegridWeights(args.x[0], args.y[0], args.dx, args.dy, args.nx, args.ny);
+
+    for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+        MeshDataVariable *mdv = *rvit;
+
+        const SparseWeights *sw;
+        switch (mdv->getGridLocation()) {
+        case node:
+            sw = &rw->nodeWeights();
+            break;
+        case face:
+            sw = &rw->faceWeights();
+            break;
+        default:
+            throw Error(malformed_expr,
+                "ugrg() - The range variable '" + mdv->getName()
+                    + "' must be associated with the nodes or the faces of the mesh.");
+        }
+
+        tdmt.setLocationCoordinateDimension(mdv);
+
+        vector<unsigned int> locations(sw->locations);
+        NDimensionalArray *gathered = 0;
+        if (!locations.empty()) gathered = gatherRangeVariable(mdv, &locations);
+        try {
+            dapResult->add_var_nocopy(regridRangeVariable(dds, mdv, gathered, *sw, rw));
+        }
+        catch (...) {
+            delete gathered;
+            throw;
+        }
+        delete gathered;
+    }
+}
+
+/**
+ * The body shared by the point sampling functions: process the arguments, group
+ * the range variables by mesh and run the sampler for each mesh. The result is a
+ * Structure holding the points (except for ugrg(), whose grids carry their own
+ * coordinates) followed by each sampler's variables.
+ */
+static void ugrid_sample(const string &func_name, const string &usage, TrailingArg trailing, MeshSampler sampler,
+    int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    try {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::" + func_name + "()", "[function_invocation]");
+
+        BESDEBUG("ugrid", func_name << "() - BEGIN" << endl);
+
+        if (argc == 0) {
+            string info = string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"" + func_name + "\" version=\"1.0\">\n"
+                + "Server function for Unstructured grid operations.\n" + "usage: " + usage + "\n" + "</function>";
+            Str *response = new Str("info");
+            response->set_value(info);
+            *btpp = response;
+            return;
+        }
+
+        UgridSampleArgs args = processSampleArgs(func_name, usage, trailing, argc, argv);
+
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        Structure *dapResult = 0;
+        try {
+            for (vector<libdap::Array *>::iterator it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
+            }
+
+            dapResult = new Structure(func_name + "_result_unwrap");
+            if (trailing != grid_spacing) {
+                dapResult->add_var_nocopy(newPointsArray("point_x", &args.x));
+                dapResult->add_var_nocopy(newPointsArray("point_y", &args.y));
+            }
+            if (!args.distance.empty()) dapResult->add_var_nocopy(newPointsArray("distance", &args.distance));
+
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                sampler(dds, mit->first, mit->second, args, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            throw;
+        }
+
+        releaseRangeVars(&meshToRangeVarsMap);
+
+        *btpp = dapResult;
+
+        BESDEBUG("ugrid", func_name << "() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
+}
+
+/**
+ @brief Sample the node range variables of an irregular mesh at a list of points.
+
+ For each point the k (default 1) nearest nodes are located using a k-d tree built
+ over the mesh's node coordinates; the tree is kept with the mesh geometry in the
+ MeshGeometryCache, so repeated requests against the same dataset do not rebuild it.
+ The result holds the points, the node indices (zero-based) and distances for each
+ mesh, and every range variable with its node dimension replaced by [points][neighbors].
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ not a node variable. */
+void ugnn(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    ugrid_sample("ugnn", ugnnUsage(), neighbor_count, nearestNodeSampler, argc, argv, dds, btpp);
+}
+
+/**
+ @brief Interpolate the range variables of an irregular mesh at a list of points.
+
+ The face containing each point is found using the mesh's face locator (cached,
+ like the node k-d tree, with the mesh geometry). Node variables are interpolated
+ with the barycentric weights of the point in that face; face variables take the
+ value of the face. The result holds the points, the zero-based index of the
+ containing face (-1 for points outside the mesh) and, for every range variable,
+ a Float64 array with the location dimension replaced by [points]. Values for
+ points outside the mesh are NaN.
+
+ All of the points are located first, then each range variable is read once, for
+ just the nodes (or faces) that were hit, and the interpolation is done for every
+ slab of the variable's other dimensions (e.g., time) in one pass.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ an edge variable. */
+void ugpi(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    ugrid_sample("ugpi", ugpiUsage(), no_trailing_arg, interpolationSampler, argc, argv, dds, btpp);
+}
+
+/**
+ @brief Extract a transect of the range variables of an irregular mesh along a polyline.
+
+ The polyline, given as 'x1 y1, x2 y2, ...', is sampled every spacing units
+ (in the units of the mesh coordinates) starting at its first vertex; its last
+ vertex is always a sample. The samples are located by walking from face to
+ face across the mesh, using the face adjacency derived from the face node
+ connectivity and cached with the mesh geometry, and then interpolated just as
+ ugpi() does. In addition to ugpi()'s result, the distance along the polyline
+ of each sample is returned.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ an edge variable. */
+void ugtx(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    ugrid_sample("ugtx", ugtxUsage(), sample_spacing, interpolationSampler, argc, argv, dds, btpp);
+}
+
+/**
+ @brief Regrid the range variables of an irregular mesh to a regular grid.
+
+ The target grid covers the bounding box 'minX minY, maxX maxY' with points
+ every dx units in x and dy units (dy defaults to dx) in y, starting at the
+ lower left corner. Each range variable is returned as a DAP Grid with its
+ location dimension replaced by [lat][lon]; node variables are interpolated
+ with barycentric weights and face variables take the value of the face that
+ holds the grid point. Grid points outside the mesh are NaN.
+
+ The interpolation weights are computed once per mesh and target grid and kept,
+ as a sparse matrix, with the cached mesh geometry. Each request then reads only
+ the nodes (or faces) the grid uses and does one sparse matrix-vector product per
+ slab of the variable's other dimensions (e.g., time).
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ an edge variable. */
+void ugrg(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    ugrid_sample("ugrg", ugrgUsage(), grid_spacing, regridSampler, argc, argv, dds, btpp);
+}
+
+} // namespace ugrid
@@ -0,0 +1,169 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef UGRID_SAMPLE_H_
+#define UGRID_SAMPLE_H_
+
+#include "BaseType.h"
+#include "DDS.h"
+#include "ServerFunction.h"
+
+namespace ugrid {
+
+/**
+ Sample the node range variables of an irregular mesh at a list of points by
+ finding the nearest node (or k nearest nodes) to each point.
+**/
+void ugnn(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ Interpolate the node and face range variables of an irregular mesh at a list
+ of points using the face that contains each point.
+**/
+void ugpi(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ Interpolate the node and face range variables of an irregular mesh at evenly
+ spaced samples along a polyline.
+**/
+void ugtx(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ Regrid the node and face range variables of an irregular mesh to a regular
+ grid, returning a DAP Grid for each.
+**/
+void ugrg(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ * The UGNN class encapsulates the function 'ugrid::ugnn'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGNN: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGNN()
+{
+        setName("ugnn");
+        setDescriptionString(
+            ((string)"This function returns the index of, distance to, and range variable values at the ") +
+            "node(s) of a two dimensional unstructured mesh nearest to each of a list of points.");
+        setUsageString("ugnn(node_var [,node_var_2,...,node_var_n], 'x1 y1, x2 y2, ...' [, k])");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_sample");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugnn);
+        setVersion("1.0");
+}
+    virtual ~UGNN()
+    {
+    }
+
+};
+
+/**
+ * The UGPI class encapsulates the function 'ugrid::ugpi'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGPI: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGPI()
+{
+        setName("ugpi");
+        setDescriptionString(
+            ((string)"This function interpolates the range variables of a two dimensional unstructured mesh ") +
+            "at each of a list of points using the barycentric weights of the point in the face that contains it.");
+        setUsageString("ugpi(range_var [,range_var_2,...,range_var_n], 'x1 y1, x2 y2, ...')");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_sample");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugpi);
+        setVersion("1.0");
+}
+    virtual ~UGPI()
+    {
+    }
+
+};
+
+/**
+ * The UGTX class encapsulates the function 'ugrid::ugtx'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGTX: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGTX()
+{
+        setName("ugtx");
+        setDescriptionString(
+            ((string)"This function returns a transect of the range variables of a two dimensional unstructured ") +
+            "mesh, interpolated at evenly spaced samples along a polyline, with the distance along the line of each sample.");
+        setUsageString("ugtx(range_var [,range_var_2,...,range_var_n], 'x1 y1, x2 y2, ...', spacing)");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_sample");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugtx);
+        setVersion("1.0");
+}
+    virtual ~UGTX()
+    {
+    }
+
+};
+
+/**
+ * The UGRG class encapsulates the function 'ugrid::ugrg'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGRG: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGRG()
+{
+        setName("ugrg");
+        setDescriptionString(
+            ((string)"This function regrids the range variables of a two dimensional unstructured mesh to a ") +
+            "regular grid covering a bounding box and returns them as DAP Grids.");
+        setUsageString("ugrg(range_var [,range_var_2,...,range_var_n], 'minX minY, maxX maxY', dx [, dy])");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_sample");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugrg);
+        setVersion("1.0");
+}
+    virtual ~UGRG()
+    {
+    }
+
+};
+
+} // namespace ugrid
+
+#endif /* UGRID_SAMPLE_H_ */
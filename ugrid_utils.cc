@@ -31,6 +31,8 @@
 
 #include <vector>
 #include <sstream>
+#include <iomanip>
+#include <limits>
 
 #include <gridfields/array.h>
 
@@ -276,4 +278,78 @@ bool checkAttributeValue(BaseType *bt, string aName, string aValue)
 
 }
 
+/**
+ * Read the _FillValue and missing_value attributes of source. Values that do
+ * not parse as numbers (e.g., 'NaN') are skipped; NaN is always missing.
+ */
+MissingValues::MissingValues(libdap::Array *source)
+{
+    AttrTable &at = source->get_attr_table();
+    const char *names[] = { "_FillValue", "missing_value" };
+
+    for (unsigned int n = 0; n < 2; ++n) {
+        AttrTable::Attr_iter loc = at.simple_find(names[n]);
+        if (loc == at.attr_end()) continue;
+
+        for (unsigned int i = 0; i < at.get_attr_num(loc); ++i) {
+            double value;
+            istringstream iss(at.get_attr(loc, i));
+            if (!(iss >> value)) continue;
+
+            // A Float32 fill value such as 9.96921e+36 is only equal to the
+            // values read once it has been rounded to a float.
+            if (source->var()->type() == dods_float32_c) value = (dods_float32) value;
+
+            d_values.push_back(value);
+            BESDEBUG("ugrid", "MissingValues() - '" << source->name() << "' " << names[n] << ": " << value << endl);
+        }
+    }
+}
+
+double MissingValues::fillValue() const
+{
+    return d_values.empty() ? numeric_limits<double>::quiet_NaN() : d_values.front();
+}
+
+/**
+ * Replace the missing values with NaN, so they are skipped by the arithmetic
+ * and comparisons that follow.
+ */
+void MissingValues::toNaN(vector<double> *values) const
+{
+    if (d_values.empty()) return;
+
+    for (vector<double>::iterator it = values->begin(); it != values->end(); ++it)
+        if (isMissing(*it)) *it = numeric_limits<double>::quiet_NaN();
+}
+
+/**
+ * Replace NaN with fillValue(), the inverse of toNaN() for a Float64 result.
+ */
+void MissingValues::fromNaN(vector<double> *values) const
+{
+    if (d_values.empty()) return;
+
+    double fill = fillValue();
+    for (vector<double>::iterator it = values->begin(); it != values->end(); ++it)
+        if (*it != *it) *it = fill;
+}
+
+/**
+ * Replace the _FillValue and missing_value attributes copied from the source
+ * with a Float64 _FillValue that matches what fromNaN() writes. With no fill
+ * value the result's missing values are NaN and it gets no _FillValue.
+ */
+void MissingValues::setFloat64Attributes(AttrTable &at) const
+{
+    at.del_attr("_FillValue");
+    at.del_attr("missing_value");
+
+    if (d_values.empty()) return;
+
+    ostringstream oss;
+    oss << setprecision(17) << fillValue();
+    at.append_attr("_FillValue", "Float64", oss.str());
+}
+
 } // namespace ugrid
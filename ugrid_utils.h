@@ -83,6 +83,39 @@ int getNfrom3byNArray(libdap::Array *array);
 
 libdap::Type getGridfieldsReturnType(libdap::Type type);
 
+/**
+ * The values that mark missing data in a range variable: NaN and the values
+ * of its _FillValue and missing_value attributes, rounded to the type of its
+ * elements so they compare equal to the values read once those are widened
+ * to double.
+ */
+class MissingValues {
+private:
+    vector<double> d_values;
+
+public:
+    MissingValues(libdap::Array *source);
+
+    bool isMissing(double v) const
+    {
+        if (v != v) return true;
+        for (vector<double>::const_iterator it = d_values.begin(); it != d_values.end(); ++it)
+            if (v == *it) return true;
+        return false;
+    }
+
+    /**
+     * @return The value a Float64 result should hold where it is missing: the
+     * source's first fill or missing value, or NaN if it has neither.
+     */
+    double fillValue() const;
+
+    void toNaN(vector<double> *values) const;
+    void fromNaN(vector<double> *values) const;
+
+    void setFloat64Attributes(libdap::AttrTable &at) const;
+};
+
 /**
  * Helper for extractArray.
  * @param a
@@ -0,0 +1,550 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Array.h>
+#include <Structure.h>
+#include <Error.h>
+#include <InternalErr.h>
+#include <util.h>
+#include <escaping.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+#include "BESStopWatch.h"
+
+#include "ugrid_utils.h"
+#include "MeshDataVariable.h"
+#include "TwoDMeshTopology.h"
+#include "NDimensionalArray.h"
+#include "MeshGeometry.h"
+#include "ZoneMembership.h"
+#include "ugrid_restrict.h"
+#include <gridfields/GFError.h>
+
+#include "ugrid_zonal.h"
+
+#ifdef NDEBUG
+#undef BESDEBUG
+#define BESDEBUG( x, y )
+#endif
+
+using namespace std;
+using namespace libdap;
+
+namespace ugrid {
+
+#define ZONES_DIMENSION "zones"
+
+/**
+ * Function Arguments
+ */
+struct UgridZonalArgs {
+    /**
+     * The range variables to reduce.
+     */
+    vector<libdap::Array *> rangeVars;
+
+    /**
+     * The zones, either as polygons or as a face variable holding a region id
+     * for each face (in which case regionVar is not null).
+     */
+    vector<vector<double> > polygonX;
+    vector<vector<double> > polygonY;
+    libdap::Array *regionVar;
+};
+
+static string ugzsUsage()
+{
+    return "ugzs(rangeVariable:array, [rangeVariable:array, ... ] zones:string|regionVariable:array)";
+}
+
+/**
+ * Parse polygons written as 'x1 y1, x2 y2, ...; x1 y1, ...' - the vertices of
+ * each polygon are separated by commas and the polygons by semicolons.
+ */
+static void parsePolygons(const string &polygonList, vector<vector<double> > *polygonX,
+    vector<vector<double> > *polygonY)
+{
+    vector<string> polygons = split(polygonList, ';');
+
+    for (vector<string>::iterator it = polygons.begin(); it != polygons.end(); ++it) {
+        string s = *it;
+        replace(s.begin(), s.end(), ',', ' ');
+
+        istringstream iss(s);
+        vector<double> values;
+        double value;
+        while (iss >> value)
+            values.push_back(value);
+
+        if (!iss.eof())
+            throw Error(malformed_expr, "ugzs() - Unable to parse the polygon '" + *it + "'");
+
+        // Allow an empty entry after a trailing semicolon.
+        if (values.empty()) continue;
+
+        if (values.size() % 2 != 0 || values.size() < 6)
+            throw Error(malformed_expr,
+                "ugzs() - Each polygon must have at least three x y vertices. The polygon '" + *it + "' held "
+                    + long_to_string(values.size()) + " value(s).");
+
+        vector<double> x, y;
+        for (unsigned int i = 0; i < values.size(); i += 2) {
+            x.push_back(values[i]);
+            y.push_back(values[i + 1]);
+        }
+        polygonX->push_back(x);
+        polygonY->push_back(y);
+    }
+
+    if (polygonX->empty()) throw Error(malformed_expr, "ugzs() - The list of polygons was empty.");
+}
+
+/**
+ * Process the functions arguments and return the structure containing their values.
+ */
+static UgridZonalArgs processZonalArgs(int argc, BaseType *argv[])
+{
+    UgridZonalArgs args;
+    args.regionVar = 0;
+
+    if (argc < 2)
+        throw Error(malformed_expr,
+            "Wrong number of arguments to ugzs(): " + ugzsUsage() + " was passed " + long_to_string(argc)
+                + " argument(s)");
+
+    BaseType *zones = argv[argc - 1];
+    if (zones->type() == dods_str_c) {
+        string polygons = www2id(dynamic_cast<Str&>(*zones).value());
+        BESDEBUG("ugrid", "processZonalArgs() - polygons: '" << polygons << "'" << endl);
+        parsePolygons(polygons, &args.polygonX, &args.polygonY);
+    }
+    else {
+        args.regionVar = dynamic_cast<libdap::Array*>(zones);
+        if (args.regionVar == 0)
+            throw Error(malformed_expr,
+                "ugzs() - Expected a DAP String holding the polygons or a DAP Array holding the region ids. "
+                    + ugzsUsage());
+    }
+
+    for (int i = 0; i < argc - 1; i++) {
+        libdap::Array *rangeVar = dynamic_cast<libdap::Array*>(argv[i]);
+        if (rangeVar == 0)
+            throw Error(malformed_expr,
+                "ugzs() - Wrong type for range variable argument, expected DAP Array. " + ugzsUsage()
+                    + " was passed a/an " + argv[i]->type_name());
+
+        args.rangeVars.push_back(rangeVar);
+    }
+
+    return args;
+}
+
+/**
+ * Get the zone membership for the mesh, building it if the geometry does not
+ * already hold it. With a region variable the zones are its distinct
+ * non-negative values, in ascending order, which are returned in zoneIds;
+ * with polygons they are the polygons' positions in the list.
+ */
+static const ZoneMembership *getZoneMembership(const string &meshVariableName, MeshGeometry *geometry,
+    UgridZonalArgs &args, vector<dods_int32> *zoneIds)
+{
+    string key;
+    vector<int> regionIds;
+
+    if (args.regionVar) {
+        MeshDataVariable region;
+        region.init(args.regionVar);
+        if (region.getMeshName() != meshVariableName || region.getGridLocation() != face)
+            throw Error(malformed_expr,
+                "ugzs() - The region variable '" + region.getName() + "' must be a face variable of the mesh '"
+                    + meshVariableName + "'.");
+        if ((unsigned int) args.regionVar->length() != geometry->faceCount())
+            throw Error(malformed_expr,
+                "ugzs() - The region variable '" + region.getName() + "' must hold one value for every face.");
+
+        double *values = extractArray<double>(args.regionVar);
+        regionIds.assign(values, values + geometry->faceCount());
+        delete[] values;
+
+        *zoneIds = vector<dods_int32>(regionIds.begin(), regionIds.end());
+        sort(zoneIds->begin(), zoneIds->end());
+        zoneIds->erase(unique(zoneIds->begin(), zoneIds->end()), zoneIds->end());
+        zoneIds->erase(zoneIds->begin(), lower_bound(zoneIds->begin(), zoneIds->end(), 0));
+
+        key = "zones region " + region.getName();
+    }
+    else {
+        for (unsigned int z = 0; z < args.polygonX.size(); ++z)
+            zoneIds->push_back(z);
+
+        ostringstream oss;
+        oss << "zones polygons" << setprecision(17);
+        for (unsigned int z = 0; z < args.polygonX.size(); ++z) {
+            oss << ";";
+            for (unsigned int i = 0; i < args.polygonX[z].size(); ++i)
+                oss << " " << args.polygonX[z][i] << " " << args.polygonY[z][i];
+        }
+        key = oss.str();
+    }
+
+    ZoneMembership *zm = dynamic_cast<ZoneMembership *>(geometry->getProduct(key));
+    if (!zm) {
+        if (args.regionVar) {
+            // Replace the region ids with zone numbers.
+            for (vector<int>::iterator it = regionIds.begin(); it != regionIds.end(); ++it) {
+                vector<dods_int32>::iterator z = lower_bound(zoneIds->begin(), zoneIds->end(), *it);
+                *it = (*it >= 0) ? z - zoneIds->begin() : -1;
+            }
+            zm = new ZoneMembership(geometry, regionIds, zoneIds->size());
+        }
+        else {
+            zm = new ZoneMembership(geometry, args.polygonX, args.polygonY);
+        }
+        geometry->putProduct(key, zm);
+    }
+
+    return zm;
+}
+
+/**
+ * Compute the value of each member face from one slab: the value at the face's
+ * single location for face variables, or the mean of its corners for node
+ * variables. The locations of face i are [start[i], start[i+1]) in positions.
+ * Missing values are skipped; a face with no other value is NaN.
+ */
+template<typename T>
+static void faceValues(const T *slab, const vector<unsigned int> &start, const vector<unsigned int> &positions,
+    const MissingValues &missing, vector<double> *values)
+{
+    for (unsigned int i = 0; i + 1 < start.size(); ++i) {
+        double sum = 0;
+        unsigned int count = 0;
+        for (unsigned int p = start[i]; p < start[i + 1]; ++p) {
+            double v = slab[positions[p]];
+            if (missing.isMissing(v)) continue;
+            sum += v;
+            ++count;
+        }
+        (*values)[i] = count > 0 ? sum / count : numeric_limits<double>::quiet_NaN();
+    }
+}
+
+/**
+ * A SlabSink that reduces each slab of a range variable to the area weighted
+ * mean, the minimum, the maximum and the area weighted sum of every zone.
+ * Faces with no value (see faceValues()) are skipped.
+ */
+class ZonalReducer: public SlabSink {
+private:
+    const ZoneMembership *d_zm;
+    libdap::Type d_type;
+    MissingValues d_missing;
+
+    vector<unsigned int> d_start;
+    vector<unsigned int> d_positions;
+
+    vector<char> d_slab;
+    vector<double> d_faceValues;
+
+public:
+    vector<double> mean, minimum, maximum, areaSum;
+
+    ZonalReducer(const ZoneMembership *zm, libdap::Array *source, unsigned int slabSize,
+        const vector<unsigned int> &start, const vector<unsigned int> &positions) :
+        d_zm(zm), d_type(source->var()->type()), d_missing(source), d_start(start), d_positions(positions),
+            d_slab(slabSize * source->var()->width()), d_faceValues(zm->faces().size())
+    {
+    }
+
+    virtual void *nextSlab()
+    {
+        return &d_slab[0];
+    }
+
+    virtual void slabFilled()
+    {
+        switch (d_type) {
+        case dods_byte_c:
+            faceValues((dods_byte *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_uint16_c:
+            faceValues((dods_uint16 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_int16_c:
+            faceValues((dods_int16 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_uint32_c:
+            faceValues((dods_uint32 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_int32_c:
+            faceValues((dods_int32 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_float32_c:
+            faceValues((dods_float32 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        case dods_float64_c:
+            faceValues((dods_float64 *) &d_slab[0], d_start, d_positions, d_missing, &d_faceValues);
+            break;
+        default:
+            throw InternalErr(__FILE__, __LINE__, "ZonalReducer::slabFilled() - Unknown DAP type encountered.");
+        }
+
+        unsigned int zoneCount = d_zm->zoneCount();
+        double nan = numeric_limits<double>::quiet_NaN();
+        vector<double> sum(zoneCount, 0.0), area(zoneCount, 0.0);
+        vector<double> zoneMin(zoneCount, nan), zoneMax(zoneCount, nan);
+
+        const vector<unsigned int> &zones = d_zm->zones();
+        const vector<double> &areas = d_zm->areas();
+        for (unsigned int i = 0; i < d_faceValues.size(); ++i) {
+            double v = d_faceValues[i];
+            if (v != v) continue;
+
+            unsigned int z = zones[i];
+            sum[z] += v * areas[i];
+            area[z] += areas[i];
+            if (!(zoneMin[z] <= v)) zoneMin[z] = v;
+            if (!(zoneMax[z] >= v)) zoneMax[z] = v;
+        }
+
+        for (unsigned int z = 0; z < zoneCount; ++z) {
+            mean.push_back(area[z] > 0 ? sum[z] / area[z] : nan);
+            minimum.push_back(zoneMin[z]);
+            maximum.push_back(zoneMax[z]);
+            areaSum.push_back(area[z] > 0 ? sum[z] : nan);
+        }
+    }
+};
+
+static libdap::Array *newZoneArray(const string &name, unsigned int zoneCount, libdap::Array *source,
+    vector<double> *values)
+{
+    Float64 proto(name);
+    libdap::Array *a = new libdap::Array(name, &proto);
+    for (libdap::Array::Dim_iter d = source->dim_begin(); d + 1 != source->dim_end(); ++d)
+        a->append_dim(source->dimension_size(d, true), source->dimension_name(d));
+    a->append_dim(zoneCount, ZONES_DIMENSION);
+
+    // With no member faces nothing was read; every value is NaN.
+    if (values->empty()) values->assign(a->length(), numeric_limits<double>::quiet_NaN());
+
+    a->set_value(*values, values->size());
+    return a;
+}
+
+/**
+ * Compute the zonal statistics of the range variables of one mesh and add them,
+ * with the zone ids, areas and face counts, to the result.
+ */
+static void zonalStatistics(DDS &dds, const string &meshVariableName, vector<MeshDataVariable *> *rangeVars,
+    UgridZonalArgs &args, Structure *dapResult)
+{
+    TwoDMeshTopology tdmt;
+    tdmt.init(meshVariableName, &dds);
+
+    MeshGeometry *geometry = tdmt.getMeshGeometry(&dds);
+
+    vector<dods_int32> zoneIds;
+    const ZoneMembership *zm = getZoneMembership(meshVariableName, geometry, args, &zoneIds);
+    unsigned int zoneCount = zm->zoneCount();
+
+    BESDEBUG("ugrid",
+        "zonalStatistics() - " << zm->faces().size() << " faces in " << zoneCount << " zone(s) on mesh '" << meshVariableName << "'" << endl);
+
+    vector<double> zoneAreas(zoneCount);
+    vector<dods_int32> zoneFaceCounts(zoneCount);
+    for (unsigned int z = 0; z < zoneCount; ++z) {
+        zoneAreas[z] = zm->zoneArea(z);
+        zoneFaceCounts[z] = zm->zoneFaceCount(z);
+    }
+
+    Int32 idProto(meshVariableName + "_zone");
+    libdap::Array *ids = new libdap::Array(meshVariableName + "_zone", &idProto);
+    ids->append_dim(zoneCount, ZONES_DIMENSION);
+    ids->set_value(zoneIds, zoneCount);
+    dapResult->add_var_nocopy(ids);
+
+    Float64 areaProto(meshVariableName + "_zone_area");
+    libdap::Array *areas = new libdap::Array(meshVariableName + "_zone_area", &areaProto);
+    areas->append_dim(zoneCount, ZONES_DIMENSION);
+    areas->set_value(zoneAreas, zoneCount);
+    dapResult->add_var_nocopy(areas);
+
+    Int32 countProto(meshVariableName + "_zone_face_count");
+    libdap::Array *counts = new libdap::Array(meshVariableName + "_zone_face_count", &countProto);
+    counts->append_dim(zoneCount, ZONES_DIMENSION);
+    counts->set_value(zoneFaceCounts, zoneCount);
+    dapResult->add_var_nocopy(counts);
+
+    const vector<unsigned int> &faces = zm->faces();
+
+    for (vector<MeshDataVariable *>::iterator rvit = rangeVars->begin(); rvit != rangeVars->end(); ++rvit) {
+        MeshDataVariable *mdv = *rvit;
+
+        // The locations to read and, for each member face, the positions of its
+        // location(s) among them.
+        vector<unsigned int> locations;
+        vector<unsigned int> start(1, 0);
+        vector<unsigned int> positions;
+        switch (mdv->getGridLocation()) {
+        case face:
+            locations = faces;
+            for (unsigned int i = 0; i < faces.size(); ++i) {
+                positions.push_back(i);
+                start.push_back(positions.size());
+            }
+            break;
+        case node: {
+            vector<unsigned int> corners;
+            for (unsigned int i = 0; i < faces.size(); ++i) {
+                for (unsigned int c = 0; c < geometry->nodesPerFace(); ++c) {
+                    unsigned int n = geometry->faceNode(faces[i], c);
+                    if (n >= geometry->nodeCount()) break;
+                    corners.push_back(n);
+                }
+                start.push_back(corners.size());
+            }
+            locations = corners;
+            sort(locations.begin(), locations.end());
+            locations.erase(unique(locations.begin(), locations.end()), locations.end());
+            for (vector<unsigned int>::iterator it = corners.begin(); it != corners.end(); ++it)
+                positions.push_back(lower_bound(locations.begin(), locations.end(), *it) - locations.begin());
+            break;
+        }
+        default:
+            throw Error(malformed_expr,
+                "ugzs() - The range variable '" + mdv->getName()
+                    + "' must be associated with the nodes or the faces of the mesh.");
+        }
+
+        tdmt.setLocationCoordinateDimension(mdv);
+
+        libdap::Array *source = mdv->getDapArray();
+        ZonalReducer reducer(zm, source, locations.size(), start, positions);
+        if (!locations.empty()) streamRangeVariable(mdv, &locations, &reducer);
+
+        string name = mdv->getName();
+        dapResult->add_var_nocopy(newZoneArray(name + "_mean", zoneCount, source, &reducer.mean));
+        dapResult->add_var_nocopy(newZoneArray(name + "_min", zoneCount, source, &reducer.minimum));
+        dapResult->add_var_nocopy(newZoneArray(name + "_max", zoneCount, source, &reducer.maximum));
+        dapResult->add_var_nocopy(newZoneArray(name + "_area_sum", zoneCount, source, &reducer.areaSum));
+    }
+}
+
+/**
+ @brief Compute zonal statistics of the range variables of an irregular mesh.
+
+ The zones are either polygons, given as 'x1 y1, x2 y2, ...; x1 y1, ...', or a
+ face variable holding an integer region id for each face (faces with a
+ negative id are in no zone). A face belongs to the first polygon that holds
+ its centroid. For every slab of each range variable's other dimensions (e.g.,
+ each time step) the result holds, per zone, the area weighted mean, the
+ minimum, the maximum and the area weighted sum of the variable, as Float64
+ arrays named <var>_mean, <var>_min, <var>_max and <var>_area_sum whose location
+ dimension is replaced by [zones]. Face variables use the value of each face;
+ node variables use the mean of each face's corners. Missing values (NaN or the
+ variable's _FillValue or missing_value) are skipped, so a face is the mean of
+ its valid corners and a face with none is left out of its zone; a zone with no
+ valid face is NaN. The zone ids (polygon number or region id), areas and face
+ counts are returned for each mesh.
+
+ The face to zone membership and the face areas are computed once per mesh and
+ set of zones and kept with the cached mesh geometry. The range variables are
+ then read one slab at a time, for just the member faces (or their nodes), and
+ each slab is reduced as soon as it is read.
+
+ @param argc Count of the function's arguments
+ @param argv Array of pointers to the functions arguments
+ @param dds Reference to the DDS object for the complete dataset.
+ @param btpp Value-result parameter for the function result.
+
+ @exception Error Thrown if the arguments are malformed or a range variable is
+ an edge variable. */
+void ugzs(int argc, BaseType *argv[], DDS &dds, BaseType **btpp)
+{
+    try {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("ugrid::ugzs()", "[function_invocation]");
+
+        BESDEBUG("ugrid", "ugzs() - BEGIN" << endl);
+
+        if (argc == 0) {
+            string info = string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<function name=\"ugzs\" version=\"1.0\">\n" + "Server function for Unstructured grid operations.\n"
+                + "usage: " + ugzsUsage() + "\n" + "</function>";
+            Str *response = new Str("info");
+            response->set_value(info);
+            *btpp = response;
+            return;
+        }
+
+        UgridZonalArgs args = processZonalArgs(argc, argv);
+
+        map<string, vector<MeshDataVariable *> *> meshToRangeVarsMap;
+        Structure *dapResult = 0;
+        try {
+            for (vector<libdap::Array *>::iterator it = args.rangeVars.begin(); it != args.rangeVars.end(); ++it) {
+                addRangeVar(&dds, *it, &meshToRangeVarsMap);
+            }
+
+            dapResult = new Structure("ugzs_result_unwrap");
+
+            map<string, vector<MeshDataVariable *> *>::iterator mit;
+            for (mit = meshToRangeVarsMap.begin(); mit != meshToRangeVarsMap.end(); ++mit) {
+                zonalStatistics(dds, mit->first, mit->second, args, dapResult);
+            }
+        }
+        catch (...) {
+            delete dapResult;
+            releaseRangeVars(&meshToRangeVarsMap);
+            throw;
+        }
+
+        releaseRangeVars(&meshToRangeVarsMap);
+
+        *btpp = dapResult;
+
+        BESDEBUG("ugrid", "ugzs() - END" << endl);
+    }
+    catch (GFError &gfe) {
+        throw BESError(gfe.get_message(), gfe.get_error_type(), gfe.get_file(), gfe.get_line());
+    }
+}
+
+} // namespace ugrid
@@ -0,0 +1,71 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2002,2003,2011,2012 OPeNDAP, Inc.
+// Authors: Nathan Potter <ndp@opendap.org>
+//          James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef UGRID_ZONAL_H_
+#define UGRID_ZONAL_H_
+
+#include "BaseType.h"
+#include "DDS.h"
+#include "ServerFunction.h"
+
+namespace ugrid {
+
+/**
+ Compute per zone reductions (area weighted mean, minimum, maximum and area
+ weighted sum) of the range variables of an irregular mesh, for every slab of
+ their other dimensions.
+**/
+void ugzs(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+
+/**
+ * The UGZS class encapsulates the function 'ugrid::ugzs'
+ * along with additional meta-data regarding its use and applicability.
+ */
+class UGZS: public libdap::ServerFunction {
+
+private:
+
+public:
+    UGZS()
+{
+        setName("ugzs");
+        setDescriptionString(
+            ((string)"This function returns the area weighted mean, minimum, maximum and area weighted sum of the ") +
+            "range variables of a two dimensional unstructured mesh over each of a set of zones.");
+        setUsageString("ugzs(range_var [,range_var_2,...,range_var_n], 'x1 y1, x2 y2, ...; x1 y1, ...' | region_var)");
+        setRole("http://services.opendap.org/dap4/server-side-function/unstructured_grids/ugrid_zonal");
+        setDocUrl("http://docs.opendap.org/index.php/UGrid_Functions");
+        setFunction(ugrid::ugzs);
+        setVersion("1.0");
+}
+    virtual ~UGZS()
+    {
+    }
+
+};
+
+} // namespace ugrid
+
+#endif /* UGRID_ZONAL_H_ */
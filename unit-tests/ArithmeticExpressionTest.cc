@@ -0,0 +1,235 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <vector>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+#include <Error.h>
+
+#include "debug.h"
+#include "ArithmeticExpression.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+class ArithmeticExpressionTest: public CppUnit::TestFixture {
+private:
+    vector<double> d_u;
+    vector<double> d_v;
+
+    // Evaluate text with u and v bound to d_u and d_v, whatever order the
+    // expression names them in.
+    vector<double> evaluate(const string &text)
+    {
+        ArithmeticExpression expression(text);
+
+        vector<const double *> inputs;
+        for (unsigned int i = 0; i < expression.variables().size(); ++i) {
+            const string &name = expression.variables()[i];
+            CPPUNIT_ASSERT(name == "u" || name == "v");
+            inputs.push_back(name == "u" ? &d_u[0] : &d_v[0]);
+        }
+
+        vector<double> result(d_u.size());
+        expression.evaluate(inputs, result.size(), &result[0]);
+        return result;
+    }
+
+    bool fails(const string &text)
+    {
+        try {
+            ArithmeticExpression expression(text);
+        }
+        catch (libdap::Error &e) {
+            DBG(cerr << e.get_error_message() << endl);
+            return true;
+        }
+        return false;
+    }
+
+public:
+    // Called once before everything gets tested
+    ArithmeticExpressionTest()
+    {
+    }
+
+    // Called at the end of the test
+    ~ArithmeticExpressionTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        double u[] = { 3, -1, 0, 2.5 };
+        double v[] = { 4, 1, -2, 0.5 };
+        d_u.assign(u, u + 4);
+        d_v.assign(v, v + 4);
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+    }
+
+CPPUNIT_TEST_SUITE( ArithmeticExpressionTest );
+
+    CPPUNIT_TEST(precedence_test);
+    CPPUNIT_TEST(variables_test);
+    CPPUNIT_TEST(functions_test);
+    CPPUNIT_TEST(mask_test);
+    CPPUNIT_TEST(syntax_error_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void precedence_test()
+    {
+        vector<double> r = evaluate("1 + 2 * 3 ^ 2 - 8 / 4");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(17.0, r[0], 1e-12);
+
+        r = evaluate("-2 ^ 2");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(-4.0, r[0], 1e-12);
+
+        r = evaluate("(1 + 2) * -3");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(-9.0, r[0], 1e-12);
+
+        r = evaluate("1.5e1 - 5 < 2 * 5 + 1");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r[0], 1e-12);
+        CPPUNIT_ASSERT(r.size() == d_u.size());
+    }
+
+    void variables_test()
+    {
+        ArithmeticExpression expression("v * u + v");
+        CPPUNIT_ASSERT(expression.variables().size() == 2);
+        CPPUNIT_ASSERT(expression.variables()[0] == "v");
+        CPPUNIT_ASSERT(expression.variables()[1] == "u");
+
+        vector<double> r = evaluate("v * u + v");
+        for (unsigned int i = 0; i < d_u.size(); ++i)
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(d_v[i] * d_u[i] + d_v[i], r[i], 1e-12);
+
+        r = evaluate("u >= v");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, r[0], 0);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, r[1], 0);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r[2], 0);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r[3], 0);
+    }
+
+    void functions_test()
+    {
+        vector<double> speed = evaluate("hypot(u, v)");
+        vector<double> direction = evaluate("atan2(v, u)");
+        vector<double> check = evaluate("sqrt(u*u + v*v) - max(abs(u), 0) + min(u, u)");
+        for (unsigned int i = 0; i < d_u.size(); ++i) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(d_u[i] * d_u[i] + d_v[i] * d_v[i]), speed[i], 1e-12);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(atan2(d_v[i], d_u[i]), direction[i], 1e-12);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(speed[i] - fabs(d_u[i]) + d_u[i], check[i], 1e-12);
+        }
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0, speed[0], 1e-12);
+    }
+
+    void mask_test()
+    {
+        vector<double> r = evaluate("mask(u > 0, v * 10)");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(40.0, r[0], 1e-12);
+        CPPUNIT_ASSERT(r[1] != r[1]);
+        CPPUNIT_ASSERT(r[2] != r[2]);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0, r[3], 1e-12);
+
+        // NaN conditions mask too.
+        r = evaluate("mask(log(u), 1)");
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r[0], 0);
+        CPPUNIT_ASSERT(r[1] != r[1]);
+    }
+
+    void syntax_error_test()
+    {
+        CPPUNIT_ASSERT(fails(""));
+        CPPUNIT_ASSERT(fails("u +"));
+        CPPUNIT_ASSERT(fails("(u + v"));
+        CPPUNIT_ASSERT(fails("u v"));
+        CPPUNIT_ASSERT(fails("hypot(u)"));
+        CPPUNIT_ASSERT(fails("speed(u, v)"));
+        CPPUNIT_ASSERT(fails("u # v"));
+        CPPUNIT_ASSERT(!fails("  hypot( u ,v )  "));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ArithmeticExpressionTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::ArithmeticExpressionTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
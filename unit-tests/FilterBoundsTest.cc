@@ -0,0 +1,152 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+
+#include "debug.h"
+#include "FilterBounds.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+class FilterBoundsTest: public CppUnit::TestFixture {
+private:
+    // Does the filter leave anything of the box [0, 10] x [20, 30]?
+    bool hits(const string &filter)
+    {
+        FilterBounds bounds(filter, "X", "Y");
+        DBG(cerr << "'" << filter << "' bounded: " << bounds.bounded() << endl);
+        return bounds.intersects(0, 20, 10, 30);
+    }
+
+public:
+    FilterBoundsTest()
+    {
+    }
+
+    ~FilterBoundsTest()
+    {
+    }
+
+    CPPUNIT_TEST_SUITE( FilterBoundsTest );
+
+    CPPUNIT_TEST(bounded_test);
+    CPPUNIT_TEST(intersects_test);
+    CPPUNIT_TEST(strict_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void bounded_test()
+    {
+        CPPUNIT_ASSERT(FilterBounds("X > 26", "X", "Y").bounded());
+        CPPUNIT_ASSERT(FilterBounds("26 < Y & depth > 3", "X", "Y").bounded());
+        CPPUNIT_ASSERT(!FilterBounds("depth > 3", "X", "Y").bounded());
+        CPPUNIT_ASSERT(!FilterBounds("X * 2 > 26", "X", "Y").bounded());
+        CPPUNIT_ASSERT(!FilterBounds("X > 26 | Y > 3", "X", "Y").bounded());
+        CPPUNIT_ASSERT(!FilterBounds("(X > 26)", "X", "Y").bounded());
+        CPPUNIT_ASSERT(!FilterBounds("x > 26", "X", "Y").bounded());
+    }
+
+    void intersects_test()
+    {
+        CPPUNIT_ASSERT(hits("X >= 0"));
+        CPPUNIT_ASSERT(hits("X > 5 & Y < 25"));
+        CPPUNIT_ASSERT(hits("depth > 1000"));
+        CPPUNIT_ASSERT(!hits("X > 26"));
+        CPPUNIT_ASSERT(!hits("Y > 26 & Y < 19"));
+        CPPUNIT_ASSERT(!hits("-5 > X"));
+        CPPUNIT_ASSERT(!hits("X > 1 & X < 0.5"));
+        CPPUNIT_ASSERT(hits("X = 3 & Y == 22"));
+        CPPUNIT_ASSERT(!hits("X = 3 & X = 4"));
+
+        // A disjunction is never ruled out.
+        CPPUNIT_ASSERT(hits("X > 26 | X < -26"));
+    }
+
+    void strict_test()
+    {
+        CPPUNIT_ASSERT(hits("X >= 10"));
+        CPPUNIT_ASSERT(!hits("X > 10"));
+        CPPUNIT_ASSERT(hits("Y <= 20"));
+        CPPUNIT_ASSERT(!hits("Y < 20"));
+        CPPUNIT_ASSERT(hits("X >= 5 & X <= 5"));
+        CPPUNIT_ASSERT(!hits("X > 5 & X <= 5"));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FilterBoundsTest);
+
+} /* namespace ugrid */
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::FilterBoundsTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,303 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "debug.h"
+#include "GatherKernel.h"
+#include "GatherPlan.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+class GatherKernelTest: public CppUnit::TestFixture {
+private:
+    // A source slab whose bytes all differ from their neighbors.
+    vector<char> source(unsigned int values, unsigned int width)
+    {
+        vector<char> src(values * width);
+        for (unsigned int i = 0; i < src.size(); ++i)
+            src[i] = (char) (i * 7 + i / 251);
+        return src;
+    }
+
+    // Gather with the kernel and compare with copying one value at a time.
+    bool gathers(const vector<unsigned int> &index, unsigned int values, unsigned int width)
+    {
+        vector<char> src = source(values, width);
+        vector<char> expected(index.size() * width + 1), result(index.size() * width + 1);
+        for (unsigned int i = 0; i < index.size(); ++i)
+            memcpy(&expected[i * width], &src[index[i] * width], width);
+
+        GatherKernel kernel(&index);
+        kernel.gather(&src[0], width, &result[0]);
+        return memcmp(&expected[0], &result[0], index.size() * width) == 0;
+    }
+
+    // Read the values the way the plan says to and compare with copying one
+    // value at a time.
+    bool plans(const GatherPlan &plan, unsigned int width)
+    {
+        const vector<unsigned int> &index = plan.index();
+        vector<char> src = source(plan.slabLength(), width);
+        vector<char> expected(index.size() * width + 1), result(index.size() * width + 1);
+        for (unsigned int i = 0; i < index.size(); ++i)
+            memcpy(&expected[i * width], &src[index[i] * width], width);
+
+        if (plan.strategy() == GatherPlan::read_full) {
+            plan.fullKernel().gather(&src[0], width, &result[0]);
+        }
+        else {
+            for (unsigned int r = 0; r < plan.readCount(); ++r) {
+                vector<char> part(src.begin() + plan.readFirst(r) * width, src.begin() + (plan.readLast(r) + 1) * width);
+                plan.readKernel(r).gather(&part[0], width, &result[plan.readPosition(r) * width]);
+            }
+        }
+        return memcmp(&expected[0], &result[0], index.size() * width) == 0;
+    }
+
+    // A sorted index over values elements: a mix of isolated indices and
+    // runs of consecutive ones.
+    vector<unsigned int> mixedIndex(unsigned int values)
+    {
+        vector<unsigned int> index;
+        srand(13);
+        for (unsigned int i = 0; i < values; ++i) {
+            int r = rand() % 100;
+            if (r < 20) {
+                unsigned int run = 10 + rand() % 60;
+                for (unsigned int j = 0; j < run && i < values; ++j)
+                    index.push_back(i++);
+            }
+            else if (r < 50) {
+                index.push_back(i);
+            }
+        }
+        return index;
+    }
+
+public:
+    GatherKernelTest()
+    {
+    }
+
+    ~GatherKernelTest()
+    {
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        GatherKernel::useAvx2(true);
+    }
+
+    CPPUNIT_TEST_SUITE( GatherKernelTest );
+
+    CPPUNIT_TEST(runs_test);
+    CPPUNIT_TEST(gather_test);
+    CPPUNIT_TEST(scalar_test);
+    CPPUNIT_TEST(plan_test);
+    CPPUNIT_TEST(gather_benchmark);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void runs_test()
+    {
+        vector<unsigned int> index;
+        CPPUNIT_ASSERT(GatherKernel(&index).runCount() == 0);
+
+        // Too short to be a run.
+        for (unsigned int i = 0; i < 5; ++i)
+            index.push_back(3 * i);
+        for (unsigned int i = 100; i < 110; ++i)
+            index.push_back(i);
+        CPPUNIT_ASSERT(GatherKernel(&index).runCount() == 0);
+
+        for (unsigned int i = 200; i < 300; ++i)
+            index.push_back(i);
+        index.push_back(400);
+        for (unsigned int i = 402; i < 500; ++i)
+            index.push_back(i);
+        CPPUNIT_ASSERT(GatherKernel(&index).runCount() == 2);
+
+        DBG(cerr << " runs_test() - AVX2 available: " << GatherKernel::avx2Available() << endl);
+    }
+
+    void gather_test()
+    {
+        unsigned int widths[] = { 1, 2, 4, 8, 3 };
+        vector<unsigned int> empty, all, mixed = mixedIndex(5000);
+        for (unsigned int i = 0; i < 5000; ++i)
+            all.push_back(i);
+
+        for (unsigned int w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+            DBG(cerr << " gather_test() - width " << widths[w] << endl);
+            CPPUNIT_ASSERT(gathers(empty, 5000, widths[w]));
+            CPPUNIT_ASSERT(gathers(all, 5000, widths[w]));
+            CPPUNIT_ASSERT(gathers(mixed, 5000, widths[w]));
+
+            // Every length up to a few vectors, so each loop's remainder is used.
+            for (unsigned int n = 1; n < 40; ++n) {
+                vector<unsigned int> sparse;
+                for (unsigned int i = 0; i < n; ++i)
+                    sparse.push_back(4999 - 3 * (n - 1 - i));
+                CPPUNIT_ASSERT(gathers(sparse, 5000, widths[w]));
+            }
+        }
+    }
+
+    // The same, without the AVX2 loops.
+    void scalar_test()
+    {
+        GatherKernel::useAvx2(false);
+        gather_test();
+    }
+
+    void plan_test()
+    {
+        vector<unsigned int> index;
+        GatherPlan empty(index, 100000);
+        CPPUNIT_ASSERT(empty.strategy() == GatherPlan::read_runs && empty.readCount() == 0);
+        CPPUNIT_ASSERT(plans(empty, 4));
+
+        // Most of the slab.
+        index = mixedIndex(100000);
+        GatherPlan full(index, 100000);
+        CPPUNIT_ASSERT(full.strategy() == GatherPlan::read_full);
+        CPPUNIT_ASSERT(plans(full, 4));
+
+        // A small part of the slab.
+        index.clear();
+        for (unsigned int i = 40000; i < 45000; i += 3)
+            index.push_back(i);
+        GatherPlan bounds(index, 100000);
+        CPPUNIT_ASSERT(bounds.strategy() == GatherPlan::read_bounds && bounds.readCount() == 1);
+        CPPUNIT_ASSERT(bounds.readFirst(0) == 40000 && bounds.readLast(0) == 44998);
+        CPPUNIT_ASSERT(plans(bounds, 8));
+
+        // A few clusters far apart.
+        index.clear();
+        for (unsigned int c = 0; c < 3; ++c)
+            for (unsigned int i = 0; i < 500; ++i)
+                index.push_back(10000 + c * 20000 + i);
+        GatherPlan runs(index, 100000);
+        CPPUNIT_ASSERT(runs.strategy() == GatherPlan::read_runs && runs.readCount() == 3);
+        CPPUNIT_ASSERT(runs.readPosition(2) == 1000);
+        CPPUNIT_ASSERT(plans(runs, 2));
+
+        // Out of order, so read whole.
+        index.clear();
+        index.push_back(7);
+        index.push_back(3);
+        GatherPlan unsorted(index, 100000);
+        CPPUNIT_ASSERT(unsorted.strategy() == GatherPlan::read_full);
+        CPPUNIT_ASSERT(plans(unsorted, 1));
+    }
+
+    // Compare the kernel with copying one value at a time. Run with -d to see
+    // the times.
+    void gather_benchmark()
+    {
+        unsigned int values = 200000;
+        vector<unsigned int> index = mixedIndex(values);
+        vector<char> src = source(values, 4);
+        vector<char> dst(index.size() * 4);
+
+        clock_t t0 = clock();
+        for (unsigned int s = 0; s < 200; ++s)
+            for (unsigned int i = 0; i < index.size(); ++i)
+                memcpy(&dst[i * 4], &src[index[i] * 4], 4);
+        clock_t t1 = clock();
+
+        GatherKernel kernel(&index);
+        for (unsigned int s = 0; s < 200; ++s)
+            kernel.gather(&src[0], 4, &dst[0]);
+        clock_t t2 = clock();
+
+        DBG(cerr << " gather_benchmark() - " << index.size() << " values, " << kernel.runCount() << " runs: one at a time "
+            << double(t1 - t0) / CLOCKS_PER_SEC << "s, kernel " << double(t2 - t1) / CLOCKS_PER_SEC << "s" << endl);
+
+        CPPUNIT_ASSERT(memcmp(&dst[(index.size() - 1) * 4], &src[index.back() * 4], 4) == 0);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(GatherKernelTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::GatherKernelTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,1131 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#define DODS_DEBUG
+
+#include <Error.h>
+#include <BESDebug.h>
+
+#include "debug.h"
+#include "KDTree.h"
+#include "FaceLocator.h"
+#include "FaceAdjacency.h"
+#include "NodeFaces.h"
+#include "FaceComponents.h"
+#include "RegridWeights.h"
+#include "ZoneMembership.h"
+#include "DecimatedMesh.h"
+#include "RestrictionResult.h"
+#include "GatherPlan.h"
+#include "RegionIndex.h"
+#include "MeshGeometry.h"
+#include "MeshGeometryCache.h"
+#include "SharedMeshStore.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+class MeshGeometryTest: public CppUnit::TestFixture {
+private:
+    vector<double> d_x;
+    vector<double> d_y;
+
+    // The k nearest points to (qx, qy) found the slow way, ordered like KDTree::nearest().
+    void bruteForce(double qx, double qy, unsigned int k, vector<unsigned int> *ids, vector<double> *distances)
+    {
+        vector<pair<double, unsigned int> > all;
+        for (unsigned int i = 0; i < d_x.size(); ++i) {
+            double dx = qx - d_x[i], dy = qy - d_y[i];
+            all.push_back(make_pair(dx * dx + dy * dy, i));
+        }
+        sort(all.begin(), all.end());
+
+        ids->clear();
+        distances->clear();
+        for (unsigned int i = 0; i < k && i < all.size(); ++i) {
+            ids->push_back(all[i].second);
+            distances->push_back(sqrt(all[i].first));
+        }
+    }
+
+    // A mesh made of two triangles over the unit square.
+    MeshGeometry *newSquare()
+    {
+        double x[] = { 0.0, 1.0, 1.0, 0.0 };
+        double y[] = { 0.0, 0.0, 1.0, 1.0 };
+        unsigned int fnc[] = { 0, 1, 2, 0, 2, 3 };
+
+        vector<double> nodeX(x, x + 4);
+        vector<double> nodeY(y, y + 4);
+        vector<unsigned int> faceNodes(fnc, fnc + 6);
+
+        return new MeshGeometry(&nodeX, &nodeY, &faceNodes, 3);
+    }
+
+    // An n x n grid of unit squares, each split into two triangles.
+    MeshGeometry *newGrid(unsigned int n)
+    {
+        vector<double> nodeX, nodeY;
+        for (unsigned int j = 0; j <= n; ++j) {
+            for (unsigned int i = 0; i <= n; ++i) {
+                nodeX.push_back(i);
+                nodeY.push_back(j);
+            }
+        }
+
+        vector<unsigned int> faceNodes;
+        for (unsigned int j = 0; j < n; ++j) {
+            for (unsigned int i = 0; i < n; ++i) {
+                unsigned int ll = j * (n + 1) + i, lr = ll + 1, ul = ll + n + 1, ur = ul + 1;
+                faceNodes.push_back(ll), faceNodes.push_back(lr), faceNodes.push_back(ur);
+                faceNodes.push_back(ll), faceNodes.push_back(ur), faceNodes.push_back(ul);
+            }
+        }
+
+        return new MeshGeometry(&nodeX, &nodeY, &faceNodes, 3);
+    }
+
+    // Check that the weights sum to one and reproduce the point.
+    void checkWeights(MeshGeometry *geometry, const FaceWeights &fw, double x, double y)
+    {
+        double sum = 0, wx = 0, wy = 0;
+        for (int i = 0; i < 3; ++i) {
+            CPPUNIT_ASSERT(fw.weights[i] >= -1e-9 && fw.weights[i] <= 1 + 1e-9);
+            sum += fw.weights[i];
+            wx += fw.weights[i] * geometry->nodeX(fw.nodes[i]);
+            wy += fw.weights[i] * geometry->nodeY(fw.nodes[i]);
+        }
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, sum, 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(x, wx, 1e-9);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(y, wy, 1e-9);
+    }
+
+    // The bytes held by the files in a directory, counted as SharedMeshStore
+    // counts them.
+    unsigned long directoryBytes(const string &directory)
+    {
+        unsigned long total = 0;
+        DIR *dir = opendir(directory.c_str());
+        CPPUNIT_ASSERT(dir != 0);
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != 0) {
+            struct stat buf;
+            string file = directory + "/" + entry->d_name;
+            if (stat(file.c_str(), &buf) == 0 && S_ISREG(buf.st_mode)) total += buf.st_blocks * 512UL;
+        }
+        closedir(dir);
+        return total;
+    }
+
+    // The number of files in a directory whose names end with suffix.
+    unsigned int countFiles(const string &directory, const string &suffix)
+    {
+        unsigned int count = 0;
+        DIR *dir = opendir(directory.c_str());
+        CPPUNIT_ASSERT(dir != 0);
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != 0) {
+            string name = entry->d_name;
+            if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                ++count;
+        }
+        closedir(dir);
+        return count;
+    }
+
+public:
+    // Called once before everything gets tested
+    MeshGeometryTest()
+    {
+    }
+
+    // Called at the end of the test
+    ~MeshGeometryTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        srand(1234);
+        d_x.clear();
+        d_y.clear();
+        for (int i = 0; i < 2000; ++i) {
+            d_x.push_back(rand() / (double) RAND_MAX * 360.0 - 180.0);
+            d_y.push_back(rand() / (double) RAND_MAX * 180.0 - 90.0);
+        }
+        // A few duplicates and collinear points to exercise ties and zero-width splits.
+        for (int i = 0; i < 20; ++i) {
+            d_x.push_back(d_x[i]);
+            d_y.push_back(d_y[i]);
+            d_x.push_back(10.0);
+            d_y.push_back(i * 0.5);
+        }
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        MeshGeometryCache::delete_instance();
+        SharedMeshStore::delete_instance();
+    }
+
+CPPUNIT_TEST_SUITE( MeshGeometryTest );
+
+    CPPUNIT_TEST(kdtree_nearest_test);
+    CPPUNIT_TEST(kdtree_k_nearest_test);
+    CPPUNIT_TEST(kdtree_small_test);
+    CPPUNIT_TEST(mesh_geometry_test);
+    CPPUNIT_TEST(face_locator_test);
+    CPPUNIT_TEST(face_locator_flexible_test);
+    CPPUNIT_TEST(face_locator_grid_test);
+    CPPUNIT_TEST(face_adjacency_test);
+    CPPUNIT_TEST(face_walk_test);
+    CPPUNIT_TEST(regrid_weights_test);
+    CPPUNIT_TEST(zone_membership_test);
+    CPPUNIT_TEST(decimated_mesh_test);
+    CPPUNIT_TEST(restriction_result_test);
+    CPPUNIT_TEST(node_faces_test);
+    CPPUNIT_TEST(face_components_test);
+    CPPUNIT_TEST(region_index_test);
+    CPPUNIT_TEST(cache_lru_test);
+    CPPUNIT_TEST(cache_stamp_test);
+    CPPUNIT_TEST(cache_restriction_test);
+    CPPUNIT_TEST(shared_store_test);
+    CPPUNIT_TEST(shared_build_test);
+    CPPUNIT_TEST(shared_budget_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void kdtree_nearest_test()
+    {
+        KDTree tree(&d_x[0], &d_y[0], d_x.size());
+
+        vector<unsigned int> ids, expectedIds;
+        vector<double> distances, expectedDistances;
+        for (int q = 0; q < 500; ++q) {
+            double qx = rand() / (double) RAND_MAX * 400.0 - 200.0;
+            double qy = rand() / (double) RAND_MAX * 200.0 - 100.0;
+
+            tree.nearest(qx, qy, 1, &ids, &distances);
+            bruteForce(qx, qy, 1, &expectedIds, &expectedDistances);
+
+            DBG(cerr << "query (" << qx << ", " << qy << ") nearest: " << ids[0] << " expected: " << expectedIds[0] << endl);
+            CPPUNIT_ASSERT(ids.size() == 1);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(expectedDistances[0], distances[0], 1e-12);
+        }
+    }
+
+    void kdtree_k_nearest_test()
+    {
+        KDTree tree(&d_x[0], &d_y[0], d_x.size());
+
+        vector<unsigned int> ids, expectedIds;
+        vector<double> distances, expectedDistances;
+        for (int q = 0; q < 200; ++q) {
+            double qx = rand() / (double) RAND_MAX * 360.0 - 180.0;
+            double qy = rand() / (double) RAND_MAX * 180.0 - 90.0;
+
+            tree.nearest(qx, qy, 7, &ids, &distances);
+            bruteForce(qx, qy, 7, &expectedIds, &expectedDistances);
+
+            CPPUNIT_ASSERT(ids.size() == 7);
+            for (unsigned int i = 0; i < 7; ++i) {
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(expectedDistances[i], distances[i], 1e-12);
+                if (i > 0) CPPUNIT_ASSERT(distances[i - 1] <= distances[i]);
+            }
+        }
+    }
+
+    void kdtree_small_test()
+    {
+        KDTree empty(0, 0, 0);
+        vector<unsigned int> ids;
+        vector<double> distances;
+        empty.nearest(0.0, 0.0, 3, &ids, &distances);
+        CPPUNIT_ASSERT(ids.empty() && distances.empty());
+
+        double x[] = { 0.0, 1.0, 5.0 };
+        double y[] = { 0.0, 0.0, 0.0 };
+        KDTree tree(x, y, 3);
+
+        // Asking for more points than the tree holds returns all of them.
+        tree.nearest(4.0, 0.0, 10, &ids, &distances);
+        CPPUNIT_ASSERT(ids.size() == 3);
+        CPPUNIT_ASSERT(ids[0] == 2 && ids[1] == 1 && ids[2] == 0);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, distances[0], 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(4.0, distances[2], 1e-12);
+    }
+
+    void mesh_geometry_test()
+    {
+        MeshGeometry *geometry = newSquare();
+
+        CPPUNIT_ASSERT(geometry->nodeCount() == 4);
+        CPPUNIT_ASSERT(geometry->faceCount() == 2);
+        CPPUNIT_ASSERT(geometry->nodesPerFace() == 3);
+        CPPUNIT_ASSERT(geometry->faceNode(1, 2) == 3);
+        CPPUNIT_ASSERT(geometry->nodeX(2) == 1.0 && geometry->nodeY(2) == 1.0);
+
+        unsigned long sizeBefore = geometry->sizeInBytes();
+        const KDTree *tree = geometry->getNodeTree();
+        CPPUNIT_ASSERT(tree == geometry->getNodeTree());
+        CPPUNIT_ASSERT(geometry->sizeInBytes() > sizeBefore);
+
+        vector<unsigned int> ids;
+        vector<double> distances;
+        tree->nearest(0.9, 0.8, 1, &ids, &distances);
+        CPPUNIT_ASSERT(ids.size() == 1 && ids[0] == 2);
+
+        delete geometry;
+    }
+
+    void face_locator_test()
+    {
+        MeshGeometry *geometry = newSquare();
+        const FaceLocator *locator = geometry->getFaceLocator();
+        CPPUNIT_ASSERT(locator == geometry->getFaceLocator());
+
+        FaceWeights fw;
+        CPPUNIT_ASSERT(locator->locate(0.75, 0.25, &fw));
+        CPPUNIT_ASSERT(fw.face == 0);
+        checkWeights(geometry, fw, 0.75, 0.25);
+
+        CPPUNIT_ASSERT(locator->locate(0.25, 0.75, &fw));
+        CPPUNIT_ASSERT(fw.face == 1);
+        checkWeights(geometry, fw, 0.25, 0.75);
+
+        // On the shared edge and on a corner.
+        CPPUNIT_ASSERT(locator->locate(0.5, 0.5, &fw));
+        checkWeights(geometry, fw, 0.5, 0.5);
+        CPPUNIT_ASSERT(locator->locate(1.0, 1.0, &fw));
+        checkWeights(geometry, fw, 1.0, 1.0);
+
+        CPPUNIT_ASSERT(!locator->locate(1.5, 0.5, &fw));
+        CPPUNIT_ASSERT(!locator->locate(-0.1, -0.1, &fw));
+
+        delete geometry;
+    }
+
+    void face_locator_flexible_test()
+    {
+        // A unit square quad and a triangle to its right; the triangle's fourth
+        // corner is a fill value.
+        double x[] = { 0.0, 1.0, 1.0, 0.0, 2.0 };
+        double y[] = { 0.0, 0.0, 1.0, 1.0, 0.5 };
+        unsigned int fnc[] = { 0, 1, 2, 3, 1, 4, 2, 999 };
+
+        vector<double> nodeX(x, x + 5);
+        vector<double> nodeY(y, y + 5);
+        vector<unsigned int> faceNodes(fnc, fnc + 8);
+        MeshGeometry geometry(&nodeX, &nodeY, &faceNodes, 4);
+
+        const FaceLocator *locator = geometry.getFaceLocator();
+        FaceWeights fw;
+
+        CPPUNIT_ASSERT(locator->locate(0.2, 0.8, &fw));
+        CPPUNIT_ASSERT(fw.face == 0);
+        checkWeights(&geometry, fw, 0.2, 0.8);
+
+        CPPUNIT_ASSERT(locator->locate(1.5, 0.5, &fw));
+        CPPUNIT_ASSERT(fw.face == 1);
+        checkWeights(&geometry, fw, 1.5, 0.5);
+
+        CPPUNIT_ASSERT(!locator->locate(1.9, 0.9, &fw));
+    }
+
+    void face_locator_grid_test()
+    {
+        const unsigned int n = 50;
+        MeshGeometry *geometry = newGrid(n);
+        const FaceLocator *locator = geometry->getFaceLocator();
+
+        FaceWeights fw;
+        for (int q = 0; q < 2000; ++q) {
+            double x = rand() / (double) RAND_MAX * n;
+            double y = rand() / (double) RAND_MAX * n;
+
+            CPPUNIT_ASSERT(locator->locate(x, y, &fw));
+            checkWeights(geometry, fw, x, y);
+
+            // The face must be in the grid square that holds the point (or on its edge).
+            unsigned int square = fw.face / 2;
+            CPPUNIT_ASSERT(fabs((square % n) + 0.5 - x) <= 0.5 + 1e-9);
+            CPPUNIT_ASSERT(fabs((square / n) + 0.5 - y) <= 0.5 + 1e-9);
+        }
+
+        CPPUNIT_ASSERT(!locator->locate(n + 0.5, 1.0, &fw));
+
+        delete geometry;
+    }
+
+    void face_adjacency_test()
+    {
+        MeshGeometry *geometry = newSquare();
+        const FaceAdjacency *adjacency = geometry->getFaceAdjacency();
+        CPPUNIT_ASSERT(adjacency == geometry->getFaceAdjacency());
+
+        // The diagonal from node 2 to node 0 is the only shared edge.
+        CPPUNIT_ASSERT(adjacency->neighbor(0, 0) == FaceAdjacency::NO_NEIGHBOR);
+        CPPUNIT_ASSERT(adjacency->neighbor(0, 1) == FaceAdjacency::NO_NEIGHBOR);
+        CPPUNIT_ASSERT(adjacency->neighbor(0, 2) == 1);
+        CPPUNIT_ASSERT(adjacency->neighbor(1, 0) == 0);
+        CPPUNIT_ASSERT(adjacency->neighbor(1, 1) == FaceAdjacency::NO_NEIGHBOR);
+        CPPUNIT_ASSERT(adjacency->neighbor(1, 2) == FaceAdjacency::NO_NEIGHBOR);
+
+        delete geometry;
+
+        const unsigned int n = 10;
+        geometry = newGrid(n);
+        adjacency = geometry->getFaceAdjacency();
+
+        // Every interior edge links two faces, both ways.
+        unsigned int linked = 0;
+        for (unsigned int f = 0; f < geometry->faceCount(); ++f) {
+            for (unsigned int e = 0; e < 3; ++e) {
+                unsigned int g = adjacency->neighbor(f, e);
+                if (g == FaceAdjacency::NO_NEIGHBOR) continue;
+                ++linked;
+                bool back = false;
+                for (unsigned int i = 0; i < 3; ++i)
+                    if (adjacency->neighbor(g, i) == f) back = true;
+                CPPUNIT_ASSERT(back);
+            }
+        }
+        // Each square has a diagonal plus there are 2n(n-1) shared grid lines.
+        CPPUNIT_ASSERT(linked == 2 * (n * n + 2 * n * (n - 1)));
+
+        delete geometry;
+    }
+
+    void face_walk_test()
+    {
+        const unsigned int n = 50;
+        MeshGeometry *geometry = newGrid(n);
+        const FaceLocator *locator = geometry->getFaceLocator();
+        const FaceAdjacency *adjacency = geometry->getFaceAdjacency();
+
+        FaceWeights fw, expected;
+        unsigned int face = 0;
+        for (int q = 0; q < 2000; ++q) {
+            // Mostly short steps, as along a transect, with an occasional jump.
+            double x, y;
+            if (q % 50 == 0) {
+                x = rand() / (double) RAND_MAX * n;
+                y = rand() / (double) RAND_MAX * n;
+            }
+            else {
+                x = min((double) n, max(0.0, geometry->nodeX(fw.nodes[0]) + rand() / (double) RAND_MAX * 4 - 2));
+                y = min((double) n, max(0.0, geometry->nodeY(fw.nodes[0]) + rand() / (double) RAND_MAX * 4 - 2));
+            }
+
+            CPPUNIT_ASSERT(locator->walk(adjacency, face, x, y, &fw));
+            checkWeights(geometry, fw, x, y);
+
+            CPPUNIT_ASSERT(locator->locate(x, y, &expected));
+            CPPUNIT_ASSERT(fw.face / 2 == expected.face / 2 || fabs(x - floor(x + 0.5)) < 1e-9
+                || fabs(y - floor(y + 0.5)) < 1e-9);
+
+            face = fw.face;
+        }
+
+        CPPUNIT_ASSERT(!locator->walk(adjacency, face, n + 1.0, 1.0, &fw));
+
+        delete geometry;
+    }
+
+    void regrid_weights_test()
+    {
+        MeshGeometry *geometry = newSquare();
+
+        // Points at -0.5, 0, 0.5 and 1 in x and 0, 0.5 and 1 in y; the first column is off the mesh.
+        const RegridWeights *rw = geometry->getRegridWeights(-0.5, 0.0, 0.5, 0.5, 4, 3);
+        CPPUNIT_ASSERT(rw == geometry->getRegridWeights(-0.5, 0.0, 0.5, 0.5, 4, 3));
+        CPPUNIT_ASSERT(rw->nx() == 4 && rw->ny() == 3);
+
+        const SparseWeights &nw = rw->nodeWeights();
+        const SparseWeights &fw = rw->faceWeights();
+        CPPUNIT_ASSERT(nw.rowStart.size() == 13 && fw.rowStart.size() == 13);
+        CPPUNIT_ASSERT(nw.locations.size() == 4);
+        CPPUNIT_ASSERT(fw.locations.size() == 2);
+
+        for (unsigned int j = 0; j < rw->ny(); ++j) {
+            for (unsigned int i = 0; i < rw->nx(); ++i) {
+                unsigned int r = j * rw->nx() + i;
+                if (i == 0) {
+                    CPPUNIT_ASSERT(nw.rowStart[r] == nw.rowStart[r + 1]);
+                    CPPUNIT_ASSERT(fw.rowStart[r] == fw.rowStart[r + 1]);
+                    continue;
+                }
+
+                double sum = 0, wx = 0, wy = 0;
+                for (unsigned int e = nw.rowStart[r]; e < nw.rowStart[r + 1]; ++e) {
+                    unsigned int node = nw.locations[nw.columns[e]];
+                    sum += nw.weights[e];
+                    wx += nw.weights[e] * geometry->nodeX(node);
+                    wy += nw.weights[e] * geometry->nodeY(node);
+                }
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, sum, 1e-12);
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(rw->x(i), wx, 1e-12);
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(rw->y(j), wy, 1e-12);
+
+                CPPUNIT_ASSERT(fw.rowStart[r + 1] - fw.rowStart[r] == 1);
+                CPPUNIT_ASSERT(fw.weights[fw.rowStart[r]] == 1.0);
+            }
+        }
+
+        // Another grid gets its own weights; both are counted in the geometry's size.
+        unsigned long size = geometry->sizeInBytes();
+        const RegridWeights *other = geometry->getRegridWeights(0.0, 0.0, 0.25, 0.25, 5, 5);
+        CPPUNIT_ASSERT(other != rw);
+        CPPUNIT_ASSERT(other->nodeWeights().rowStart.size() == 26);
+        CPPUNIT_ASSERT(geometry->sizeInBytes() > size);
+
+        // Only the most recently used weights that fit the budget are kept.
+        unsigned long maxBytes = MeshGeometry::getMaxProductBytes();
+        MeshGeometry::setMaxProductBytes(geometry->sizeInBytes() - size);
+        CPPUNIT_ASSERT(geometry->productCount() == 2);
+        geometry->getRegridWeights(0.0, 0.0, 0.2, 0.2, 6, 6);
+        CPPUNIT_ASSERT(geometry->productCount() == 1);
+        CPPUNIT_ASSERT(geometry->getRegridWeights(0.0, 0.0, 0.5, 0.5, 3, 3)->nx() == 3);
+        CPPUNIT_ASSERT(geometry->productCount() == 1);
+
+        // A product bigger than the budget is still kept, by itself.
+        MeshGeometry::setMaxProductBytes(1);
+        CPPUNIT_ASSERT(geometry->getRegridWeights(0.0, 0.0, 0.25, 0.25, 5, 5)->nx() == 5);
+        CPPUNIT_ASSERT(geometry->productCount() == 1);
+        MeshGeometry::setMaxProductBytes(maxBytes);
+
+        // With the default budget, all of them are kept.
+        for (unsigned int n = 2; n < 10; ++n)
+            geometry->getRegridWeights(0.0, 0.0, 1.0 / n, 1.0 / n, n + 1, n + 1);
+        CPPUNIT_ASSERT(geometry->productCount() == 8);
+
+        delete geometry;
+    }
+
+    void zone_membership_test()
+    {
+        MeshGeometry *geometry = newGrid(4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, ZoneMembership::faceArea(geometry, 0), 1e-12);
+
+        // An L shaped (concave) polygon.
+        double lx[] = { 0, 2, 2, 1, 1, 0 };
+        double ly[] = { 0, 0, 1, 1, 2, 2 };
+        vector<double> px(lx, lx + 6), py(ly, ly + 6);
+        CPPUNIT_ASSERT(ZoneMembership::inPolygon(0.5, 1.5, px, py));
+        CPPUNIT_ASSERT(!ZoneMembership::inPolygon(1.5, 1.5, px, py));
+        CPPUNIT_ASSERT(!ZoneMembership::inPolygon(2.5, 0.5, px, py));
+
+        // The lower left 2 x 2 squares, then the whole mesh; a face is in the first polygon that holds it.
+        vector<vector<double> > polygonX, polygonY;
+        double ax[] = { 0, 2, 2, 0 }, ay[] = { 0, 0, 2, 2 };
+        double bx[] = { 0, 4, 4, 0 }, by[] = { 0, 0, 4, 4 };
+        polygonX.push_back(vector<double>(ax, ax + 4));
+        polygonY.push_back(vector<double>(ay, ay + 4));
+        polygonX.push_back(vector<double>(bx, bx + 4));
+        polygonY.push_back(vector<double>(by, by + 4));
+
+        ZoneMembership zm(geometry, polygonX, polygonY);
+        CPPUNIT_ASSERT(zm.zoneCount() == 2);
+        CPPUNIT_ASSERT(zm.faces().size() == 32);
+        CPPUNIT_ASSERT(zm.zoneFaceCount(0) == 8 && zm.zoneFaceCount(1) == 24);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(4.0, zm.zoneArea(0), 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(12.0, zm.zoneArea(1), 1e-12);
+
+        // Zones given per face: the faces of even squares are in zone 0, face 1 in none.
+        vector<int> faceZones(geometry->faceCount(), 1);
+        for (unsigned int f = 0; f < faceZones.size(); f += 4) {
+            faceZones[f] = 0;
+            faceZones[f + 1] = 0;
+        }
+        faceZones[1] = -1;
+
+        ZoneMembership byRegion(geometry, faceZones, 2);
+        CPPUNIT_ASSERT(byRegion.faces().size() == 31);
+        CPPUNIT_ASSERT(byRegion.zoneFaceCount(0) == 15 && byRegion.zoneFaceCount(1) == 16);
+        CPPUNIT_ASSERT(byRegion.zones()[0] == 0 && byRegion.faces()[1] == 2);
+
+        delete geometry;
+    }
+
+    void restriction_result_test()
+    {
+        MeshGeometry *geometry = newGrid(4);
+        CPPUNIT_ASSERT(geometry->minX() == 0 && geometry->minY() == 0);
+        CPPUNIT_ASSERT(geometry->maxX() == 4 && geometry->maxY() == 4);
+
+        // The left half of the grid: the nodes with x <= 2 and the faces made of them.
+        vector<unsigned int> nodes, faces;
+        for (unsigned int n = 0; n < geometry->nodeCount(); ++n)
+            if (geometry->nodeX(n) <= 2) nodes.push_back(n);
+        for (unsigned int f = 0; f < geometry->faceCount(); ++f) {
+            bool in = true;
+            for (unsigned int c = 0; c < 3; ++c)
+                if (geometry->nodeX(geometry->faceNode(f, c)) > 2) in = false;
+            if (in) faces.push_back(f);
+        }
+
+        RestrictionResult rr(geometry->nodeCount(), geometry->faceCount(), &nodes, &faces);
+        CPPUNIT_ASSERT(nodes.empty() && faces.empty());
+        CPPUNIT_ASSERT(rr.nodes().size() == 15 && rr.faces().size() == 16);
+        CPPUNIT_ASSERT(!rr.empty());
+
+        // The edges and bounding box are only computed when asked for.
+        CPPUNIT_ASSERT(rr.edgeCount() == 0 && rr.minX() != rr.minX());
+        rr.measure(geometry);
+
+        // 10 horizontal, 12 vertical and 8 diagonal edges.
+        CPPUNIT_ASSERT(rr.edgeCount() == 30);
+
+        CPPUNIT_ASSERT(rr.minX() == 0 && rr.minY() == 0 && rr.maxX() == 2 && rr.maxY() == 4);
+
+        // The plans read the subset out of the whole mesh.
+        CPPUNIT_ASSERT(rr.nodePlan() == rr.nodePlan());
+        CPPUNIT_ASSERT(rr.nodePlan()->sizeInBytes() > 0 && rr.facePlan() != 0);
+
+        vector<unsigned int> none;
+        RestrictionResult empty(geometry->nodeCount(), geometry->faceCount(), &none, &none);
+        empty.measure(geometry);
+        CPPUNIT_ASSERT(empty.empty() && empty.edgeCount() == 0);
+        CPPUNIT_ASSERT(empty.minX() != empty.minX() && empty.maxY() != empty.maxY());
+
+        delete geometry;
+    }
+
+    void cache_restriction_test()
+    {
+        MeshGeometryCache *cache = MeshGeometryCache::TheCache();
+
+        vector<unsigned int> nodes(3), faces(1);
+        nodes[1] = 1, nodes[2] = 2;
+        RestrictionResult *a = new RestrictionResult(4, 2, &nodes, &faces);
+        cache->putRestriction("f.nc#mesh#a", "1:100", a);
+        CPPUNIT_ASSERT(cache->getRestriction("f.nc#mesh#a", "1:100") == a);
+
+        CPPUNIT_ASSERT(MeshGeometryCache::makeRestrictionKey("f.nc", "mesh", 0, "X>0")
+            != MeshGeometryCache::makeRestrictionKey("f.nc", "mesh", 2, "X>0"));
+        CPPUNIT_ASSERT(MeshGeometryCache::makeRestrictionKey("f.nc", "mesh", 0, "X>0").find(
+            MeshGeometryCache::makeKey("f.nc", "mesh")) == 0);
+
+        // Results are kept apart from the geometries.
+        CPPUNIT_ASSERT(cache->get("f.nc#mesh#a", "1:100") == 0);
+
+        // A different stamp means the file changed; the old entry is dropped.
+        CPPUNIT_ASSERT(cache->getRestriction("f.nc#mesh#a", "2:100") == 0);
+        CPPUNIT_ASSERT(cache->getRestriction("f.nc#mesh#a", "1:100") == 0);
+
+        // Only the most recently used results that fit the budget are kept.
+        unsigned long maxBytes = MeshGeometry::getMaxProductBytes();
+        vector<unsigned int> more(1000);
+        RestrictionResult *b = new RestrictionResult(1000, 0, &more, &faces);
+        MeshGeometry::setMaxProductBytes(b->sizeInBytes() + 1);
+        cache->putRestriction("b", "1", b);
+        RestrictionResult *c = new RestrictionResult(4, 2, &nodes, &faces);
+        cache->putRestriction("c", "1", c);
+        CPPUNIT_ASSERT(cache->getRestriction("b", "1") == 0);
+        CPPUNIT_ASSERT(cache->getRestriction("c", "1") == c);
+        MeshGeometry::setMaxProductBytes(maxBytes);
+
+        cache->clear();
+        CPPUNIT_ASSERT(cache->getRestriction("c", "1") == 0);
+    }
+
+    void node_faces_test()
+    {
+        MeshGeometry *geometry = newGrid(4);
+        const NodeFaces *nf = geometry->getNodeFaces();
+        CPPUNIT_ASSERT(geometry->getNodeFaces() == nf);
+
+        // Every corner of every face is listed once.
+        CPPUNIT_ASSERT(nf->start().size() == 26 && nf->faces().size() == 32 * 3);
+        // An interior node of the grid is used by six triangles; the corner (0, 0) by two.
+        CPPUNIT_ASSERT(nf->start()[7] - nf->start()[6] == 6);
+        CPPUNIT_ASSERT(nf->start()[1] - nf->start()[0] == 2);
+
+        vector<unsigned int> faces(1, 0);
+        nf->grow(&faces, 0);
+        CPPUNIT_ASSERT(faces.size() == 1 && faces[0] == 0);
+
+        // One ring: the faces that share a node with face 0.
+        nf->grow(&faces, 1);
+        unsigned int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+        CPPUNIT_ASSERT(faces == vector<unsigned int>(expected, expected + 7));
+
+        // Growing by two rings at once is growing by one ring twice.
+        vector<unsigned int> twice(1, 17), once(1, 17);
+        nf->grow(&twice, 2);
+        nf->grow(&once, 1);
+        nf->grow(&once, 1);
+        CPPUNIT_ASSERT(twice == once);
+
+        faces.assign(1, 31);
+        nf->grow(&faces, 100);
+        CPPUNIT_ASSERT(faces.size() == 32);
+
+        delete geometry;
+    }
+
+    void face_components_test()
+    {
+        MeshGeometry *geometry = newGrid(4);
+        const FaceAdjacency *adjacency = geometry->getFaceAdjacency();
+
+        // The two triangles of the first cell, the lower triangle of the
+        // second (it only touches the first cell at a node) and the two
+        // triangles of the last cell of the first row.
+        unsigned int subset[] = { 0, 1, 2, 6, 7 };
+        vector<unsigned int> faces(subset, subset + 5);
+
+        FaceComponents components(adjacency, geometry->nodesPerFace(), faces);
+        CPPUNIT_ASSERT(components.componentCount() == 3);
+        CPPUNIT_ASSERT(components.component(0) == 0 && components.component(1) == 0);
+        CPPUNIT_ASSERT(components.component(2) == 1);
+        CPPUNIT_ASSERT(components.component(3) == 2 && components.component(4) == 2);
+        CPPUNIT_ASSERT(components.size(0) == 2 && components.size(1) == 1 && components.size(2) == 2);
+
+        vector<unsigned int> large = faces;
+        components.keepLarge(&large, 2);
+        unsigned int expected[] = { 0, 1, 6, 7 };
+        CPPUNIT_ASSERT(large == vector<unsigned int>(expected, expected + 4));
+
+        vector<unsigned int> one = faces;
+        components.keepComponentOf(&one, 7);
+        CPPUNIT_ASSERT(one.size() == 2 && one[0] == 6 && one[1] == 7);
+
+        one = faces;
+        components.keepComponentOf(&one, 5);
+        CPPUNIT_ASSERT(one.empty());
+
+        // The whole grid is one piece.
+        vector<unsigned int> all;
+        for (unsigned int f = 0; f < geometry->faceCount(); ++f)
+            all.push_back(f);
+        FaceComponents whole(adjacency, geometry->nodesPerFace(), all);
+        CPPUNIT_ASSERT(whole.componentCount() == 1 && whole.size(0) == 32);
+
+        delete geometry;
+    }
+
+    void region_index_test()
+    {
+        int faceIds[] = { 7, 3, 7, -1, 3, 9, 7 };
+        RegionIndex index(vector<int>(faceIds, faceIds + 7));
+
+        int ids[] = { -1, 3, 7, 9 };
+        CPPUNIT_ASSERT(index.ids() == vector<int>(ids, ids + 4));
+        unsigned int start[] = { 0, 1, 3, 6, 7 };
+        CPPUNIT_ASSERT(index.start() == vector<unsigned int>(start, start + 5));
+        unsigned int faces[] = { 3, 1, 4, 0, 2, 6, 5 };
+        CPPUNIT_ASSERT(index.faces() == vector<unsigned int>(faces, faces + 7));
+
+        // The faces of several ids come out merged, in ascending order;
+        // repeated and unknown ids are ignored.
+        int wanted[] = { 9, 3, 42, 3 };
+        vector<unsigned int> selected;
+        index.select(vector<int>(wanted, wanted + 4), &selected);
+        unsigned int expected[] = { 1, 4, 5 };
+        CPPUNIT_ASSERT(selected == vector<unsigned int>(expected, expected + 3));
+
+        index.select(vector<int>(1, 42), &selected);
+        CPPUNIT_ASSERT(selected.empty());
+
+        CPPUNIT_ASSERT(index.sizeInBytes() >= 4 * sizeof(int) + 12 * sizeof(unsigned int));
+    }
+
+    void decimated_mesh_test()
+    {
+        MeshGeometry *geometry = newGrid(8);
+
+        // A budget the mesh meets leaves it alone.
+        const DecimatedMesh *same = geometry->getDecimatedMesh(1000);
+        CPPUNIT_ASSERT(same->nodeCount() == 81 && same->faceCount() == 128);
+        CPPUNIT_ASSERT(same->faceNode(5, 1) == geometry->faceNode(5, 1));
+
+        const DecimatedMesh *dm = geometry->getDecimatedMesh(32);
+        CPPUNIT_ASSERT(geometry->getDecimatedMesh(32) == dm);
+
+        DBG(cerr << "decimated to " << dm->nodeCount() << " nodes and " << dm->faceCount() << " faces" << endl);
+        CPPUNIT_ASSERT(dm->faceCount() > 0 && dm->faceCount() <= 32);
+        CPPUNIT_ASSERT(dm->nodeCount() == 16);
+
+        // Every node is in exactly one cluster, which is centered on its members.
+        CPPUNIT_ASSERT(dm->nodeMembers().size() == 81);
+        vector<bool> seen(81, false);
+        for (unsigned int c = 0; c < dm->nodeCount(); ++c) {
+            double x = 0, y = 0;
+            bool hasRepresentative = false;
+            for (unsigned int i = dm->nodeStart()[c]; i < dm->nodeStart()[c + 1]; ++i) {
+                unsigned int n = dm->nodeMembers()[i];
+                CPPUNIT_ASSERT(!seen[n]);
+                seen[n] = true;
+                x += geometry->nodeX(n), y += geometry->nodeY(n);
+                if (n == dm->representativeNode(c)) hasRepresentative = true;
+            }
+            unsigned int members = dm->nodeStart()[c + 1] - dm->nodeStart()[c];
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(x / members, dm->nodeX(c), 1e-12);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(y / members, dm->nodeY(c), 1e-12);
+            CPPUNIT_ASSERT(hasRepresentative);
+        }
+
+        // Coarse faces have distinct corners and each source face is merged into at most one.
+        vector<bool> merged(geometry->faceCount(), false);
+        for (unsigned int f = 0; f < dm->faceCount(); ++f) {
+            unsigned int a = dm->faceNode(f, 0), b = dm->faceNode(f, 1), c = dm->faceNode(f, 2);
+            CPPUNIT_ASSERT(a < 16 && b < 16 && c < 16 && a != b && b != c && a != c);
+            CPPUNIT_ASSERT(dm->representativeFace(f) == dm->faceMembers()[dm->faceStart()[f]]);
+            for (unsigned int i = dm->faceStart()[f]; i < dm->faceStart()[f + 1]; ++i) {
+                CPPUNIT_ASSERT(!merged[dm->faceMembers()[i]]);
+                merged[dm->faceMembers()[i]] = true;
+            }
+        }
+
+        delete geometry;
+    }
+
+    void cache_lru_test()
+    {
+        MeshGeometryCache *cache = MeshGeometryCache::TheCache();
+        cache->setMaxEntries(2);
+
+        MeshGeometry *a = newSquare();
+        MeshGeometry *b = newSquare();
+        cache->put("a", "1", a);
+        cache->put("b", "1", b);
+
+        // Touch 'a' so that 'b' is the least recently used entry.
+        CPPUNIT_ASSERT(cache->get("a", "1") == a);
+
+        MeshGeometry *c = newSquare();
+        cache->put("c", "1", c);
+
+        CPPUNIT_ASSERT(cache->get("b", "1") == 0);
+        CPPUNIT_ASSERT(cache->get("a", "1") == a);
+        CPPUNIT_ASSERT(cache->get("c", "1") == c);
+
+        cache->setMaxEntries(1);
+        CPPUNIT_ASSERT(cache->get("a", "1") == 0);
+        CPPUNIT_ASSERT(cache->get("c", "1") == c);
+    }
+
+    void cache_stamp_test()
+    {
+        MeshGeometryCache *cache = MeshGeometryCache::TheCache();
+
+        CPPUNIT_ASSERT(MeshGeometryCache::makeStamp("/this/file/does/not/exist").empty());
+        CPPUNIT_ASSERT(!MeshGeometryCache::makeStamp("/").empty());
+        CPPUNIT_ASSERT(MeshGeometryCache::makeKey("f.nc", "mesh") != MeshGeometryCache::makeKey("f.nc", "mesh2"));
+
+        cache->put("a", "1:100", newSquare());
+        CPPUNIT_ASSERT(cache->get("a", "1:100") != 0);
+
+        // A different stamp means the file changed; the old entry is dropped.
+        CPPUNIT_ASSERT(cache->get("a", "2:100") == 0);
+        CPPUNIT_ASSERT(cache->get("a", "1:100") == 0);
+    }
+
+    void shared_store_test()
+    {
+        char directory[] = "/tmp/ugrid_shared_XXXXXX";
+        CPPUNIT_ASSERT(mkdtemp(directory) != 0);
+
+        SharedMeshStore *store = SharedMeshStore::TheStore();
+        CPPUNIT_ASSERT(!store->enabled());
+        CPPUNIT_ASSERT(store->attach("a", "1") == 0);
+
+        store->setDirectory(string(directory) + "/meshes");
+        CPPUNIT_ASSERT(store->attach("a", "1") == 0);
+
+        MeshGeometry *grid = newGrid(4);
+        grid->setSourceLayout(1, true);
+
+        MeshGeometry *shared;
+        {
+            SharedMeshStore::BuildLock lock(store, "a");
+            CPPUNIT_ASSERT(lock.locked());
+            shared = store->publish("a", "1", grid);
+        }
+        CPPUNIT_ASSERT(shared != 0);
+        CPPUNIT_ASSERT(shared->isShared());
+        CPPUNIT_ASSERT(!grid->isShared());
+        CPPUNIT_ASSERT_EQUAL(grid->nodeCount(), shared->nodeCount());
+        CPPUNIT_ASSERT_EQUAL(grid->faceCount(), shared->faceCount());
+        CPPUNIT_ASSERT_EQUAL(grid->nodesPerFace(), shared->nodesPerFace());
+        CPPUNIT_ASSERT_EQUAL(1, shared->startIndex());
+        CPPUNIT_ASSERT(shared->facesFirst());
+        for (unsigned int n = 0; n < grid->nodeCount(); ++n) {
+            CPPUNIT_ASSERT_EQUAL(grid->nodeX(n), shared->nodeX(n));
+            CPPUNIT_ASSERT_EQUAL(grid->nodeY(n), shared->nodeY(n));
+        }
+        for (unsigned int f = 0; f < grid->faceCount(); ++f)
+            for (unsigned int c = 0; c < grid->nodesPerFace(); ++c)
+                CPPUNIT_ASSERT_EQUAL(grid->faceNode(f, c), shared->faceNode(f, c));
+
+        // The indexes work over the mapped arrays.
+        FaceLocator locator(shared);
+        FaceWeights fw;
+        CPPUNIT_ASSERT(locator.locate(2.25, 1.5, &fw));
+        checkWeights(shared, fw, 2.25, 1.5);
+
+        // Another process sees the same mesh; it and other datasets do not
+        // see it under another key or stamp.
+        pid_t pid = fork();
+        if (pid == 0) {
+            MeshGeometry *child = SharedMeshStore::TheStore()->attach("a", "1");
+            bool same = child && child->nodeCount() == grid->nodeCount() && child->nodeX(7) == grid->nodeX(7);
+            _exit(same ? 0 : 1);
+        }
+        int status = -1;
+        CPPUNIT_ASSERT(waitpid(pid, &status, 0) == pid);
+        CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        CPPUNIT_ASSERT(store->attach("b", "1") == 0);
+        CPPUNIT_ASSERT(store->attach("a", "2") == 0);
+
+        // A new version of the dataset replaces the file; the old mapping
+        // stays good until it is deleted.
+        MeshGeometry *square = newSquare();
+        MeshGeometry *replaced = store->publish("a", "2", square);
+        CPPUNIT_ASSERT(replaced != 0);
+        CPPUNIT_ASSERT_EQUAL(4U, replaced->nodeCount());
+        CPPUNIT_ASSERT(store->attach("a", "1") == 0);
+        CPPUNIT_ASSERT_EQUAL(grid->nodeX(7), shared->nodeX(7));
+
+        delete replaced;
+        delete square;
+        delete shared;
+        delete grid;
+
+        string command = string("rm -rf ") + directory;
+        CPPUNIT_ASSERT(system(command.c_str()) == 0);
+    }
+
+    void shared_build_test()
+    {
+        char directory[] = "/tmp/ugrid_shared_XXXXXX";
+        CPPUNIT_ASSERT(mkdtemp(directory) != 0);
+
+        SharedMeshStore *store = SharedMeshStore::TheStore();
+        store->setDirectory(directory);
+        store->setBuildTimeout(1);
+
+        unsigned int n[] = { 4, 0, 7 }, f[] = { 2, 9 };
+        vector<unsigned int> nodes(n, n + 3), faces(f, f + 2), sharedNodes, sharedFaces;
+        CPPUNIT_ASSERT(!store->attachSubset("s", "1", &sharedNodes, &sharedFaces));
+        CPPUNIT_ASSERT(store->publishSubset("s", "1", nodes, faces));
+        CPPUNIT_ASSERT(store->attachSubset("s", "1", &sharedNodes, &sharedFaces));
+        CPPUNIT_ASSERT(sharedNodes == nodes);
+        CPPUNIT_ASSERT(sharedFaces == faces);
+        CPPUNIT_ASSERT(!store->attachSubset("s", "2", &sharedNodes, &sharedFaces));
+        CPPUNIT_ASSERT(!store->attachSubset("t", "1", &sharedNodes, &sharedFaces));
+
+        // An empty subset is still a result.
+        nodes.clear(), faces.clear();
+        CPPUNIT_ASSERT(store->publishSubset("e", "1", nodes, faces));
+        CPPUNIT_ASSERT(store->attachSubset("e", "1", &sharedNodes, &sharedFaces));
+        CPPUNIT_ASSERT(sharedNodes.empty() && sharedFaces.empty());
+
+        // A failed build is reported for the same version of the dataset only,
+        // and is forgotten once the build succeeds.
+        store->recordFailure("s", "1", malformed_expr, "bad filter");
+        store->rethrowFailure("s", "2");
+        bool thrown = false;
+        try {
+            store->rethrowFailure("s", "1");
+        }
+        catch (libdap::Error &e) {
+            thrown = true;
+            CPPUNIT_ASSERT_EQUAL(string("bad filter"), e.get_error_message());
+        }
+        CPPUNIT_ASSERT(thrown);
+        CPPUNIT_ASSERT(store->publishSubset("s", "1", nodes, faces));
+        store->rethrowFailure("s", "1");
+
+        // While another process builds, a lock waits for it and then gives up.
+        int ready[2];
+        CPPUNIT_ASSERT(pipe(ready) == 0);
+        pid_t pid = fork();
+        if (pid == 0) {
+            SharedMeshStore::BuildLock lock(SharedMeshStore::TheStore(), "s");
+            char c = lock.locked() ? 'y' : 'n';
+            if (write(ready[1], &c, 1) != 1) _exit(1);
+            sleep(3);
+            _exit(0);
+        }
+        char c = 0;
+        CPPUNIT_ASSERT(read(ready[0], &c, 1) == 1 && c == 'y');
+        {
+            SharedMeshStore::BuildLock lock(store, "s");
+            CPPUNIT_ASSERT(!lock.locked());
+            CPPUNIT_ASSERT(lock.waited());
+            CPPUNIT_ASSERT(lock.timedOut());
+        }
+
+        // With no timeout it waits until the builder is done.
+        store->setBuildTimeout(0);
+        {
+            SharedMeshStore::BuildLock lock(store, "s");
+            CPPUNIT_ASSERT(lock.locked());
+            CPPUNIT_ASSERT(lock.waited());
+            CPPUNIT_ASSERT(!lock.timedOut());
+        }
+        int status = -1;
+        CPPUNIT_ASSERT(waitpid(pid, &status, 0) == pid);
+        close(ready[0]);
+        close(ready[1]);
+
+        string command = string("rm -rf ") + directory;
+        CPPUNIT_ASSERT(system(command.c_str()) == 0);
+    }
+
+    void shared_budget_test()
+    {
+        char directory[] = "/tmp/ugrid_shared_XXXXXX";
+        CPPUNIT_ASSERT(mkdtemp(directory) != 0);
+
+        SharedMeshStore *store = SharedMeshStore::TheStore();
+        store->setDirectory(directory);
+        store->setMaxBytes(0);
+
+        MeshGeometry *grid = newGrid(4);
+        delete store->publish("a", "1", grid);
+        unsigned long fileBytes = directoryBytes(directory);
+        CPPUNIT_ASSERT(fileBytes > 0);
+
+        // Room for two of the three meshes.
+        delete store->publish("b", "1", grid);
+        sleep(1);
+        store->setMaxBytes(2 * fileBytes + fileBytes / 2);
+
+        // Using 'a' makes 'b' the one to go.
+        MeshGeometry *a = store->attach("a", "1");
+        CPPUNIT_ASSERT(a != 0);
+        MeshGeometry *c = store->publish("c", "1", grid);
+        CPPUNIT_ASSERT(c != 0);
+        MeshGeometry *b = store->attach("b", "1");
+        CPPUNIT_ASSERT(b == 0);
+
+        // What is mapped stays good.
+        CPPUNIT_ASSERT_EQUAL(grid->nodeX(7), a->nodeX(7));
+
+        CPPUNIT_ASSERT(directoryBytes(directory) <= store->getMaxBytes());
+
+        delete a;
+        delete c;
+        delete grid;
+
+        // Subsets share the budget, so publishing them removes meshes, and the
+        // locks and errors that are no longer needed go with them.
+        {
+            SharedMeshStore::BuildLock lock(store, "x");
+            CPPUNIT_ASSERT(lock.locked());
+            store->recordFailure("x", "1", malformed_expr, "bad filter");
+        }
+        string command = string("touch -d '1 minute ago' ") + directory + "/*.err";
+        CPPUNIT_ASSERT(system(command.c_str()) == 0);
+        CPPUNIT_ASSERT_EQUAL(1U, countFiles(directory, ".lock"));
+        CPPUNIT_ASSERT_EQUAL(1U, countFiles(directory, ".err"));
+
+        vector<unsigned int> nodes(fileBytes / 8, 1), faces;
+        {
+            SharedMeshStore::BuildLock lock(store, "s");
+            CPPUNIT_ASSERT(store->publishSubset("s", "1", nodes, faces));
+        }
+        CPPUNIT_ASSERT(store->publishSubset("t", "1", nodes, faces));
+        CPPUNIT_ASSERT(directoryBytes(directory) <= store->getMaxBytes());
+        CPPUNIT_ASSERT_EQUAL(2U, countFiles(directory, ".subset"));
+        CPPUNIT_ASSERT_EQUAL(0U, countFiles(directory, ".mesh"));
+        CPPUNIT_ASSERT_EQUAL(0U, countFiles(directory, ".err"));
+
+        // Only the lock of the subset that is still there is kept.
+        CPPUNIT_ASSERT_EQUAL(1U, countFiles(directory, ".lock"));
+
+        command = string("rm -rf ") + directory;
+        CPPUNIT_ASSERT(system(command.c_str()) == 0);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MeshGeometryTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::MeshGeometryTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
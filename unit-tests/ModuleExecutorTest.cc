@@ -0,0 +1,231 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <BESDebug.h>
+
+#include <sstream>
+#include <vector>
+
+#include "debug.h"
+#include "ModuleExecutor.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+// Counts its runs; a job that holds waits until it is released.
+class CountingJob: public ModuleExecutor::Job {
+public:
+    volatile int started;
+    volatile int runs;
+    volatile int released;
+
+    CountingJob(bool hold = false) :
+        started(0), runs(0), released(hold ? 0 : 1)
+    {
+    }
+
+    virtual void run()
+    {
+        __sync_lock_test_and_set(&started, 1);
+        while (!__sync_fetch_and_add(&released, 0))
+            usleep(100);
+        __sync_fetch_and_add(&runs, 1);
+    }
+
+    void release()
+    {
+        __sync_lock_test_and_set(&released, 1);
+    }
+
+    bool waitForRun()
+    {
+        for (unsigned int i = 0; i < 20000 && !__sync_fetch_and_add(&runs, 0); ++i)
+            usleep(100);
+        return runs == 1;
+    }
+};
+
+class ModuleExecutorTest: public CppUnit::TestFixture {
+public:
+    ModuleExecutorTest()
+    {
+    }
+
+    ~ModuleExecutorTest()
+    {
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        ModuleExecutor::delete_instance();
+    }
+
+    CPPUNIT_TEST_SUITE( ModuleExecutorTest );
+
+    CPPUNIT_TEST(config_test);
+    CPPUNIT_TEST(submit_test);
+    CPPUNIT_TEST(queue_test);
+    CPPUNIT_TEST(fork_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void config_test()
+    {
+        ModuleExecutor *executor = ModuleExecutor::TheExecutor();
+        CPPUNIT_ASSERT(executor->getThreads() == UGRID_EXECUTOR_DEFAULT_THREADS);
+        CPPUNIT_ASSERT(executor->concurrency() == 1);
+
+        CountingJob job;
+        CPPUNIT_ASSERT(!executor->submit(&job));
+
+        executor->configure(2, 16, 8);
+        CPPUNIT_ASSERT(executor->concurrency() == 3);
+        executor->configure(16, 16, 4);
+        CPPUNIT_ASSERT(executor->concurrency() == 4);
+    }
+
+    void submit_test()
+    {
+        ModuleExecutor *executor = ModuleExecutor::TheExecutor();
+        executor->configure(4, 64, 4);
+
+        vector<CountingJob *> jobs;
+        for (unsigned int i = 0; i < 50; ++i) {
+            jobs.push_back(new CountingJob());
+            CPPUNIT_ASSERT(executor->submit(jobs.back()));
+        }
+        for (unsigned int i = 0; i < jobs.size(); ++i) {
+            CPPUNIT_ASSERT(jobs[i]->waitForRun());
+            delete jobs[i];
+        }
+
+        ostringstream oss;
+        executor->dump(oss);
+        DBG(cerr << oss.str());
+        CPPUNIT_ASSERT(oss.str().find("completed: 50") != string::npos);
+    }
+
+    // With the one thread busy, jobs queue up to the depth and can be cancelled.
+    void queue_test()
+    {
+        ModuleExecutor *executor = ModuleExecutor::TheExecutor();
+        executor->configure(1, 2, 1);
+
+        CountingJob busy(true), first, second, third;
+        CPPUNIT_ASSERT(executor->submit(&busy));
+        while (!__sync_fetch_and_add(&busy.started, 0))
+            usleep(100);
+
+        CPPUNIT_ASSERT(!executor->runNow(&first));
+        CPPUNIT_ASSERT(executor->submit(&first));
+        CPPUNIT_ASSERT(executor->submit(&second));
+        CPPUNIT_ASSERT(!executor->submit(&third));
+        CPPUNIT_ASSERT(executor->cancel(&second));
+        CPPUNIT_ASSERT(!executor->cancel(&third));
+
+        busy.release();
+        CPPUNIT_ASSERT(busy.waitForRun() && first.waitForRun());
+        CPPUNIT_ASSERT(second.runs == 0 && third.runs == 0);
+    }
+
+    // A forked child starts threads of its own.
+    void fork_test()
+    {
+        ModuleExecutor *executor = ModuleExecutor::TheExecutor();
+        executor->configure(2, 8, 2);
+
+        CountingJob job;
+        CPPUNIT_ASSERT(executor->submit(&job) && job.waitForRun());
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            CountingJob childJob;
+            bool ran = executor->submit(&childJob) && childJob.waitForRun();
+            _exit(ran ? 0 : 1);
+        }
+
+        int status = 0;
+        CPPUNIT_ASSERT(waitpid(pid, &status, 0) == pid);
+        CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ModuleExecutorTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::ModuleExecutorTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -30,6 +30,10 @@
 
 #include <BESDebug.h>
 
+#include <ctime>
+#include <cstring>
+#include <new>
+
 #include "util.h"
 #include "debug.h"
 #include "Array.h"
@@ -41,6 +45,9 @@
 
 static bool debug = false;
 
+// Run the tests that need a lot of (virtual) memory; see largeArray_stress().
+static bool stress = false;
+
 #undef DBG
 #define DBG(x) do { if (debug) (x); } while(false);
 
@@ -76,10 +83,224 @@ CPPUNIT_TEST_SUITE( NDimArrayTest );
     CPPUNIT_TEST(getStorageIndex_test);
     CPPUNIT_TEST(getLastDimesnionHyperSlab_test);
     CPPUNIT_TEST(setLastDimesnionHyperSlab_test);
+    CPPUNIT_TEST(setValue_test);
+    CPPUNIT_TEST(storageIndex_benchmark);
+    CPPUNIT_TEST(nextHyperSlab_benchmark);
+    CPPUNIT_TEST(mappedStorage_test);
+    CPPUNIT_TEST(largeArray_stress);
 
     CPPUNIT_TEST_SUITE_END()
     ;
 
+    // setValue() at every location of arrays of rank 1 to 5 writes the element
+    // getStorageIndex() names.
+    void setValue_test()
+    {
+        DBG(cerr << " setValue_test() - BEGIN." << endl);
+
+        for (unsigned int rank = 1; rank <= 5; ++rank) {
+            vector<unsigned int> shape;
+            for (unsigned int d = 0; d < rank; ++d)
+                shape.push_back(2 + d);
+
+            NDimensionalArray nda(&shape, dods_int32_c);
+            nda.setAll(0);
+
+            vector<unsigned int> location(rank, 0);
+            for (long i = 0; i < nda.elementCount(); ++i) {
+                nda.setValue(&location, (dods_int32) i);
+                CPPUNIT_ASSERT(((dods_int32 *) nda.getStorage())[NDimensionalArray::getStorageIndex(&shape, &location)] == i);
+
+                // Next location in row major order.
+                for (int d = rank - 1; d >= 0 && ++location[d] == shape[d]; --d)
+                    location[d] = 0;
+            }
+
+            // Storage order is row major order.
+            for (long i = 0; i < nda.elementCount(); ++i)
+                CPPUNIT_ASSERT(((dods_int32 *) nda.getStorage())[i] == i);
+
+            location.assign(rank, 0);
+            location[rank - 1] = shape[rank - 1];
+            try {
+                nda.setValue(&location, (dods_int32) 0);
+                CPPUNIT_FAIL("Failed to detect a bounds violation");
+            }
+            catch (libdap::Error &e) {
+                DBG(cerr << " setValue_test() - Detected bounds violation: " << e.get_error_message() << endl);
+            }
+        }
+
+        DBG(cerr << " setValue_test() - END." << endl);
+    }
+
+    // Compare setValue() with the general per-call computation of the storage
+    // index it replaced. Run with -d to see the times.
+    void storageIndex_benchmark()
+    {
+        vector<unsigned int> shape(3);
+        shape[0] = 40, shape[1] = 50, shape[2] = 1000;
+        NDimensionalArray nda(&shape, dods_float64_c);
+
+        vector<unsigned int> location(3);
+        clock_t t0 = clock();
+        for (location[0] = 0; location[0] < shape[0]; ++location[0])
+            for (location[1] = 0; location[1] < shape[1]; ++location[1])
+                for (location[2] = 0; location[2] < shape[2]; ++location[2])
+                    nda.setValue(&location, (dods_float64) location[2]);
+        clock_t t1 = clock();
+
+        dods_float64 *store = (dods_float64 *) nda.getStorage();
+        for (location[0] = 0; location[0] < shape[0]; ++location[0])
+            for (location[1] = 0; location[1] < shape[1]; ++location[1])
+                for (location[2] = 0; location[2] < shape[2]; ++location[2])
+                    store[NDimensionalArray::getStorageIndex(&shape, &location)] = location[2];
+        clock_t t2 = clock();
+
+        DBG(cerr << " storageIndex_benchmark() - " << nda.elementCount() << " values: setValue() "
+            << double(t1 - t0) / CLOCKS_PER_SEC << "s, getStorageIndex() " << double(t2 - t1) / CLOCKS_PER_SEC << "s" << endl);
+
+        CPPUNIT_ASSERT(store[nda.elementCount() - 1] == shape[2] - 1);
+    }
+
+    // Fill an array one last dimension hyper-slab at a time, the way the
+    // range variable gathers do. Run with -d to see the time.
+    void nextHyperSlab_benchmark()
+    {
+        vector<unsigned int> shape(3);
+        shape[0] = 40, shape[1] = 500, shape[2] = 100;
+        NDimensionalArray nda(&shape, dods_float32_c);
+
+        clock_t t0 = clock();
+        unsigned int slabs = shape[0] * shape[1];
+        for (unsigned int n = 0; n < slabs; ++n) {
+            dods_float32 *slab;
+            nda.getNextLastDimensionHyperSlab((void **) &slab);
+            for (unsigned int i = 0; i < shape[2]; ++i)
+                slab[i] = n;
+        }
+        clock_t t1 = clock();
+
+        DBG(cerr << " nextHyperSlab_benchmark() - " << slabs << " slabs: " << double(t1 - t0) / CLOCKS_PER_SEC << "s" << endl);
+
+        vector<unsigned int> location(2);
+        location[0] = 39, location[1] = 499;
+        dods_float32 *last;
+        unsigned long count;
+        nda.getLastDimensionHyperSlab(&location, (void **) &last, &count);
+        CPPUNIT_ASSERT(count == shape[2] && last[0] == slabs - 1 && last[count - 1] == slabs - 1);
+    }
+
+    // Storage above the map threshold is mapped rather than allocated with
+    // new[]; the two must behave the same.
+    void mappedStorage_test()
+    {
+        DBG(cerr << " mappedStorage_test() - BEGIN." << endl);
+
+        unsigned long threshold = NDimensionalArray::getMapThreshold();
+
+        vector<unsigned int> shape(2);
+        shape[0] = 30, shape[1] = 700;
+
+        NDimensionalArray heap(&shape, dods_int32_c);
+        NDimensionalArray::setMapThreshold(4096);
+        NDimensionalArray mapped(&shape, dods_int32_c);
+        NDimensionalArray::setMapThreshold(threshold);
+
+        CPPUNIT_ASSERT(!heap.isStorageMapped());
+        CPPUNIT_ASSERT(mapped.isStorageMapped());
+
+        heap.setAll(0);
+        mapped.setAll(0);
+        vector<unsigned int> location(2);
+        for (location[0] = 0; location[0] < shape[0]; ++location[0]) {
+            for (location[1] = 0; location[1] < shape[1]; ++location[1]) {
+                dods_int32 v = location[0] * 1000 + location[1];
+                heap.setValue(&location, v);
+                mapped.setValue(&location, v);
+            }
+        }
+        CPPUNIT_ASSERT(memcmp(heap.getStorage(), mapped.getStorage(), heap.elementCount() * sizeof(dods_int32)) == 0);
+
+        // Relinquished storage is always freed with delete[].
+        dods_int32 *values = (dods_int32 *) mapped.relinquishStorage();
+        CPPUNIT_ASSERT(!mapped.isStorageMapped());
+        CPPUNIT_ASSERT(values[(shape[0] - 1) * shape[1] + 5] == 29005);
+        delete[] values;
+
+        DBG(cerr << " mappedStorage_test() - END." << endl);
+    }
+
+    // An array of more than 2^32 elements and 2^32 last dimension slabs. The
+    // mapped storage is only committed where it is written, but it still needs
+    // 10GB of address space, so this only runs when asked for (-s).
+    void largeArray_stress()
+    {
+        DBG(cerr << " largeArray_stress() - BEGIN." << endl);
+
+        if (!stress) {
+            DBG(cerr << " largeArray_stress() - Skipped; run with -s to include it." << endl);
+            return;
+        }
+
+        if (sizeof(long) < 8) {
+            DBG(cerr << " largeArray_stress() - Skipped; long is not 64 bits." << endl);
+            return;
+        }
+
+        vector<unsigned int> shape(3);
+        shape[0] = 5, shape[1] = 1U << 30, shape[2] = 2;
+
+        NDimensionalArray *nda = 0;
+        try {
+            nda = new NDimensionalArray(&shape, dods_byte_c);
+        }
+        catch (std::bad_alloc &e) {
+            DBG(cerr << " largeArray_stress() - Skipped; could not allocate the array." << endl);
+            return;
+        }
+
+        CPPUNIT_ASSERT(nda->elementCount() == 5L * (1L << 31));
+
+        // Writing to the last element of unmapped storage would commit all of it.
+        if (!nda->isStorageMapped()) {
+            DBG(cerr << " largeArray_stress() - Skipped; the storage is not mapped." << endl);
+            delete nda;
+            return;
+        }
+
+        char *storage = (char *) nda->getStorage();
+
+        // A slab index past 2^32.
+        unsigned long slabIndex = (4UL << 30) + 7;
+        nda->setCurrentLastDimensionHyperSlab(slabIndex);
+        dods_byte *slab;
+        nda->getNextLastDimensionHyperSlab((void **) &slab);
+        CPPUNIT_ASSERT((char *) slab - storage == (long) (slabIndex * 2));
+        CPPUNIT_ASSERT(nda->getCurrentLastDimensionHyperSlab() == slabIndex + 1);
+        slab[0] = 11, slab[1] = 12;
+
+        vector<unsigned int> location(3);
+        location[0] = 4, location[1] = 7, location[2] = 1;
+        CPPUNIT_ASSERT(nda->setValue(&location, (dods_byte) 13) == 12);
+        CPPUNIT_ASSERT(NDimensionalArray::getStorageIndex(&shape, &location) == (long) (slabIndex * 2 + 1));
+
+        // The last element.
+        location[0] = 4, location[1] = shape[1] - 1, location[2] = 1;
+        nda->setValue(&location, (dods_byte) 14);
+        CPPUNIT_ASSERT(storage[nda->elementCount() - 1] == 14);
+
+        vector<unsigned int> slabLocation(2);
+        slabLocation[0] = 4, slabLocation[1] = 7;
+        unsigned long count;
+        nda->getLastDimensionHyperSlab(&slabLocation, (void **) &slab, &count);
+        CPPUNIT_ASSERT(count == 2 && slab[0] == 11 && slab[1] == 13);
+
+        delete nda;
+
+        DBG(cerr << " largeArray_stress() - END." << endl);
+    }
+
     void setLastDimesnionHyperSlab_test()
     {
         DBG(cerr << " setLastDimesnionHyperSlab_test() - BEGIN." << endl);
@@ -138,7 +359,7 @@ CPPUNIT_TEST_SUITE( NDimArrayTest );
         nda.setLastDimensionHyperSlab(&location, stuff, nda.getLastDimensionElementCount());
 
         dods_float64 *slab;
-        unsigned int slabElementCount = 0;
+        unsigned long slabElementCount = 0;
         nda.getLastDimensionHyperSlab(&location, (void**) &slab, &slabElementCount);
         DBG(
             cerr << " setLastDimesnionHyperSlab_test() - Retrieved  slab. Slab element count " << slabElementCount
@@ -194,7 +415,7 @@ CPPUNIT_TEST_SUITE( NDimArrayTest );
 
         vector<unsigned int> location(test.dimensions(true) - 1);
         void *slab, *firstSlab;
-        unsigned int slabElementCount;
+        unsigned long slabElementCount;
         unsigned long offset;
 
         void *internalStorage = nda.getStorage();
@@ -317,7 +538,7 @@ int main(int argc, char*argv[])
     CppUnit::TextTestRunner runner;
     runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
 
-    GetOpt getopt(argc, argv, "d");
+    GetOpt getopt(argc, argv, "ds");
     int option_char;
     while ((option_char = getopt()) != -1)
         switch (option_char) {
@@ -325,6 +546,9 @@ int main(int argc, char*argv[])
             debug = 1;  // debug is a static global
             BESDebug::SetUp("cerr,ugrid");
             break;
+        case 's':
+            stress = true;
+            break;
         default:
             break;
         }
@@ -0,0 +1,212 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <BESDebug.h>
+#include <Error.h>
+
+#include <cstring>
+#include <vector>
+
+#include "debug.h"
+#include "ModuleExecutor.h"
+#include "SlabPipeline.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+// Fills each buffer with its slab number; throws after failAfter slabs, if set.
+class CountingProducer: public SlabPipeline::Producer {
+public:
+    unsigned int slabs;
+    unsigned int failAfter;
+    unsigned int produced;
+
+    CountingProducer(unsigned int slabs, unsigned int failAfter = 0) :
+        slabs(slabs), failAfter(failAfter), produced(0)
+    {
+    }
+
+    virtual void run(SlabPipeline *pipeline)
+    {
+        for (unsigned int s = 0; s < slabs; ++s) {
+            if (failAfter && s == failAfter) throw libdap::Error(malformed_expr, "failed");
+
+            unsigned int *buffer = (unsigned int *) pipeline->nextEmpty();
+            if (!buffer) return;
+
+            for (unsigned int i = 0; i < pipeline->bufferBytes() / sizeof(unsigned int); ++i)
+                buffer[i] = s;
+            pipeline->filled();
+            ++produced;
+        }
+    }
+};
+
+class SlabPipelineTest: public CppUnit::TestFixture {
+private:
+    // Consume every slab, checking each holds its own number.
+    unsigned int consume(SlabPipeline *pipeline, unsigned int values)
+    {
+        unsigned int count = 0;
+        while (unsigned int *buffer = (unsigned int *) pipeline->nextFull()) {
+            for (unsigned int i = 0; i < values; ++i)
+                CPPUNIT_ASSERT(buffer[i] == count);
+            pipeline->consumed();
+            ++count;
+        }
+        return count;
+    }
+
+public:
+    SlabPipelineTest()
+    {
+    }
+
+    ~SlabPipelineTest()
+    {
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        ModuleExecutor::delete_instance();
+    }
+
+    CPPUNIT_TEST_SUITE( SlabPipelineTest );
+
+    CPPUNIT_TEST(order_test);
+    CPPUNIT_TEST(error_test);
+    CPPUNIT_TEST(stop_test);
+    CPPUNIT_TEST(executor_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void order_test()
+    {
+        unsigned int depths[] = { 1, 2, 3, 8 };
+        for (unsigned int d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+            SlabPipeline pipeline(depths[d], 1000 * sizeof(unsigned int));
+            CountingProducer producer(500);
+            pipeline.start(&producer);
+            CPPUNIT_ASSERT(consume(&pipeline, 1000) == 500);
+            DBG(cerr << " order_test() - depth " << depths[d] << ": 500 slabs" << endl);
+        }
+    }
+
+    // The same, with the reader on a thread of the executor.
+    void executor_test()
+    {
+        ModuleExecutor::TheExecutor()->configure(2, 8, 2);
+        order_test();
+        error_test();
+        stop_test();
+    }
+
+    // The slabs read before the error are delivered, then the error.
+    void error_test()
+    {
+        SlabPipeline pipeline(3, 100 * sizeof(unsigned int));
+        CountingProducer producer(500, 20);
+        pipeline.start(&producer);
+
+        unsigned int count = 0;
+        try {
+            count = consume(&pipeline, 100);
+            CPPUNIT_FAIL("Expected an Error");
+        }
+        catch (libdap::Error &e) {
+            CPPUNIT_ASSERT(producer.produced == 20);
+        }
+        CPPUNIT_ASSERT(count == 0);
+    }
+
+    // A consumer that stops early stops the producer.
+    void stop_test()
+    {
+        CountingProducer producer(100000);
+        {
+            SlabPipeline pipeline(2, 100 * sizeof(unsigned int));
+            pipeline.start(&producer);
+            for (unsigned int i = 0; i < 5; ++i) {
+                CPPUNIT_ASSERT(pipeline.nextFull() != 0);
+                pipeline.consumed();
+            }
+        }
+        CPPUNIT_ASSERT(producer.produced < 100000);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SlabPipelineTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::SlabPipelineTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+#include <Error.h>
+
+#include "debug.h"
+#include "ValuePredicates.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+class ValuePredicatesTest: public CppUnit::TestFixture {
+private:
+    set<string> d_variables;
+
+public:
+    ValuePredicatesTest()
+    {
+        d_variables.insert("depth");
+        d_variables.insert("twoDnodedata");
+    }
+
+    ~ValuePredicatesTest()
+    {
+    }
+
+    CPPUNIT_TEST_SUITE( ValuePredicatesTest );
+
+    CPPUNIT_TEST(split_test);
+    CPPUNIT_TEST(indices_test);
+    CPPUNIT_TEST(compare_test);
+    CPPUNIT_TEST(errors_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void split_test()
+    {
+        ValuePredicates vp("X > 26 & depth > 5 & Y <= 27.5", d_variables);
+        DBG(cerr << "remaining: '" << vp.remaining() << "'" << endl);
+        CPPUNIT_ASSERT(vp.remaining() == "X > 26 & Y <= 27.5");
+        CPPUNIT_ASSERT(vp.predicates().size() == 1);
+        CPPUNIT_ASSERT(vp.predicates()[0].variable == "depth");
+        CPPUNIT_ASSERT(vp.predicates()[0].op == ">" && vp.predicates()[0].value == 5);
+        CPPUNIT_ASSERT(vp.predicates()[0].indices.empty());
+
+        // Only value predicates.
+        ValuePredicates only("depth >= 1 & 3 > depth", d_variables);
+        CPPUNIT_ASSERT(only.remaining().empty());
+        CPPUNIT_ASSERT(only.predicates().size() == 2);
+        CPPUNIT_ASSERT(only.predicates()[1].op == "<" && only.predicates()[1].value == 3);
+
+        // No value predicates; a disjunction is left alone.
+        ValuePredicates none("X > 26 | Y < 3", d_variables);
+        CPPUNIT_ASSERT(none.remaining() == "X > 26 | Y < 3");
+        CPPUNIT_ASSERT(none.predicates().empty());
+
+        // Names that are not range variables stay with the filter.
+        ValuePredicates other("temp > 4 & depth2 < 1", d_variables);
+        CPPUNIT_ASSERT(other.predicates().empty());
+    }
+
+    void indices_test()
+    {
+        ValuePredicates vp("twoDnodedata[2] >= 0.5 & X > 0", d_variables);
+        CPPUNIT_ASSERT(vp.remaining() == "X > 0");
+        CPPUNIT_ASSERT(vp.predicates().size() == 1);
+        CPPUNIT_ASSERT(vp.predicates()[0].variable == "twoDnodedata");
+        CPPUNIT_ASSERT(vp.predicates()[0].indices.size() == 1 && vp.predicates()[0].indices[0] == 2);
+
+        ValuePredicates two("twoDnodedata[1] [0] < 1", d_variables);
+        CPPUNIT_ASSERT(two.predicates()[0].indices.size() == 2);
+        CPPUNIT_ASSERT(two.predicates()[0].indices[0] == 1 && two.predicates()[0].indices[1] == 0);
+    }
+
+    void compare_test()
+    {
+        ValuePredicate p;
+        p.value = 5;
+
+        p.op = ">";
+        CPPUNIT_ASSERT(p.test(6) && !p.test(5));
+        p.op = ">=";
+        CPPUNIT_ASSERT(p.test(5) && !p.test(4));
+        p.op = "<";
+        CPPUNIT_ASSERT(p.test(4) && !p.test(5));
+        p.op = "<=";
+        CPPUNIT_ASSERT(p.test(5) && !p.test(6));
+        p.op = "=";
+        CPPUNIT_ASSERT(p.test(5) && !p.test(6));
+        p.op = "!=";
+        CPPUNIT_ASSERT(p.test(6) && !p.test(5));
+    }
+
+    void errors_test()
+    {
+        // Value predicates must be and-ed with the rest of the filter.
+        try {
+            ValuePredicates vp("X > 26 | depth > 5", d_variables);
+            CPPUNIT_FAIL("Expected an error for a disjunction");
+        }
+        catch (libdap::Error &e) {
+            DBG(cerr << e.get_error_message() << endl);
+        }
+
+        try {
+            ValuePredicates vp("twoDnodedata[x] > 5", d_variables);
+            CPPUNIT_FAIL("Expected an error for a bad index");
+        }
+        catch (libdap::Error &e) {
+            DBG(cerr << e.get_error_message() << endl);
+        }
+
+        try {
+            ValuePredicates vp("twoDnodedata[1 > 5", d_variables);
+            CPPUNIT_FAIL("Expected an error for a missing bracket");
+        }
+        catch (libdap::Error &e) {
+            DBG(cerr << e.get_error_message() << endl);
+        }
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ValuePredicatesTest);
+
+} /* namespace ugrid */
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::ValuePredicatesTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <unistd.h>
+
+#include <BESDebug.h>
+#include <Error.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "ModuleExecutor.h"
+#include "WorkStealingPool.h"
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+using namespace std;
+
+namespace ugrid {
+
+// Counts the times each index is run; indices below slowBelow take longer
+// and the index failAt, if set, throws.
+class CountingTask: public WorkStealingPool::Task {
+public:
+    vector<int> runs;
+    unsigned long slowBelow;
+    unsigned long failAt;
+
+    CountingTask(unsigned long count, unsigned long slowBelow = 0, unsigned long failAt = 0) :
+        runs(count, 0), slowBelow(slowBelow), failAt(failAt)
+    {
+    }
+
+    virtual void run(unsigned long begin, unsigned long end)
+    {
+        for (unsigned long i = begin; i < end; ++i) {
+            if (failAt && i == failAt) throw libdap::Error(malformed_expr, "failed");
+            if (i < slowBelow) usleep(200);
+            __sync_fetch_and_add(&runs[i], 1);
+        }
+    }
+
+    bool eachOnce()
+    {
+        for (unsigned long i = 0; i < runs.size(); ++i)
+            if (runs[i] != 1) return false;
+        return true;
+    }
+};
+
+class WorkStealingPoolTest: public CppUnit::TestFixture {
+public:
+    WorkStealingPoolTest()
+    {
+    }
+
+    ~WorkStealingPoolTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        ModuleExecutor::TheExecutor()->configure(8, 64, 8);
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        ModuleExecutor::delete_instance();
+    }
+
+    CPPUNIT_TEST_SUITE( WorkStealingPoolTest );
+
+    CPPUNIT_TEST(coverage_test);
+    CPPUNIT_TEST(steal_test);
+    CPPUNIT_TEST(serial_test);
+    CPPUNIT_TEST(error_test);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void coverage_test()
+    {
+        unsigned int threads[] = { 1, 2, 3, 8 };
+        unsigned long counts[] = { 1, 7, 1000, 100003 };
+        for (unsigned int t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+            for (unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+                WorkStealingPool pool(threads[t]);
+                CountingTask task(counts[c]);
+                pool.parallelFor(counts[c], 16, &task);
+                CPPUNIT_ASSERT(task.eachOnce());
+            }
+        }
+
+        // The pool can be used again.
+        WorkStealingPool pool(4);
+        CountingTask first(5000), second(3000);
+        pool.parallelFor(5000, 1, &first);
+        pool.parallelFor(3000, 1, &second);
+        CPPUNIT_ASSERT(first.eachOnce() && second.eachOnce());
+    }
+
+    // All of the slow indices are in the first thread's share, so the others
+    // have to take some of it.
+    void steal_test()
+    {
+        WorkStealingPool pool(4);
+        CountingTask task(4000, 1000);
+        pool.parallelFor(4000, 1, &task);
+        CPPUNIT_ASSERT(task.eachOnce());
+
+        DBG(cerr << " steal_test() - " << pool.steals() << " steals" << endl);
+        CPPUNIT_ASSERT(pool.steals() > 0);
+    }
+
+    // Without the executor's threads the calling thread does it all.
+    void serial_test()
+    {
+        ModuleExecutor::TheExecutor()->configure(0, 64, 8);
+        WorkStealingPool pool(4);
+        CountingTask task(1000);
+        pool.parallelFor(1000, 1, &task);
+        CPPUNIT_ASSERT(task.eachOnce());
+        CPPUNIT_ASSERT(pool.steals() > 0);
+    }
+
+    void error_test()
+    {
+        WorkStealingPool pool(4);
+        CountingTask task(10000, 0, 5000);
+        try {
+            pool.parallelFor(10000, 8, &task);
+            CPPUNIT_FAIL("Expected an Error");
+        }
+        catch (libdap::Error &e) {
+            CPPUNIT_ASSERT(task.runs[5000] == 0);
+        }
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WorkStealingPoolTest);
+
+} /* namespace ugrid */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            BESDebug::SetUp("cerr,ugrid");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("ugrid::WorkStealingPoolTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}